@@ -30,6 +30,9 @@ namespace Pisces
                  enableVSync = true,
                  enableDebugContext = true,
                  initRemotery = true;
+
+            // See PipelineManager::setProgramCacheDirectory, nullptr disables the program cache
+            const char *programCacheDirectory = nullptr;
         };
 
     public:
@@ -48,6 +51,8 @@ namespace Pisces
         PISCES_API HardwareResourceManager* getHardwareResourceManager();
         PISCES_API PipelineManager* getPipelineManager();
         PISCES_API SpriteManager* getSpriteManager();
+        // Shared ring buffer for per frame vertex, index & uniform data
+        PISCES_API TransientBuffer* getTransientBuffer();
         PISCES_API RenderTargetHandle getMainRenderTarget();
 
         PISCES_API RenderCommandQueuePtr createRenderCommandQueue( RenderTargetHandle target=RenderTargetHandle(), RenderCommandQueueFlags flags=RenderCommandQueueFlags::None );
@@ -60,6 +65,11 @@ namespace Pisces
 
         PISCES_API uint64_t currentFrame();
 
+        // A fence is signaled once the gpu has finished the frame it was inserted in,
+        // after that memory used by the frame (e.g. ranges of a buffer) can be reused
+        PISCES_API FenceHandle insertFence();
+        PISCES_API bool isFenceSignaled( FenceHandle fence );
+
         PISCES_API int displayWidth();
         PISCES_API int displayHeight();
 
@@ -19,9 +19,12 @@ namespace Pisces
     static const int MAX_BOUND_UNIFORMS = 16;
     static const int MAX_BOUND_UNIFORM_BUFFERS = 16;
     static const int MAX_BOUND_IMAGE_TEXTURES = 4;
+    static const int MAX_VERTEX_BUFFERS = 4;
     static const int MAX_TRANFORM_FEEDBACK_CAPTURE_VARIABLES = 4;
 
     static const int MIN_UNIFORM_BLOCK_BUFFER_SIZE = 1024*16; // 16 Kb
+    // Initial size of the context wide transient buffer, it grows if needed
+    static const size_t DEFAULT_TRANSIENT_BUFFER_SIZE = 1024*1024*4; // 4 Mb
 
     static const int FRAMES_IN_FLIGHT = 3;
 
@@ -43,6 +46,12 @@ namespace Pisces
     MAKE_HANDLE( RenderTargetHandle, uint32_t );
 
     MAKE_HANDLE( VertexArrayHandle, uint32_t );
+    // Vertex layout without buffers, see RenderCommandQueue::useVertexBuffers
+    MAKE_HANDLE( VertexFormatHandle, uint32_t );
+
+    MAKE_HANDLE( FenceHandle, uint64_t );
+
+    MAKE_HANDLE( BufferAllocationHandle, uint32_t );
 
     class Context;
     class HardwareResourceManager;
@@ -51,6 +60,7 @@ namespace Pisces
     using RenderCommandQueuePtr = std::shared_ptr<RenderCommandQueue>;
     class CompiledRenderQueue;
     using CompiledRenderQueuePtr = std::shared_ptr<CompiledRenderQueue>;
+    class TransientBuffer;
     class IResourceLoader;
 
     struct Sprite;
@@ -73,7 +83,8 @@ namespace Pisces
 
     enum class TextureType {
         Texture2D = 0,
-        Cubemap   = 1
+        Cubemap   = 1,
+        Texture2DArray = 2
     };
 
     enum class CubemapFace {
@@ -130,6 +141,12 @@ namespace Pisces
         DiscardBuffer = 8,
 
         Persistent = 16,
+
+        // Only ranges marked with HardwareResourceManager::markBufferWritten are flushed
+        FlushExplicit = 32,
+
+        // Don't wait for the gpu, the caller guarantees that the range isn't in use. Ignored for persistent mappings.
+        Unsynchronized = 64,
     };
     DECLARE_ENUM_FLAG( BufferMapFlags );
 
@@ -185,6 +202,8 @@ namespace Pisces
         FaceCulling = 4,
 
         OwnProgram  = 8,
+
+        StencilTest = 16,
     };
     DECLARE_ENUM_FLAG(PipelineFlags);
 
@@ -218,6 +237,9 @@ namespace Pisces
 
     enum class RenderQueueCompileFlags {
         None = 0,
+        // Bind textures as resident ARB_bindless_texture handles instead of texture units when supported,
+        // sampler params of a texture are fixed once it was drawn with (use createSampler to change them)
+        BindlessTextures = 1,
     };
     DECLARE_ENUM_FLAG(RenderQueueCompileFlags);
 
@@ -234,6 +256,22 @@ namespace Pisces
         None, UInt16, UInt32
     };
 
+    // Part of a buffer, used for allocations from the buffer heap
+    struct BufferRange {
+        BufferHandle buffer;
+        size_t offset = 0, size = 0;
+    };
+
+    struct BufferHeapStats {
+        size_t buffers = 0,
+               allocations = 0,
+               capacity = 0,
+               used = 0,
+               largestFreeBlock = 0;
+        // 0 if all free space is in one block, goes towards 1 as the free space gets split up
+        float fragmentation = 0.f;
+    };
+
     enum class BlendMode {
         Replace,
         Alpha,
@@ -244,6 +282,84 @@ namespace Pisces
         (Alpha),
         (PreMultipledAlpha, "pre_multipled_alpha", "premultiplied_alpha")
     );
+
+    enum class BlendEquation {
+        Add,
+        Subtract,
+        ReverseSubtract,
+        Min,
+        Max
+    };
+    DECL_ENUM_TO_FROM_STRING(BlendEquation, PISCES_API,
+        (Add),
+        (Subtract),
+        (ReverseSubtract, "reverse_subtract"),
+        (Min),
+        (Max)
+    );
+
+    enum class CompareFunc {
+        Never,
+        Less,
+        Equal,
+        LessEqual,
+        Greater,
+        NotEqual,
+        GreaterEqual,
+        Always
+    };
+    DECL_ENUM_TO_FROM_STRING(CompareFunc, PISCES_API,
+        (Never),
+        (Less),
+        (Equal),
+        (LessEqual, "less_equal"),
+        (Greater),
+        (NotEqual, "not_equal"),
+        (GreaterEqual, "greater_equal"),
+        (Always)
+    );
+
+    enum class StencilOp {
+        Keep,
+        Zero,
+        Replace,
+        Increment,
+        IncrementWrap,
+        Decrement,
+        DecrementWrap,
+        Invert
+    };
+    DECL_ENUM_TO_FROM_STRING(StencilOp, PISCES_API,
+        (Keep),
+        (Zero),
+        (Replace),
+        (Increment),
+        (IncrementWrap, "increment_wrap"),
+        (Decrement),
+        (DecrementWrap, "decrement_wrap"),
+        (Invert)
+    );
+
+    enum class CullMode {
+        Back,
+        Front,
+        FrontAndBack
+    };
+    DECL_ENUM_TO_FROM_STRING(CullMode, PISCES_API,
+        (Back),
+        (Front),
+        (FrontAndBack, "front_and_back")
+    );
+
+    enum class ColorWriteMask {
+        None = 0,
+        Red = 1,
+        Green = 2,
+        Blue = 4,
+        Alpha = 8,
+        All = 15
+    };
+    DECLARE_ENUM_FLAG(ColorWriteMask);
     
     enum class Shape {
         Cube,
@@ -20,6 +20,7 @@ namespace Pisces
         // if mipmaps is 0, its automatic calculated based on the size
         PISCES_API TextureHandle allocateTexture2D( PixelFormat format, TextureFlags flags, int width, int height, int mipmaps=0 );
         PISCES_API TextureHandle allocateCubemap( PixelFormat format, TextureFlags flags, int size, int mipmaps=0 );
+        PISCES_API TextureHandle allocateTexture2DArray( PixelFormat format, TextureFlags flags, int width, int height, int layers, int mipmaps=0 );
         PISCES_API void freeTexture( TextureHandle texture );
         
         PISCES_API BufferHandle allocateBuffer( BufferType type, BufferUsage usage, BufferFlags flags, size_t size, const void *data );
@@ -27,11 +28,21 @@ namespace Pisces
 
         PISCES_API void uploadTexture2D( TextureHandle texture, int mipmap, TextureUploadFlags flags, PixelFormat format, const void *data );
         PISCES_API void uploadCubemap( TextureHandle texture, CubemapFace face, int mipmap, TextureUploadFlags flags, PixelFormat format, const void *data );
+        // Uploads a region of a single layer, data is expected to be width*height pixels
+        PISCES_API void uploadTexture2DArray( TextureHandle texture, int mipmap, int layer, int x, int y, int width, int height, 
+                                              TextureUploadFlags flags, PixelFormat format, const void *data );
+        // Regenerates all mipmap levels from level 0, useful after several partial uploads
+        PISCES_API void generateMipmaps( TextureHandle texture );
         PISCES_API void uploadBuffer( BufferHandle buffer, size_t offset, size_t size, const void *data );
 
         PISCES_API void setSwizzleMask( TextureHandle texture, SwizzleMask red, SwizzleMask green, SwizzleMask blue, SwizzleMask alpha );
         PISCES_API TextureHandle createSampler( TextureHandle texture, const SamplerParams &params );
-        PISCES_API void setSamplerParams( TextureHandle texture, const SamplerParams &params );
+        // On a sampler handle this switches to the shared sampler object matching params. Render queues compiled
+        // before are patched to the new object the next time they are executed.
+        // On a texture handle the params are stored in the texture, they can't change anymore once the texture was
+        // drawn with RenderQueueCompileFlags::BindlessTextures (its bindless handle made them immutable). Returns
+        // false in that case or for an invalid handle, nothing is changed then - use a sampler from createSampler instead.
+        PISCES_API bool setSamplerParams( TextureHandle texture, const SamplerParams &params );
 
         PISCES_API VertexArrayHandle createVertexArray( const VertexAttribute *attributes, int attributeCount,
                                                         const BufferHandle *sourceBuffers, int sourceCount,
@@ -39,6 +50,28 @@ namespace Pisces
                                                         VertexArrayFlags flags = VertexArrayFlags::None );
         PISCES_API void deleteVertexArray( VertexArrayHandle vertexArray );
 
+        // Layout without buffers, bind them with RenderCommandQueue::useVertexBuffers (buffer i is read by source i).
+        // Formats with the same layout share one vertex array, so switching buffers doesn't switch vertex arrays.
+        // Attributes of one source must share the stride, a stride of 0 is only allowed for a source with a single attribute
+        PISCES_API VertexFormatHandle createVertexFormat( const VertexAttribute *attributes, int attributeCount,
+                                                          IndexType indexType, VertexArrayFlags flags = VertexArrayFlags::None );
+        PISCES_API void deleteVertexFormat( VertexFormatHandle format );
+
+        // Sub allocates static data from a few large buffers per BufferType, offset is a multiple of alignment
+        // Ranges can move when the heap is compacted, so query them again after compactBufferHeap
+        PISCES_API BufferAllocationHandle allocateFromHeap( BufferType type, size_t size, size_t alignment, const void *data );
+        PISCES_API void freeHeapAllocation( BufferAllocationHandle allocation );
+        PISCES_API BufferRange getHeapAllocation( BufferAllocationHandle allocation );
+        // Vertex array shared by all heap allocations in the same buffers with an identical layout (all attributes
+        // from source 0). Draw with base = vertexes.offset/stride and first = indexes.offset/sizeof(index)
+        PISCES_API VertexArrayHandle getHeapVertexArray( const VertexAttribute *attributes, int attributeCount,
+                                                         BufferAllocationHandle vertexes,
+                                                         BufferAllocationHandle indexes, IndexType indexType );
+        PISCES_API BufferHeapStats getBufferHeapStats( BufferType type );
+        // Moves all allocations to the start of their heap buffer and frees the buffers that are left empty
+        // Render queues compiled before this needs to be recompiled
+        PISCES_API void compactBufferHeap( BufferType type );
+
         PISCES_API TextureHandle loadTexture2D( PixelFormat format, TextureFlags flags, const char *filename );
         // filenameTemplate should have a %FACE% that gets replaces with pos_x, neg_x, etc..
         PISCES_API TextureHandle loadCubemap( PixelFormat format, TextureFlags flags, const char *filenameTemplate );
@@ -49,11 +82,17 @@ namespace Pisces
         PISCES_API TextureHandle getBuiltinTexture( BuiltinTexture texture );
 
         PISCES_API bool getTextureSize( TextureHandle texture, int *width, int *height, int *depth=nullptr );
+        PISCES_API bool getTextureType( TextureHandle texture, TextureType *type );
 
 
         PISCES_API void* mapBuffer( BufferHandle buffer, size_t offset, size_t size, BufferMapFlags flags );
         // Returns true if persistent mapped
         PISCES_API bool unmapBuffer( BufferHandle buffer, bool keepPersistent=false );
+        // Marks a range (in buffer offsets) as written, with BufferMapFlags::FlushExplicit only these ranges
+        // are flushed by unmapBuffer or flushBuffer. Close ranges are merged to keep the number of flushes low.
+        PISCES_API void markBufferWritten( BufferHandle buffer, size_t offset, size_t size );
+        // Flushes the marked ranges of a persistently mapped buffer without remapping it
+        PISCES_API void flushBuffer( BufferHandle buffer );
 
         template< typename Type >
         Type* mapBuffer( BufferHandle buffer, size_t first, size_t count, BufferMapFlags flags )
@@ -62,7 +101,9 @@ namespace Pisces
         }
 
         PISCES_API UniformBufferHandle allocateStaticUniform( size_t size, const void *data );
+        // Updates are uploaded by the next Context::execute, many updates in a frame cost a few uploads
         PISCES_API void updateStaticUniform( UniformBufferHandle uniform, size_t size, const void *data );
+        PISCES_API void freeStaticUniform( UniformBufferHandle uniform );
 
         template< typename Type >
         UniformBufferHandle allocateStaticUniform( const Type &type ) {
@@ -7,6 +7,8 @@
 #include "Common/StringId.h"
 
 #include <string>
+#include <utility>
+#include <vector>
 
 namespace Pisces
 {
@@ -39,6 +41,13 @@ namespace Pisces
                     geometrySource,
                     fragmentSource;
 
+        // (name, value) pairs defined in every shader, right after the #version line
+        std::vector<std::pair<std::string, std::string>> defines;
+        // Optional defines, bit i of the variant key passed to findRenderprogram defines variants[i].
+        // Variants are compiled the first time they are looked up, createRenderProgram returns variant 0.
+        // Destroying variant 0 destroys all other variants of the program as well.
+        std::vector<std::string> variants;
+
         ProgramInitBindings bindings;
     };
     struct TransformCaptureVariable {
@@ -56,12 +65,43 @@ namespace Pisces
         size_t captureCount = 0;
     };
 
+    struct StencilFaceState {
+        CompareFunc func = CompareFunc::Always;
+        StencilOp fail = StencilOp::Keep,
+                  depthFail = StencilOp::Keep,
+                  pass = StencilOp::Keep;
+    };
+
+    // Fixed function state of a pipeline besides PipelineFlags & BlendMode, the defaults match the GL defaults
+    struct PipelineState {
+        CompareFunc depthFunc = CompareFunc::Less;
+        // Used with PipelineFlags::FaceCulling
+        CullMode cullMode = CullMode::Back;
+        ColorWriteMask colorWriteMask = ColorWriteMask::All;
+
+        // Used with PipelineFlags::StencilTest
+        StencilFaceState stencilFront,
+                         stencilBack;
+        int stencilReference = 0;
+        uint32_t stencilReadMask = 0xFF,
+                 stencilWriteMask = 0xFF;
+
+        // Polygon offset is enabled when either is non zero
+        float polygonOffsetFactor = 0.f,
+              polygonOffsetUnits = 0.f;
+
+        // Used when blending, the blend factors are given by the BlendMode
+        BlendEquation colorBlendEquation = BlendEquation::Add,
+                      alphaBlendEquation = BlendEquation::Add;
+    };
+
     struct PipelineInitParams {
         Common::StringId name;
         ProgramHandle program;
 
         BlendMode blendMode = BlendMode::Replace;
         PipelineFlags flags = PipelineFlags::None;
+        PipelineState state;
     };
 
     struct PipelineProgramInitParams {
@@ -69,6 +109,7 @@ namespace Pisces
         
         BlendMode blendMode = BlendMode::Replace;
         PipelineFlags flags = PipelineFlags::None;
+        PipelineState state;
 
         Common::StringId name;
     };
@@ -77,10 +118,23 @@ namespace Pisces
     public:
         PISCES_API PipelineManager( Context *context );
         PISCES_API ~PipelineManager();
+
+        // Caches linked programs as driver binaries in directory (which must exist), nullptr or "" disables the cache.
+        // Entries are keyed on the sources, bindings and driver, so edited shaders and driver updates just miss
+        PISCES_API void setProgramCacheDirectory( const char *directory );
+
+        // Programs created until finishProgramBatch are compiled & linked without waiting for the result, so the
+        // driver can build them in parallel (KHR_parallel_shader_compile). Their handles can't be used before the
+        // batch is finished. Programs that fail to build keep their handle until destroyed, pipelines using them
+        // are skipped by the render queue compiler
+        PISCES_API void beginProgramBatch();
+        PISCES_API void finishProgramBatch();
         
         PISCES_API ProgramHandle createRenderProgram( const RenderProgramInitParams &params );
         PISCES_API void destroyProgram( ProgramHandle handle );
         PISCES_API ProgramHandle findRenderprogram( Common::StringId name );
+        // Compiles the variant if it doesn't exist yet, returns null if name has no variants or the key is invalid
+        PISCES_API ProgramHandle findRenderprogram( Common::StringId name, uint32_t variantKey );
 
         PISCES_API bool supportsComputePrograms();
         PISCES_API ComputeProgramHandle createComputeProgram( const ComputeProgramInitParams &params );
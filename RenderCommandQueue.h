@@ -25,6 +25,10 @@ namespace Pisces
     public:
         PISCES_API void usePipeline( PipelineHandle pipeline );
         PISCES_API void useVertexArray( VertexArrayHandle vertexArray );
+        // Binds buffers[i] at offsets[i] (nullptr for 0) to source i of the format, at most MAX_VERTEX_BUFFERS.
+        // Draws switching between buffers of the same format only rebind the buffers that changed
+        PISCES_API void useVertexBuffers( VertexFormatHandle format, const BufferHandle *buffers, const size_t *offsets, int count,
+                                          BufferHandle indexBuffer = BufferHandle() );
         PISCES_API void bindTexture( int slot, TextureHandle texture );
         PISCES_API void bindTexture( int slot, BuiltinTexture texture );
         PISCES_API void bindUniformBuffer( int slot, UniformBufferHandle uniform );
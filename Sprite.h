@@ -11,5 +11,7 @@ namespace Pisces
             float x1, y1,
                   x2, y2;
         } uv = {};
+        // Layer in texture, only used for array textures
+        int layer = 0;
     };
 }
\ No newline at end of file
@@ -18,4 +18,20 @@ namespace Pisces
 
         PISCES_API virtual ResourceHandle loadResource( Common::Archive &archive, libyaml::Node node ) override;
     };
+
+    // Loads a set of images and packs them into the layers of a array texture,
+    // so all sprites in the set can be drawn without rebinding textures
+    class SpriteAtlasLoader :
+        public IResourceLoader
+    {
+        SpriteManager *mSpriteMgr;
+        HardwareResourceManager *mHardwareMgr;
+    public:
+        SpriteAtlasLoader( SpriteManager *spriteMgr, HardwareResourceManager *hardwareMgr ) :
+            mSpriteMgr(spriteMgr),
+            mHardwareMgr(hardwareMgr)
+        {}
+
+        PISCES_API virtual ResourceHandle loadResource( Common::Archive &archive, libyaml::Node node ) override;
+    };
 }
\ No newline at end of file
@@ -26,7 +26,9 @@ namespace Pisces
         StreamingBufferBase( const StreamingBufferBase& ) = delete;
         StreamingBufferBase& operator = ( const StreamingBufferBase& ) = delete;
 
-        PISCES_API void* mapBuffer( size_t offset, size_t size );
+        // With flushExplicit only the ranges passed to markWritten are flushed on unmap
+        PISCES_API void* mapBuffer( size_t offset, size_t size, bool flushExplicit=false );
+        PISCES_API void markWritten( size_t offset, size_t size );
         PISCES_API void unmapBuffer();
 
         PISCES_API void resize( size_t newSize, StreamingBufferResizeFlags flags );
@@ -37,7 +39,7 @@ namespace Pisces
 
     protected:
         struct Impl;
-        PImplHelper<Impl,32> mImpl;
+        PImplHelper<Impl,64> mImpl;
     };
 
     template< typename Type_ >
@@ -56,8 +58,11 @@ namespace Pisces
         StreamingBuffer( const StreamingBuffer& ) = delete;
         StreamingBuffer& operator = ( const StreamingBuffer& ) = delete;
 
-        Type* mapBuffer( size_t first, size_t count ) {
-            return (Type*)StreamingBufferBase::mapBuffer(first*sizeof(Type), count*sizeof(Type));
+        Type* mapBuffer( size_t first, size_t count, bool flushExplicit=false ) {
+            return (Type*)StreamingBufferBase::mapBuffer(first*sizeof(Type), count*sizeof(Type), flushExplicit);
+        }
+        void markWritten( size_t first, size_t count ) {
+            StreamingBufferBase::markWritten(first*sizeof(Type), count*sizeof(Type));
         }
         void unmapBuffer() {
             StreamingBufferBase::unmapBuffer();
@@ -106,4 +111,93 @@ namespace Pisces
         void *mCurrentMapping = nullptr;
         bool mAutoResize = false;
     };
-}
\ No newline at end of file
+
+    struct TransientAllocation {
+        BufferHandle buffer;
+        size_t offset = 0, size = 0;
+        void *data = nullptr;
+
+        explicit operator bool () const {
+            return data != nullptr;
+        }
+    };
+
+    // Ring buffer shared by all transient data (vertexes, indexes and uniforms) of a frame.
+    // Space is reclaimed as soon as the gpu has finished the frame that used it, so memory use
+    // follows the actual usage instead of the sum of every clients worst case.
+    class TransientBuffer {
+    public:
+        PISCES_API TransientBuffer( Context *context, size_t size );
+        PISCES_API ~TransientBuffer();
+
+        TransientBuffer( const TransientBuffer& ) = delete;
+        TransientBuffer& operator = ( const TransientBuffer& ) = delete;
+
+        // The range is valid until the gpu has finished the current frame, offset is a multiple of alignment
+        PISCES_API TransientAllocation allocate( size_t size, size_t alignment=16 );
+        PISCES_API UniformBufferHandle allocateUniform( const void *data, size_t size, const UniformBlockInfo *blockInfo=nullptr );
+
+        template< typename Type >
+        UniformBufferHandle allocateUniform( const Type &type ) {
+            return allocateUniform(&type, sizeof(Type), getUniformBlockInfo<Type>());
+        }
+
+        // Makes all data written since the last flush visible to the gpu, done by Context::execute
+        PISCES_API void flush();
+
+        // The buffer is replaced if the ring has to grow, vertex arrays using it must then be recreated.
+        // Earlier allocations stay valid in the old buffer until the frame is done, draw with TransientAllocation::buffer.
+        PISCES_API BufferHandle handle();
+        PISCES_API size_t size();
+        PISCES_API size_t usedSize();
+
+    private:
+        struct Impl;
+        PImplHelper<Impl,256> mImpl;
+    };
+
+    struct PagedAllocation {
+        BufferHandle buffer;
+        // Vertex array of the page, only valid if the buffer has a vertex layout
+        VertexArrayHandle vertexArray;
+        size_t offset = 0, size = 0;
+        void *data = nullptr;
+
+        explicit operator bool () const {
+            return data != nullptr;
+        }
+    };
+
+    // Streaming buffer made of fixed size pages, every page is a separate buffer that is never resized.
+    // Growing adds pages instead of copying, so buffers and vertex arrays of a page stay valid for its
+    // lifetime. Pages are reused once the gpu has finished the frames that wrote them and released
+    // again after a while of lower usage.
+    class PagedStreamingBuffer {
+    public:
+        PISCES_API PagedStreamingBuffer( Context *context, BufferType type, size_t pageSize );
+        PISCES_API ~PagedStreamingBuffer();
+
+        PagedStreamingBuffer( const PagedStreamingBuffer& ) = delete;
+        PagedStreamingBuffer& operator = ( const PagedStreamingBuffer& ) = delete;
+
+        // Creates a vertex array for every page with the page as the only vertex buffer. If indexBuffer
+        // is null the page is used as index buffer as well. Must be called before the first allocation.
+        PISCES_API void setVertexLayout( const VertexAttribute *attributes, int attributeCount, BufferHandle indexBuffer, IndexType indexType );
+
+        // The allocation has to fit in one page
+        PISCES_API PagedAllocation allocate( size_t size, size_t alignment=16 );
+        // Allocates at least minSize and at most size bytes from one page, used to split large streams
+        // into one draw per page. If less than size fits, the returned size is a multiple of minSize.
+        PISCES_API PagedAllocation allocatePartial( size_t size, size_t minSize, size_t alignment=16 );
+
+        // Makes all data written since the last flush visible to the gpu
+        PISCES_API void flush();
+
+        PISCES_API size_t pageSize();
+        PISCES_API size_t pageCount();
+
+    private:
+        struct Impl;
+        PImplHelper<Impl,256> mImpl;
+    };
+}
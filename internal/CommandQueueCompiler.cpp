@@ -8,6 +8,7 @@
 #include "RenderCommandQueue.h"
 #include "RenderCommandQueueImpl.h"
 #include "CompiledRenderQueueImpl.h"
+#include "GLCompat.h"
 #include "Helpers.h"
 #include "UniformBlockInfo.h"
 
@@ -74,23 +75,35 @@ namespace Pisces
         Uniform uniforms[MAX_BOUND_UNIFORMS];
     };
 
+    // The sampler bound to a unit is unknown until the queue binds one
+    static const GLuint UNKNOWN_SAMPLER = ~0u;
+
+    // Texture and sampler are tracked separately, so a unit switching only the sampler skips glBindTexture.
+    // The sampler handle is tracked too, the glBindSampler of a sampler handle is patched when its params change
+    // so units are never shared between sampler handles, even with the same sampler object.
     struct TextureUnitInfo {
         TextureHandle texture;
         TextureType type = TextureType(-1);
+        // Empty for plain textures
+        TextureHandle sampler;
+        GLuint glSampler = UNKNOWN_SAMPLER;
         int lastUsed = 0;
     };
 
     struct State {
         PipelineHandle pipeline;
         VertexArrayHandle vertexArray;
+        // Used instead of vertexArray when set
+        VertexFormatHandle vertexFormat;
+        BufferHandle vertexBuffers[MAX_VERTEX_BUFFERS];
+        size_t vertexOffsets[MAX_VERTEX_BUFFERS] = {};
+        BufferHandle indexBuffer;
         ClipRect clipRect;
 
         bool clipping = false, 
-             depthTest = true,
-             faceCulling = true,
-             depthWrite = true,
              primitiveRestart = false;
-        BlendMode blendMode = BlendMode::Replace;
+        // Index of the pipeline render state in the pipeline manager
+        uint32_t renderState = PipelineManagerImpl::DEFAULT_RENDER_STATE;
 
         ResourceBindings bindings;
     };
@@ -118,17 +131,22 @@ namespace Pisces
         const PMI::ComputeProgramInfo *computeProgramInfo = nullptr;
         const PMI::TransformProgramInfo *transformProgramInfo = nullptr;
 
-        const HRMI::VertexArrayInfo *vertexArrayInfo = nullptr;
+        // Index type of the bound vertex array or format, None when no index buffer is bound
+        IndexType indexType = IndexType::None;
 
         State state;
         State current;
         std::vector<CCQI::Command> commands;
+        std::vector<CCQI::SamplerReference> samplerReferences;
 
         int currentCommand = 0;
 
         int numTextureUnits = -1;
         std::vector<TextureUnitInfo> textureUnits;
 
+        // Samplers are set to resident handles, texture units are left alone
+        bool bindlessTextures = false;
+
         void init( Context *ctx,  const RenderQueueCompileOptions &opts ) 
         {
             context = ctx;
@@ -142,6 +160,8 @@ namespace Pisces
 
             numTextureUnits = ctx->getHardwareLimit(HardwareLimitName::TextureUnits);
             textureUnits.resize(numTextureUnits);
+
+            bindlessTextures = all(opts.flags, RenderQueueCompileFlags::BindlessTextures) && GLCompat::SupportsBindlessTexture();
         }
 
         void onProgramChanged()
@@ -161,7 +181,7 @@ namespace Pisces
             sampler = impl.hardwareMgr->samplers.find(handle);
             if (!sampler) return false;
 
-            texture = impl.hardwareMgr->textures.find(handle);
+            texture = impl.hardwareMgr->textures.find(sampler->texture);
             if (!texture) return false;
 
             return true;
@@ -169,17 +189,23 @@ namespace Pisces
         return false;
     }
 
-    int findSlotForTexture( CompilerImpl &impl, TextureHandle handle, bool &existing )
+    int findSlotForTexture( CompilerImpl &impl, TextureHandle texture, TextureHandle sampler, GLuint glSampler, bool &existing )
     {
         int lastUsed = -1;
         int slot = -1;
+        // Unit with the texture but another sampler, only the sampler has to be rebound there
+        int textureSlot = -1;
         assert (impl.textureUnits.size() == impl.numTextureUnits);
         for (int i=0; i < impl.numTextureUnits; ++i) {
-            if (impl.textureUnits[i].texture == handle) {
+            if (impl.textureUnits[i].texture == texture && impl.textureUnits[i].sampler == sampler && impl.textureUnits[i].glSampler == glSampler) {
                 // We found a binding for the texture, return the slot
                 existing = true;
                 return i;
             }
+            // Units used by the current draw are kept, another sampler of the draw may read the texture with the old sampler
+            if (impl.textureUnits[i].texture == texture && impl.textureUnits[i].lastUsed != impl.currentCommand && textureSlot == -1) {
+                textureSlot = i;
+            }
 
             // Is this slot free?, and the first free slot we found so far?
             if (!impl.textureUnits[i].texture && (lastUsed != -1 || slot == -1)) {
@@ -195,7 +221,7 @@ namespace Pisces
         }
         // We didn't find any existing binding for the texture
         existing = false;
-        return slot;
+        return textureSlot != -1 ? textureSlot : slot;
     }
 
     void Emit( CompilerImpl &impl, const CCQI::Command &command ) 
@@ -203,6 +229,15 @@ namespace Pisces
         impl.commands.push_back(command);
     }
 
+    // Records the next command as using sampler, so it can be patched if the sampler switches sampler objects
+    void EmitSamplerReference( CompilerImpl &impl, const HRMI::SamplerInfo *sampler, TextureHandle handle, const CCQI::Command &command )
+    {
+        if (sampler) {
+            impl.samplerReferences.push_back({impl.commands.size(), handle, sampler->generation});
+        }
+        Emit(impl, command);
+    }
+
     void EmitEnableDisable( CompilerImpl &impl, bool &var, bool test, GLenum cap )
     {
         if (test != var) {
@@ -216,48 +251,34 @@ namespace Pisces
         }
     }
 
-    void EmitBlendMode( CompilerImpl &impl, BlendMode blendMode )
+    // Replays the precomputed commands between the current and the new render state
+    void EmitRenderState( CompilerImpl &impl, uint32_t renderState )
     {
-        switch (blendMode) {
-        case BlendMode::Replace:
-            Emit(impl, CCQI::Disable(GL_BLEND));
-            break;
-        case BlendMode::Alpha:
-            Emit(impl, CCQI::Enable(GL_BLEND));
-            Emit(impl, CCQI::SetBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA));
-            break;
-        case BlendMode::PreMultipledAlpha:
-            Emit(impl, CCQI::Enable(GL_BLEND));
-            Emit(impl, CCQI::SetBlendFunc(GL_ONE, GL_ONE_MINUS_SRC_ALPHA));
-            break;
+        if (impl.current.renderState == renderState) return;
+
+        for (const auto &command : PMI::GetRenderStateDelta(impl.pipelineMgr, impl.current.renderState, renderState)) {
+            Emit(impl, command);
         }
-        impl.current.blendMode = blendMode;
+        impl.current.renderState = renderState;
     }
 
     bool EmitBindPipeline( CompilerImpl &impl, PipelineHandle handle )
     {
-        if (handle && impl.current.pipeline == handle) return true;
+        if (handle && impl.current.pipeline == handle) {
+            // A clear may have switched to the default render state since
+            if (impl.pipelineInfo) EmitRenderState(impl, impl.pipelineInfo->renderState);
+            return true;
+        }
         // ignore if we are in transform feedback mode
         if (impl.transformProgramInfo) return true;
 
         PMI::PipelineInfo *pipeline = impl.pipelineMgr->pipelines.find(handle);
         if (!pipeline) return false;
 
-        EmitEnableDisable(impl, impl.current.depthTest, all(pipeline->flags, PipelineFlags::DepthTest), GL_DEPTH_TEST);
-        EmitEnableDisable(impl, impl.current.faceCulling, all(pipeline->flags, PipelineFlags::FaceCulling), GL_CULL_FACE);
-
-        bool depthWrite = all(pipeline->flags, PipelineFlags::DepthWrite);
-        if (depthWrite != impl.current.depthWrite) {
-            Emit(impl, CCQI::SetDepthMask(depthWrite));
-            impl.current.depthWrite = depthWrite;
-        }
-
-        if (impl.current.blendMode != pipeline->blendMode) {
-            EmitBlendMode(impl, pipeline->blendMode);
-        }
+        EmitRenderState(impl, pipeline->renderState);
 
         PMI::RenderProgramInfo *programInfo = impl.pipelineMgr->renderPrograms.find(pipeline->program);
-        if (!programInfo) return false;
+        if (!programInfo || programInfo->failed) return false;
 
         Emit(impl, CCQI::SetProgram(programInfo->glProgram));
 
@@ -282,25 +303,55 @@ namespace Pisces
         // Program doesn't have a sampler for this slot - ignore it
         if (impl.programInfo->samplers[i].type == TextureType(-1)) return true;
 
-        bool existing = false;
-        int slot = findSlotForTexture(impl, handle, existing);
+        const HRMI::TextureInfo *texture = nullptr;
+        const HRMI::SamplerInfo *sampler = nullptr;
 
-        if (!existing) {
-            const HRMI::TextureInfo *texture = nullptr;
-            const HRMI::SamplerInfo *sampler = nullptr;
+        if (!LookupTextureSampler(impl, handle, texture, sampler)) return false;
 
-            if (!LookupTextureSampler(impl, handle, texture, sampler)) return false;
+        // Plain textures use the sampler state stored in the texture
+        TextureHandle realTexture = sampler ? sampler->texture : handle;
+        TextureHandle samplerHandle = sampler ? handle : TextureHandle();
+        GLuint glSampler = sampler ? sampler->glSampler : 0;
 
-            Emit(impl, CCQI::BindSampler(
-                slot,
-                TextureTarget(texture->type),
-                texture->glTexture,
-                sampler ? sampler->glSampler : 0
-            ));
+        if (impl.bindlessTextures) {
+            if (texture->type != impl.programInfo->samplers[i].type) {
+                LOG_WARNING("Missmatch between bound texture type (%i) and expected type (%i) for program %s", 
+                    (int)texture->type, (int)impl.programInfo->samplers[i].type, Common::GetCString(impl.programInfo->name)
+                );
+            }
+
+            uint64_t glHandle = impl.hardwareMgr->acquireBindlessHandle(texture->glTexture, glSampler);
+            if (!glHandle) return false;
+
+            EmitSamplerReference(impl, sampler, handle,
+                CCQI::BindUniformHandle(impl.programInfo->samplers[i].location, glHandle)
+            );
+
+            impl.current.bindings.samplers[i] = handle;
+            return true;
+        }
+
+        bool existing = false;
+        int slot = findSlotForTexture(impl, realTexture, samplerHandle, glSampler, existing);
 
+        if (!existing) {
             TextureUnitInfo &info = impl.textureUnits[slot];
-                info.texture = handle;
+
+            if (info.texture != realTexture) {
+                Emit(impl, CCQI::BindTexture(
+                    slot,
+                    TextureTarget(texture->type),
+                    texture->glTexture
+                ));
+
+                info.texture = realTexture;
                 info.type = texture->type;
+            }
+            if (info.sampler != samplerHandle || info.glSampler != glSampler) {
+                EmitSamplerReference(impl, sampler, handle, CCQI::BindSampler(slot, glSampler));
+                info.sampler = samplerHandle;
+                info.glSampler = glSampler;
+            }
         }
         
 
@@ -364,10 +415,11 @@ namespace Pisces
 
         int loc = impl.programInfo->imageTextures[i].location;
 
+        // Bind all layers of array textures
         Emit(impl, CCQI::BindImageTexture(i,
             texture->glTexture,
             0,
-            GL_FALSE,
+            texture->type == TextureType::Texture2DArray ? GL_TRUE : GL_FALSE,
             0,
             ToGL(handle.access),
             InternalPixelFormat(handle.format)
@@ -408,8 +460,10 @@ namespace Pisces
         case GLType::Mat4x3:
         case GLType::Sampler1D:
         case GLType::Sampler2D:
+        case GLType::Sampler2DArray:
         case GLType::ImageTexture1D:
         case GLType::ImageTexture2D:
+        case GLType::ImageTexture2DArray:
             FATAL_ERROR("Unsupported uniform type!");
             break;
         case GLType::Int:
@@ -482,6 +536,25 @@ namespace Pisces
         return true;
     }
 
+    void EmitPrimitiveRestart( CompilerImpl &impl, IndexType indexType, VertexArrayFlags flags )
+    {
+        if (indexType != IndexType::None && all(flags, VertexArrayFlags::UsePrimitiveRestart)) {
+            EmitEnableDisable(impl, impl.current.primitiveRestart, true, GL_PRIMITIVE_RESTART);
+            if (indexType == IndexType::UInt16) {
+                Emit(impl, CCQI::PrimitiveRestartIndex(uint16_t(-1)));
+            }
+            else if((indexType == IndexType::UInt32)) {
+                Emit(impl, CCQI::PrimitiveRestartIndex(uint32_t(-1)));
+            }
+            else {
+                FATAL_ERROR("Unknown index type!");
+            }
+        }
+        else {
+            EmitEnableDisable(impl, impl.current.primitiveRestart, false, GL_PRIMITIVE_RESTART);
+        }
+    }
+
     bool EmitBindVertexArray( CompilerImpl &impl, VertexArrayHandle handle )
     {
         if (handle && impl.current.vertexArray == handle) return true;
@@ -491,31 +564,82 @@ namespace Pisces
 
 
         Emit(impl, CCQI::BindVertexArray(vertexArray->glVertexArray));
-        impl.vertexArrayInfo = vertexArray;
         impl.current.vertexArray = handle;
+        impl.current.vertexFormat = {};
+        impl.indexType = IndexType::None;
 
         if (vertexArray->indexBuffer) {
             HRMI::BufferInfo *indexBuffer = impl.hardwareMgr->buffers.find(vertexArray->indexBuffer);
             if (!indexBuffer) return false;
 
             Emit(impl, CCQI::BindBuffer(gl::GL_ELEMENT_ARRAY_BUFFER, indexBuffer->glBuffer));
-            
+            impl.indexType = vertexArray->indexType;
         }
 
-        if (vertexArray->indexType != IndexType::None && all(vertexArray->flags, VertexArrayFlags::UsePrimitiveRestart)) {
-            EmitEnableDisable(impl, impl.current.primitiveRestart, true, GL_PRIMITIVE_RESTART);
-            if (vertexArray->indexType == IndexType::UInt16) {
-                Emit(impl, CCQI::PrimitiveRestartIndex(uint16_t(-1)));
+        EmitPrimitiveRestart(impl, vertexArray->indexType, vertexArray->flags);
+
+        return true;
+    }
+
+    // Buffers are resolved to gl buffers here, so a format stays valid when its buffers are resized
+    bool EmitBindVertexBuffers( CompilerImpl &impl, const State &state )
+    {
+        HRMI::VertexFormatInfo *format = impl.hardwareMgr->vertexFormats.find(state.vertexFormat);
+        if (!format) return false;
+
+        if (impl.current.vertexFormat != state.vertexFormat) {
+            Emit(impl, CCQI::BindVertexArray(format->glVertexArray));
+            impl.current.vertexFormat = state.vertexFormat;
+            impl.current.vertexArray = {};
+            impl.indexType = IndexType::None;
+
+            // The bindings of the vertex array are unknown, they might be from another queue
+            for (int i=0; i < MAX_VERTEX_BUFFERS; ++i) {
+                impl.current.vertexBuffers[i] = {};
             }
-            else if((vertexArray->indexType == IndexType::UInt32)) {
-                Emit(impl, CCQI::PrimitiveRestartIndex(uint32_t(-1)));
+            impl.current.indexBuffer = {};
+
+            EmitPrimitiveRestart(impl, format->indexType, format->flags);
+        }
+
+        for (int i=0; i < format->bindingCount; ++i) {
+            if (state.vertexBuffers[i] == impl.current.vertexBuffers[i] && state.vertexOffsets[i] == impl.current.vertexOffsets[i]) {
+                continue;
+            }
+
+            HRMI::BufferInfo *buffer = impl.hardwareMgr->buffers.find(state.vertexBuffers[i]);
+            if (!buffer) return false;
+
+            if (GLCompat::SupportsVertexAttribBinding()) {
+                Emit(impl, CCQI::BindVertexBuffer(i, buffer->glBuffer, (GLintptr)state.vertexOffsets[i], format->strides[i]));
             }
             else {
-                FATAL_ERROR("Unknown index type!");
+                for (size_t j=0; j < format->layout.size(); ++j) {
+                    const VertexAttribute &attribute = format->layout[j];
+                    if (attribute.source != i) continue;
+
+                    Emit(impl, CCQI::VertexAttribPointer((GLuint)j, buffer->glBuffer, attribute.count, ToGL(attribute.type),
+                                                         IsNormalized(attribute.type) == GL_TRUE, IsIntegear(attribute.type) == GL_TRUE,
+                                                         format->strides[i], (GLintptr)(state.vertexOffsets[i] + attribute.offset)));
+                }
+            }
+
+            impl.current.vertexBuffers[i] = state.vertexBuffers[i];
+            impl.current.vertexOffsets[i] = state.vertexOffsets[i];
+        }
+
+        if (format->indexType != IndexType::None && state.indexBuffer) {
+            if (state.indexBuffer != impl.current.indexBuffer) {
+                HRMI::BufferInfo *indexBuffer = impl.hardwareMgr->buffers.find(state.indexBuffer);
+                if (!indexBuffer) return false;
+
+                Emit(impl, CCQI::BindBuffer(gl::GL_ELEMENT_ARRAY_BUFFER, indexBuffer->glBuffer));
+                impl.current.indexBuffer = state.indexBuffer;
             }
+            impl.indexType = format->indexType;
         }
         else {
-            EmitEnableDisable(impl, impl.current.primitiveRestart, false, GL_PRIMITIVE_RESTART);
+            impl.indexType = IndexType::None;
         }
 
         return true;
@@ -527,7 +651,13 @@ namespace Pisces
             LOG_ERROR("Failed to bind pipeline (%i)", (int)state.pipeline);
             return;
         }
-        if (!EmitBindVertexArray(impl, state.vertexArray)) {
+        if (state.vertexFormat) {
+            if (!EmitBindVertexBuffers(impl, state)) {
+                LOG_ERROR("Failed to bind vertex buffers of format (%i)", (int)state.vertexFormat);
+                return;
+            }
+        }
+        else if (!EmitBindVertexArray(impl, state.vertexArray)) {
             LOG_ERROR("Failed to bind vertexarray (%i)", (int)state.vertexArray);
             return;
         }
@@ -594,14 +724,13 @@ namespace Pisces
             impl.current.clipRect = state.clipRect;
         }
 
-        assert(impl.vertexArrayInfo);
-        if (impl.vertexArrayInfo->indexBuffer) {
+        if (impl.indexType != IndexType::None) {
             Emit(impl, CCQI::DrawIndexed(
                 ToGL(data.primitive), 
-                ToGL(impl.vertexArrayInfo->indexType), 
+                ToGL(impl.indexType), 
                 data.count,
                 data.base + base, 
-                (void*)OffsetForIndexType(impl.vertexArrayInfo->indexType, data.first+first)
+                (void*)OffsetForIndexType(impl.indexType, data.first+first)
             ));
         }
         else {
@@ -634,12 +763,22 @@ namespace Pisces
 
         State state = impl.state;
         state.vertexArray = drawInfo.vertexArray;
+        state.vertexFormat = {};
 
         EmitDraw(impl, draw, state, 0, 0);
     }
 
     void EmitClear( CompilerImpl &impl, const CQI::ClearData &data )
     {
+        // Clears go through the write masks of the last pipeline, the default render state writes everything
+        const PMI::GLRenderState &renderState = impl.pipelineMgr->renderStates[impl.current.renderState].state;
+        bool masked = (all(data.flags, ClearFlags::Color) && !(renderState.colorMask[0] && renderState.colorMask[1] && renderState.colorMask[2] && renderState.colorMask[3])) ||
+                      (all(data.flags, ClearFlags::Depth) && !renderState.depthWrite) ||
+                      (all(data.flags, ClearFlags::Stencil) && renderState.stencilWriteMask != ~0u);
+        if (masked) {
+            EmitRenderState(impl, PMI::DEFAULT_RENDER_STATE);
+        }
+
         gl::ClearBufferMask mask = GL_NONE_BIT;
 
         if (all(data.flags, ClearFlags::Color)) {
@@ -663,7 +802,7 @@ namespace Pisces
         FATAL_ASSERT(impl.transformProgramInfo == nullptr, "Can't execute compute! - Transform feedback is in progress");
 
         PMI::ComputeProgramInfo *programInfo = impl.pipelineMgr->computePrograms.find(data.program);
-        if (!programInfo) return;
+        if (!programInfo || programInfo->failed) return;
 
         impl.programInfo = programInfo;
         impl.computeProgramInfo = programInfo;
@@ -691,6 +830,18 @@ namespace Pisces
     void UseVertexArray( CompilerImpl &impl, const CQI::UseVertexArrayData &data )
     {
         impl.state.vertexArray = data.vertexArray;
+        impl.state.vertexFormat = {};
+    }
+
+    void UseVertexBuffers( CompilerImpl &impl, const CQI::UseVertexBuffersData &data )
+    {
+        impl.state.vertexArray = {};
+        impl.state.vertexFormat = data.format;
+        for (int i=0; i < MAX_VERTEX_BUFFERS; ++i) {
+            impl.state.vertexBuffers[i] = data.buffers[i];
+            impl.state.vertexOffsets[i] = data.offsets[i];
+        }
+        impl.state.indexBuffer = data.indexBuffer;
     }
 
     void UseClipping( CompilerImpl &impl, const CQI::UseClippingData &data )
@@ -825,6 +976,10 @@ namespace Pisces
             LOG_ERROR("Faield to bind transform feedback program %i", (int)data.program);
             return;
         }
+        if (programInfo->failed) {
+            LOG_ERROR("Transform feedback program %i failed to build", (int)data.program);
+            return;
+        }
 
         impl.programInfo = programInfo;
         impl.renderProgramInfo = nullptr;
@@ -893,27 +1048,14 @@ namespace Pisces
             EmitEnableDisable(impl, impl.current.clipping, state.clipping, GL_SCISSOR_TEST);
             impl.current.clipping = state.clipping;
         }
-        if (impl.current.depthTest != state.depthTest) {
-            EmitEnableDisable(impl, impl.current.depthTest, state.depthTest, GL_DEPTH_TEST);
-            impl.current.depthTest = state.depthTest;
-        }
-        if (impl.current.faceCulling != state.faceCulling) {
-            EmitEnableDisable(impl, impl.current.faceCulling, state.faceCulling, GL_CULL_FACE);
-            impl.current.faceCulling = state.faceCulling;
-        }
         if (impl.current.primitiveRestart != state.primitiveRestart) {
             EmitEnableDisable(impl, impl.current.primitiveRestart, state.primitiveRestart, GL_PRIMITIVE_RESTART);
         }
-        if (impl.current.depthWrite != state.depthWrite) {
-            Emit(impl, CCQI::SetDepthMask(state.depthWrite));
-            impl.current.depthWrite = state.depthWrite;
-        }
-        if (impl.current.blendMode != state.blendMode) {
-            EmitBlendMode(impl, state.blendMode);
-        }
+        EmitRenderState(impl, state.renderState);
     }
 
-    std::vector<CompiledRenderQueueImpl::Command> Compile( Context *context, const RenderQueueCompileOptions &options, const RenderCommandQueuePtr &queue )
+    std::vector<CompiledRenderQueueImpl::Command> Compile( Context *context, const RenderQueueCompileOptions &options, const RenderCommandQueuePtr &queue, 
+                                                           std::vector<CompiledRenderQueueImpl::SamplerReference> &samplerReferences )
     {
         CompilerImpl impl;
         impl.init(context, options);
@@ -944,6 +1086,9 @@ namespace Pisces
             case CommandType::UseVertexArray:
                 UseVertexArray(impl, command.useVertexArray);
                 break;
+            case CommandType::UseVertexBuffers:
+                UseVertexBuffers(impl, command.useVertexBuffers);
+                break;
             case CommandType::UseClipping:
                 UseClipping(impl, command.useClipping);
                 break;
@@ -1000,6 +1145,7 @@ namespace Pisces
         }
 
         resetState(impl);
+        samplerReferences = std::move(impl.samplerReferences);
         return std::move(impl.commands);
     }
 
@@ -1013,11 +1159,8 @@ namespace Pisces
 
         // Assume worst case - all the state different from the default
         state.clipping = !state.clipping;
-        state.depthTest = !state.depthTest;
-        state.faceCulling = !state.faceCulling;
-        state.depthWrite = !state.depthWrite;
         state.primitiveRestart = !state.primitiveRestart;
-        state.blendMode = BlendMode(-1);
+        state.renderState = PMI::UNKNOWN_RENDER_STATE;
 
         // create the instructions needed to restore the state to the default
         resetState(impl);
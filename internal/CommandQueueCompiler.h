@@ -5,6 +5,7 @@
 
 namespace Pisces
 {
-    std::vector<CompiledRenderQueueImpl::Command> Compile( Context *context, const RenderQueueCompileOptions &options, const RenderCommandQueuePtr &queue );
+    std::vector<CompiledRenderQueueImpl::Command> Compile( Context *context, const RenderQueueCompileOptions &options, const RenderCommandQueuePtr &queue, 
+                                                           std::vector<CompiledRenderQueueImpl::SamplerReference> &samplerReferences );
     std::vector<CompiledRenderQueueImpl::Command> RestoreDefaultState( Context *context );
 }
\ No newline at end of file
@@ -20,13 +20,24 @@ namespace Pisces
 
             SetProgram,
             SetBlendFunc,
+            SetBlendEquation,
             SetDepthMask,
+            SetDepthFunc,
+            SetCullFace,
+            SetColorMask,
+            SetStencilFunc,
+            SetStencilOp,
+            SetStencilMask,
+            SetPolygonOffset,
             SetClipRect,
             SetClearColor,
             SetClearDepth,
             SetClearStencil,
 
             BindVertexArray,
+            BindVertexBuffer,
+            VertexAttribPointer,
+            BindTexture,
             BindSampler,
 
             Clear,
@@ -41,6 +52,7 @@ namespace Pisces
             BindUniformVec3,
             BindUniformVec4,
             BindUniformMat4,
+            BindUniformHandle,
             
             BindImageTexture,
             DispatchCompute,
@@ -74,9 +86,45 @@ namespace Pisces
             (GLenum, sfactor),
             (GLenum, dfactor)
         );
+        CREATE_DATA_STRUCT( SetBlendEquation, Type,
+            (GLenum, modeRGB),
+            (GLenum, modeAlpha)
+        );
         CREATE_DATA_STRUCT( SetDepthMask, Type,
             (bool, mask)                  
         );
+        CREATE_DATA_STRUCT( SetDepthFunc, Type,
+            (GLenum, func)
+        );
+        CREATE_DATA_STRUCT( SetCullFace, Type,
+            (GLenum, mode)
+        );
+        CREATE_DATA_STRUCT( SetColorMask, Type,
+            (bool, red),
+            (bool, green),
+            (bool, blue),
+            (bool, alpha)
+        );
+        CREATE_DATA_STRUCT( SetStencilFunc, Type,
+            (GLenum, face),
+            (GLenum, func),
+            (GLint, ref),
+            (GLuint, mask)
+        );
+        CREATE_DATA_STRUCT( SetStencilOp, Type,
+            (GLenum, face),
+            (GLenum, sfail),
+            (GLenum, dpfail),
+            (GLenum, dppass)
+        );
+        CREATE_DATA_STRUCT( SetStencilMask, Type,
+            (GLenum, face),
+            (GLuint, mask)
+        );
+        CREATE_DATA_STRUCT( SetPolygonOffset, Type,
+            (GLfloat, factor),
+            (GLfloat, units)
+        );
         CREATE_DATA_STRUCT(SetClipRect, Type,
             (ClipRect, rect)                  
         );
@@ -93,10 +141,30 @@ namespace Pisces
         CREATE_DATA_STRUCT( BindVertexArray, Type,
             (GLuint, vertexArray)
         );
-        CREATE_DATA_STRUCT( BindSampler, Type,
+        CREATE_DATA_STRUCT( BindVertexBuffer, Type,
+            (GLuint, binding),
+            (GLuint, buffer),
+            (GLintptr, offset),
+            (GLsizei, stride)
+        );
+        // Fallback for BindVertexBuffer without ARB_vertex_attrib_binding, one per attribute of the binding
+        CREATE_DATA_STRUCT( VertexAttribPointer, Type,
+            (GLuint, index),
+            (GLuint, buffer),
+            (GLint, count),
+            (GLenum, type),
+            (bool, normalized),
+            (bool, integer),
+            (GLsizei, stride),
+            (GLintptr, offset)
+        );
+        CREATE_DATA_STRUCT( BindTexture, Type,
             (int, unit),
             (GLenum, target),
-            (GLuint, texture),
+            (GLuint, texture)
+        );
+        CREATE_DATA_STRUCT( BindSampler, Type,
+            (int, unit),
             (GLuint, sampler)
         );
 
@@ -145,6 +213,11 @@ namespace Pisces
             (GLint, location),
             (mat4, matrix)
         );
+        // Bindless texture handle for a sampler uniform
+        CREATE_DATA_STRUCT(BindUniformHandle, Type,
+            (GLint, location),
+            (GLuint64, handle)
+        );
 
         CREATE_DATA_STRUCT(BindImageTexture, Type,
             (GLuint, unit),
@@ -197,13 +270,24 @@ namespace Pisces
             
             (SetProgramData, setProgram),
             (SetBlendFuncData, setBlendFunc),
+            (SetBlendEquationData, setBlendEquation),
             (SetDepthMaskData, setDepthMask),
+            (SetDepthFuncData, setDepthFunc),
+            (SetCullFaceData, setCullFace),
+            (SetColorMaskData, setColorMask),
+            (SetStencilFuncData, setStencilFunc),
+            (SetStencilOpData, setStencilOp),
+            (SetStencilMaskData, setStencilMask),
+            (SetPolygonOffsetData, setPolygonOffset),
             (SetClipRectData, setClipRect),
             (SetClearColorData, setClearColor),
             (SetClearDepthData, setClearDepth),
             (SetClearStencilData, setClearStencil),
             
             (BindVertexArrayData, bindVertexArray),
+            (BindVertexBufferData, bindVertexBuffer),
+            (VertexAttribPointerData, vertexAttribPointer),
+            (BindTextureData, bindTexture),
             (BindSamplerData, bindSampler),
             
             (ClearData, clear),
@@ -218,6 +302,7 @@ namespace Pisces
             (BindUniformVec3Data, bindUniformVec3),
             (BindUniformVec4Data, bindUniformVec4),
             (BindUniformMat4Data, bindUniformMat4),
+            (BindUniformHandleData, bindUniformHandle),
 
             (BindImageTextureData, bindImageTexture),
             (DispatchComputeData, dispatchCompute),
@@ -233,11 +318,20 @@ namespace Pisces
             (PrimitiveRestartIndexData, primitiveRestartIndex)
         );
 
+        // BindSampler or BindUniformHandle command emitted for a sampler handle
+        struct SamplerReference {
+            size_t command;
+            TextureHandle sampler;
+            // SamplerInfo::generation the command was emitted / last patched for
+            uint32_t generation;
+        };
+
         struct Impl {
             Context *context;
 
             RenderTargetHandle renderTarget;
             std::vector<Command> commands;
+            std::vector<SamplerReference> samplerReferences;
 
             Impl( Context *context_ ) :
                 context(context_)
@@ -21,10 +21,33 @@ namespace Pisces
         void  (*BindTexture)( int slot, gl::GLenum target, gl::GLuint texture );
         void  (*TexStorage2D)( gl::GLenum target, int levels, gl::GLenum internalFormat, gl::GLsizei width, gl::GLsizei height );
         void  (*TexStorageCube)( gl::GLenum target, int levels, gl::GLenum internalFormat, gl::GLsizei size );
+        void  (*TexStorage3D)( gl::GLenum target, int levels, gl::GLenum internalFormat, gl::GLsizei width, gl::GLsizei height, gl::GLsizei depth );
         void  (*BufferStorage)( gl::GLenum target, BufferUsage usage, BufferFlags flags, size_t size, const void *data );
 
-        void* (*MapBuffer)( gl::GLenum target, size_t offset, size_t size, BufferMapFlags flags, size_t bufferSize, BufferPersistentMapping &mapping );
-        bool  (*UnMapBuffer)( gl::GLenum target, bool keepPersistent, BufferPersistentMapping &mapping );
+        void* (*MapBuffer)( gl::GLenum target, gl::GLuint buffer, size_t offset, size_t size, BufferMapFlags flags, size_t bufferSize, BufferPersistentMapping &mapping );
+        bool  (*UnMapBuffer)( gl::GLenum target, gl::GLuint buffer, bool keepPersistent, BufferPersistentMapping &mapping );
+
+        void  (*CreateTexture)( gl::GLenum target, gl::GLuint *texture );
+        void  (*TextureStorage)( gl::GLenum target, gl::GLuint texture, int levels, gl::GLenum internalFormat, gl::GLsizei width, gl::GLsizei height, gl::GLsizei depth );
+        void  (*TextureSubImage)( gl::GLenum target, gl::GLuint texture, int level, int x, int y, int z, gl::GLsizei width, gl::GLsizei height, gl::GLenum format, gl::GLenum type, const void *data );
+        void  (*GenerateMipmap)( gl::GLenum target, gl::GLuint texture );
+        void  (*TextureParameteri)( gl::GLenum target, gl::GLuint texture, gl::GLenum name, gl::GLint value );
+        void  (*TextureParameteriv)( gl::GLenum target, gl::GLuint texture, gl::GLenum name, const gl::GLint *values );
+        void  (*TextureParameterfv)( gl::GLenum target, gl::GLuint texture, gl::GLenum name, const gl::GLfloat *values );
+
+        void  (*CreateBuffer)( gl::GLenum target, gl::GLuint *buffer );
+        void  (*NamedBufferStorage)( gl::GLenum target, gl::GLuint buffer, BufferUsage usage, BufferFlags flags, size_t size, const void *data );
+        void  (*NamedBufferSubData)( gl::GLenum target, gl::GLuint buffer, size_t offset, size_t size, const void *data );
+        void  (*GetNamedBufferSubData)( gl::GLenum target, gl::GLuint buffer, size_t offset, size_t size, void *data );
+        void  (*CopyNamedBufferSubData)( gl::GLuint readBuffer, gl::GLuint writeBuffer, size_t readOffset, size_t writeOffset, size_t size );
+
+        void  (*CreateVertexArray)( gl::GLuint *vertexArray );
+        void  (*VertexArrayAttribute)( gl::GLuint vertexArray, int index, gl::GLuint buffer, int count, gl::GLenum type, bool normalized, bool integer, size_t offset, int stride );
+        void  (*VertexArrayAttributeFormat)( gl::GLuint vertexArray, int index, int binding, int count, gl::GLenum type, bool normalized, bool integer, size_t relativeOffset );
+
+        static bool DirectStateAccess = false;
+        static bool VertexAttribBinding = false;
+        static bool BindlessTexture = false;
 
 
 
@@ -68,6 +91,23 @@ namespace Pisces
             TexStorage2D_Storage(target, levels, internalFormat, size, size);
         }
 
+        void TexStorage3D_NoStorage( gl::GLenum target, int levels, gl::GLenum internalFormat, gl::GLsizei width, gl::GLsizei height, gl::GLsizei depth )
+        {
+            for (int i = 0; i < levels; i++) {
+                glTexImage3D(target, i, internalFormat, width, height, depth, 0, GL_RED, GL_BYTE, NULL);
+                width = std::max(1, (width / 2));
+                height = std::max(1, (height / 2));
+                // The layer count of a array texture is the same for all levels
+                if (target == GL_TEXTURE_3D) {
+                    depth = std::max(1, (depth / 2));
+                }
+            }
+        }
+        void TexStorage3D_Storage( gl::GLenum target, int levels, gl::GLenum internalFormat, gl::GLsizei width, gl::GLsizei height, gl::GLsizei depth )
+        {
+            glTexStorage3D(target, levels, internalFormat, width, height, depth);
+        }
+
         void BufferStorage_NoStorage( gl::GLenum target, BufferUsage usage, BufferFlags flags, size_t size, const void *data )
         {
             GLenum buffUsage;
@@ -87,7 +127,7 @@ namespace Pisces
 
             glBufferData( target, size, data, buffUsage );
         }
-        void BufferStorage_Storage( gl::GLenum target, BufferUsage usage, BufferFlags flags, size_t size, const void *data )
+        static gl::BufferStorageMask StorageFlags( BufferFlags flags )
         {
             gl::BufferStorageMask buffFlags = GL_NONE_BIT;
 
@@ -107,21 +147,381 @@ namespace Pisces
                 buffFlags = buffFlags | GL_DYNAMIC_STORAGE_BIT;
             }
 
-            glBufferStorage( target, size, data, buffFlags );
+            return buffFlags;
+        }
+        void BufferStorage_Storage( gl::GLenum target, BufferUsage usage, BufferFlags flags, size_t size, const void *data )
+        {
+            glBufferStorage( target, size, data, StorageFlags(flags) );
+        }
+
+        // Texture target used for binding, cubemap faces are bound as the cubemap
+        static gl::GLenum TextureBindTarget( gl::GLenum target )
+        {
+            if (target >= GL_TEXTURE_CUBE_MAP_POSITIVE_X && target <= GL_TEXTURE_CUBE_MAP_NEGATIVE_Z) {
+                return GL_TEXTURE_CUBE_MAP;
+            }
+            return target;
+        }
+
+        static int TypeSize( gl::GLenum type )
+        {
+            switch (type) {
+            case GL_BYTE:
+            case GL_UNSIGNED_BYTE:
+                return 1;
+            case GL_SHORT:
+            case GL_UNSIGNED_SHORT:
+            case GL_HALF_FLOAT:
+                return 2;
+            case GL_DOUBLE:
+                return 8;
+            default:
+                return 4;
+            }
+        }
+
+        // Size of a whole attribute, packed types hold all of their components in 4 bytes
+        static int AttributeSize( int count, gl::GLenum type )
+        {
+            switch (type) {
+            case GL_INT_2_10_10_10_REV:
+            case GL_UNSIGNED_INT_2_10_10_10_REV:
+                return 4;
+            default:
+                return count * TypeSize(type);
+            }
+        }
+
+        void CreateTexture_Bind( gl::GLenum target, gl::GLuint *texture )
+        {
+            glGenTextures(1, texture);
+            glBindTexture(target, *texture);
+        }
+        void CreateTexture_DSA( gl::GLenum target, gl::GLuint *texture )
+        {
+            glCreateTextures(target, 1, texture);
+        }
+
+        void TextureStorage_Bind( gl::GLenum target, gl::GLuint texture, int levels, gl::GLenum internalFormat, gl::GLsizei width, gl::GLsizei height, gl::GLsizei depth )
+        {
+            glBindTexture(target, texture);
+            if (target == GL_TEXTURE_CUBE_MAP) {
+                TexStorageCube(target, levels, internalFormat, width);
+            }
+            else if (target == GL_TEXTURE_2D_ARRAY) {
+                TexStorage3D(target, levels, internalFormat, width, height, depth);
+            }
+            else {
+                TexStorage2D(target, levels, internalFormat, width, height);
+            }
+        }
+        void TextureStorage_DSA( gl::GLenum target, gl::GLuint texture, int levels, gl::GLenum internalFormat, gl::GLsizei width, gl::GLsizei height, gl::GLsizei depth )
+        {
+            if (target == GL_TEXTURE_2D_ARRAY) {
+                glTextureStorage3D(texture, levels, internalFormat, width, height, depth);
+            }
+            else {
+                glTextureStorage2D(texture, levels, internalFormat, width, height);
+            }
+        }
+
+        void TextureSubImage_Bind( gl::GLenum target, gl::GLuint texture, int level, int x, int y, int z, gl::GLsizei width, gl::GLsizei height, gl::GLenum format, gl::GLenum type, const void *data )
+        {
+            glBindTexture(TextureBindTarget(target), texture);
+            if (target == GL_TEXTURE_2D_ARRAY) {
+                glTexSubImage3D(target, level, x, y, z, width, height, 1, format, type, data);
+            }
+            else {
+                glTexSubImage2D(target, level, x, y, width, height, format, type, data);
+            }
+        }
+        void TextureSubImage_DSA( gl::GLenum target, gl::GLuint texture, int level, int x, int y, int z, gl::GLsizei width, gl::GLsizei height, gl::GLenum format, gl::GLenum type, const void *data )
+        {
+            if (TextureBindTarget(target) == GL_TEXTURE_CUBE_MAP) {
+                // The faces of a cubemap are layers for the dsa functions
+                int face = (int)target - (int)GL_TEXTURE_CUBE_MAP_POSITIVE_X;
+                glTextureSubImage3D(texture, level, x, y, face, width, height, 1, format, type, data);
+            }
+            else if (target == GL_TEXTURE_2D_ARRAY) {
+                glTextureSubImage3D(texture, level, x, y, z, width, height, 1, format, type, data);
+            }
+            else {
+                glTextureSubImage2D(texture, level, x, y, width, height, format, type, data);
+            }
+        }
+
+        void GenerateMipmap_Bind( gl::GLenum target, gl::GLuint texture )
+        {
+            glBindTexture(target, texture);
+            glGenerateMipmap(target);
+        }
+        void GenerateMipmap_DSA( gl::GLenum target, gl::GLuint texture )
+        {
+            glGenerateTextureMipmap(texture);
+        }
+
+        void TextureParameteri_Bind( gl::GLenum target, gl::GLuint texture, gl::GLenum name, gl::GLint value )
+        {
+            glBindTexture(target, texture);
+            glTexParameteri(target, name, value);
+        }
+        void TextureParameteri_DSA( gl::GLenum target, gl::GLuint texture, gl::GLenum name, gl::GLint value )
+        {
+            glTextureParameteri(texture, name, value);
+        }
+        void TextureParameteriv_Bind( gl::GLenum target, gl::GLuint texture, gl::GLenum name, const gl::GLint *values )
+        {
+            glBindTexture(target, texture);
+            glTexParameteriv(target, name, values);
+        }
+        void TextureParameteriv_DSA( gl::GLenum target, gl::GLuint texture, gl::GLenum name, const gl::GLint *values )
+        {
+            glTextureParameteriv(texture, name, values);
+        }
+        void TextureParameterfv_Bind( gl::GLenum target, gl::GLuint texture, gl::GLenum name, const gl::GLfloat *values )
+        {
+            glBindTexture(target, texture);
+            glTexParameterfv(target, name, values);
+        }
+        void TextureParameterfv_DSA( gl::GLenum target, gl::GLuint texture, gl::GLenum name, const gl::GLfloat *values )
+        {
+            glTextureParameterfv(texture, name, values);
+        }
+
+        void CreateBuffer_Bind( gl::GLenum target, gl::GLuint *buffer )
+        {
+            glGenBuffers(1, buffer);
+            glBindBuffer(target, *buffer);
+        }
+        void CreateBuffer_DSA( gl::GLenum target, gl::GLuint *buffer )
+        {
+            glCreateBuffers(1, buffer);
+        }
+
+        void NamedBufferStorage_Bind( gl::GLenum target, gl::GLuint buffer, BufferUsage usage, BufferFlags flags, size_t size, const void *data )
+        {
+            glBindBuffer(target, buffer);
+            BufferStorage(target, usage, flags, size, data);
+        }
+        void NamedBufferStorage_DSA( gl::GLenum target, gl::GLuint buffer, BufferUsage usage, BufferFlags flags, size_t size, const void *data )
+        {
+            glNamedBufferStorage(buffer, size, data, StorageFlags(flags));
+        }
+
+        void NamedBufferSubData_Bind( gl::GLenum target, gl::GLuint buffer, size_t offset, size_t size, const void *data )
+        {
+            glBindBuffer(target, buffer);
+            glBufferSubData(target, offset, size, data);
+        }
+        void NamedBufferSubData_DSA( gl::GLenum target, gl::GLuint buffer, size_t offset, size_t size, const void *data )
+        {
+            glNamedBufferSubData(buffer, offset, size, data);
+        }
+
+        void GetNamedBufferSubData_Bind( gl::GLenum target, gl::GLuint buffer, size_t offset, size_t size, void *data )
+        {
+            glBindBuffer(target, buffer);
+            glGetBufferSubData(target, offset, size, data);
+        }
+        void GetNamedBufferSubData_DSA( gl::GLenum target, gl::GLuint buffer, size_t offset, size_t size, void *data )
+        {
+            glGetNamedBufferSubData(buffer, offset, size, data);
+        }
+
+        void CopyNamedBufferSubData_Bind( gl::GLuint readBuffer, gl::GLuint writeBuffer, size_t readOffset, size_t writeOffset, size_t size )
+        {
+            glBindBuffer(GL_COPY_READ_BUFFER, readBuffer);
+            glBindBuffer(GL_COPY_WRITE_BUFFER, writeBuffer);
+            glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, readOffset, writeOffset, size);
+        }
+        void CopyNamedBufferSubData_DSA( gl::GLuint readBuffer, gl::GLuint writeBuffer, size_t readOffset, size_t writeOffset, size_t size )
+        {
+            glCopyNamedBufferSubData(readBuffer, writeBuffer, readOffset, writeOffset, size);
+        }
+
+        void CreateVertexArray_Bind( gl::GLuint *vertexArray )
+        {
+            glGenVertexArrays(1, vertexArray);
+            glBindVertexArray(*vertexArray);
+        }
+        void CreateVertexArray_DSA( gl::GLuint *vertexArray )
+        {
+            glCreateVertexArrays(1, vertexArray);
+        }
+
+        void VertexArrayAttribute_Bind( gl::GLuint vertexArray, int index, gl::GLuint buffer, int count, gl::GLenum type, bool normalized, bool integer, size_t offset, int stride )
+        {
+            glBindVertexArray(vertexArray);
+            glBindBuffer(GL_ARRAY_BUFFER, buffer);
+            glEnableVertexAttribArray(index);
+            if (integer) {
+                glVertexAttribIPointer(index, count, type, stride, reinterpret_cast<void*>((uintptr_t)offset));
+            }
+            else {
+                glVertexAttribPointer(index, count, type, normalized ? GL_TRUE : GL_FALSE, stride, reinterpret_cast<void*>((uintptr_t)offset));
+            }
+        }
+        void VertexArrayAttribute_DSA( gl::GLuint vertexArray, int index, gl::GLuint buffer, int count, gl::GLenum type, bool normalized, bool integer, size_t offset, int stride )
+        {
+            // Every attribute gets a binding of its own, so the offset can be passed with the buffer and
+            // isn't limited by GL_MAX_VERTEX_ATTRIB_RELATIVE_OFFSET
+            if (stride == 0) {
+                stride = AttributeSize(count, type);
+            }
+
+            glVertexArrayVertexBuffer(vertexArray, index, buffer, offset, stride);
+            if (integer) {
+                glVertexArrayAttribIFormat(vertexArray, index, count, type, 0);
+            }
+            else {
+                glVertexArrayAttribFormat(vertexArray, index, count, type, normalized ? GL_TRUE : GL_FALSE, 0);
+            }
+            glVertexArrayAttribBinding(vertexArray, index, index);
+            glEnableVertexArrayAttrib(vertexArray, index);
+        }
+
+        void VertexArrayAttributeFormat_Pointer( gl::GLuint vertexArray, int index, int binding, int count, gl::GLenum type, bool normalized, bool integer, size_t relativeOffset )
+        {
+            glBindVertexArray(vertexArray);
+            glEnableVertexAttribArray(index);
+        }
+        void VertexArrayAttributeFormat_Binding( gl::GLuint vertexArray, int index, int binding, int count, gl::GLenum type, bool normalized, bool integer, size_t relativeOffset )
+        {
+            glBindVertexArray(vertexArray);
+            if (integer) {
+                glVertexAttribIFormat(index, count, type, (gl::GLuint)relativeOffset);
+            }
+            else {
+                glVertexAttribFormat(index, count, type, normalized ? GL_TRUE : GL_FALSE, (gl::GLuint)relativeOffset);
+            }
+            glVertexAttribBinding(index, binding);
+            glEnableVertexAttribArray(index);
+        }
+        void VertexArrayAttributeFormat_DSA( gl::GLuint vertexArray, int index, int binding, int count, gl::GLenum type, bool normalized, bool integer, size_t relativeOffset )
+        {
+            if (integer) {
+                glVertexArrayAttribIFormat(vertexArray, index, count, type, (gl::GLuint)relativeOffset);
+            }
+            else {
+                glVertexArrayAttribFormat(vertexArray, index, count, type, normalized ? GL_TRUE : GL_FALSE, (gl::GLuint)relativeOffset);
+            }
+            glVertexArrayAttribBinding(vertexArray, index, binding);
+            glEnableVertexArrayAttrib(vertexArray, index);
+        }
+
+        bool SupportsVertexAttribBinding()
+        {
+            return VertexAttribBinding;
+        }
+
+        bool SupportsBindlessTexture()
+        {
+            return BindlessTexture;
         }
 
-        void* MapBuffer_NoStorage( gl::GLenum target, size_t offset, size_t size, BufferMapFlags flags, size_t bufferSize, BufferPersistentMapping &mapping )
+        // Mapping functions are shared by the storage & no storage path
+        static void BindForMapping( gl::GLenum target, gl::GLuint buffer )
         {
+            if (!DirectStateAccess) glBindBuffer(target, buffer);
+        }
+        static void* MapRange( gl::GLenum target, gl::GLuint buffer, size_t offset, size_t size, gl::BufferAccessMask access )
+        {
+            if (DirectStateAccess) return glMapNamedBufferRange(buffer, offset, size, access);
+            return glMapBufferRange(target, offset, size, access);
+        }
+        static void FlushRange( gl::GLenum target, gl::GLuint buffer, size_t offset, size_t size )
+        {
+            if (DirectStateAccess) glFlushMappedNamedBufferRange(buffer, offset, size);
+            else glFlushMappedBufferRange(target, offset, size);
+        }
+        static void Unmap( gl::GLenum target, gl::GLuint buffer )
+        {
+            if (DirectStateAccess) glUnmapNamedBuffer(buffer);
+            else glUnmapBuffer(target);
+        }
+
+        // Gaps smaller than this are flushed with the ranges around them, as every flush has a fixed cost
+        static const size_t DIRTY_RANGE_MERGE_GAP = 256;
+        // Closest ranges are merged above this count
+        static const size_t MAX_DIRTY_RANGES = 32;
+
+        void MarkDirtyRange( std::vector<DirtyRange> &ranges, size_t offset, size_t size )
+        {
+            if (size == 0) return;
+
+            DirtyRange range = {offset, offset+size};
+
+            // First range that ends close enough to be merged
+            size_t first = 0;
+            while (first < ranges.size() && ranges[first].end + DIRTY_RANGE_MERGE_GAP < range.begin) {
+                first++;
+            }
+            size_t last = first;
+            while (last < ranges.size() && ranges[last].begin <= range.end + DIRTY_RANGE_MERGE_GAP) {
+                if (ranges[last].begin < range.begin) range.begin = ranges[last].begin;
+                if (ranges[last].end > range.end) range.end = ranges[last].end;
+                last++;
+            }
+
+            if (first == last) {
+                ranges.insert(ranges.begin() + first, range);
+            }
+            else {
+                ranges[first] = range;
+                ranges.erase(ranges.begin() + first + 1, ranges.begin() + last);
+            }
+
+            if (ranges.size() > MAX_DIRTY_RANGES) {
+                size_t closest = 0;
+                for (size_t i=1; i+1 < ranges.size(); ++i) {
+                    if (ranges[i+1].begin - ranges[i].end < ranges[closest+1].begin - ranges[closest].end) {
+                        closest = i;
+                    }
+                }
+                ranges[closest].end = ranges[closest+1].end;
+                ranges.erase(ranges.begin() + closest + 1);
+            }
+        }
+
+        void FlushDirtyRanges( gl::GLenum target, gl::GLuint buffer, BufferPersistentMapping &mapping )
+        {
+            BindForMapping(target, buffer);
+
+            // Offsets are relative to the start of the mapping, persistent mappings always map the whole buffer
+            size_t mapBegin = mapping.data != nullptr ? 0 : mapping.offset,
+                   mapEnd = mapping.data != nullptr ? ~(size_t)0 : mapping.offset + mapping.size;
+
+            for (const auto &range : mapping.dirtyRanges) {
+                size_t begin = range.begin > mapBegin ? range.begin : mapBegin,
+                       end = range.end < mapEnd ? range.end : mapEnd;
+                if (begin < end) {
+                    FlushRange(target, buffer, begin - mapBegin, end - begin);
+                }
+            }
+            mapping.dirtyRanges.clear();
+        }
+
+        void* MapBuffer_NoStorage( gl::GLenum target, gl::GLuint buffer, size_t offset, size_t size, BufferMapFlags flags, size_t bufferSize, BufferPersistentMapping &mapping )
+        {
+            BindForMapping(target, buffer);
+
             gl::BufferAccessMask mask = GL_NONE_BIT;
             if (all(flags, BufferMapFlags::MapRead)) mask |= GL_MAP_READ_BIT;
             if (all(flags, BufferMapFlags::MapWrite)) mask |= GL_MAP_WRITE_BIT;
             if (all(flags, BufferMapFlags::DiscardRange)) mask |= GL_MAP_INVALIDATE_RANGE_BIT;
             if (all(flags, BufferMapFlags::DiscardBuffer)) mask |= GL_MAP_INVALIDATE_BUFFER_BIT;
+            if (all(flags, BufferMapFlags::FlushExplicit|BufferMapFlags::MapWrite)) mask |= GL_MAP_FLUSH_EXPLICIT_BIT;
+            if (all(flags, BufferMapFlags::Unsynchronized)) mask |= GL_MAP_UNSYNCHRONIZED_BIT;
 
-            return glMapBufferRange(target, offset, size, mask);
+            mapping.offset = offset;
+            mapping.size = size;
+            mapping.flushExplicit = all(flags, BufferMapFlags::FlushExplicit|BufferMapFlags::MapWrite);
+            return MapRange(target, buffer, offset, size, mask);
         }
-        void* MapBuffer_Storage( gl::GLenum target, size_t offset, size_t size, BufferMapFlags flags, size_t bufferSize, BufferPersistentMapping &mapping )
+        void* MapBuffer_Storage( gl::GLenum target, gl::GLuint buffer, size_t offset, size_t size, BufferMapFlags flags, size_t bufferSize, BufferPersistentMapping &mapping )
         {
+            mapping.flushExplicit = all(flags, BufferMapFlags::FlushExplicit|BufferMapFlags::MapWrite);
+
             if (all(flags, BufferMapFlags::Persistent) && mapping.data != nullptr) {
                 mapping.offset = offset;
                 mapping.size = size;
@@ -134,29 +534,50 @@ namespace Pisces
             if (all(flags, BufferMapFlags::DiscardRange) && none(flags,BufferMapFlags::Persistent)) mask |= GL_MAP_INVALIDATE_RANGE_BIT;
             if (all(flags, BufferMapFlags::DiscardBuffer)) mask |= GL_MAP_INVALIDATE_BUFFER_BIT;
             if (all(flags, BufferMapFlags::Persistent)) mask |= GL_MAP_PERSISTENT_BIT;
+            if (mapping.flushExplicit) mask |= GL_MAP_FLUSH_EXPLICIT_BIT;
 
+            BindForMapping(target, buffer);
             if (all(flags,BufferMapFlags::Persistent)) {
-                mapping.data = glMapBufferRange(target, 0, bufferSize, mask | GL_MAP_FLUSH_EXPLICIT_BIT);
+                mapping.data = MapRange(target, buffer, 0, bufferSize, mask | GL_MAP_FLUSH_EXPLICIT_BIT);
                 mapping.offset = offset;
                 mapping.size = size;
                 return Common::advance(mapping.data, offset);
             }
 
-            return glMapBufferRange(target, offset, size, mask);
+            if (all(flags, BufferMapFlags::Unsynchronized)) mask |= GL_MAP_UNSYNCHRONIZED_BIT;
+
+            mapping.offset = offset;
+            mapping.size = size;
+            return MapRange(target, buffer, offset, size, mask);
         }
 
-        bool UnMapBuffer_NoStorage( gl::GLenum target, bool keepPersistent, BufferPersistentMapping &mapping )
+        bool UnMapBuffer_NoStorage( gl::GLenum target, gl::GLuint buffer, bool keepPersistent, BufferPersistentMapping &mapping )
         {
-            glUnmapBuffer(target);
+            BindForMapping(target, buffer);
+            if (mapping.flushExplicit) {
+                FlushDirtyRanges(target, buffer, mapping);
+            }
+            mapping.dirtyRanges.clear();
+
+            Unmap(target, buffer);
             return false;
         }
-        bool UnMapBuffer_Storage( gl::GLenum target, bool keepPersistent, BufferPersistentMapping &mapping )
+        bool UnMapBuffer_Storage( gl::GLenum target, gl::GLuint buffer, bool keepPersistent, BufferPersistentMapping &mapping )
         {
+            BindForMapping(target, buffer);
+            if (mapping.flushExplicit) {
+                FlushDirtyRanges(target, buffer, mapping);
+            }
+            else if (mapping.data != nullptr) {
+                // Persistent mappings are always done with GL_MAP_FLUSH_EXPLICIT_BIT
+                FlushRange(target, buffer, mapping.offset, mapping.size);
+            }
+            mapping.dirtyRanges.clear();
+
             if (keepPersistent && mapping.data != nullptr) {
-                glFlushMappedBufferRange(target, mapping.offset, mapping.size);
                 return true;
             }
-            glUnmapBuffer(target);
+            Unmap(target, buffer);
             mapping.data = nullptr;
             return false;
         }
@@ -178,11 +599,13 @@ namespace Pisces
             if (enableExtensions && ContextInfo::supported(Meta::extensions("glTexStorage2D"))) {
                 TexStorage2D = TexStorage2D_Storage;
                 TexStorageCube = TexStorageCube_Storage;
+                TexStorage3D = TexStorage3D_Storage;
                 LOG_INFORMATION("Context supports glTexStorage2D");
             }
             else {
                 TexStorage2D = TexStorage2D_NoStorage;
                 TexStorageCube = TexStorageCube_NoStorage;
+                TexStorage3D = TexStorage3D_NoStorage;
                 LOG_INFORMATION("Context missing supports for glTexStorage2D");
             }
 
@@ -198,6 +621,66 @@ namespace Pisces
                 UnMapBuffer = UnMapBuffer_NoStorage;
                 LOG_INFORMATION("Context missing supports for glBufferStorage");
             }
+
+            // Core in 4.3, implied by direct state access
+            if (enableExtensions && ContextInfo::supported(Meta::extensions("glBindVertexBuffer"))) {
+                VertexAttribBinding = true;
+                VertexArrayAttributeFormat = VertexArrayAttributeFormat_Binding;
+                LOG_INFORMATION("Context supports ARB_vertex_attrib_binding");
+            }
+            else {
+                VertexAttribBinding = false;
+                VertexArrayAttributeFormat = VertexArrayAttributeFormat_Pointer;
+                LOG_INFORMATION("Context missing supports for ARB_vertex_attrib_binding");
+            }
+
+            BindlessTexture = enableExtensions && ContextInfo::supported(Meta::extensions("glGetTextureHandleARB"));
+            if (BindlessTexture) {
+                LOG_INFORMATION("Context supports ARB_bindless_texture");
+            }
+            else {
+                LOG_INFORMATION("Context missing supports for ARB_bindless_texture");
+            }
+
+            // The dsa functions are core in 4.5, which also has texture & buffer storage
+            if (enableExtensions && ContextInfo::supported(Meta::extensions("glCreateTextures")) &&
+                BufferStorage == BufferStorage_Storage && TexStorage2D == TexStorage2D_Storage) {
+                DirectStateAccess = true;
+                CreateTexture = CreateTexture_DSA;
+                TextureStorage = TextureStorage_DSA;
+                TextureSubImage = TextureSubImage_DSA;
+                GenerateMipmap = GenerateMipmap_DSA;
+                TextureParameteri = TextureParameteri_DSA;
+                TextureParameteriv = TextureParameteriv_DSA;
+                TextureParameterfv = TextureParameterfv_DSA;
+                CreateBuffer = CreateBuffer_DSA;
+                NamedBufferStorage = NamedBufferStorage_DSA;
+                NamedBufferSubData = NamedBufferSubData_DSA;
+                GetNamedBufferSubData = GetNamedBufferSubData_DSA;
+                CopyNamedBufferSubData = CopyNamedBufferSubData_DSA;
+                CreateVertexArray = CreateVertexArray_DSA;
+                VertexArrayAttribute = VertexArrayAttribute_DSA;
+                VertexArrayAttributeFormat = VertexArrayAttributeFormat_DSA;
+                LOG_INFORMATION("Context supports ARB_direct_state_access");
+            }
+            else {
+                DirectStateAccess = false;
+                CreateTexture = CreateTexture_Bind;
+                TextureStorage = TextureStorage_Bind;
+                TextureSubImage = TextureSubImage_Bind;
+                GenerateMipmap = GenerateMipmap_Bind;
+                TextureParameteri = TextureParameteri_Bind;
+                TextureParameteriv = TextureParameteriv_Bind;
+                TextureParameterfv = TextureParameterfv_Bind;
+                CreateBuffer = CreateBuffer_Bind;
+                NamedBufferStorage = NamedBufferStorage_Bind;
+                NamedBufferSubData = NamedBufferSubData_Bind;
+                GetNamedBufferSubData = GetNamedBufferSubData_Bind;
+                CopyNamedBufferSubData = CopyNamedBufferSubData_Bind;
+                CreateVertexArray = CreateVertexArray_Bind;
+                VertexArrayAttribute = VertexArrayAttribute_Bind;
+                LOG_INFORMATION("Context missing supports for ARB_direct_state_access");
+            }
         }
     };
 }
\ No newline at end of file
@@ -4,21 +4,67 @@
 
 #include <glbinding/gl/types.h>
 
+#include <vector>
+
 namespace Pisces
 {
     namespace GLCompat 
     {
+        struct DirtyRange {
+            size_t begin, end;
+        };
+
         struct BufferPersistentMapping {
             void *data = nullptr;
             size_t offset, size;
+
+            // With explicit flushing only the dirty ranges are flushed instead of the mapped range
+            bool flushExplicit = false;
+            // Sorted, non overlapping and in buffer offsets
+            std::vector<DirtyRange> dirtyRanges;
         };
 
         extern void  (*BindTexture)( int slot, gl::GLenum target, gl::GLuint texture );
         extern void  (*TexStorage2D)( gl::GLenum target, int levels, gl::GLenum internalFormat, gl::GLsizei width, gl::GLsizei height );
         extern void  (*TexStorageCube)( gl::GLenum target, int levels, gl::GLenum internalFormat, gl::GLsizei size );
+        extern void  (*TexStorage3D)( gl::GLenum target, int levels, gl::GLenum internalFormat, gl::GLsizei width, gl::GLsizei height, gl::GLsizei depth );
         extern void  (*BufferStorage)( gl::GLenum target, BufferUsage usage, BufferFlags flags, size_t size, const void *data );
-        extern void* (*MapBuffer)( gl::GLenum target, size_t offset, size_t size, BufferMapFlags flags, size_t bufferSize, BufferPersistentMapping &mapping );
-        extern bool  (*UnMapBuffer)( gl::GLenum target, bool keepPersistent, BufferPersistentMapping &mapping );
+        extern void* (*MapBuffer)( gl::GLenum target, gl::GLuint buffer, size_t offset, size_t size, BufferMapFlags flags, size_t bufferSize, BufferPersistentMapping &mapping );
+        extern bool  (*UnMapBuffer)( gl::GLenum target, gl::GLuint buffer, bool keepPersistent, BufferPersistentMapping &mapping );
+
+        // Resource operations on a named object. With ARB_direct_state_access the bindings are left alone,
+        // otherwise the object is bound to target (for textures the target of the texture type).
+        extern void  (*CreateTexture)( gl::GLenum target, gl::GLuint *texture );
+        // depth is the layer count of array textures and ignored for other types
+        extern void  (*TextureStorage)( gl::GLenum target, gl::GLuint texture, int levels, gl::GLenum internalFormat, gl::GLsizei width, gl::GLsizei height, gl::GLsizei depth );
+        // target can be a cubemap face, z is the layer of array textures
+        extern void  (*TextureSubImage)( gl::GLenum target, gl::GLuint texture, int level, int x, int y, int z, gl::GLsizei width, gl::GLsizei height, gl::GLenum format, gl::GLenum type, const void *data );
+        extern void  (*GenerateMipmap)( gl::GLenum target, gl::GLuint texture );
+        extern void  (*TextureParameteri)( gl::GLenum target, gl::GLuint texture, gl::GLenum name, gl::GLint value );
+        extern void  (*TextureParameteriv)( gl::GLenum target, gl::GLuint texture, gl::GLenum name, const gl::GLint *values );
+        extern void  (*TextureParameterfv)( gl::GLenum target, gl::GLuint texture, gl::GLenum name, const gl::GLfloat *values );
+
+        extern void  (*CreateBuffer)( gl::GLenum target, gl::GLuint *buffer );
+        extern void  (*NamedBufferStorage)( gl::GLenum target, gl::GLuint buffer, BufferUsage usage, BufferFlags flags, size_t size, const void *data );
+        extern void  (*NamedBufferSubData)( gl::GLenum target, gl::GLuint buffer, size_t offset, size_t size, const void *data );
+        extern void  (*GetNamedBufferSubData)( gl::GLenum target, gl::GLuint buffer, size_t offset, size_t size, void *data );
+        extern void  (*CopyNamedBufferSubData)( gl::GLuint readBuffer, gl::GLuint writeBuffer, size_t readOffset, size_t writeOffset, size_t size );
+
+        extern void  (*CreateVertexArray)( gl::GLuint *vertexArray );
+        // offset & stride are in bytes, a stride of 0 means tightly packed
+        extern void  (*VertexArrayAttribute)( gl::GLuint vertexArray, int index, gl::GLuint buffer, int count, gl::GLenum type, bool normalized, bool integer, size_t offset, int stride );
+        // Attribute format without a buffer, the attribute reads from the buffer bound to binding (ARB_vertex_attrib_binding).
+        // Without the extension only the attribute is enabled, the buffer is attached per attribute when it is bound.
+        extern void  (*VertexArrayAttributeFormat)( gl::GLuint vertexArray, int index, int binding, int count, gl::GLenum type, bool normalized, bool integer, size_t relativeOffset );
+        // True when vertex buffers can be bound per binding with glBindVertexBuffer
+        bool SupportsVertexAttribBinding();
+        // True when textures can be sampled through resident 64 bit handles (ARB_bindless_texture)
+        bool SupportsBindlessTexture();
+
+        // Adds the range to the dirty ranges, merging it with ranges it overlaps or is close to
+        void MarkDirtyRange( std::vector<DirtyRange> &ranges, size_t offset, size_t size );
+        // Flushes and clears the dirty ranges of a mapping done with GL_MAP_FLUSH_EXPLICIT_BIT
+        void FlushDirtyRanges( gl::GLenum target, gl::GLuint buffer, BufferPersistentMapping &mapping );
 
         void InitCompat( bool enableExtensions );
     };
@@ -1,6 +1,8 @@
 #include "HardwareResourceManagerImpl.h"
 #include "Helpers.h"
 
+#include "Context.h"
+
 #include <glbinding/gl33core/gl.h>
 using namespace gl33core;
 
@@ -26,12 +28,10 @@ namespace Pisces
 
         void setRealSamplerParamsTexture( gl::GLenum target, gl::GLuint texture, const SamplerParams &params )
         {
-            glBindTexture(target, texture);
-
-            glTexParameteri(target, GL_TEXTURE_MIN_FILTER, ToGL(params.minFilter));
-            glTexParameteri(target, GL_TEXTURE_MAG_FILTER, ToGL(params.magFilter));
-            glTexParameteri(target, GL_TEXTURE_WRAP_S, ToGL(params.edgeSamplingX));
-            glTexParameteri(target, GL_TEXTURE_WRAP_T, ToGL(params.edgeSamplingY));
+            GLCompat::TextureParameteri(target, texture, GL_TEXTURE_MIN_FILTER, (GLint)ToGL(params.minFilter));
+            GLCompat::TextureParameteri(target, texture, GL_TEXTURE_MAG_FILTER, (GLint)ToGL(params.magFilter));
+            GLCompat::TextureParameteri(target, texture, GL_TEXTURE_WRAP_S, (GLint)ToGL(params.edgeSamplingX));
+            GLCompat::TextureParameteri(target, texture, GL_TEXTURE_WRAP_T, (GLint)ToGL(params.edgeSamplingY));
 
             GLfloat borderColor[4] = {
                 params.borderColor.r / (float)0xFF,
@@ -39,7 +39,125 @@ namespace Pisces
                 params.borderColor.b / (float)0xFF,
                 params.borderColor.a / (float)0xFF,
             };
-            glTexParameterfv(target, GL_TEXTURE_BORDER_COLOR, borderColor);
+            GLCompat::TextureParameterfv(target, texture, GL_TEXTURE_BORDER_COLOR, borderColor);
+        }
+
+        uint64_t SamplerParamsKey( const SamplerParams &params )
+        {
+            uint64_t key = 0;
+            key |= (uint64_t)(uint8_t)params.minFilter;
+            key |= (uint64_t)(uint8_t)params.magFilter << 8;
+            key |= (uint64_t)(uint8_t)params.edgeSamplingX << 16;
+            key |= (uint64_t)(uint8_t)params.edgeSamplingY << 24;
+            key |= (uint64_t)params.borderColor.r << 32;
+            key |= (uint64_t)params.borderColor.g << 40;
+            key |= (uint64_t)params.borderColor.b << 48;
+            key |= (uint64_t)params.borderColor.a << 56;
+            return key;
+        }
+
+        gl::GLuint Impl::acquireSamplerObject( const SamplerParams &params, uint64_t &key )
+        {
+            key = SamplerParamsKey(params);
+
+            auto iter = samplerObjects.find(key);
+            if (iter == samplerObjects.end()) {
+                SamplerObjectInfo info;
+                glGenSamplers(1, &info.glSampler.handle);
+                setRealSamplerParams(info.glSampler, params);
+
+                iter = samplerObjects.emplace(key, std::move(info)).first;
+            }
+
+            iter->second.refCount++;
+            return iter->second.glSampler;
+        }
+
+        void Impl::releaseSamplerObject( uint64_t key )
+        {
+            auto iter = samplerObjects.find(key);
+            if (iter == samplerObjects.end()) return;
+
+            if (--iter->second.refCount <= 0) {
+                retireBindlessHandles(0, iter->second.glSampler);
+                retired().samplers.push_back(std::move(iter->second.glSampler));
+                samplerObjects.erase(iter);
+            }
+        }
+
+        RetiredObjects& Impl::retired()
+        {
+            uint64_t frame = context->currentFrame();
+            if (retiredObjects.empty() || retiredObjects.back().frame != frame) {
+                retiredObjects.emplace_back();
+                retiredObjects.back().frame = frame;
+            }
+            return retiredObjects.back();
+        }
+
+        void Impl::releaseRetiredObjects( uint64_t finishedFrames )
+        {
+            while (!retiredObjects.empty() && retiredObjects.front().frame < finishedFrames) {
+                for (uint64_t handle : retiredObjects.front().bindlessHandles) {
+                    gl::glMakeTextureHandleNonResidentARB(handle);
+                }
+                retiredObjects.pop_front();
+            }
+        }
+
+        void Impl::flushStaticUniforms()
+        {
+            if (staticUniforms.dirtyRanges.empty()) return;
+
+            BufferInfo *info = buffers.find(staticUniforms.buffer);
+            if (info) {
+                for (const auto &range : staticUniforms.dirtyRanges) {
+                    GLCompat::NamedBufferSubData(GL_COPY_WRITE_BUFFER, info->glBuffer, range.begin, range.end - range.begin, staticUniforms.shadow.data() + range.begin);
+                }
+            }
+
+            staticUniforms.dirtyRanges.clear();
+        }
+
+        uint64_t Impl::acquireBindlessHandle( gl::GLuint texture, gl::GLuint sampler )
+        {
+            uint64_t key = (uint64_t)texture << 32 | (uint64_t)sampler;
+
+            auto iter = bindlessHandles.find(key);
+            if (iter != bindlessHandles.end()) return iter->second;
+
+            uint64_t handle = sampler ? gl::glGetTextureSamplerHandleARB(texture, sampler) : gl::glGetTextureHandleARB(texture);
+            if (handle == 0) {
+                LOG_ERROR("Failed to get bindless handle for texture %u", (unsigned)texture);
+                return 0;
+            }
+            gl::glMakeTextureHandleResidentARB(handle);
+
+            bindlessHandles.emplace(key, handle);
+            return handle;
+        }
+
+        void Impl::retireBindlessHandles( gl::GLuint texture, gl::GLuint sampler )
+        {
+            for (auto iter = bindlessHandles.begin(); iter != bindlessHandles.end(); ) {
+                gl::GLuint handleTexture = (gl::GLuint)(iter->first >> 32),
+                           handleSampler = (gl::GLuint)(iter->first & 0xFFFFFFFF);
+                if ((texture && handleTexture == texture) || (sampler && handleSampler == sampler)) {
+                    retired().bindlessHandles.push_back(iter->second);
+                    iter = bindlessHandles.erase(iter);
+                }
+                else {
+                    ++iter;
+                }
+            }
+        }
+
+        bool Impl::hasBindlessHandle( gl::GLuint texture ) const
+        {
+            for (const auto &entry : bindlessHandles) {
+                if ((gl::GLuint)(entry.first >> 32) == texture) return true;
+            }
+            return false;
         }
     }
 }
\ No newline at end of file
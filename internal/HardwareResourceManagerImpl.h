@@ -2,10 +2,17 @@
 
 #include "internal/GLTypes.h"
 #include "internal/GLCompat.h"
+#include "internal/NameIndex.h"
+#include "internal/TlsfAllocator.h"
 
 #include "Common/HandleVector.h"
 #include "Common/StringId.h"
 
+#include <deque>
+#include <memory>
+#include <unordered_map>
+#include <vector>
+
 namespace Pisces
 {
     namespace HardwareResourceManagerImpl
@@ -34,9 +41,19 @@ namespace Pisces
             size_t expectedMemoryUse = 0;
         };
 
+        // GL sampler object shared by all samplers with the same SamplerParams
+        struct SamplerObjectInfo {
+            GLSampler glSampler;
+            int refCount = 0;
+        };
+
         struct SamplerInfo {
             Common::StringId name;
-            GLSampler glSampler;
+            // Owned by Impl::samplerObjects
+            gl::GLuint glSampler = 0;
+            uint64_t samplerKey = 0;
+            // Incremented when the handle switches sampler objects, compiled queues patch commands from older generations
+            uint32_t generation = 0;
             TextureHandle texture;
         };
 
@@ -73,6 +90,87 @@ namespace Pisces
             VertexArrayFlags flags;
         };
 
+        // Vertex arrays with only the attribute formats, shared by every createVertexFormat with the same layout
+        struct VertexFormatInfo {
+            GLVertexArray glVertexArray;
+            std::vector<VertexAttribute> layout;
+            IndexType indexType;
+            VertexArrayFlags flags;
+
+            // Sources used by the layout and the vertex stride of each
+            int bindingCount = 0;
+            int strides[MAX_VERTEX_BUFFERS] = {};
+
+            int refCount = 0;
+        };
+
+        // Default size of the buffers backing the buffer heap, larger allocations get a buffer of their own
+        static const size_t BUFFER_HEAP_PAGE_SIZE = 32*1024*1024;
+        static const int BUFFER_TYPE_COUNT = 3;
+
+        struct BufferHeapPage {
+            BufferHeapPage( BufferHandle buffer_, size_t size ) :
+                buffer(buffer_),
+                allocator(size)
+            {}
+
+            BufferHandle buffer;
+            TlsfAllocator allocator;
+            std::vector<BufferAllocationHandle> allocations;
+        };
+
+        struct BufferHeapAllocationInfo {
+            BufferType type;
+            BufferHeapPage *page = nullptr;
+            uint32_t id = 0;
+            // The block can start before offset to satisfy the alignment
+            size_t blockOffset = 0, blockSize = 0,
+                   offset = 0, size = 0,
+                   alignment = 0;
+        };
+
+        struct HeapVertexArrayInfo {
+            std::vector<VertexAttribute> layout;
+            BufferHandle vertexBuffer,
+                         indexBuffer;
+            IndexType indexType;
+            VertexArrayHandle vertexArray;
+        };
+
+        struct BufferHeap {
+            std::vector<std::unique_ptr<BufferHeapPage>> pages;
+        };
+
+        // All static uniforms share one buffer, the allocator works in units of the uniform alignment
+        // so every allocation is aligned without padding blocks
+        struct StaticUniformHeap {
+            BufferHandle buffer;
+            size_t size = 0;
+
+            TlsfAllocator allocator{0};
+            struct Allocation {
+                uint32_t id;
+                size_t size;
+            };
+            std::unordered_map<size_t, Allocation> allocations;
+
+            // Updates are written to the shadow and uploaded in a few coalesced calls
+            std::vector<uint8_t> shadow;
+            std::vector<GLCompat::DirtyRange> dirtyRanges;
+        };
+
+        // GL objects that were freed while the gpu might still use them
+        struct RetiredObjects {
+            uint64_t frame = 0;
+
+            std::vector<GLTexture> textures;
+            std::vector<GLBuffer> buffers;
+            std::vector<GLVertexArray> vertexArrays;
+            std::vector<GLSampler> samplers;
+            // Made non resident before the objects above are deleted
+            std::vector<uint64_t> bindlessHandles;
+        };
+
         struct Impl {
             Context *context = nullptr;
             std::size_t textureMemoryUsage = 0;
@@ -80,9 +178,20 @@ namespace Pisces
 
             TextureHandleVector textures;
             SamplerHandleVector samplers;
+            // Names of textures & samplers, they share the handle type so a name is unique across both
+            NameIndex<TextureHandle> textureNames{"texture"};
+            std::unordered_map<uint64_t, SamplerObjectInfo> samplerObjects;
+
+            BufferHeap bufferHeaps[BUFFER_TYPE_COUNT];
+            HandleVector<BufferAllocationHandle, BufferHeapAllocationInfo> heapAllocations;
+            std::vector<HeapVertexArrayInfo> heapVertexArrays;
+
+            // Ordered by frame, the oldest first
+            std::deque<RetiredObjects> retiredObjects;
 
             HandleVector<BufferHandle, BufferInfo> buffers;
             HandleVector<VertexArrayHandle, VertexArrayInfo> vertexArrays;
+            HandleVector<VertexFormatHandle, VertexFormatInfo> vertexFormats;
 
             BuiltinDrawInfo builtinDrawInfo[BUILTIN_OBJECT_COUNT];
 
@@ -91,11 +200,10 @@ namespace Pisces
             size_t uniformBlockAllignment = 0,
                    maxTextxureUnits = 0;
 
-            struct {
-                BufferHandle buffer;
-                size_t size = 0,
-                       nextOffset = 0;
-            } staticUniforms;
+            StaticUniformHeap staticUniforms;
+
+            // (glTexture << 32 | glSampler) -> resident bindless handle
+            std::unordered_map<uint64_t, uint64_t> bindlessHandles;
 
             Impl( Context *context_ ) :
                 context(context_)
@@ -107,8 +215,30 @@ namespace Pisces
             void onBufferAllocation( std::size_t size ) {
                 bufferMemoryUsage += size;
             }
+
+            // Returns a sampler object with params, reusing an existing one if possible
+            gl::GLuint acquireSamplerObject( const SamplerParams &params, uint64_t &key );
+            void releaseSamplerObject( uint64_t key );
+
+            // Objects are deleted once the frame they were retired in is finished by the gpu
+            RetiredObjects& retired();
+            // Delete all objects retired in frames before finishedFrames
+            void releaseRetiredObjects( uint64_t finishedFrames );
+
+            // Uploads static uniforms changed since the last flush, done before executing a queue
+            void flushStaticUniforms();
+
+            // Returns a resident handle for texture sampled with sampler (0 for the texture params), creating it if needed.
+            // The texture params are immutable once the texture has a handle
+            uint64_t acquireBindlessHandle( gl::GLuint texture, gl::GLuint sampler );
+            // Retires the handles of texture, or of sampler when it isn't 0. Call before retiring the object
+            void retireBindlessHandles( gl::GLuint texture, gl::GLuint sampler );
+            bool hasBindlessHandle( gl::GLuint texture ) const;
         };
 
+        // Unique key for the content of params
+        uint64_t SamplerParamsKey( const SamplerParams &params );
+
         void setRealSamplerParams( gl::GLuint sampler, const SamplerParams &params );
         void setRealSamplerParamsTexture( gl::GLenum target, gl::GLuint texture, const SamplerParams &params );
     }
@@ -300,6 +300,40 @@ namespace Pisces
         FATAL_ERROR("Unknown VertexAttributeType %i", (int)type);
     }
 
+    // Size in bytes of one vertex worth of the attribute, without padding
+    inline int AttributeSize( const VertexAttribute &attribute )
+    {
+        switch (attribute.type) {
+        case VertexAttributeType::Int8:
+        case VertexAttributeType::IInt8:
+        case VertexAttributeType::NormInt8:
+        case VertexAttributeType::UInt8:
+        case VertexAttributeType::IUInt8:
+        case VertexAttributeType::NormUInt8:
+            return attribute.count;
+        case VertexAttributeType::Int16:
+        case VertexAttributeType::IInt16:
+        case VertexAttributeType::NormInt16:
+        case VertexAttributeType::UInt16:
+        case VertexAttributeType::IUInt16:
+        case VertexAttributeType::NormUInt16:
+        case VertexAttributeType::Float16:
+            return attribute.count*2;
+        case VertexAttributeType::Int32:
+        case VertexAttributeType::IInt32:
+        case VertexAttributeType::NormInt32:
+        case VertexAttributeType::UInt32:
+        case VertexAttributeType::IUInt32:
+        case VertexAttributeType::NormUInt32:
+        case VertexAttributeType::Float32:
+            return attribute.count*4;
+        case VertexAttributeType::NormInt3x10_1x2:
+        case VertexAttributeType::NormUInt3x10_1x2:
+            return 4;
+        }
+        FATAL_ERROR("Unknown VertexAttributeType %i", (int)attribute.type);
+    }
+
     inline gl::GLenum ToGL( IndexType type ) {
         switch (type) {
         case IndexType::UInt16:
@@ -322,6 +356,78 @@ namespace Pisces
         FATAL_ERROR("Unknown Primitive %i", (int)primitive);
     }
 
+    inline gl::GLenum ToGL( CompareFunc func ) {
+        switch (func) {
+        case CompareFunc::Never:
+            return gl::GL_NEVER;
+        case CompareFunc::Less:
+            return gl::GL_LESS;
+        case CompareFunc::Equal:
+            return gl::GL_EQUAL;
+        case CompareFunc::LessEqual:
+            return gl::GL_LEQUAL;
+        case CompareFunc::Greater:
+            return gl::GL_GREATER;
+        case CompareFunc::NotEqual:
+            return gl::GL_NOTEQUAL;
+        case CompareFunc::GreaterEqual:
+            return gl::GL_GEQUAL;
+        case CompareFunc::Always:
+            return gl::GL_ALWAYS;
+        }
+        FATAL_ERROR("Unknown CompareFunc %i", (int)func);
+    }
+
+    inline gl::GLenum ToGL( StencilOp op ) {
+        switch (op) {
+        case StencilOp::Keep:
+            return gl::GL_KEEP;
+        case StencilOp::Zero:
+            return gl::GL_ZERO;
+        case StencilOp::Replace:
+            return gl::GL_REPLACE;
+        case StencilOp::Increment:
+            return gl::GL_INCR;
+        case StencilOp::IncrementWrap:
+            return gl::GL_INCR_WRAP;
+        case StencilOp::Decrement:
+            return gl::GL_DECR;
+        case StencilOp::DecrementWrap:
+            return gl::GL_DECR_WRAP;
+        case StencilOp::Invert:
+            return gl::GL_INVERT;
+        }
+        FATAL_ERROR("Unknown StencilOp %i", (int)op);
+    }
+
+    inline gl::GLenum ToGL( CullMode mode ) {
+        switch (mode) {
+        case CullMode::Back:
+            return gl::GL_BACK;
+        case CullMode::Front:
+            return gl::GL_FRONT;
+        case CullMode::FrontAndBack:
+            return gl::GL_FRONT_AND_BACK;
+        }
+        FATAL_ERROR("Unknown CullMode %i", (int)mode);
+    }
+
+    inline gl::GLenum ToGL( BlendEquation equation ) {
+        switch (equation) {
+        case BlendEquation::Add:
+            return gl::GL_FUNC_ADD;
+        case BlendEquation::Subtract:
+            return gl::GL_FUNC_SUBTRACT;
+        case BlendEquation::ReverseSubtract:
+            return gl::GL_FUNC_REVERSE_SUBTRACT;
+        case BlendEquation::Min:
+            return gl::GL_MIN;
+        case BlendEquation::Max:
+            return gl::GL_MAX;
+        }
+        FATAL_ERROR("Unknown BlendEquation %i", (int)equation);
+    }
+
     inline uintptr_t OffsetForIndexType( IndexType type, uintptr_t index ) {
         switch (type) {
         case IndexType::UInt16:
@@ -339,6 +445,8 @@ namespace Pisces
             return gl::GL_TEXTURE_2D;
         case TextureType::Cubemap:
             return gl::GL_TEXTURE_CUBE_MAP;
+        case TextureType::Texture2DArray:
+            return gl::GL_TEXTURE_2D_ARRAY;
         }
         FATAL_ERROR("Unknown TextureType %i", (int)type);
     }
@@ -414,9 +522,11 @@ namespace Pisces
         
         Sampler1D,
         Sampler2D,
+        Sampler2DArray,
 
         ImageTexture1D,
-        ImageTexture2D
+        ImageTexture2D,
+        ImageTexture2DArray
     };
     // Sentinel value, not used in any functions
     static const GLType GLTypeNone = GLType(-1);
@@ -459,10 +569,14 @@ namespace Pisces
             return GLType::Sampler1D;
         case gl::GL_SAMPLER_2D:
             return GLType::Sampler2D;
+        case gl::GL_SAMPLER_2D_ARRAY:
+            return GLType::Sampler2DArray;
         case gl::GL_IMAGE_1D:
             return GLType::ImageTexture1D;
         case gl::GL_IMAGE_2D:
             return GLType::ImageTexture2D;
+        case gl::GL_IMAGE_2D_ARRAY:
+            return GLType::ImageTexture2DArray;
         }
 #include "compiler_warnings/pop.h"
         FATAL_ERROR("Unknown GL type %s (%i)", glbinding::Meta::getString(type).c_str(), (int)type);
@@ -473,6 +587,7 @@ namespace Pisces
         switch (type) {
         case GLType::Sampler1D:
         case GLType::Sampler2D:
+        case GLType::Sampler2DArray:
             return true;
         case GLType::Int:
         case GLType::UInt:
@@ -491,6 +606,7 @@ namespace Pisces
         case GLType::Mat4x4:
         case GLType::ImageTexture1D:
         case GLType::ImageTexture2D:
+        case GLType::ImageTexture2DArray:
             return false;
         }
         FATAL_ERROR("Unknown GLType (%i)", (int)type);
@@ -501,6 +617,7 @@ namespace Pisces
         switch (type) {
         case GLType::ImageTexture1D:
         case GLType::ImageTexture2D:
+        case GLType::ImageTexture2DArray:
             return true;
         case GLType::Int:
         case GLType::UInt:
@@ -519,6 +636,7 @@ namespace Pisces
         case GLType::Mat4x4:
         case GLType::Sampler1D:
         case GLType::Sampler2D:
+        case GLType::Sampler2DArray:
             return false;
         }
         FATAL_ERROR("Unknown GLType (%i)", (int)type);
@@ -534,6 +652,9 @@ namespace Pisces
         case GLType::Sampler2D:
         case GLType::ImageTexture2D:
             return TextureType::Texture2D;
+        case GLType::Sampler2DArray:
+        case GLType::ImageTexture2DArray:
+            return TextureType::Texture2DArray;
         case GLType::Int:
         case GLType::UInt:
         case GLType::Float:
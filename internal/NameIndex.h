@@ -0,0 +1,79 @@
+#pragma once
+
+#include "Common/ErrorUtils.h"
+#include "Common/StringId.h"
+
+#include <algorithm>
+#include <functional>
+#include <unordered_map>
+#include <vector>
+
+namespace Pisces
+{
+    // StringId -> handle index, so resources are found by name without scanning their HandleVector.
+    // Names should be unique within an index, null names are never indexed.
+    template< typename Handle >
+    class NameIndex {
+    public:
+        explicit NameIndex( const char *kind ) :
+            mKind(kind)
+        {}
+
+        // A name already used by another handle is reported and keeps pointing at that handle,
+        // the duplicate takes over once the handles before it are erased
+        bool insert( Common::StringId name, Handle handle )
+        {
+            if (!name) return true;
+
+            std::vector<Handle> &handles = mHandles[name];
+            if (std::find(handles.begin(), handles.end(), handle) != handles.end()) return true;
+
+            handles.push_back(handle);
+            if (handles.size() > 1) {
+                LOG_WARNING("Duplicate %s name \"%s\", only the first one can be found by name", mKind, Common::GetCString(name));
+                return false;
+            }
+            return true;
+        }
+
+        void erase( Common::StringId name, Handle handle )
+        {
+            if (!name) return;
+
+            auto iter = mHandles.find(name);
+            if (iter == mHandles.end()) return;
+
+            std::vector<Handle> &handles = iter->second;
+            handles.erase(std::remove(handles.begin(), handles.end(), handle), handles.end());
+            if (handles.empty()) {
+                mHandles.erase(iter);
+            }
+        }
+
+        void rename( Common::StringId oldName, Common::StringId newName, Handle handle )
+        {
+            if (oldName == newName) return;
+
+            erase(oldName, handle);
+            insert(newName, handle);
+        }
+
+        Handle find( Common::StringId name ) const
+        {
+            auto iter = mHandles.find(name);
+            return iter != mHandles.end() ? iter->second.front() : Handle();
+        }
+
+    private:
+        // Strings behind StringIds are interned, so the pointer identifies the name
+        struct Hash {
+            size_t operator () ( Common::StringId name ) const {
+                return std::hash<const char*>()(Common::GetCString(name));
+            }
+        };
+
+        const char *mKind;
+        // Handles with the name in insertion order, the first one is found
+        std::unordered_map<Common::StringId, std::vector<Handle>, Hash> mHandles;
+    };
+}
@@ -8,51 +8,211 @@
 using namespace gl33core;
 
 #include <stdexcept>
+#include <algorithm>
 #include <cassert>
+#include <cinttypes>
+#include <fstream>
 
 namespace Pisces { 
 namespace PipelineManagerImpl
 {    
-    GLShader LoadShader( GLenum type, const char *file ) {
-        try {
-            std::string sourceStr = FileUtils::getFileContent(file, false);
+    namespace CCQI = CompiledRenderQueueImpl;
+
+    void ProgramHash::add( const void *data, size_t size )
+    {
+        // FNV-1a
+        const uint8_t *bytes = (const uint8_t*)data;
+        for (size_t i=0; i < size; ++i) {
+            value ^= bytes[i];
+            value *= 1099511628211ull;
+        }
+    }
 
-            const char *source = sourceStr.c_str();
-            GLint lenght = (GLint)sourceStr.size();
+    void ProgramHash::add( const std::string &str )
+    {
+        // Include the terminator so ("ab", "c") and ("a", "bc") differ
+        add(str.c_str(), str.size()+1);
+    }
+
+    void ProgramHash::add( const ProgramInitBindings &bindings )
+    {
+        for (const auto &name : bindings.uniforms) add(name);
+        for (const auto &name : bindings.uniformBuffers) add(name);
+        for (const auto &name : bindings.samplers) add(name);
+        for (const auto &name : bindings.imageTextures) add(name);
+    }
 
-            return CreateShader(type, 1, &source, &lenght);
+    void ProgramHash::add( const GLRenderState &state )
+    {
+        auto addValue = [this]( auto value ) { add(&value, sizeof(value)); };
+        // -0 == 0, so both have to hash the same
+        auto addFloat = [&]( float value ) { addValue(value + 0.f); };
+
+        addValue(state.depthTest);
+        addValue(state.depthWrite);
+        addValue(state.cullFace);
+        addValue(state.blend);
+        addValue(state.stencilTest);
+        addValue(state.polygonOffset);
+        for (bool mask : state.colorMask) addValue(mask);
+
+        addValue(state.depthFunc);
+        addValue(state.cullFaceMode);
+        addValue(state.blendSrc);
+        addValue(state.blendDst);
+        addValue(state.blendEquationRGB);
+        addValue(state.blendEquationAlpha);
+
+        for (int face=0; face < 2; ++face) {
+            addValue(state.stencilFunc[face]);
+            addValue(state.stencilFail[face]);
+            addValue(state.stencilDepthFail[face]);
+            addValue(state.stencilPass[face]);
+        }
+        addValue(state.stencilReference);
+        addValue(state.stencilReadMask);
+        addValue(state.stencilWriteMask);
+
+        addFloat(state.polygonOffsetFactor);
+        addFloat(state.polygonOffsetUnits);
+    }
+
+    bool GLRenderState::operator == ( const GLRenderState &other ) const
+    {
+        for (int i=0; i < 4; ++i) {
+            if (colorMask[i] != other.colorMask[i]) return false;
+        }
+        for (int face=0; face < 2; ++face) {
+            if (stencilFunc[face] != other.stencilFunc[face] ||
+                stencilFail[face] != other.stencilFail[face] ||
+                stencilDepthFail[face] != other.stencilDepthFail[face] ||
+                stencilPass[face] != other.stencilPass[face]) 
+            {
+                return false;
+            }
+        }
+
+        return depthTest == other.depthTest &&
+               depthWrite == other.depthWrite &&
+               cullFace == other.cullFace &&
+               blend == other.blend &&
+               stencilTest == other.stencilTest &&
+               polygonOffset == other.polygonOffset &&
+               depthFunc == other.depthFunc &&
+               cullFaceMode == other.cullFaceMode &&
+               blendSrc == other.blendSrc &&
+               blendDst == other.blendDst &&
+               blendEquationRGB == other.blendEquationRGB &&
+               blendEquationAlpha == other.blendEquationAlpha &&
+               stencilReference == other.stencilReference &&
+               stencilReadMask == other.stencilReadMask &&
+               stencilWriteMask == other.stencilWriteMask &&
+               polygonOffsetFactor == other.polygonOffsetFactor &&
+               polygonOffsetUnits == other.polygonOffsetUnits;
+    }
+
+    std::string LoadShaderSource( const char *file )
+    {
+        try {
+            return FileUtils::getFileContent(file, false);
         } catch (const std::exception &e) {
             THROW(std::runtime_error, "Failed to load shader from file \"%s\" error: %s", file, e.what());
         }
     }
 
-    GLShader CreateShader( GLenum type, int count, const char* const *sources, const GLint *sourceLenghts )
+    std::string SpecializeSource( const std::string &source, const std::vector<std::pair<std::string, std::string>> &defines )
+    {
+        if (defines.empty()) return source;
+
+        // #version must stay the first directive
+        size_t insertAt = 0;
+        size_t version = source.find("#version");
+        if (version != std::string::npos) {
+            insertAt = source.find('\n', version);
+            insertAt = insertAt == std::string::npos ? source.size() : insertAt+1;
+        }
+        int nextLine = 1 + (int)std::count(source.begin(), source.begin() + insertAt, '\n');
+
+        std::string prelude;
+        for (const auto &define : defines) {
+            prelude += "#define " + define.first + " " + define.second + "\n";
+        }
+        prelude += "#line " + std::to_string(nextLine) + "\n";
+
+        std::string result = source.substr(0, insertAt);
+        if (!result.empty() && result.back() != '\n') result += '\n';
+        result += prelude;
+        result.append(source, insertAt, std::string::npos);
+        return result;
+    }
+
+    void SubmitShader( ProgramBuild &build, GLenum type, const std::string &source )
     {
         GLShader shader(glCreateShader(type));
 
-        glShaderSource(shader, count, sources, sourceLenghts);
-        glCompileShader(shader);
+        const char *sourcePtr = source.c_str();
+        GLint lenght = (GLint)source.size();
 
-        GLint status;
-        glGetShaderiv(shader, GL_COMPILE_STATUS, &status);
+        glShaderSource(shader, 1, &sourcePtr, &lenght);
+        glCompileShader(shader);
 
-        if (status != (GLint)GL_TRUE) {
-            GLint logLenght = 0;
-            glGetShaderiv(shader, GL_INFO_LOG_LENGTH, &logLenght);
+        build.shaders.push_back(std::move(shader));
+    }
 
-            std::vector<char> log(logLenght+1); // logLenght can be 0, so make sure to allocate atleast 1 byte
-            glGetShaderInfoLog(shader, logLenght, nullptr, log.data());
+    void SubmitLink( ProgramBuild &build, const char* const *captures, int captureCount, bool retrievable )
+    {
+        build.program = GLProgram(glCreateProgram());
 
-            THROW(std::runtime_error, "%s", log.data());
+        for (const auto &shader : build.shaders) {
+            glAttachShader(build.program, shader);
+        }
+        if (captureCount > 0) {
+            glTransformFeedbackVaryings(build.program, (GLsizei)captureCount, captures, GL_INTERLEAVED_ATTRIBS);
+        }
+        if (retrievable) {
+            gl::glProgramParameteri(build.program, gl::GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
         }
 
-        return std::move(shader);
+        glLinkProgram(build.program);
     }
 
-    void LinkProgram( GLuint program )
+    bool IsProgramBuildDone( const Impl *impl, const ProgramBuild &build )
     {
-        glLinkProgram(program);
+        if (!impl->supportsParallelCompile) return true;
+
+        GLint done = 0;
+        glGetProgramiv(build.program, gl::GL_COMPLETION_STATUS_KHR, &done);
+        return done != 0;
+    }
+
+    void FinishProgramBuild( const Impl *impl, ProgramBuild &build )
+    {
+        // The link log only says that a shader failed, so report the compile log of the shader
+        for (const auto &shader : build.shaders) {
+            GLint status;
+            glGetShaderiv(shader, GL_COMPILE_STATUS, &status);
+
+            if (status != (GLint)GL_TRUE) {
+                GLint logLenght = 0;
+                glGetShaderiv(shader, GL_INFO_LOG_LENGTH, &logLenght);
+
+                std::vector<char> log(logLenght+1); // logLenght can be 0, so make sure to allocate atleast 1 byte
+                glGetShaderInfoLog(shader, logLenght, nullptr, log.data());
 
+                THROW(std::runtime_error, "%s", log.data());
+            }
+        }
+
+        CheckLinkStatus(build.program);
+
+        if (build.cacheKey != 0) {
+            SaveProgramBinary(impl, build.cacheKey, build.program);
+        }
+        build.shaders.clear();
+    }
+
+    void CheckLinkStatus( GLuint program )
+    {
         GLint status;
         glGetProgramiv(program, GL_LINK_STATUS, &status);
 
@@ -67,17 +227,146 @@ namespace PipelineManagerImpl
         }
     }
 
-    GLProgram CreateProgram( int count, const GLShader *shaders )
+    void VerifyCaptureVariables( GLuint program, const TransformCaptureVariable *capture, size_t count )
     {
-        GLProgram program(glCreateProgram());
+        for (size_t i=0; i < count; ++i) {
+            const char *name = capture[i].name.c_str();
 
-        for (int i=0; i < count; ++i) {
-            glAttachShader(program, shaders[i]);
+            GLint index = gl::glGetProgramResourceIndex(program, gl::GL_TRANSFORM_FEEDBACK_VARYING, name);
+            if (index == GL_INVALID_INDEX) {
+                LOG_ERROR("Capture variable \"%s\" is not active!", name);
+                continue;
+            }
+
+            GLsizei size = 1;
+            GLenum type;
+            glGetTransformFeedbackVarying(program, index, 0, nullptr, &size, &type, nullptr);
+
+            if (size != 1) {
+                LOG_ERROR("Arrays are currently not supported for capture variables!");
+            }
+
+            TransformCaptureType captureType = ToTransformCaptureType(type);
+            if (captureType != capture[i].type) {
+                LOG_ERROR("Capture variable \"%s\" type missmatch, expected \"%s\" got \"%s\"", 
+                            name, 
+                            TransformCaptureTypeToString(capture[i].type),
+                            TransformCaptureTypeToString(captureType)
+                );
+            }
         }
+    }
+
+    void FinishPendingProgram( Impl *impl, PendingProgram &pending )
+    {
+        BaseProgramInfo *info = nullptr;
+        if (pending.render) info = impl->renderPrograms.find(pending.render);
+        else if (pending.compute) info = impl->computePrograms.find(pending.compute);
+        else if (pending.transform) info = impl->transformPrograms.find(pending.transform);
+        // Destroyed before the batch finished
+        if (!info) return;
 
-        LinkProgram(program);
-        
-        return std::move(program);
+        try {
+            FinishProgramBuild(impl, pending.build);
+            info->glProgram = std::move(pending.build.program);
+
+            if (pending.transform) {
+                VerifyCaptureVariables(info->glProgram, pending.capture.data(), pending.capture.size());
+            }
+            OnProgramCreated(info, pending.bindings);
+        } catch (const std::exception &e) {
+            LOG_ERROR("Failed to create program \"%s\" - error: %s", Common::GetCString(info->name), e.what());
+
+            // The handle was already returned and may be used by pipelines, so it stays as a failed placeholder
+            // until it is destroyed. Only the name is released, so the program can be created again
+            info->failed = true;
+            info->glProgram = GLProgram();
+
+            if (pending.render) {
+                impl->renderProgramNames.erase(info->name, pending.render);
+            }
+            else if (pending.compute) {
+                impl->computeProgramNames.erase(info->name, pending.compute);
+            }
+            else if (pending.transform) {
+                impl->transformProgramNames.erase(info->name, pending.transform);
+            }
+        }
+    }
+
+    struct ProgramBinaryHeader {
+        uint32_t magic, version;
+        uint64_t key;
+        uint32_t format, size;
+    };
+    static const uint32_t PROGRAM_BINARY_MAGIC = 0x42505350; // "PSPB"
+    static const uint32_t PROGRAM_BINARY_VERSION = 1;
+
+    static std::string ProgramBinaryPath( const Impl *impl, uint64_t key )
+    {
+        char name[32];
+        snprintf(name, sizeof(name), "%016" PRIx64 ".bin", key);
+        return impl->programCacheDirectory + "/" + name;
+    }
+
+    bool LoadProgramBinary( const Impl *impl, uint64_t key, GLProgram &program )
+    {
+        std::string path = ProgramBinaryPath(impl, key);
+
+        std::ifstream file(path, std::ios::binary);
+        if (!file) return false;
+
+        ProgramBinaryHeader header;
+        std::vector<char> binary;
+
+        bool valid = file.read((char*)&header, sizeof(header)) && 
+                     header.magic == PROGRAM_BINARY_MAGIC && header.version == PROGRAM_BINARY_VERSION && 
+                     header.key == key && header.size > 0;
+        if (valid) {
+            binary.resize(header.size);
+            valid = (bool)file.read(binary.data(), header.size);
+        }
+        if (!valid) {
+            LOG_WARNING("Ignoring invalid program binary \"%s\"", path.c_str());
+            return false;
+        }
+
+        GLProgram loaded(glCreateProgram());
+        gl::glProgramBinary(loaded, (GLenum)header.format, binary.data(), (GLsizei)header.size);
+
+        GLint status;
+        glGetProgramiv(loaded, GL_LINK_STATUS, &status);
+        if (status != (GLint)GL_TRUE) {
+            LOG_INFORMATION("Driver rejected program binary \"%s\", recompiling", path.c_str());
+            return false;
+        }
+
+        program = std::move(loaded);
+        return true;
+    }
+
+    void SaveProgramBinary( const Impl *impl, uint64_t key, GLuint program )
+    {
+        GLint size = 0;
+        glGetProgramiv(program, gl::GL_PROGRAM_BINARY_LENGTH, &size);
+        if (size <= 0) return;
+
+        std::vector<char> binary(size);
+        GLenum format;
+        gl::glGetProgramBinary(program, size, &size, &format, binary.data());
+
+        ProgramBinaryHeader header;
+            header.magic = PROGRAM_BINARY_MAGIC;
+            header.version = PROGRAM_BINARY_VERSION;
+            header.key = key;
+            header.format = (uint32_t)format;
+            header.size = (uint32_t)size;
+
+        std::string path = ProgramBinaryPath(impl, key);
+        std::ofstream file(path, std::ios::binary | std::ios::trunc);
+        if (!file.write((const char*)&header, sizeof(header)) || !file.write(binary.data(), size)) {
+            LOG_WARNING("Failed to write program binary \"%s\"", path.c_str());
+        }
     }
 
     void OnProgramCreated( BaseProgramInfo *program, const ProgramInitBindings &bindings )
@@ -191,4 +480,167 @@ namespace PipelineManagerImpl
 
         verifyUniformBlocksInProgram(program);
     }
+
+    GLRenderState ResolveRenderState( PipelineFlags flags, BlendMode blendMode, const PipelineState &params )
+    {
+        // Starts out as the GL defaults, only the state that is in use is changed from them
+        GLRenderState state;
+            state.depthFunc = GL_LESS;
+            state.cullFaceMode = GL_BACK;
+            state.blendSrc = GL_ONE;
+            state.blendDst = GL_ZERO;
+            state.blendEquationRGB = state.blendEquationAlpha = GL_FUNC_ADD;
+            state.stencilReadMask = state.stencilWriteMask = ~0u;
+        for (int i=0; i < 2; ++i) {
+            state.stencilFunc[i] = GL_ALWAYS;
+            state.stencilFail[i] = state.stencilDepthFail[i] = state.stencilPass[i] = GL_KEEP;
+        }
+
+        state.depthTest = all(flags, PipelineFlags::DepthTest);
+        state.depthWrite = all(flags, PipelineFlags::DepthWrite);
+        if (state.depthTest) {
+            state.depthFunc = ToGL(params.depthFunc);
+        }
+
+        state.cullFace = all(flags, PipelineFlags::FaceCulling);
+        if (state.cullFace) {
+            state.cullFaceMode = ToGL(params.cullMode);
+        }
+
+        state.colorMask[0] = all(params.colorWriteMask, ColorWriteMask::Red);
+        state.colorMask[1] = all(params.colorWriteMask, ColorWriteMask::Green);
+        state.colorMask[2] = all(params.colorWriteMask, ColorWriteMask::Blue);
+        state.colorMask[3] = all(params.colorWriteMask, ColorWriteMask::Alpha);
+
+        switch (blendMode) {
+        case BlendMode::Replace:
+            break;
+        case BlendMode::Alpha:
+            state.blend = true;
+            state.blendSrc = GL_SRC_ALPHA;
+            state.blendDst = GL_ONE_MINUS_SRC_ALPHA;
+            break;
+        case BlendMode::PreMultipledAlpha:
+            state.blend = true;
+            state.blendSrc = GL_ONE;
+            state.blendDst = GL_ONE_MINUS_SRC_ALPHA;
+            break;
+        }
+        if (state.blend) {
+            state.blendEquationRGB = ToGL(params.colorBlendEquation);
+            state.blendEquationAlpha = ToGL(params.alphaBlendEquation);
+        }
+
+        state.stencilTest = all(flags, PipelineFlags::StencilTest);
+        if (state.stencilTest) {
+            const StencilFaceState *faces[2] = {&params.stencilFront, &params.stencilBack};
+            for (int i=0; i < 2; ++i) {
+                state.stencilFunc[i] = ToGL(faces[i]->func);
+                state.stencilFail[i] = ToGL(faces[i]->fail);
+                state.stencilDepthFail[i] = ToGL(faces[i]->depthFail);
+                state.stencilPass[i] = ToGL(faces[i]->pass);
+            }
+            state.stencilReference = params.stencilReference;
+            state.stencilReadMask = params.stencilReadMask;
+            state.stencilWriteMask = params.stencilWriteMask;
+        }
+
+        state.polygonOffset = params.polygonOffsetFactor != 0.f || params.polygonOffsetUnits != 0.f;
+        if (state.polygonOffset) {
+            state.polygonOffsetFactor = params.polygonOffsetFactor;
+            state.polygonOffsetUnits = params.polygonOffsetUnits;
+        }
+
+        return state;
+    }
+
+    uint32_t FindOrAddRenderState( Impl *impl, const GLRenderState &state )
+    {
+        ProgramHash hash;
+        hash.add(state);
+
+        auto range = impl->renderStateIndexes.equal_range(hash.value);
+        for (auto iter = range.first; iter != range.second; ++iter) {
+            if (impl->renderStates[iter->second].state == state) {
+                return iter->second;
+            }
+        }
+
+        RenderStateInfo info;
+            info.state = state;
+        impl->renderStates.push_back(info);
+
+        uint32_t index = (uint32_t)(impl->renderStates.size()-1);
+        impl->renderStateIndexes.emplace(hash.value, index);
+        return index;
+    }
+
+    // from is null when the current GL state is unknown
+    static void AppendRenderStateDelta( const GLRenderState *from, const GLRenderState &to, std::vector<CCQI::Command> &commands )
+    {
+        auto enableDisable = [&]( bool GLRenderState::*var, GLenum cap ) {
+            if (from && from->*var == to.*var) return;
+            if (to.*var) commands.push_back(CCQI::Enable(cap));
+            else commands.push_back(CCQI::Disable(cap));
+        };
+        enableDisable(&GLRenderState::depthTest, GL_DEPTH_TEST);
+        enableDisable(&GLRenderState::cullFace, GL_CULL_FACE);
+        enableDisable(&GLRenderState::blend, GL_BLEND);
+        enableDisable(&GLRenderState::stencilTest, GL_STENCIL_TEST);
+        enableDisable(&GLRenderState::polygonOffset, GL_POLYGON_OFFSET_FILL);
+
+        if (!from || from->depthWrite != to.depthWrite) {
+            commands.push_back(CCQI::SetDepthMask(to.depthWrite));
+        }
+        if (!from || from->depthFunc != to.depthFunc) {
+            commands.push_back(CCQI::SetDepthFunc(to.depthFunc));
+        }
+        if (!from || from->cullFaceMode != to.cullFaceMode) {
+            commands.push_back(CCQI::SetCullFace(to.cullFaceMode));
+        }
+        if (!from || memcmp(from->colorMask, to.colorMask, sizeof(to.colorMask)) != 0) {
+            commands.push_back(CCQI::SetColorMask(to.colorMask[0], to.colorMask[1], to.colorMask[2], to.colorMask[3]));
+        }
+
+        if (!from || from->blendSrc != to.blendSrc || from->blendDst != to.blendDst) {
+            commands.push_back(CCQI::SetBlendFunc(to.blendSrc, to.blendDst));
+        }
+        if (!from || from->blendEquationRGB != to.blendEquationRGB || from->blendEquationAlpha != to.blendEquationAlpha) {
+            commands.push_back(CCQI::SetBlendEquation(to.blendEquationRGB, to.blendEquationAlpha));
+        }
+
+        const GLenum faces[2] = {GL_FRONT, GL_BACK};
+        for (int i=0; i < 2; ++i) {
+            if (!from || from->stencilFunc[i] != to.stencilFunc[i] || from->stencilReference != to.stencilReference || from->stencilReadMask != to.stencilReadMask) {
+                commands.push_back(CCQI::SetStencilFunc(faces[i], to.stencilFunc[i], to.stencilReference, to.stencilReadMask));
+            }
+            if (!from || from->stencilFail[i] != to.stencilFail[i] || from->stencilDepthFail[i] != to.stencilDepthFail[i] || from->stencilPass[i] != to.stencilPass[i]) {
+                commands.push_back(CCQI::SetStencilOp(faces[i], to.stencilFail[i], to.stencilDepthFail[i], to.stencilPass[i]));
+            }
+            if (!from || from->stencilWriteMask != to.stencilWriteMask) {
+                commands.push_back(CCQI::SetStencilMask(faces[i], to.stencilWriteMask));
+            }
+        }
+
+        if (!from || from->polygonOffsetFactor != to.polygonOffsetFactor || from->polygonOffsetUnits != to.polygonOffsetUnits) {
+            commands.push_back(CCQI::SetPolygonOffset(to.polygonOffsetFactor, to.polygonOffsetUnits));
+        }
+    }
+
+    const std::vector<CCQI::Command>& GetRenderStateDelta( Impl *impl, uint32_t from, uint32_t to )
+    {
+        assert(to < impl->renderStates.size());
+        assert(from == UNKNOWN_RENDER_STATE || from < impl->renderStates.size());
+
+        uint64_t key = ((uint64_t)from << 32) | to;
+        auto iter = impl->renderStateDeltas.find(key);
+        if (iter != impl->renderStateDeltas.end()) {
+            return iter->second;
+        }
+
+        std::vector<CCQI::Command> &commands = impl->renderStateDeltas[key];
+        const GLRenderState *fromState = from != UNKNOWN_RENDER_STATE ? &impl->renderStates[from].state : nullptr;
+        AppendRenderStateDelta(fromState, impl->renderStates[to].state, commands);
+        return commands;
+    }
 }}
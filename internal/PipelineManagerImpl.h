@@ -3,11 +3,19 @@
 #include "Fwd.h"
 #include "PipelineManager.h"
 #include "internal/GLTypes.h"
+#include "internal/CompiledRenderQueueImpl.h"
 #include "internal/Helpers.h"
+#include "internal/NameIndex.h"
 
 #include "Common/HandleVector.h"
 #include "Common/StringId.h"
 
+#include <cstring>
+#include <map>
+#include <memory>
+#include <unordered_map>
+#include <vector>
+
 namespace Pisces
 {
     namespace PipelineManagerImpl
@@ -32,6 +40,9 @@ namespace Pisces
         struct BaseProgramInfo {
             Common::StringId name;
             GLProgram glProgram;
+            // The batched build failed. The handle stays allocated until the program is destroyed, so pipelines
+            // holding it never see a reused slot, but the compiler skips everything using it
+            bool failed = false;
             
             SamplerInfo samplers[MAX_BOUND_SAMPLERS];
             UniformBufferInfo uniformBuffers[MAX_BOUND_UNIFORM_BUFFERS];
@@ -56,12 +67,68 @@ namespace Pisces
             TransformProgramFlags flags = TransformProgramFlags::None;
         };
 
+        // Pipeline state resolved to GL values. State that is disabled is left at the GL defaults, so pipelines
+        // that only differ in unused values share the render state.
+        // Compared & hashed field by field (ProgramHash::add), the padding is never read
+        struct GLRenderState {
+            bool depthTest = false, depthWrite = false, cullFace = false, blend = false, stencilTest = false, polygonOffset = false;
+            bool colorMask[4] = {};
+
+            gl::GLenum depthFunc = {}, cullFaceMode = {};
+            gl::GLenum blendSrc = {}, blendDst = {}, blendEquationRGB = {}, blendEquationAlpha = {};
+
+            // Front & back face
+            gl::GLenum stencilFunc[2] = {}, stencilFail[2] = {}, stencilDepthFail[2] = {}, stencilPass[2] = {};
+            gl::GLint stencilReference = 0;
+            gl::GLuint stencilReadMask = 0, stencilWriteMask = 0;
+
+            float polygonOffsetFactor = 0.f, polygonOffsetUnits = 0.f;
+
+            bool operator == ( const GLRenderState &other ) const;
+        };
+
+        struct RenderStateInfo {
+            GLRenderState state;
+        };
+
+        // Index of the state the compiler starts with and restores at the end of a queue
+        static const uint32_t DEFAULT_RENDER_STATE = 0;
+        // The GL state is unknown, the delta to a state sets all of it
+        static const uint32_t UNKNOWN_RENDER_STATE = ~0u;
+
         struct PipelineInfo {
             ProgramHandle program;
             Common::StringId name;
 
             PipelineFlags flags = PipelineFlags::None;
-            BlendMode blendMode = BlendMode::Replace;
+            // Index in Impl::renderStates
+            uint32_t renderState = DEFAULT_RENDER_STATE;
+        };
+
+        // A submitted compile & link, the shaders are kept until the result has been checked
+        struct ProgramBuild {
+            GLProgram program;
+            std::vector<GLShader> shaders;
+            // Key in the program cache, 0 if the binary isn't cached
+            uint64_t cacheKey = 0;
+        };
+
+        // Program created during a batch, only one of the handles is set
+        struct PendingProgram {
+            ProgramBuild build;
+            ProgramInitBindings bindings;
+            std::vector<TransformCaptureVariable> capture;
+
+            ProgramHandle render;
+            ComputeProgramHandle compute;
+            TransformProgramHandle transform;
+        };
+
+        // Everything needed to compile a variant of a render program on demand
+        struct ProgramVariants {
+            // Sources are loaded, sourceIsFilename is always false
+            RenderProgramInitParams params;
+            std::map<uint32_t, ProgramHandle> programs;
         };
 
         struct Impl {
@@ -72,21 +139,79 @@ namespace Pisces
             HandleVector<ComputeProgramHandle, ComputeProgramInfo> computePrograms;
             HandleVector<TransformProgramHandle, TransformProgramInfo> transformPrograms;
 
+            NameIndex<ProgramHandle> renderProgramNames{"render program"};
+            NameIndex<PipelineHandle> pipelineNames{"pipeline"};
+            NameIndex<ComputeProgramHandle> computeProgramNames{"compute program"};
+            NameIndex<TransformProgramHandle> transformProgramNames{"transform program"};
+
             bool veryfyUniformBlocks = true;
 
             bool supportsComputeShaders = false;
 
+            // Linked programs are cached as driver binaries in this directory, empty when disabled
+            std::string programCacheDirectory;
+            // Vendor, renderer & version, part of every cache key so a driver update misses the cache
+            std::string driverId;
+
+            bool supportsParallelCompile = false;
+            // Set between beginProgramBatch and finishProgramBatch
+            bool batchPrograms = false;
+            std::vector<std::unique_ptr<PendingProgram>> pendingPrograms;
+
+            // Render programs with variants, keyed on the name of the program
+            std::map<Common::StringId, ProgramVariants> renderVariants;
+
+            // Distinct render states of all pipelines created so far, never removed so indexes stay valid
+            std::vector<RenderStateInfo> renderStates;
+            // Hash of the state to its index, equal hashes are told apart by comparing the states
+            std::unordered_multimap<uint64_t, uint32_t> renderStateIndexes;
+            // Commands switching between two render states, keyed on (from << 32 | to)
+            std::unordered_map<uint64_t, std::vector<CompiledRenderQueueImpl::Command>> renderStateDeltas;
+
             Impl( Context *context_ ) :
                 context(context_)
             {}
         };
 
-        GLShader LoadShader( gl::GLenum type, const char *file );
-        GLShader CreateShader( gl::GLenum type, int count, const char* const*sources, const gl::GLint *sourceLenghts );
-        
-        void LinkProgram( gl::GLuint program );
-        GLProgram CreateProgram( int count, const GLShader *shaders );
+        // Hashes everything that goes into a linked program, stable between runs so it can name cache files.
+        // Also keys the render states
+        struct ProgramHash {
+            uint64_t value = 14695981039346656037ull;
+
+            void add( const void *data, size_t size );
+            void add( const std::string &str );
+            void add( const ProgramInitBindings &bindings );
+            void add( const GLRenderState &state );
+        };
+
+        std::string LoadShaderSource( const char *file );
+        // Inserts the defines after the #version line, a #line directive keeps the line numbers of the source
+        std::string SpecializeSource( const std::string &source, const std::vector<std::pair<std::string, std::string>> &defines );
+
+        // Compiles & links without asking for the result, so the driver can work on several programs at once.
+        // retrievable hints the driver that the binary will be saved with SaveProgramBinary
+        void SubmitShader( ProgramBuild &build, gl::GLenum type, const std::string &source );
+        void SubmitLink( ProgramBuild &build, const char* const *captures, int captureCount, bool retrievable );
+        // Always true without KHR_parallel_shader_compile, FinishProgramBuild blocks in that case
+        bool IsProgramBuildDone( const Impl *impl, const ProgramBuild &build );
+        // Throws with the compile or link log if the build failed, saves the binary if it has a cache key
+        void FinishProgramBuild( const Impl *impl, ProgramBuild &build );
+
+        void CheckLinkStatus( gl::GLuint program );
+        void VerifyCaptureVariables( gl::GLuint program, const TransformCaptureVariable *capture, size_t count );
+        // Completes a program created during a batch, if the build failed the program is marked as failed (BaseProgramInfo::failed)
+        void FinishPendingProgram( Impl *impl, PendingProgram &pending );
+
+        // Returns false on a cache miss, a corrupt file or a binary the driver no longer accepts
+        bool LoadProgramBinary( const Impl *impl, uint64_t key, GLProgram &program );
+        void SaveProgramBinary( const Impl *impl, uint64_t key, gl::GLuint program );
 
         void OnProgramCreated( BaseProgramInfo *program, const ProgramInitBindings &bindings );
+
+        GLRenderState ResolveRenderState( PipelineFlags flags, BlendMode blendMode, const PipelineState &state );
+        // Returns the index of an equal render state, adding it if there is none
+        uint32_t FindOrAddRenderState( Impl *impl, const GLRenderState &state );
+        // The minimal commands to go from one render state to the other, computed on the first use of the pair
+        const std::vector<CompiledRenderQueueImpl::Command>& GetRenderStateDelta( Impl *impl, uint32_t from, uint32_t to );
     }
 }
\ No newline at end of file
@@ -0,0 +1,424 @@
+#include "PixelKernels.h"
+
+#include "Common/ErrorUtils.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+#if defined(_M_X64) || defined(__x86_64__) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2) || defined(__SSE2__)
+#   define PISCES_PIXEL_KERNELS_SSE2
+#   include <emmintrin.h>
+#   include <immintrin.h>
+#   if defined(_MSC_VER)
+#       include <intrin.h>
+#       define PISCES_TARGET_AVX2
+#   else
+#       define PISCES_TARGET_AVX2 __attribute__((target("avx2")))
+#   endif
+#endif
+
+namespace Pisces
+{
+    namespace PixelKernels
+    {
+        void (*FlipVertical)( void *pixels, size_t rowBytes, size_t stride, int rows );
+        void (*FlipVerticalCopy)( void *dst, size_t dstStride, const void *src, size_t srcStride, size_t rowBytes, int rows );
+        void (*PremultiplyAlpha)( uint8_t *dst, const uint8_t *src, size_t pixelCount );
+        void (*ConvertChannels)( uint8_t *dst, int dstChannels, const uint8_t *src, int srcChannels, size_t pixelCount );
+        void (*Swizzle)( uint8_t *dst, const uint8_t *src, const uint8_t mask[4], size_t pixelCount );
+        void (*SrgbToLinear)( float *dst, const uint8_t *src, size_t count, bool hasAlpha );
+        void (*LinearToSrgb)( uint8_t *dst, const float *src, size_t count, bool hasAlpha );
+
+        static const int LINEAR_TO_SRGB_TABLE_SIZE = 4096;
+
+        struct SrgbTables {
+            float toLinear[256];
+            // Linear value where the rounded sRGB value goes from i-1 to i
+            float thresholds[256];
+            // Approximation of the sRGB value, is at most one of from the correctly rounded value
+            uint8_t fromLinear[LINEAR_TO_SRGB_TABLE_SIZE+1];
+
+            SrgbTables()
+            {
+                auto decode = []( double v ) {
+                    return v <= 0.04045 ? v / 12.92 : std::pow((v + 0.055) / 1.055, 2.4);
+                };
+                auto encode = []( double v ) {
+                    return v <= 0.0031308 ? v * 12.92 : 1.055 * std::pow(v, 1.0 / 2.4) - 0.055;
+                };
+
+                for (int i=0; i < 256; ++i) {
+                    toLinear[i] = (float)decode(i / 255.0);
+                    thresholds[i] = i == 0 ? 0.f : (float)decode((i - 0.5) / 255.0);
+                }
+                for (int i=0; i <= LINEAR_TO_SRGB_TABLE_SIZE; ++i) {
+                    double v = encode((double)i / LINEAR_TO_SRGB_TABLE_SIZE);
+                    fromLinear[i] = (uint8_t)std::min(255.0, std::floor(v * 255.0 + 0.5));
+                }
+            }
+        };
+
+        static const SrgbTables& GetSrgbTables()
+        {
+            static const SrgbTables tables;
+            return tables;
+        }
+
+        static inline uint8_t MulDiv255( unsigned a, unsigned b )
+        {
+            unsigned t = a * b + 128;
+            return (uint8_t)((t + (t >> 8)) >> 8);
+        }
+
+        static inline float Saturate( float v )
+        {
+            // written so NaN ends up as 0
+            return v > 0.f ? (v < 1.f ? v : 1.f) : 0.f;
+        }
+
+        static inline uint8_t EncodeSrgb( const SrgbTables &tables, float v, int approx )
+        {
+            while (approx < 255 && v >= tables.thresholds[approx+1]) ++approx;
+            while (approx > 0 && v < tables.thresholds[approx]) --approx;
+            return (uint8_t)approx;
+        }
+
+        // Scalar implementations
+
+        void FlipVertical_Scalar( void *pixels, size_t rowBytes, size_t stride, int rows )
+        {
+            uint8_t *bytes = (uint8_t*)pixels;
+            for (int y=0; y < rows/2; ++y) {
+                uint8_t *a = bytes + y * stride;
+                uint8_t *b = bytes + (rows-y-1) * stride;
+                std::swap_ranges(a, a+rowBytes, b);
+            }
+        }
+
+        void FlipVerticalCopy_Generic( void *dst, size_t dstStride, const void *src, size_t srcStride, size_t rowBytes, int rows )
+        {
+            // memcpy is already vectorized by the runtime, so there is nothing to gain from a SIMD version
+            uint8_t *out = (uint8_t*)dst;
+            const uint8_t *in = (const uint8_t*)src;
+            for (int y=0; y < rows; ++y) {
+                memcpy(out + y * dstStride, in + (rows-y-1) * srcStride, rowBytes);
+            }
+        }
+
+        void PremultiplyAlpha_Scalar( uint8_t *dst, const uint8_t *src, size_t pixelCount )
+        {
+            for (size_t i=0; i < pixelCount; ++i, dst += 4, src += 4) {
+                uint8_t a = src[3];
+                dst[0] = MulDiv255(src[0], a);
+                dst[1] = MulDiv255(src[1], a);
+                dst[2] = MulDiv255(src[2], a);
+                dst[3] = a;
+            }
+        }
+
+        void ConvertChannels_Scalar( uint8_t *dst, int dstChannels, const uint8_t *src, int srcChannels, size_t pixelCount )
+        {
+            if (srcChannels == dstChannels) {
+                memmove(dst, src, pixelCount * srcChannels);
+                return;
+            }
+            if (srcChannels == 3 && dstChannels == 4) {
+                for (size_t i=0; i < pixelCount; ++i, dst += 4, src += 3) {
+                    dst[0] = src[0];
+                    dst[1] = src[1];
+                    dst[2] = src[2];
+                    dst[3] = 255;
+                }
+                return;
+            }
+
+            const uint8_t fill[4] = {0, 0, 0, 255};
+            for (size_t i=0; i < pixelCount; ++i, dst += dstChannels, src += srcChannels) {
+                for (int c=0; c < dstChannels; ++c) {
+                    dst[c] = c < srcChannels ? src[c] : fill[c];
+                }
+            }
+        }
+
+        void Swizzle_Scalar( uint8_t *dst, const uint8_t *src, const uint8_t mask[4], size_t pixelCount )
+        {
+            for (size_t i=0; i < pixelCount; ++i, dst += 4, src += 4) {
+                uint8_t tmp[4] = { src[0], src[1], src[2], src[3] };
+                dst[0] = tmp[mask[0]];
+                dst[1] = tmp[mask[1]];
+                dst[2] = tmp[mask[2]];
+                dst[3] = tmp[mask[3]];
+            }
+        }
+
+        void SrgbToLinear_Scalar( float *dst, const uint8_t *src, size_t count, bool hasAlpha )
+        {
+            const SrgbTables &tables = GetSrgbTables();
+            for (size_t i=0; i < count; ++i) {
+                if (hasAlpha && (i & 3) == 3) {
+                    dst[i] = src[i] * (1.f / 255.f);
+                }
+                else {
+                    dst[i] = tables.toLinear[src[i]];
+                }
+            }
+        }
+
+        void LinearToSrgb_Scalar( uint8_t *dst, const float *src, size_t count, bool hasAlpha )
+        {
+            const SrgbTables &tables = GetSrgbTables();
+            for (size_t i=0; i < count; ++i) {
+                float v = Saturate(src[i]);
+                if (hasAlpha && (i & 3) == 3) {
+                    dst[i] = (uint8_t)(v * 255.f + 0.5f);
+                }
+                else {
+                    int approx = tables.fromLinear[(int)(v * LINEAR_TO_SRGB_TABLE_SIZE)];
+                    dst[i] = EncodeSrgb(tables, v, approx);
+                }
+            }
+        }
+
+#ifdef PISCES_PIXEL_KERNELS_SSE2
+        // SSE2 implementations
+
+        void FlipVertical_SSE2( void *pixels, size_t rowBytes, size_t stride, int rows )
+        {
+            uint8_t *bytes = (uint8_t*)pixels;
+            for (int y=0; y < rows/2; ++y) {
+                uint8_t *a = bytes + y * stride;
+                uint8_t *b = bytes + (rows-y-1) * stride;
+
+                size_t i = 0;
+                for (; i+16 <= rowBytes; i += 16) {
+                    __m128i va = _mm_loadu_si128((const __m128i*)(a+i));
+                    __m128i vb = _mm_loadu_si128((const __m128i*)(b+i));
+                    _mm_storeu_si128((__m128i*)(a+i), vb);
+                    _mm_storeu_si128((__m128i*)(b+i), va);
+                }
+                std::swap_ranges(a+i, a+rowBytes, b+i);
+            }
+        }
+
+        static inline __m128i PremultiplyAlpha16_SSE2( __m128i v, __m128i alphaMask, __m128i bias )
+        {
+            // v holds two pixels as 16 bit values, broadcast the alpha of each pixel
+            __m128i a = _mm_shufflehi_epi16(_mm_shufflelo_epi16(v, _MM_SHUFFLE(3,3,3,3)), _MM_SHUFFLE(3,3,3,3));
+            __m128i t = _mm_add_epi16(_mm_mullo_epi16(v, a), bias);
+            t = _mm_srli_epi16(_mm_add_epi16(t, _mm_srli_epi16(t, 8)), 8);
+            return _mm_or_si128(_mm_andnot_si128(alphaMask, t), _mm_and_si128(alphaMask, v));
+        }
+
+        void PremultiplyAlpha_SSE2( uint8_t *dst, const uint8_t *src, size_t pixelCount )
+        {
+            const __m128i zero = _mm_setzero_si128();
+            const __m128i bias = _mm_set1_epi16(128);
+            const __m128i alphaMask = _mm_set_epi16(-1, 0, 0, 0, -1, 0, 0, 0);
+
+            size_t i = 0;
+            for (; i+4 <= pixelCount; i += 4) {
+                __m128i px = _mm_loadu_si128((const __m128i*)(src + i*4));
+                __m128i lo = PremultiplyAlpha16_SSE2(_mm_unpacklo_epi8(px, zero), alphaMask, bias);
+                __m128i hi = PremultiplyAlpha16_SSE2(_mm_unpackhi_epi8(px, zero), alphaMask, bias);
+                _mm_storeu_si128((__m128i*)(dst + i*4), _mm_packus_epi16(lo, hi));
+            }
+            PremultiplyAlpha_Scalar(dst + i*4, src + i*4, pixelCount - i);
+        }
+
+        void LinearToSrgb_SSE2( uint8_t *dst, const float *src, size_t count, bool hasAlpha )
+        {
+            const SrgbTables &tables = GetSrgbTables();
+            const __m128 zero = _mm_setzero_ps();
+            const __m128 one = _mm_set1_ps(1.f);
+            const __m128 scale = _mm_set1_ps((float)LINEAR_TO_SRGB_TABLE_SIZE);
+
+            alignas(16) float values[4];
+            alignas(16) int32_t indices[4];
+
+            size_t i = 0;
+            for (; i+4 <= count; i += 4) {
+                // _mm_max_ps returns the second operand for NaN
+                __m128 v = _mm_min_ps(_mm_max_ps(_mm_loadu_ps(src + i), zero), one);
+                _mm_store_ps(values, v);
+                _mm_store_si128((__m128i*)indices, _mm_cvttps_epi32(_mm_mul_ps(v, scale)));
+
+                for (int j=0; j < 4; ++j) {
+                    dst[i+j] = EncodeSrgb(tables, values[j], tables.fromLinear[indices[j]]);
+                }
+                if (hasAlpha) {
+                    dst[i+3] = (uint8_t)(values[3] * 255.f + 0.5f);
+                }
+            }
+            LinearToSrgb_Scalar(dst + i, src + i, count - i, hasAlpha);
+        }
+
+        // AVX2 implementations
+
+        PISCES_TARGET_AVX2 void FlipVertical_AVX2( void *pixels, size_t rowBytes, size_t stride, int rows )
+        {
+            uint8_t *bytes = (uint8_t*)pixels;
+            for (int y=0; y < rows/2; ++y) {
+                uint8_t *a = bytes + y * stride;
+                uint8_t *b = bytes + (rows-y-1) * stride;
+
+                size_t i = 0;
+                for (; i+32 <= rowBytes; i += 32) {
+                    __m256i va = _mm256_loadu_si256((const __m256i*)(a+i));
+                    __m256i vb = _mm256_loadu_si256((const __m256i*)(b+i));
+                    _mm256_storeu_si256((__m256i*)(a+i), vb);
+                    _mm256_storeu_si256((__m256i*)(b+i), va);
+                }
+                std::swap_ranges(a+i, a+rowBytes, b+i);
+            }
+        }
+
+        PISCES_TARGET_AVX2 static inline __m256i PremultiplyAlpha16_AVX2( __m256i v, __m256i alphaMask, __m256i bias )
+        {
+            __m256i a = _mm256_shufflehi_epi16(_mm256_shufflelo_epi16(v, _MM_SHUFFLE(3,3,3,3)), _MM_SHUFFLE(3,3,3,3));
+            __m256i t = _mm256_add_epi16(_mm256_mullo_epi16(v, a), bias);
+            t = _mm256_srli_epi16(_mm256_add_epi16(t, _mm256_srli_epi16(t, 8)), 8);
+            return _mm256_blendv_epi8(t, v, alphaMask);
+        }
+
+        PISCES_TARGET_AVX2 void PremultiplyAlpha_AVX2( uint8_t *dst, const uint8_t *src, size_t pixelCount )
+        {
+            const __m256i zero = _mm256_setzero_si256();
+            const __m256i bias = _mm256_set1_epi16(128);
+            const __m256i alphaMask = _mm256_set_epi16(-1, 0, 0, 0, -1, 0, 0, 0, -1, 0, 0, 0, -1, 0, 0, 0);
+
+            size_t i = 0;
+            for (; i+8 <= pixelCount; i += 8) {
+                // unpack and pack both work within 128 bit lanes, so the pixel order is preserved
+                __m256i px = _mm256_loadu_si256((const __m256i*)(src + i*4));
+                __m256i lo = PremultiplyAlpha16_AVX2(_mm256_unpacklo_epi8(px, zero), alphaMask, bias);
+                __m256i hi = PremultiplyAlpha16_AVX2(_mm256_unpackhi_epi8(px, zero), alphaMask, bias);
+                _mm256_storeu_si256((__m256i*)(dst + i*4), _mm256_packus_epi16(lo, hi));
+            }
+            PremultiplyAlpha_SSE2(dst + i*4, src + i*4, pixelCount - i);
+        }
+
+        PISCES_TARGET_AVX2 void ConvertChannels_AVX2( uint8_t *dst, int dstChannels, const uint8_t *src, int srcChannels, size_t pixelCount )
+        {
+            // RGB8 -> RGBA8 is the only conversion common enough to bother with
+            if (!(srcChannels == 3 && dstChannels == 4)) {
+                ConvertChannels_Scalar(dst, dstChannels, src, srcChannels, pixelCount);
+                return;
+            }
+
+            const __m256i shuffle = _mm256_setr_epi8(
+                0, 1, 2, -1, 3, 4, 5, -1, 6, 7, 8, -1, 9, 10, 11, -1,
+                0, 1, 2, -1, 3, 4, 5, -1, 6, 7, 8, -1, 9, 10, 11, -1
+            );
+            const __m256i alpha = _mm256_set1_epi32((int)0xFF000000);
+
+            size_t i = 0;
+            // Each iteration reads 28 bytes (the upper lane starts at pixel 4), stop early so we never read past the end
+            for (; i+10 <= pixelCount; i += 8) {
+                const uint8_t *in = src + i*3;
+                __m128i lo = _mm_loadu_si128((const __m128i*)in);
+                __m128i hi = _mm_loadu_si128((const __m128i*)(in + 12));
+                __m256i px = _mm256_inserti128_si256(_mm256_castsi128_si256(lo), hi, 1);
+                px = _mm256_or_si256(_mm256_shuffle_epi8(px, shuffle), alpha);
+                _mm256_storeu_si256((__m256i*)(dst + i*4), px);
+            }
+            ConvertChannels_Scalar(dst + i*4, 4, src + i*3, 3, pixelCount - i);
+        }
+
+        PISCES_TARGET_AVX2 void Swizzle_AVX2( uint8_t *dst, const uint8_t *src, const uint8_t mask[4], size_t pixelCount )
+        {
+            alignas(32) int8_t indices[32];
+            for (int i=0; i < 32; ++i) {
+                // shuffle_epi8 indexes within 128 bit lanes
+                indices[i] = (int8_t)((i & 12) + (mask[i & 3] & 3));
+            }
+            const __m256i shuffle = _mm256_load_si256((const __m256i*)indices);
+
+            size_t i = 0;
+            for (; i+8 <= pixelCount; i += 8) {
+                __m256i px = _mm256_loadu_si256((const __m256i*)(src + i*4));
+                _mm256_storeu_si256((__m256i*)(dst + i*4), _mm256_shuffle_epi8(px, shuffle));
+            }
+            Swizzle_Scalar(dst + i*4, src + i*4, mask, pixelCount - i);
+        }
+
+        PISCES_TARGET_AVX2 void SrgbToLinear_AVX2( float *dst, const uint8_t *src, size_t count, bool hasAlpha )
+        {
+            const SrgbTables &tables = GetSrgbTables();
+            const __m256 invMax = _mm256_set1_ps(1.f / 255.f);
+
+            size_t i = 0;
+            for (; i+8 <= count; i += 8) {
+                __m256i idx = _mm256_cvtepu8_epi32(_mm_loadl_epi64((const __m128i*)(src + i)));
+                __m256 linear = _mm256_i32gather_ps(tables.toLinear, idx, 4);
+                if (hasAlpha) {
+                    // i is a multiple of 8, so every 4th lane is alpha
+                    __m256 alpha = _mm256_mul_ps(_mm256_cvtepi32_ps(idx), invMax);
+                    linear = _mm256_blend_ps(linear, alpha, 0x88);
+                }
+                _mm256_storeu_ps(dst + i, linear);
+            }
+            SrgbToLinear_Scalar(dst + i, src + i, count - i, hasAlpha);
+        }
+
+        static bool CpuSupportsAVX2()
+        {
+#if defined(_MSC_VER)
+            int info[4];
+            __cpuid(info, 0);
+            if (info[0] < 7) return false;
+
+            __cpuid(info, 1);
+            bool osxsave = (info[2] & (1 << 27)) != 0;
+            if (!osxsave) return false;
+            // The OS has to save the ymm registers
+            if ((_xgetbv(0) & 0x6) != 0x6) return false;
+
+            __cpuidex(info, 7, 0);
+            return (info[1] & (1 << 5)) != 0;
+#else
+            return __builtin_cpu_supports("avx2");
+#endif
+        }
+#endif
+
+        Level InitPixelKernels( Level maxLevel )
+        {
+            FlipVertical = FlipVertical_Scalar;
+            FlipVerticalCopy = FlipVerticalCopy_Generic;
+            PremultiplyAlpha = PremultiplyAlpha_Scalar;
+            ConvertChannels = ConvertChannels_Scalar;
+            Swizzle = Swizzle_Scalar;
+            SrgbToLinear = SrgbToLinear_Scalar;
+            LinearToSrgb = LinearToSrgb_Scalar;
+
+#ifdef PISCES_PIXEL_KERNELS_SSE2
+            if (maxLevel == Level::Scalar) {
+                LOG_INFORMATION("Using scalar pixel kernels");
+                return Level::Scalar;
+            }
+
+            FlipVertical = FlipVertical_SSE2;
+            PremultiplyAlpha = PremultiplyAlpha_SSE2;
+            LinearToSrgb = LinearToSrgb_SSE2;
+
+            if (maxLevel == Level::AVX2 && CpuSupportsAVX2()) {
+                LOG_INFORMATION("Using AVX2 pixel kernels");
+
+                FlipVertical = FlipVertical_AVX2;
+                PremultiplyAlpha = PremultiplyAlpha_AVX2;
+                ConvertChannels = ConvertChannels_AVX2;
+                Swizzle = Swizzle_AVX2;
+                SrgbToLinear = SrgbToLinear_AVX2;
+                return Level::AVX2;
+            }
+
+            LOG_INFORMATION("Using SSE2 pixel kernels");
+            return Level::SSE2;
+#else
+            LOG_INFORMATION("Using scalar pixel kernels");
+            return Level::Scalar;
+#endif
+        }
+    }
+}
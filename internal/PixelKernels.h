@@ -0,0 +1,44 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+namespace Pisces
+{
+    // Vectorized pixel conversion routines used when staging texture data.
+    // The implementation is chosen at runtime by InitPixelKernels, AVX2 and SSE2
+    // are used when available with a scalar fallback for everything else.
+    namespace PixelKernels
+    {
+        // Reverse the order of the rows - in place
+        extern void (*FlipVertical)( void *pixels, size_t rowBytes, size_t stride, int rows );
+        // Reverse the order of the rows while copying from src to dst, the buffers may not overlap
+        extern void (*FlipVerticalCopy)( void *dst, size_t dstStride, const void *src, size_t srcStride, size_t rowBytes, int rows );
+
+        // Multiply the color channels of RGBA8 pixels with the alpha channel, rounded to nearest (c*a/255)
+        // dst and src may be the same buffer
+        extern void (*PremultiplyAlpha)( uint8_t *dst, const uint8_t *src, size_t pixelCount );
+
+        // Convert between 8 bit formats with 1-4 channels, missing color channels are set to 0 and a
+        // missing alpha channel is set to 255 (same rules as glTexImage2D uses)
+        extern void (*ConvertChannels)( uint8_t *dst, int dstChannels, const uint8_t *src, int srcChannels, size_t pixelCount );
+
+        // Reorder the channels of RGBA8 pixels, dst[i] = src[mask[i]]
+        // dst and src may be the same buffer
+        extern void (*Swizzle)( uint8_t *dst, const uint8_t *src, const uint8_t mask[4], size_t pixelCount );
+
+        // Convert 8 bit sRGB encoded values to linear floats in [0, 1]
+        // If hasAlpha is true every 4th value is left linear, count is the number of values
+        extern void (*SrgbToLinear)( float *dst, const uint8_t *src, size_t count, bool hasAlpha );
+        // Convert linear floats to 8 bit sRGB encoded values, rounded to nearest
+        // If hasAlpha is true every 4th value is only quantized, count is the number of values
+        extern void (*LinearToSrgb)( uint8_t *dst, const float *src, size_t count, bool hasAlpha );
+
+        enum class Level {
+            Scalar, SSE2, AVX2
+        };
+        // Selects the fastest implementations the cpu supports, up to maxLevel (lower levels are used by
+        // pisces-pixelbench to compare the implementations). Returns the level in use
+        Level InitPixelKernels( Level maxLevel = Level::AVX2 );
+    }
+}
@@ -17,6 +17,9 @@ namespace Pisces
 
         using uvec3 = std::array<uint32_t, 3>;
 
+        using BufferArray = std::array<BufferHandle, MAX_VERTEX_BUFFERS>;
+        using OffsetArray = std::array<size_t, MAX_VERTEX_BUFFERS>;
+
         enum class Type {
             Draw,
             DrawBuiltin,
@@ -25,6 +28,7 @@ namespace Pisces
 
             UsePipeline,
             UseVertexArray,
+            UseVertexBuffers,
             UseClipping,
             UseClipRect,
 
@@ -74,6 +78,12 @@ namespace Pisces
         CREATE_DATA_STRUCT(UseVertexArray, Type,
             (VertexArrayHandle, vertexArray)                  
         );
+        CREATE_DATA_STRUCT(UseVertexBuffers, Type,
+            (VertexFormatHandle, format),
+            (BufferArray, buffers),
+            (OffsetArray, offsets),
+            (BufferHandle, indexBuffer)
+        );
         CREATE_DATA_STRUCT(UseClipping, Type,
             (bool, use)                  
         );
@@ -155,6 +165,7 @@ namespace Pisces
 
             (UsePipelineData, usePipeline),
             (UseVertexArrayData, useVertexArray),
+            (UseVertexBuffersData, useVertexBuffers),
             (UseClippingData, useClipping),
             (UseClipRectData, useClipRect),
 
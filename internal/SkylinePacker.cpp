@@ -0,0 +1,106 @@
+#include "SkylinePacker.h"
+
+#include <algorithm>
+#include <climits>
+
+namespace Pisces
+{
+    SkylinePacker::SkylinePacker( int width, int height ) :
+        mWidth(width),
+        mHeight(height)
+    {
+        reset();
+    }
+
+    void SkylinePacker::reset()
+    {
+        mUsedArea = 0;
+        mSkyline.clear();
+        mSkyline.push_back(Segment{0, 0, mWidth});
+    }
+
+    float SkylinePacker::occupancy() const
+    {
+        return (float)mUsedArea / ((float)mWidth * (float)mHeight);
+    }
+
+    bool SkylinePacker::insert( int width, int height, int &x, int &y )
+    {
+        if (width <= 0 || height <= 0) return false;
+
+        size_t bestIdx = mSkyline.size();
+        int bestTop = INT_MAX,
+            bestWidth = INT_MAX,
+            bestY = 0;
+
+        for (size_t i=0; i < mSkyline.size(); ++i) {
+            int segmentY;
+            if (!fits(i, width, height, segmentY)) continue;
+
+            // Prefer the lowest top edge, break ties with the narrowest segment to reduce wasted space
+            int top = segmentY + height;
+            if (top < bestTop || (top == bestTop && mSkyline[i].width < bestWidth)) {
+                bestIdx = i;
+                bestTop = top;
+                bestWidth = mSkyline[i].width;
+                bestY = segmentY;
+            }
+        }
+
+        if (bestIdx == mSkyline.size()) return false;
+
+        x = mSkyline[bestIdx].x;
+        y = bestY;
+        addSegment(bestIdx, x, y, width, height);
+        mUsedArea += (size_t)width * height;
+        return true;
+    }
+
+    bool SkylinePacker::fits( size_t idx, int width, int height, int &y ) const
+    {
+        int x = mSkyline[idx].x;
+        if (x + width > mWidth) return false;
+
+        // The rectangle rests on the highest segment it spans
+        int remaining = width;
+        y = mSkyline[idx].y;
+        for (size_t i=idx; remaining > 0; ++i) {
+            y = std::max(y, mSkyline[i].y);
+            if (y + height > mHeight) return false;
+            remaining -= mSkyline[i].width;
+        }
+        return true;
+    }
+
+    void SkylinePacker::addSegment( size_t idx, int x, int y, int width, int height )
+    {
+        mSkyline.insert(mSkyline.begin() + idx, Segment{x, y + height, width});
+
+        // Shrink or remove the segments now covered by the new one
+        int right = x + width;
+        for (size_t i=idx+1; i < mSkyline.size(); ) {
+            Segment &segment = mSkyline[i];
+            if (segment.x >= right) break;
+
+            int overlap = right - segment.x;
+            if (overlap >= segment.width) {
+                mSkyline.erase(mSkyline.begin() + i);
+                continue;
+            }
+            segment.x += overlap;
+            segment.width -= overlap;
+            break;
+        }
+
+        // Merge neighbours at the same height
+        for (size_t i=0; i+1 < mSkyline.size(); ) {
+            if (mSkyline[i].y == mSkyline[i+1].y) {
+                mSkyline[i].width += mSkyline[i+1].width;
+                mSkyline.erase(mSkyline.begin() + i + 1);
+            }
+            else {
+                ++i;
+            }
+        }
+    }
+}
@@ -0,0 +1,33 @@
+#pragma once
+
+#include <vector>
+#include <cstddef>
+
+namespace Pisces
+{
+    // Packs rectangles into a fixed size page using the skyline bottom-left heuristic.
+    // Works best if the rectangles are inserted sorted by decreasing height.
+    class SkylinePacker {
+    public:
+        SkylinePacker( int width, int height );
+
+        // Returns false if there is no room left for the rectangle
+        bool insert( int width, int height, int &x, int &y );
+        void reset();
+
+        // Fraction of the page area covered by inserted rectangles
+        float occupancy() const;
+
+    private:
+        struct Segment {
+            int x, y, width;
+        };
+
+        bool fits( size_t idx, int width, int height, int &y ) const;
+        void addSegment( size_t idx, int x, int y, int width, int height );
+
+        int mWidth, mHeight;
+        size_t mUsedArea = 0;
+        std::vector<Segment> mSkyline;
+    };
+}
@@ -0,0 +1,279 @@
+#include "TlsfAllocator.h"
+
+#include <cassert>
+
+#ifdef _MSC_VER
+#   include <intrin.h>
+#endif
+
+namespace Pisces
+{
+    static int HighestBit( uint64_t value )
+    {
+        assert(value != 0);
+#ifdef _MSC_VER
+        unsigned long index;
+        _BitScanReverse64(&index, value);
+        return (int)index;
+#else
+        return 63 - __builtin_clzll(value);
+#endif
+    }
+
+    static int LowestBit( uint64_t value )
+    {
+        assert(value != 0);
+#ifdef _MSC_VER
+        unsigned long index;
+        _BitScanForward64(&index, value);
+        return (int)index;
+#else
+        return __builtin_ctzll(value);
+#endif
+    }
+
+    // First level is the highest set bit, second level is the next SL_BITS bits below it
+    static void Mapping( size_t size, int slBits, int &fl, int &sl )
+    {
+        fl = HighestBit(size);
+        sl = (int)(size >> (fl - slBits)) ^ (1 << slBits);
+    }
+
+    TlsfAllocator::TlsfAllocator( size_t size ) :
+        mSize(size / GRANULARITY * GRANULARITY)
+    {
+        reset();
+    }
+
+    void TlsfAllocator::reset()
+    {
+        mBlocks.clear();
+        mUnusedBlocks.clear();
+        mUsedSize = 0;
+        mAllocationCount = 0;
+
+        mFirstLevel = 0;
+        for (int i=0; i < FL_COUNT; ++i) {
+            mSecondLevel[i] = 0;
+            for (int j=0; j < SL_COUNT; ++j) {
+                mFreeLists[i][j] = NO_BLOCK;
+            }
+        }
+
+        if (mSize > 0) {
+            insertFree(createBlock(0, mSize));
+        }
+    }
+
+    void TlsfAllocator::grow( size_t newSize )
+    {
+        newSize = newSize / GRANULARITY * GRANULARITY;
+        if (newSize <= mSize) return;
+
+        uint32_t last = NO_BLOCK;
+        for (uint32_t i=0; i < (uint32_t)mBlocks.size(); ++i) {
+            if (mBlocks[i].size > 0 && mBlocks[i].offset + mBlocks[i].size == mSize) {
+                last = i;
+                break;
+            }
+        }
+
+        size_t added = newSize - mSize;
+        mSize = newSize;
+
+        if (last != NO_BLOCK && mBlocks[last].isFree) {
+            removeFree(last);
+            mBlocks[last].size += added;
+            insertFree(last);
+            return;
+        }
+
+        uint32_t block = createBlock(newSize - added, added);
+        mBlocks[block].prevPhysical = last;
+        if (last != NO_BLOCK) {
+            mBlocks[last].nextPhysical = block;
+        }
+        insertFree(block);
+    }
+
+    uint32_t TlsfAllocator::createBlock( size_t offset, size_t size )
+    {
+        uint32_t idx;
+        if (!mUnusedBlocks.empty()) {
+            idx = mUnusedBlocks.back();
+            mUnusedBlocks.pop_back();
+        }
+        else {
+            idx = (uint32_t)mBlocks.size();
+            mBlocks.emplace_back();
+        }
+
+        Block &block = mBlocks[idx];
+            block = Block();
+            block.offset = offset;
+            block.size = size;
+        return idx;
+    }
+
+    void TlsfAllocator::destroyBlock( uint32_t block )
+    {
+        mBlocks[block] = Block();
+        mUnusedBlocks.push_back(block);
+    }
+
+    void TlsfAllocator::insertFree( uint32_t idx )
+    {
+        Block &block = mBlocks[idx];
+
+        int fl, sl;
+        Mapping(block.size, SL_BITS, fl, sl);
+
+        uint32_t head = mFreeLists[fl][sl];
+        block.isFree = true;
+        block.prevFree = NO_BLOCK;
+        block.nextFree = head;
+        if (head != NO_BLOCK) {
+            mBlocks[head].prevFree = idx;
+        }
+        mFreeLists[fl][sl] = idx;
+
+        mFirstLevel |= (uint64_t)1 << fl;
+        mSecondLevel[fl] |= 1u << sl;
+    }
+
+    void TlsfAllocator::removeFree( uint32_t idx )
+    {
+        Block &block = mBlocks[idx];
+
+        int fl, sl;
+        Mapping(block.size, SL_BITS, fl, sl);
+
+        if (block.prevFree != NO_BLOCK) {
+            mBlocks[block.prevFree].nextFree = block.nextFree;
+        }
+        else {
+            mFreeLists[fl][sl] = block.nextFree;
+        }
+        if (block.nextFree != NO_BLOCK) {
+            mBlocks[block.nextFree].prevFree = block.prevFree;
+        }
+
+        if (mFreeLists[fl][sl] == NO_BLOCK) {
+            mSecondLevel[fl] &= ~(1u << sl);
+            if (mSecondLevel[fl] == 0) {
+                mFirstLevel &= ~((uint64_t)1 << fl);
+            }
+        }
+
+        block.isFree = false;
+        block.prevFree = block.nextFree = NO_BLOCK;
+    }
+
+    uint32_t TlsfAllocator::findFree( size_t size ) const
+    {
+        // Round up to the next list, so every block in the found list is large enough
+        int fl = HighestBit(size);
+        size_t rounded = size + ((size_t)1 << (fl - SL_BITS)) - 1;
+
+        int sl;
+        Mapping(rounded, SL_BITS, fl, sl);
+        if (fl >= FL_COUNT) return NO_BLOCK;
+
+        uint32_t slMap = mSecondLevel[fl] & (~0u << sl);
+        if (slMap == 0) {
+            uint64_t flMap = fl+1 < FL_COUNT ? mFirstLevel & (~(uint64_t)0 << (fl+1)) : 0;
+            if (flMap == 0) return NO_BLOCK;
+
+            fl = LowestBit(flMap);
+            slMap = mSecondLevel[fl];
+        }
+        sl = LowestBit(slMap);
+
+        return mFreeLists[fl][sl];
+    }
+
+    bool TlsfAllocator::allocate( size_t size, size_t &offset, uint32_t &id )
+    {
+        if (size == 0) size = 1;
+        size = (size + GRANULARITY - 1) / GRANULARITY * GRANULARITY;
+
+        uint32_t idx = findFree(size);
+        if (idx == NO_BLOCK) return false;
+
+        removeFree(idx);
+
+        // Return the tail of the block to the free lists
+        size_t remaining = mBlocks[idx].size - size;
+        if (remaining >= GRANULARITY) {
+            uint32_t rest = createBlock(mBlocks[idx].offset + size, remaining);
+
+            Block &block = mBlocks[idx];
+            mBlocks[rest].prevPhysical = idx;
+            mBlocks[rest].nextPhysical = block.nextPhysical;
+            if (block.nextPhysical != NO_BLOCK) {
+                mBlocks[block.nextPhysical].prevPhysical = rest;
+            }
+            block.nextPhysical = rest;
+            block.size = size;
+
+            insertFree(rest);
+        }
+
+        mUsedSize += mBlocks[idx].size;
+        mAllocationCount++;
+
+        offset = mBlocks[idx].offset;
+        id = idx;
+        return true;
+    }
+
+    void TlsfAllocator::free( uint32_t idx )
+    {
+        assert(idx < mBlocks.size() && !mBlocks[idx].isFree);
+
+        mUsedSize -= mBlocks[idx].size;
+        mAllocationCount--;
+
+        // Merge with free neighbours
+        uint32_t prev = mBlocks[idx].prevPhysical;
+        if (prev != NO_BLOCK && mBlocks[prev].isFree) {
+            removeFree(prev);
+
+            mBlocks[prev].size += mBlocks[idx].size;
+            mBlocks[prev].nextPhysical = mBlocks[idx].nextPhysical;
+            if (mBlocks[idx].nextPhysical != NO_BLOCK) {
+                mBlocks[mBlocks[idx].nextPhysical].prevPhysical = prev;
+            }
+            destroyBlock(idx);
+            idx = prev;
+        }
+
+        uint32_t next = mBlocks[idx].nextPhysical;
+        if (next != NO_BLOCK && mBlocks[next].isFree) {
+            removeFree(next);
+
+            mBlocks[idx].size += mBlocks[next].size;
+            mBlocks[idx].nextPhysical = mBlocks[next].nextPhysical;
+            if (mBlocks[next].nextPhysical != NO_BLOCK) {
+                mBlocks[mBlocks[next].nextPhysical].prevPhysical = idx;
+            }
+            destroyBlock(next);
+        }
+
+        insertFree(idx);
+    }
+
+    size_t TlsfAllocator::largestFreeBlock() const
+    {
+        if (mFirstLevel == 0) return 0;
+
+        int fl = HighestBit(mFirstLevel);
+        int sl = HighestBit(mSecondLevel[fl]);
+
+        size_t largest = 0;
+        for (uint32_t idx = mFreeLists[fl][sl]; idx != NO_BLOCK; idx = mBlocks[idx].nextFree) {
+            if (mBlocks[idx].size > largest) largest = mBlocks[idx].size;
+        }
+        return largest;
+    }
+}
@@ -0,0 +1,60 @@
+#pragma once
+
+#include <vector>
+#include <cstddef>
+#include <cstdint>
+
+namespace Pisces
+{
+    // Two level segregated fit allocator for ranges of an external memory block (e.g. a gpu buffer).
+    // Only book keeping is done here, allocate and free are O(1) and adjacent free blocks are merged.
+    class TlsfAllocator {
+    public:
+        static const size_t GRANULARITY = 16;
+
+        explicit TlsfAllocator( size_t size );
+
+        // Returns false if there is no free block large enough, offset is a multiple of GRANULARITY
+        // and id identifies the allocation when freeing it
+        bool allocate( size_t size, size_t &offset, uint32_t &id );
+        void free( uint32_t id );
+        void reset();
+        // Adds space at the end, existing allocations keep their offsets
+        void grow( size_t newSize );
+
+        size_t size() const { return mSize; }
+        size_t usedSize() const { return mUsedSize; }
+        size_t freeSize() const { return mSize - mUsedSize; }
+        size_t largestFreeBlock() const;
+        size_t allocationCount() const { return mAllocationCount; }
+
+    private:
+        static const int SL_BITS = 4;
+        static const int SL_COUNT = 1 << SL_BITS;
+        static const int FL_COUNT = 64;
+        static const uint32_t NO_BLOCK = ~0u;
+
+        struct Block {
+            size_t offset = 0, size = 0;
+            uint32_t prevPhysical = NO_BLOCK, nextPhysical = NO_BLOCK;
+            uint32_t prevFree = NO_BLOCK, nextFree = NO_BLOCK;
+            bool isFree = false;
+        };
+
+        uint32_t createBlock( size_t offset, size_t size );
+        void destroyBlock( uint32_t block );
+
+        void insertFree( uint32_t block );
+        void removeFree( uint32_t block );
+        uint32_t findFree( size_t size ) const;
+
+        size_t mSize, mUsedSize = 0, mAllocationCount = 0;
+
+        std::vector<Block> mBlocks;
+        std::vector<uint32_t> mUnusedBlocks;
+
+        uint64_t mFirstLevel = 0;
+        uint32_t mSecondLevel[FL_COUNT] = {};
+        uint32_t mFreeLists[FL_COUNT][SL_COUNT];
+    };
+}
@@ -25,7 +25,7 @@ namespace Pisces
         mImpl(context)
     {
         mImpl->renderTarget = queue->impl()->renderTarget;
-        mImpl->commands = Compile(context, options, queue);
+        mImpl->commands = Compile(context, options, queue, mImpl->samplerReferences);
     }
 
     PISCES_API CompiledRenderQueue::~CompiledRenderQueue()
@@ -7,6 +7,7 @@
 #include "TextureLoader.h"
 #include "PipelineLoader.h"
 #include "SpriteManager.h"
+#include "StreamingBuffer.h"
 #include "SpriteLoader.h"
 #include "ProgramLoader.h"
 
@@ -106,10 +107,13 @@ namespace Pisces
         std::unique_ptr<HardwareResourceManager> hardwareResourceMgr;
         std::unique_ptr<PipelineManager> pipelineMgr;
         std::unique_ptr<SpriteManager> spriteMgr;
+        std::unique_ptr<TransientBuffer> transientBuffer;
 
         HandleVector<RenderTargetHandle, RenderTargetInfo> renderTargets;
 
         uint64_t currentFrame = 0;
+        // All frames before this one are finished by the gpu
+        uint64_t finishedFrames = 0;
         GLFrameSync frameSync[FRAMES_IN_FLIGHT];
 
         RenderTargetHandle mainRenderTarget;
@@ -302,6 +306,7 @@ namespace Pisces
 
         mImpl->hardwareResourceMgr.reset(new HardwareResourceManager(this));
         mImpl->pipelineMgr.reset(new PipelineManager(this));
+        mImpl->pipelineMgr->setProgramCacheDirectory(params.programCacheDirectory);
         mImpl->spriteMgr.reset(new SpriteManager(this));
 
         RenderTargetInfo info;
@@ -317,6 +322,8 @@ namespace Pisces
         // wait 10ms for sync
         glClientWaitSync(mImpl->frameSync[0], GL_SYNC_FLUSH_COMMANDS_BIT, 10000000);
 
+        mImpl->transientBuffer.reset(new TransientBuffer(this, DEFAULT_TRANSIENT_BUFFER_SIZE));
+
         mImpl->coreResourceLoaders.emplace_back(new TextureLoader(mImpl->hardwareResourceMgr.get()));
         registerResourceLoader(Common::CreateStringId("Texture"), mImpl->coreResourceLoaders.back().get());
 
@@ -336,6 +343,9 @@ namespace Pisces
         mImpl->coreResourceLoaders.emplace_back(new SpriteLoader(mImpl->spriteMgr.get(), mImpl->hardwareResourceMgr.get()));
         registerResourceLoader(Common::CreateStringId("Sprite"), mImpl->coreResourceLoaders.back().get());
 
+        mImpl->coreResourceLoaders.emplace_back(new SpriteAtlasLoader(mImpl->spriteMgr.get(), mImpl->hardwareResourceMgr.get()));
+        registerResourceLoader(Common::CreateStringId("SpriteAtlas"), mImpl->coreResourceLoaders.back().get());
+
         // Initilize the default state
         execute(std::make_shared<CompiledRenderQueue>(this, CompiledRenderQueue::InitDefaultState_tag{}));
     }
@@ -355,6 +365,11 @@ namespace Pisces
         return mImpl->spriteMgr.get();
     }
 
+    PISCES_API TransientBuffer* Context::getTransientBuffer()
+    {
+        return mImpl->transientBuffer.get();
+    }
+
     PISCES_API RenderTargetHandle Context::getMainRenderTarget()
     {
         return mImpl->mainRenderTarget;
@@ -387,6 +402,30 @@ namespace Pisces
         using namespace CompiledRenderQueueImpl;
         CompiledRenderQueueImpl::Impl *queueImpl = queue->impl();
 
+        // Sampler handles which switched sampler objects (setSamplerParams) since the queue was compiled
+        HardwareResourceManagerImpl::Impl *hardwareImpl = mImpl->hardwareResourceMgr->impl();
+        for (SamplerReference &reference : queueImpl->samplerReferences) {
+            const HardwareResourceManagerImpl::SamplerInfo *sampler = hardwareImpl->samplers.find(reference.sampler);
+            if (!sampler || sampler->generation == reference.generation) continue;
+
+            Command &cmd = queueImpl->commands[reference.command];
+            if (cmd.type == Type::BindSampler) {
+                cmd.bindSampler.sampler = sampler->glSampler;
+            }
+            else {
+                assert (cmd.type == Type::BindUniformHandle);
+                const HardwareResourceManagerImpl::TextureInfo *texture = hardwareImpl->textures.find(sampler->texture);
+                if (!texture) continue;
+
+                cmd.bindUniformHandle.handle = hardwareImpl->acquireBindlessHandle(texture->glTexture, sampler->glSampler);
+            }
+            reference.generation = sampler->generation;
+        }
+
+        // Make transient data written since the last execute visible to the gpu
+        mImpl->transientBuffer->flush();
+        mImpl->hardwareResourceMgr->impl()->flushStaticUniforms();
+
         // @todo cache current rendertarget
         RenderTargetInfo *info = mImpl->renderTargets.find(queueImpl->renderTarget);
         if (!info) return;
@@ -408,9 +447,33 @@ namespace Pisces
             case Type::SetBlendFunc:
                 glBlendFunc(cmd.setBlendFunc.sfactor, cmd.setBlendFunc.dfactor);
                 break;
+            case Type::SetBlendEquation:
+                glBlendEquationSeparate(cmd.setBlendEquation.modeRGB, cmd.setBlendEquation.modeAlpha);
+                break;
             case Type::SetDepthMask:
                 glDepthMask(cmd.setDepthMask.mask);
                 break;
+            case Type::SetDepthFunc:
+                glDepthFunc(cmd.setDepthFunc.func);
+                break;
+            case Type::SetCullFace:
+                glCullFace(cmd.setCullFace.mode);
+                break;
+            case Type::SetColorMask:
+                glColorMask(cmd.setColorMask.red, cmd.setColorMask.green, cmd.setColorMask.blue, cmd.setColorMask.alpha);
+                break;
+            case Type::SetStencilFunc:
+                glStencilFuncSeparate(cmd.setStencilFunc.face, cmd.setStencilFunc.func, cmd.setStencilFunc.ref, cmd.setStencilFunc.mask);
+                break;
+            case Type::SetStencilOp:
+                glStencilOpSeparate(cmd.setStencilOp.face, cmd.setStencilOp.sfail, cmd.setStencilOp.dpfail, cmd.setStencilOp.dppass);
+                break;
+            case Type::SetStencilMask:
+                glStencilMaskSeparate(cmd.setStencilMask.face, cmd.setStencilMask.mask);
+                break;
+            case Type::SetPolygonOffset:
+                glPolygonOffset(cmd.setPolygonOffset.factor, cmd.setPolygonOffset.units);
+                break;
             case Type::SetClipRect: {
                 ClipRect rect = cmd.setClipRect.rect;
                 glScissor(rect.x, rect.y, rect.w, rect.h);
@@ -428,9 +491,24 @@ namespace Pisces
             case Type::BindVertexArray:
                 glBindVertexArray(cmd.bindVertexArray.vertexArray);
                 break;
+            case Type::BindVertexBuffer:
+                gl::glBindVertexBuffer(cmd.bindVertexBuffer.binding, cmd.bindVertexBuffer.buffer, cmd.bindVertexBuffer.offset, cmd.bindVertexBuffer.stride);
+                break;
+            case Type::VertexAttribPointer: {
+                const auto &data = cmd.vertexAttribPointer;
+                glBindBuffer(GL_ARRAY_BUFFER, data.buffer);
+                if (data.integer) {
+                    glVertexAttribIPointer(data.index, data.count, data.type, data.stride, reinterpret_cast<void*>(data.offset));
+                }
+                else {
+                    glVertexAttribPointer(data.index, data.count, data.type, data.normalized ? GL_TRUE : GL_FALSE, data.stride, reinterpret_cast<void*>(data.offset));
+                }
+              } break;
+            case Type::BindTexture:
+                GLCompat::BindTexture(cmd.bindTexture.unit, cmd.bindTexture.target, cmd.bindTexture.texture);
+                break;
             case Type::BindSampler:
                 glBindSampler(cmd.bindSampler.unit, cmd.bindSampler.sampler);
-                GLCompat::BindTexture(cmd.bindSampler.unit, cmd.bindSampler.target, cmd.bindSampler.texture);
                 break;
             case Type::Clear:
                 glClear((gl::ClearBufferMask)cmd.clear.mask);
@@ -462,6 +540,9 @@ namespace Pisces
             case Type::BindUniformMat4:
                 glUniformMatrix4fv(cmd.bindUniformMat4.location, 1, GL_FALSE, cmd.bindUniformMat4.matrix.data());
                 break;
+            case Type::BindUniformHandle:
+                gl::glUniformHandleui64ARB(cmd.bindUniformHandle.location, cmd.bindUniformHandle.handle);
+                break;
             case Type::BindImageTexture:
                 gl::glBindImageTexture(cmd.bindImageTexture.unit, cmd.bindImageTexture.texture, cmd.bindImageTexture.level, cmd.bindImageTexture.layered, cmd.bindImageTexture.layer, cmd.bindImageTexture.access, cmd.bindImageTexture.format);
                 break;
@@ -499,6 +580,12 @@ namespace Pisces
         if (glClientWaitSync(mImpl->frameSync[syncNum], GL_SYNC_FLUSH_COMMANDS_BIT, GL_TIMEOUT_IGNORED) != GL_ALREADY_SIGNALED) {
             LOG_WARNING("Gpu had not finnished the frame when we expected it to, consider increasing FRAMES_IN_FLIGHT (currently %i)", FRAMES_IN_FLIGHT);
         }
+        // The sync was inserted at the end of frame currentFrame-FRAMES_IN_FLIGHT (or at init for the first frames)
+        if (mImpl->currentFrame >= FRAMES_IN_FLIGHT) {
+            mImpl->finishedFrames = mImpl->currentFrame - FRAMES_IN_FLIGHT + 1;
+        }
+        mImpl->hardwareResourceMgr->impl()->releaseRetiredObjects(mImpl->finishedFrames);
+
         mImpl->frameSync[syncNum] = GLFrameSync(glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, GL_NONE_BIT));
         
         SDL_GL_SwapWindow(mImpl->window);
@@ -510,6 +597,26 @@ namespace Pisces
         return mImpl->currentFrame;
     }
 
+    PISCES_API FenceHandle Context::insertFence()
+    {
+        // Offset by one so the first frame doesn't give a null handle
+        return FenceHandle(mImpl->currentFrame + 1);
+    }
+
+    PISCES_API bool Context::isFenceSignaled( FenceHandle fence )
+    {
+        if (!fence) return true;
+
+        uint64_t frame = (uint64_t)fence - 1;
+        if (frame < mImpl->finishedFrames) return true;
+        // The frame hasn't been submitted yet
+        if (frame >= mImpl->currentFrame) return false;
+
+        // Poll the sync inserted at the end of the frame, without waiting
+        GLenum result = glClientWaitSync(mImpl->frameSync[frame % FRAMES_IN_FLIGHT], GL_SYNC_FLUSH_COMMANDS_BIT, 0);
+        return result == GL_ALREADY_SIGNALED || result == GL_CONDITION_SATISFIED;
+    }
+
     PISCES_API int Context::displayWidth()
     {
         return mImpl->displaySize.x;
@@ -587,6 +694,9 @@ namespace Pisces
         LOG_INFORMATION("Loading resource pack \"%s\"", name);
 
         std::vector<ResourceInfo> resources;
+
+        // Programs of the pack are compiled in parallel, nothing is drawn before the batch is finished
+        mImpl->pipelineMgr->beginProgramBatch();
         try {
             Common::Archive archive = Common::Archive::OpenArchive(name);
             auto file = archive.openFile("resources.txt");
@@ -649,8 +759,10 @@ namespace Pisces
         }
         catch (const std::exception &e) {
             LOG_ERROR("Failed to load resource pack \"%s\" - caught exception \"%s\"", name, e.what());
+            mImpl->pipelineMgr->finishProgramBatch();
             return ResourcePackHandle{};
         }
+        mImpl->pipelineMgr->finishProgramBatch();
 
         LOG_INFORMATION("Finnished loading resoruce pack \"%s\", %zu resources was loaded", name, resources.size());
         ResourcePackInfo info;
@@ -4,6 +4,7 @@
 #include "internal/Helpers.h"
 #include "internal/BuiltinObjects.h"
 #include "internal/BuiltinTextures.h"
+#include "internal/PixelKernels.h"
 
 #include "Common/HandleVector.h"
 #include "Common/PointerHelpers.h"
@@ -11,7 +12,11 @@
 #include <glbinding/gl33core/gl.h>
 using namespace gl33core;
 
+#include <Remotery.h>
+
 #include <cassert>
+#include <cstring>
+#include <algorithm>
 
 #include "stb_image.h"
 WRAP_HANDLE_FUNC(stbi_image, stbi_uc*, stbi_image_free, nullptr);
@@ -38,6 +43,11 @@ namespace Pisces
         mImpl->maxTextxureUnits = maxTextureUnits;
 
 
+        // All pixel data handed to gl is tightly packed
+        glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+
+        PixelKernels::InitPixelKernels();
+
         loadBuiltinTypes(this);
 
         stbi_set_flip_vertically_on_load(true);
@@ -61,14 +71,13 @@ namespace Pisces
         }
 
         GLTexture texture;
-        glGenTextures(1, &texture.handle);
-        glBindTexture(GL_TEXTURE_2D, texture);
+        GLCompat::CreateTexture(GL_TEXTURE_2D, &texture.handle);
 
         // Set default sampler params
         setRealSamplerParamsTexture(GL_TEXTURE_2D, texture, SamplerParams());
 
         GLenum internalFormat = InternalPixelFormat(format);
-        GLCompat::TexStorage2D(GL_TEXTURE_2D, mipmaps, internalFormat, width, height);
+        GLCompat::TextureStorage(GL_TEXTURE_2D, texture, mipmaps, internalFormat, width, height, 1);
 
         TextureInfo info(std::move(texture), format, flags, TextureType::Texture2D);
             info.size.x = width;
@@ -89,14 +98,13 @@ namespace Pisces
         }
 
         GLTexture texture;
-        glGenTextures(1, &texture.handle);
-        glBindTexture(GL_TEXTURE_CUBE_MAP, texture);
+        GLCompat::CreateTexture(GL_TEXTURE_CUBE_MAP, &texture.handle);
 
         // Set default sampler params
         setRealSamplerParamsTexture(GL_TEXTURE_CUBE_MAP, texture, SamplerParams());
 
         GLenum internalFormat = InternalPixelFormat(format);
-        GLCompat::TexStorageCube(GL_TEXTURE_CUBE_MAP, mipmaps, internalFormat, size);
+        GLCompat::TextureStorage(GL_TEXTURE_CUBE_MAP, texture, mipmaps, internalFormat, size, size, 1);
 
         TextureInfo info(std::move(texture), format, flags, TextureType::Cubemap);
             info.size.x = info.size.y = size;
@@ -109,25 +117,62 @@ namespace Pisces
         return mImpl->textures.create(std::move(info));
     }
 
+    PISCES_API TextureHandle HardwareResourceManager::allocateTexture2DArray( PixelFormat format, TextureFlags flags, int width, int height, int layers, int mipmaps )
+    {
+        if (mipmaps == 0) {
+            mipmaps = MipmapsForSize(width, height);
+        }
+
+        GLTexture texture;
+        GLCompat::CreateTexture(GL_TEXTURE_2D_ARRAY, &texture.handle);
+
+        // Set default sampler params
+        setRealSamplerParamsTexture(GL_TEXTURE_2D_ARRAY, texture, SamplerParams());
+
+        GLenum internalFormat = InternalPixelFormat(format);
+        GLCompat::TextureStorage(GL_TEXTURE_2D_ARRAY, texture, mipmaps, internalFormat, width, height, layers);
+
+        TextureInfo info(std::move(texture), format, flags, TextureType::Texture2DArray);
+            info.size.x = width;
+            info.size.y = height;
+            info.size.z = layers;
+            info.mipmaps = mipmaps;
+            info.expectedMemoryUse = layers * expectedMemoryUseTexture2D(format, width, height, mipmaps);
+
+        mImpl->onTextureAllocation(info.expectedMemoryUse);
+
+
+        return mImpl->textures.create(std::move(info));
+    }
+
     PISCES_API void HardwareResourceManager::freeTexture( TextureHandle texture )
     {
         if (TextureHandleVector::IsHandleFromThis(texture)) {
+            TextureInfo *info = mImpl->textures.find(texture);
+            if (!info) return;
+
+            mImpl->retireBindlessHandles(info->glTexture, 0);
+            mImpl->retired().textures.push_back(std::move(info->glTexture));
+            mImpl->textureNames.erase(info->name, texture);
             mImpl->textures.free(texture);
         }
         if (SamplerHandleVector::IsHandleFromThis(texture)) {
+            SamplerInfo *info = mImpl->samplers.find(texture);
+            if (!info) return;
+
+            mImpl->releaseSamplerObject(info->samplerKey);
+            mImpl->textureNames.erase(info->name, texture);
             mImpl->samplers.free(texture);
         }
     }
 
     PISCES_API BufferHandle HardwareResourceManager::allocateBuffer( BufferType type, BufferUsage usage, BufferFlags flags, size_t size, const void *data )
     {
-        GLBuffer buffer;
-        glGenBuffers(1, &buffer.handle);
-
         GLenum target = BufferTarget(type);
-        glBindBuffer(target, buffer);
 
-        GLCompat::BufferStorage(target, usage, flags, size, data);
+        GLBuffer buffer;
+        GLCompat::CreateBuffer(target, &buffer.handle);
+        GLCompat::NamedBufferStorage(target, buffer, usage, flags, size, data);
 
         BufferInfo info;
             info.glBuffer = std::move(buffer);
@@ -143,41 +188,71 @@ namespace Pisces
 
     PISCES_API void HardwareResourceManager::freeBuffer( BufferHandle buffer )
     {
+        BufferInfo *info = mImpl->buffers.find(buffer);
+        if (!info) return;
+
+        mImpl->retired().buffers.push_back(std::move(info->glBuffer));
         mImpl->buffers.free(buffer);
     }
 
-    template< typename PixelType >
-    void flipTexture( PixelType *pixels, int w, int h )
-    {
-        for (int y=0; y < h/2; ++y) {
-            PixelType *src = pixels + y * w;
-            PixelType *dst = pixels + (h-y-1) * w;
-            std::swap_ranges(src, src+w, dst);
-        }
-    }
-    
-    struct Pixel_R8 {
-        uint8_t r;
-    };
-    struct Pixel_RG8 {
-        uint8_t r, g;
-    };
-    struct Pixel_RGB8 {
-        uint8_t r, g, b;
-    };
-    struct Pixel_RGBA8 {
-        uint8_t r, g, b, a;
-    };
-    
-    void premulAlpha( Pixel_RGBA8 *pixels, int w, int h )
+    // Size of the staging memory used when the pixels needs to be converted before upload.
+    // Larger textures are converted and uploaded in bands, so uploads never allocate.
+    static const size_t TEXTURE_UPLOAD_SCRATCH_SIZE = 256*1024;
+
+    static void uploadConvertedTexture2D( GLenum target, GLuint texture, int mipmap, int layer, int offsetX, int offsetY, int width, int height, 
+                                          TextureUploadFlags flags, PixelFormat srcFormat, PixelFormat dstFormat, const void *data )
     {
-        auto mul = []( uint8_t a, uint8_t b ) -> uint8_t {
-            return (uint8_t) (((unsigned)a * (unsigned)b) >> 8);
-        };
-        for (int i=0; i < (w*h); ++i) {
-            pixels[i].r = mul(pixels[i].r, pixels[i].a);
-            pixels[i].g = mul(pixels[i].g, pixels[i].a);
-            pixels[i].b = mul(pixels[i].b, pixels[i].a);
+        // Only used from the thread owning the gl context
+        alignas(32) static uint8_t scratch[TEXTURE_UPLOAD_SCRATCH_SIZE];
+
+        int srcChannels = ChannelsInFormat(srcFormat),
+            dstChannels = ChannelsInFormat(dstFormat);
+
+        size_t srcRowBytes = (size_t)width * srcChannels;
+        bool flip = all(flags, TextureUploadFlags::FlipVerticaly),
+             premul = all(flags, TextureUploadFlags::PreMultiplyAlpha);
+
+        // Normally a band is a number of full rows, but really wide textures are split horizontally as well
+        int bandWidth = (int)std::min((size_t)width, TEXTURE_UPLOAD_SCRATCH_SIZE / dstChannels);
+        int bandHeight = (int)std::min((size_t)height, TEXTURE_UPLOAD_SCRATCH_SIZE / (bandWidth * dstChannels));
+
+        GLenum symbolicFormat = SymbolicPixelFormat(dstFormat);
+        GLenum pixelType = PixelType(dstFormat);
+
+        for (int x=0; x < width; x += bandWidth) {
+            int w = std::min(bandWidth, width - x);
+            size_t dstRowBytes = (size_t)w * dstChannels;
+
+            for (int y=0; y < height; y += bandHeight) {
+                int h = std::min(bandHeight, height - y);
+
+                // When flipping the destination band [y, y+h) comes from the source rows [height-y-h, height-y) in reverse order
+                int srcY = flip ? height - y - h : y;
+                const uint8_t *src = (const uint8_t*)data + srcY * srcRowBytes + x * srcChannels;
+
+                if (srcChannels == dstChannels) {
+                    if (flip) {
+                        PixelKernels::FlipVerticalCopy(scratch, dstRowBytes, src, srcRowBytes, dstRowBytes, h);
+                    }
+                    else {
+                        for (int row=0; row < h; ++row) {
+                            memcpy(scratch + row * dstRowBytes, src + row * srcRowBytes, dstRowBytes);
+                        }
+                    }
+                }
+                else {
+                    for (int row=0; row < h; ++row) {
+                        int srcRow = flip ? h - row - 1 : row;
+                        PixelKernels::ConvertChannels(scratch + row * dstRowBytes, dstChannels, src + srcRow * srcRowBytes, srcChannels, w);
+                    }
+                }
+
+                if (premul) {
+                    PixelKernels::PremultiplyAlpha(scratch, scratch, (size_t)w * h);
+                }
+
+                GLCompat::TextureSubImage(target, texture, mipmap, offsetX + x, offsetY + y, layer, w, h, symbolicFormat, pixelType, scratch);
+            }
         }
     }
 
@@ -190,57 +265,26 @@ namespace Pisces
             return;
         }
 
-        GLenum symbolicFormat = SymbolicPixelFormat(format);
-        GLenum pixelType = PixelType(format);
-        
-        glBindTexture(GL_TEXTURE_2D, info->glTexture);
-        
-        if (all(flags, TextureUploadFlags::PreMultiplyAlpha) && PixelFormatHasAlpha(format) == false) {
+        rmt_ScopedCPUSampleString("Pisces::HardwareResourceManager::uploadTexture2D", RMTSF_Aggregate);
+
+        if (all(flags, TextureUploadFlags::PreMultiplyAlpha) && (PixelFormatHasAlpha(format) == false || PixelFormatHasAlpha(info->format) == false)) {
             flags = clear(flags, TextureUploadFlags::PreMultiplyAlpha);
             LOG_WARNING("Invalid TextureUploadFlags PreMultiplyAlpha - format don't have a alpha channel");
         }
 
-        if (any(flags, TextureUploadFlags::PreMultiplyAlpha | TextureUploadFlags::FlipVerticaly)) {
-
-            int w = info->size.x,
-                h = info->size.y;
-
-            switch(format) {
-            case PixelFormat::R8: {
-                std::vector<Pixel_R8> tmp((Pixel_R8*)data, ((Pixel_R8*)data) + w*h);
-                flipTexture(tmp.data(), w, h); 
-                glTexSubImage2D(GL_TEXTURE_2D, mipmap, 0, 0, info->size.x, info->size.y, symbolicFormat, pixelType, tmp.data());
-              } break;
-            case PixelFormat::RG8: {
-                std::vector<Pixel_RG8> tmp((Pixel_RG8*)data, ((Pixel_RG8*)data) + w*h);
-                flipTexture(tmp.data(), w, h); 
-                glTexSubImage2D(GL_TEXTURE_2D, mipmap, 0, 0, info->size.x, info->size.y, symbolicFormat, pixelType, tmp.data());
-              } break;
-            case PixelFormat::RGB8: {
-                std::vector<Pixel_RGB8> tmp((Pixel_RGB8*)data, ((Pixel_RGB8*)data) + w*h);
-                flipTexture(tmp.data(), w, h); 
-                glTexSubImage2D(GL_TEXTURE_2D, mipmap, 0, 0, info->size.x, info->size.y, symbolicFormat, pixelType, tmp.data());
-              } break;
-            case PixelFormat::RGBA8: {
-                std::vector<Pixel_RGBA8> tmp((Pixel_RGBA8*)data, ((Pixel_RGBA8*)data) + w*h);
-                if (all(flags, TextureUploadFlags::FlipVerticaly)) {
-                    flipTexture(tmp.data(), w, h);
-                }
-                if (all(flags, TextureUploadFlags::PreMultiplyAlpha)) {
-                    premulAlpha(tmp.data(), w, h);
-                }
-                glTexSubImage2D(GL_TEXTURE_2D, mipmap, 0, 0, info->size.x, info->size.y, symbolicFormat, pixelType, tmp.data());
-              } break;
-            }
+        int w = std::max(1, info->size.x >> mipmap),
+            h = std::max(1, info->size.y >> mipmap);
 
+        if (any(flags, TextureUploadFlags::PreMultiplyAlpha | TextureUploadFlags::FlipVerticaly) || format != info->format) {
+            uploadConvertedTexture2D(GL_TEXTURE_2D, info->glTexture, mipmap, 0, 0, 0, w, h, flags, format, info->format, data);
         }
         else {
-            glTexSubImage2D(GL_TEXTURE_2D, mipmap, 0, 0, info->size.x, info->size.y, symbolicFormat, pixelType, data);
+            GLCompat::TextureSubImage(GL_TEXTURE_2D, info->glTexture, mipmap, 0, 0, 0, w, h, SymbolicPixelFormat(format), PixelType(format), data);
         }
 
         if (all(flags, TextureUploadFlags::GenerateMipmaps)) {
             assert(mipmap == 0);
-            glGenerateMipmap(GL_TEXTURE_2D);
+            GLCompat::GenerateMipmap(GL_TEXTURE_2D, info->glTexture);
         }
     }
 
@@ -257,23 +301,67 @@ namespace Pisces
         GLenum symbolicFormat = SymbolicPixelFormat(format);
         GLenum pixelType = PixelType(format);
 
-        glBindTexture(GL_TEXTURE_CUBE_MAP, info->glTexture);
         GLenum target = CubemapFaceToTarget(face);
-        glTexSubImage2D(target, mipmap, 0, 0, info->size.x, info->size.y, symbolicFormat, pixelType, data);
+        GLCompat::TextureSubImage(target, info->glTexture, mipmap, 0, 0, 0, info->size.x, info->size.y, symbolicFormat, pixelType, data);
 
         if (all(flags, TextureUploadFlags::GenerateMipmaps)) {
             LOG_WARNING("Unsupported to generate mipmaps for cubemaps :/");
         }
     }
 
+    PISCES_API void HardwareResourceManager::uploadTexture2DArray( TextureHandle texture, int mipmap, int layer, int x, int y, int width, int height, 
+                                                                   TextureUploadFlags flags, PixelFormat format, const void *data )
+    {
+        TextureInfo *info = mImpl->textures.find(texture);
+        if (!info) return;
+        if (info->type != TextureType::Texture2DArray) {
+            LOG_WARNING("Wrong texture type %i for uploadTexture2DArray to texture %i", (int)info->type, (int)texture);
+            return;
+        }
+
+        int levelWidth = std::max(1, info->size.x >> mipmap),
+            levelHeight = std::max(1, info->size.y >> mipmap);
+
+        if (layer < 0 || layer >= info->size.z || x < 0 || y < 0 || (x+width) > levelWidth || (y+height) > levelHeight) {
+            LOG_WARNING("Invalid upload region [%i, %i, %i, %i] layer %i for texture %i of size %ix%i with %i layers",
+                        x, y, x+width, y+height, layer, (int)texture, levelWidth, levelHeight, info->size.z);
+            return;
+        }
+
+        rmt_ScopedCPUSampleString("Pisces::HardwareResourceManager::uploadTexture2DArray", RMTSF_Aggregate);
+
+        if (all(flags, TextureUploadFlags::PreMultiplyAlpha) && (PixelFormatHasAlpha(format) == false || PixelFormatHasAlpha(info->format) == false)) {
+            flags = clear(flags, TextureUploadFlags::PreMultiplyAlpha);
+            LOG_WARNING("Invalid TextureUploadFlags PreMultiplyAlpha - format don't have a alpha channel");
+        }
+
+        if (any(flags, TextureUploadFlags::PreMultiplyAlpha | TextureUploadFlags::FlipVerticaly) || format != info->format) {
+            uploadConvertedTexture2D(GL_TEXTURE_2D_ARRAY, info->glTexture, mipmap, layer, x, y, width, height, flags, format, info->format, data);
+        }
+        else {
+            GLCompat::TextureSubImage(GL_TEXTURE_2D_ARRAY, info->glTexture, mipmap, x, y, layer, width, height, SymbolicPixelFormat(format), PixelType(format), data);
+        }
+
+        if (all(flags, TextureUploadFlags::GenerateMipmaps)) {
+            assert(mipmap == 0);
+            GLCompat::GenerateMipmap(GL_TEXTURE_2D_ARRAY, info->glTexture);
+        }
+    }
+
+    PISCES_API void HardwareResourceManager::generateMipmaps( TextureHandle texture )
+    {
+        TextureInfo *info = mImpl->textures.find(texture);
+        if (!info) return;
+
+        GLCompat::GenerateMipmap(TextureTarget(info->type), info->glTexture);
+    }
+
     PISCES_API void HardwareResourceManager::uploadBuffer( BufferHandle buffer, size_t offset, size_t size, const void * data )
     {
         BufferInfo *info = mImpl->buffers.find(buffer);
         if (info == nullptr) return;
 
-        GLenum target = BufferTarget(info->type);
-        glBindBuffer(target, info->glBuffer);
-        glBufferSubData(target, offset, size, data);
+        GLCompat::NamedBufferSubData(BufferTarget(info->type), info->glBuffer, offset, size, data);
     }
 
     PISCES_API void HardwareResourceManager::setSwizzleMask( TextureHandle texture, SwizzleMask red, SwizzleMask green, SwizzleMask blue, SwizzleMask alpha )
@@ -281,21 +369,14 @@ namespace Pisces
         TextureInfo *info = mImpl->textures.find(texture);
         if (!info) return;
 
-        glBindTexture(GL_TEXTURE_2D, info->glTexture);
-
-        GLenum swizzle[4] = {
-            ToGL(red), ToGL(green), ToGL(blue), ToGL(alpha)
+        GLint swizzle[4] = {
+            (GLint)ToGL(red), (GLint)ToGL(green), (GLint)ToGL(blue), (GLint)ToGL(alpha)
         };
-        glTexParameteriv(GL_TEXTURE_2D, GL_TEXTURE_SWIZZLE_RGBA, swizzle);
+        GLCompat::TextureParameteriv(TextureTarget(info->type), info->glTexture, GL_TEXTURE_SWIZZLE_RGBA, swizzle);
     }
 
     PISCES_API TextureHandle HardwareResourceManager::createSampler( TextureHandle texture, const SamplerParams &params )
     {
-        GLSampler sampler;
-        glGenSamplers(1, &sampler.handle);
-
-        setRealSamplerParams(sampler, params);
-
         TextureHandle realTexture;
         if (TextureHandleVector::IsHandleFromThis(texture)) {
             realTexture = texture;
@@ -307,66 +388,77 @@ namespace Pisces
             }
         }
 
-        if (realTexture) {
-            SamplerInfo info;
-                info.glSampler = std::move(sampler);
-                info.texture = texture;
-            return mImpl->samplers.create(std::move(info));
-        }
-        return {};
+        if (!realTexture) return {};
+
+        SamplerInfo info;
+            info.glSampler = mImpl->acquireSamplerObject(params, info.samplerKey);
+            info.texture = realTexture;
+        return mImpl->samplers.create(std::move(info));
     }
 
-    PISCES_API void HardwareResourceManager::setSamplerParams( TextureHandle texture, const SamplerParams &params )
+    PISCES_API bool HardwareResourceManager::setSamplerParams( TextureHandle texture, const SamplerParams &params )
     {
         if (TextureHandleVector::IsHandleFromThis(texture)) {
             TextureInfo *info = mImpl->textures.find(texture);
             
-            if (!info) return;
+            if (!info) return false;
+
+            // A bindless handle makes the texture params immutable
+            if (mImpl->hasBindlessHandle(info->glTexture)) {
+                LOG_ERROR("Can't change sampler params of texture %i after it was used bindless, use createSampler instead", (int)texture);
+                return false;
+            }
 
             GLenum target = TextureTarget(info->type);
-            setRealSamplerParamsTexture(target, texture, params);
+            setRealSamplerParamsTexture(target, info->glTexture, params);
+            return true;
         }
         else if(SamplerHandleVector::IsHandleFromThis(texture)) {
             SamplerInfo *info = mImpl->samplers.find(texture);
 
-            if (!info) return;
+            if (!info) return false;
+
+            if (SamplerParamsKey(params) == info->samplerKey) return true;
 
-            setRealSamplerParams(info->glSampler, params);
+            // Sampler objects are shared, so switch to the one matching params instead of modifying it.
+            // Compiled queues still referencing the old object (or its bindless handle) are patched on execute.
+            uint64_t oldKey = info->samplerKey;
+            info->glSampler = mImpl->acquireSamplerObject(params, info->samplerKey);
+            info->generation++;
+            mImpl->releaseSamplerObject(oldKey);
+            return true;
         }
+        return false;
     }
 
-    PISCES_API VertexArrayHandle HardwareResourceManager::createVertexArray( const VertexAttribute *attributes, int attributeCount, 
-                                                                             const BufferHandle *sourceBuffers, int sourceCount, 
-                                                                             BufferHandle indexBuffer, IndexType indexType,
-                                                                             VertexArrayFlags flags )
+    static GLVertexArray createGLVertexArray( Impl *impl, const VertexAttribute *attributes, int attributeCount, const BufferHandle *sourceBuffers )
     {
-        if (indexType == IndexType::None) indexBuffer = BufferHandle{};
-
         GLVertexArray vertexArray;
-        glGenVertexArrays(1, &vertexArray.handle);
-        glBindVertexArray(vertexArray);
+        GLCompat::CreateVertexArray(&vertexArray.handle);
 
         for (int i=0; i < attributeCount; ++i) {
             const VertexAttribute &attribute = attributes[i];
-            
-            GLenum type = ToGL(attribute.type);
-            GLboolean normalized = IsNormalized(attribute.type);
 
-            BufferInfo *buffer = mImpl->buffers.find(sourceBuffers[attribute.source]);
+            BufferInfo *buffer = impl->buffers.find(sourceBuffers[attribute.source]);
             if (!buffer) continue;
 
-            glBindBuffer(GL_ARRAY_BUFFER, buffer->glBuffer);
-            glEnableVertexAttribArray(i);
-            if (IsIntegear(attribute.type)) {
-                gl::glVertexAttribIPointer(i, attribute.count, type, attribute.stride, reinterpret_cast<void*>((uintptr_t)attribute.offset));
-            }
-            else {
-                glVertexAttribPointer(i, attribute.count, type, normalized, attribute.stride, reinterpret_cast<void*>((uintptr_t)attribute.offset));
-            }
+            GLCompat::VertexArrayAttribute(vertexArray, i, buffer->glBuffer, attribute.count, ToGL(attribute.type), 
+                                           IsNormalized(attribute.type) == GL_TRUE, IsIntegear(attribute.type), 
+                                           attribute.offset, attribute.stride);
         }
 
+        return vertexArray;
+    }
+
+    PISCES_API VertexArrayHandle HardwareResourceManager::createVertexArray( const VertexAttribute *attributes, int attributeCount, 
+                                                                             const BufferHandle *sourceBuffers, int sourceCount, 
+                                                                             BufferHandle indexBuffer, IndexType indexType,
+                                                                             VertexArrayFlags flags )
+    {
+        if (indexType == IndexType::None) indexBuffer = BufferHandle{};
+
         VertexArrayInfo info;
-            info.glVertexArray = std::move(vertexArray);
+            info.glVertexArray = createGLVertexArray(mImpl.impl(), attributes, attributeCount, sourceBuffers);
             info.indexBuffer = indexBuffer;
             info.indexType = indexType;
             info.flags = flags;
@@ -376,14 +468,318 @@ namespace Pisces
 
     PISCES_API void HardwareResourceManager::deleteVertexArray( VertexArrayHandle vertexArray )
     {
+        VertexArrayInfo *info = mImpl->vertexArrays.find(vertexArray);
+        if (!info) return;
+
+        mImpl->retired().vertexArrays.push_back(std::move(info->glVertexArray));
         mImpl->vertexArrays.free(vertexArray);
     }
 
+    PISCES_API BufferAllocationHandle HardwareResourceManager::allocateFromHeap( BufferType type, size_t size, size_t alignment, const void *data )
+    {
+        if (size == 0) return {};
+        if (alignment == 0) alignment = 1;
+
+        // Blocks are aligned to the allocator granularity, other alignments need room to move the start
+        size_t blockSize = size;
+        if (TlsfAllocator::GRANULARITY % alignment != 0) {
+            blockSize += alignment - 1;
+        }
+
+        BufferHeap &heap = mImpl->bufferHeaps[(int)type];
+
+        BufferHeapPage *page = nullptr;
+        size_t blockOffset = 0;
+        uint32_t id = 0;
+        for (auto &candidate : heap.pages) {
+            if (candidate->allocator.allocate(blockSize, blockOffset, id)) {
+                page = candidate.get();
+                break;
+            }
+        }
+
+        if (!page) {
+            size_t pageSize = std::max(BUFFER_HEAP_PAGE_SIZE, (blockSize + TlsfAllocator::GRANULARITY - 1) / TlsfAllocator::GRANULARITY * TlsfAllocator::GRANULARITY);
+            BufferHandle buffer = allocateBuffer(type, BufferUsage::Static, BufferFlags::Upload, pageSize, nullptr);
+            if (!buffer) return {};
+
+            heap.pages.emplace_back(new BufferHeapPage(buffer, pageSize));
+            page = heap.pages.back().get();
+
+            if (!page->allocator.allocate(blockSize, blockOffset, id)) {
+                LOG_ERROR("Failed to allocate %zu bytes from a new heap buffer", size);
+                return {};
+            }
+        }
+
+        BufferHeapAllocationInfo info;
+            info.type = type;
+            info.page = page;
+            info.id = id;
+            info.blockOffset = blockOffset;
+            info.blockSize = blockSize;
+            info.offset = (blockOffset + alignment - 1) / alignment * alignment;
+            info.size = size;
+            info.alignment = alignment;
+
+        if (data) {
+            uploadBuffer(page->buffer, info.offset, size, data);
+        }
+
+        BufferAllocationHandle handle = mImpl->heapAllocations.create(std::move(info));
+        page->allocations.push_back(handle);
+        return handle;
+    }
+
+    PISCES_API void HardwareResourceManager::freeHeapAllocation( BufferAllocationHandle allocation )
+    {
+        BufferHeapAllocationInfo *info = mImpl->heapAllocations.find(allocation);
+        if (!info) return;
+
+        BufferHeapPage *page = info->page;
+        page->allocator.free(info->id);
+
+        auto iter = std::find(page->allocations.begin(), page->allocations.end(), allocation);
+        if (iter != page->allocations.end()) {
+            *iter = page->allocations.back();
+            page->allocations.pop_back();
+        }
+
+        mImpl->heapAllocations.free(allocation);
+    }
+
+    PISCES_API BufferRange HardwareResourceManager::getHeapAllocation( BufferAllocationHandle allocation )
+    {
+        BufferRange range;
+
+        const BufferHeapAllocationInfo *info = mImpl->heapAllocations.find(allocation);
+        if (!info) return range;
+
+        range.buffer = info->page->buffer;
+        range.offset = info->offset;
+        range.size = info->size;
+        return range;
+    }
+
+    static bool SameLayout( const std::vector<VertexAttribute> &layout, const VertexAttribute *attributes, int attributeCount )
+    {
+        if (layout.size() != (size_t)attributeCount) return false;
+
+        for (int i=0; i < attributeCount; ++i) {
+            const VertexAttribute &lhs = layout[i],
+                                  &rhs = attributes[i];
+            if (lhs.type != rhs.type || lhs.offset != rhs.offset || lhs.count != rhs.count || 
+                lhs.stride != rhs.stride || lhs.source != rhs.source) {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    PISCES_API VertexArrayHandle HardwareResourceManager::getHeapVertexArray( const VertexAttribute *attributes, int attributeCount,
+                                                                              BufferAllocationHandle vertexes,
+                                                                              BufferAllocationHandle indexes, IndexType indexType )
+    {
+        BufferRange vertexRange = getHeapAllocation(vertexes),
+                    indexRange = getHeapAllocation(indexes);
+
+        if (!vertexRange.buffer) {
+            LOG_ERROR("Can't create heap vertex array from an invalid allocation");
+            return {};
+        }
+        if (indexType == IndexType::None) indexRange.buffer = BufferHandle{};
+
+        for (int i=0; i < attributeCount; ++i) {
+            if (attributes[i].source != 0) {
+                LOG_ERROR("Heap vertex arrays only support a single vertex source");
+                return {};
+            }
+        }
+
+        for (const auto &vertexArray : mImpl->heapVertexArrays) {
+            if (vertexArray.vertexBuffer == vertexRange.buffer && vertexArray.indexBuffer == indexRange.buffer &&
+                vertexArray.indexType == indexType && SameLayout(vertexArray.layout, attributes, attributeCount)) {
+                return vertexArray.vertexArray;
+            }
+        }
+
+        HeapVertexArrayInfo info;
+            info.layout.assign(attributes, attributes + attributeCount);
+            info.vertexBuffer = vertexRange.buffer;
+            info.indexBuffer = indexRange.buffer;
+            info.indexType = indexType;
+            info.vertexArray = createVertexArray(attributes, attributeCount, &vertexRange.buffer, 1, indexRange.buffer, indexType);
+
+        mImpl->heapVertexArrays.push_back(std::move(info));
+        return mImpl->heapVertexArrays.back().vertexArray;
+    }
+
+    PISCES_API VertexFormatHandle HardwareResourceManager::createVertexFormat( const VertexAttribute *attributes, int attributeCount,
+                                                                               IndexType indexType, VertexArrayFlags flags )
+    {
+        VertexFormatHandle handle = mImpl->vertexFormats.findIf(
+            [&] (const VertexFormatInfo &info) {
+                return info.indexType == indexType && info.flags == flags && SameLayout(info.layout, attributes, attributeCount);
+            }
+        );
+        if (handle) {
+            mImpl->vertexFormats.find(handle)->refCount++;
+            return handle;
+        }
+
+        VertexFormatInfo info;
+            info.layout.assign(attributes, attributes + attributeCount);
+            info.indexType = indexType;
+            info.flags = flags;
+            info.refCount = 1;
+
+        int sourceAttributes[MAX_VERTEX_BUFFERS] = {};
+        for (int i=0; i < attributeCount; ++i) {
+            const VertexAttribute &attribute = attributes[i];
+            if (attribute.source < 0 || attribute.source >= MAX_VERTEX_BUFFERS) {
+                LOG_ERROR("Vertex format source %i is out of range, max is %i", attribute.source, MAX_VERTEX_BUFFERS-1);
+                return {};
+            }
+
+            int stride = attribute.stride != 0 ? attribute.stride : AttributeSize(attribute);
+            if (sourceAttributes[attribute.source]++ > 0 && (attribute.stride == 0 || info.strides[attribute.source] != stride)) {
+                LOG_ERROR("Attributes of vertex format source %i don't share a stride", attribute.source);
+                return {};
+            }
+
+            info.strides[attribute.source] = stride;
+            info.bindingCount = std::max(info.bindingCount, attribute.source+1);
+        }
+
+        GLCompat::CreateVertexArray(&info.glVertexArray.handle);
+        for (int i=0; i < attributeCount; ++i) {
+            const VertexAttribute &attribute = attributes[i];
+
+            GLCompat::VertexArrayAttributeFormat(info.glVertexArray, i, attribute.source, attribute.count, ToGL(attribute.type), 
+                                                 IsNormalized(attribute.type) == GL_TRUE, IsIntegear(attribute.type), 
+                                                 attribute.offset);
+        }
+
+        return mImpl->vertexFormats.create(std::move(info));
+    }
+
+    PISCES_API void HardwareResourceManager::deleteVertexFormat( VertexFormatHandle format )
+    {
+        VertexFormatInfo *info = mImpl->vertexFormats.find(format);
+        if (!info || --info->refCount > 0) return;
+
+        mImpl->retired().vertexArrays.push_back(std::move(info->glVertexArray));
+        mImpl->vertexFormats.free(format);
+    }
+
+    PISCES_API BufferHeapStats HardwareResourceManager::getBufferHeapStats( BufferType type )
+    {
+        BufferHeapStats stats;
+
+        size_t free = 0;
+        for (const auto &page : mImpl->bufferHeaps[(int)type].pages) {
+            const TlsfAllocator &allocator = page->allocator;
+
+            stats.buffers++;
+            stats.allocations += allocator.allocationCount();
+            stats.capacity += allocator.size();
+            stats.used += allocator.usedSize();
+            stats.largestFreeBlock = std::max(stats.largestFreeBlock, allocator.largestFreeBlock());
+            free += allocator.freeSize();
+        }
+
+        if (free > 0) {
+            stats.fragmentation = 1.f - (float)stats.largestFreeBlock / (float)free;
+        }
+        return stats;
+    }
+
+    PISCES_API void HardwareResourceManager::compactBufferHeap( BufferType type )
+    {
+        rmt_ScopedCPUSampleString("Pisces::HardwareResourceManager::compactBufferHeap", RMTSF_None);
+
+        BufferHeap &heap = mImpl->bufferHeaps[(int)type];
+
+        std::vector<BufferHeapAllocationInfo*> allocations;
+        for (size_t i=0; i < heap.pages.size(); ) {
+            BufferHeapPage *page = heap.pages[i].get();
+
+            if (page->allocator.allocationCount() == 0) {
+                // Release the shared vertex arrays using the buffer as well
+                auto &vertexArrays = mImpl->heapVertexArrays;
+                for (size_t j=0; j < vertexArrays.size(); ) {
+                    if (vertexArrays[j].vertexBuffer == page->buffer || vertexArrays[j].indexBuffer == page->buffer) {
+                        deleteVertexArray(vertexArrays[j].vertexArray);
+                        vertexArrays.erase(vertexArrays.begin() + j);
+                    }
+                    else {
+                        ++j;
+                    }
+                }
+
+                freeBuffer(page->buffer);
+                heap.pages.erase(heap.pages.begin() + i);
+                continue;
+            }
+            ++i;
+
+            allocations.clear();
+            for (BufferAllocationHandle handle : page->allocations) {
+                BufferHeapAllocationInfo *info = mImpl->heapAllocations.find(handle);
+                if (info) allocations.push_back(info);
+            }
+            std::sort(allocations.begin(), allocations.end(), []( const BufferHeapAllocationInfo *lhs, const BufferHeapAllocationInfo *rhs ) {
+                return lhs->blockOffset < rhs->blockOffset;
+            });
+
+            BufferInfo *buffer = mImpl->buffers.find(page->buffer);
+            if (!buffer) continue;
+
+            // Copy into a new buffer, source and destination ranges can't overlap within one buffer
+            GLenum target = BufferTarget(buffer->type);
+
+            GLBuffer newBuffer;
+            GLCompat::CreateBuffer(target, &newBuffer.handle);
+            GLCompat::NamedBufferStorage(target, newBuffer, buffer->usage, buffer->flags, buffer->size, nullptr);
+
+            // Allocating in order from an empty allocator packs the blocks from the start
+            page->allocator.reset();
+            for (BufferHeapAllocationInfo *info : allocations) {
+                size_t blockOffset;
+                page->allocator.allocate(info->blockSize, blockOffset, info->id);
+
+                size_t offset = (blockOffset + info->alignment - 1) / info->alignment * info->alignment;
+                GLCompat::CopyNamedBufferSubData(buffer->glBuffer, newBuffer, info->offset, offset, info->size);
+
+                info->blockOffset = blockOffset;
+                info->offset = offset;
+            }
+
+            mImpl->retired().buffers.push_back(std::move(buffer->glBuffer));
+            buffer->glBuffer = std::move(newBuffer);
+
+            // The vertex arrays still reference the old buffer
+            for (auto &vertexArray : mImpl->heapVertexArrays) {
+                if (vertexArray.vertexBuffer != page->buffer) continue;
+
+                VertexArrayInfo *info = mImpl->vertexArrays.find(vertexArray.vertexArray);
+                if (!info) continue;
+
+                mImpl->retired().vertexArrays.push_back(std::move(info->glVertexArray));
+                info->glVertexArray = createGLVertexArray(mImpl.impl(), vertexArray.layout.data(), (int)vertexArray.layout.size(), &vertexArray.vertexBuffer);
+            }
+        }
+    }
+
     PISCES_API TextureHandle HardwareResourceManager::loadTexture2D( PixelFormat format, TextureFlags flags, const char *filename )
     {
         int width, height, channels;
 
         int formatChannels = ChannelsInFormat(format);
+        // Let uploadTexture2D expand RGB to RGBA instead of stb
+        if (formatChannels == 4 && stbi_info(filename, &width, &height, &channels) && channels == 3) {
+            formatChannels = 3;
+        }
         stbi_image image(stbi_load( filename, &width, &height, &channels, formatChannels));
 
         if (!image) {
@@ -467,8 +863,7 @@ namespace Pisces
             assert (info != nullptr);
             assert (info->type == TextureType::Cubemap);
 
-            glBindTexture(GL_TEXTURE_CUBE_MAP, info->glTexture);
-            glGenerateMipmap(GL_TEXTURE_CUBE_MAP);
+            GLCompat::GenerateMipmap(GL_TEXTURE_CUBE_MAP, info->glTexture);
         }
 
         return texture;
@@ -480,33 +875,21 @@ namespace Pisces
             TextureInfo *info = mImpl->textures.find(texture);
             
             if (!info) return;
+            mImpl->textureNames.rename(info->name, name, texture);
             info->name = name;
         }
         else if(SamplerHandleVector::IsHandleFromThis(texture)) {
             SamplerInfo *info = mImpl->samplers.find(texture);
 
             if (!info) return;
+            mImpl->textureNames.rename(info->name, name, texture);
             info->name = name;
         }
     }
 
     PISCES_API TextureHandle HardwareResourceManager::findTextureByName( Common::StringId name )
     {
-        TextureHandle texture = mImpl->samplers.findIf(
-            [name] (const SamplerInfo &info) {
-                return info.name == name;
-            }
-        );
-        if (texture) return texture;
-
-        texture = mImpl->textures.findIf(
-            [name] (const TextureInfo &info) {
-                return info.name == name;
-            }
-        );
-        if (texture) return texture;
-
-        return TextureHandle();
+        return mImpl->textureNames.find(name);
     }
 
     PISCES_API TextureHandle HardwareResourceManager::getBuiltinTexture( BuiltinTexture texture )
@@ -535,7 +918,25 @@ namespace Pisces
         if (!texture) return false;
         if (width) *width = texture->size.x;
         if (height) *height = texture->size.y;
-        if (depth) *depth = 1;
+        if (depth) *depth = texture->type == TextureType::Texture2DArray ? texture->size.z : 1;
+        return true;
+    }
+
+    PISCES_API bool HardwareResourceManager::getTextureType( TextureHandle handle, TextureType *type )
+    {
+        const TextureInfo *texture = nullptr;
+        if (TextureHandleVector::IsHandleFromThis(handle)) {
+            texture = mImpl->textures.find(handle);
+        }
+        else if(SamplerHandleVector::IsHandleFromThis(handle)) {
+            SamplerInfo *sampler = mImpl->samplers.find(handle);
+
+            if (!sampler) return false;
+            texture = mImpl->textures.find(sampler->texture);
+        }
+
+        if (!texture) return false;
+        if (type) *type = texture->type;
         return true;
     }
 
@@ -554,9 +955,7 @@ namespace Pisces
         }
         info->isMapped = true;
 
-        GLenum target = BufferTarget(info->type);
-        glBindBuffer(target, info->glBuffer);
-        return GLCompat::MapBuffer(target, offset, size, flags, info->size, info->persistentMapping);
+        return GLCompat::MapBuffer(BufferTarget(info->type), info->glBuffer, offset, size, flags, info->size, info->persistentMapping);
     }
 
     PISCES_API bool HardwareResourceManager::unmapBuffer( BufferHandle buffer, bool keepPersistent )
@@ -570,43 +969,85 @@ namespace Pisces
         }
         info->isMapped = false;
 
-        GLenum target = BufferTarget(info->type);
-        glBindBuffer(target, info->glBuffer);
-        return GLCompat::UnMapBuffer(target, keepPersistent, info->persistentMapping);
+        return GLCompat::UnMapBuffer(BufferTarget(info->type), info->glBuffer, keepPersistent, info->persistentMapping);
+    }
+
+    PISCES_API void HardwareResourceManager::markBufferWritten( BufferHandle buffer, size_t offset, size_t size )
+    {
+        BufferInfo *info = mImpl->buffers.find(buffer);
+        if (info == nullptr) return;
+
+        if ((offset+size) > info->size) {
+            LOG_WARNING("Invalid written interval [%zd, %zd] the buffer (%i) has a size of %zd", offset, offset+size, (int)buffer, info->size);
+            return;
+        }
+        if (!info->isMapped && info->persistentMapping.data == nullptr) {
+            LOG_ERROR("Buffer (%i) is not mapped!", (int)buffer);
+            return;
+        }
+
+        GLCompat::MarkDirtyRange(info->persistentMapping.dirtyRanges, offset, size);
+    }
+
+    PISCES_API void HardwareResourceManager::flushBuffer( BufferHandle buffer )
+    {
+        BufferInfo *info = mImpl->buffers.find(buffer);
+        if (info == nullptr) return;
+
+        if (info->persistentMapping.data == nullptr) {
+            LOG_ERROR("Buffer (%i) is not persistently mapped!", (int)buffer);
+            return;
+        }
+        if (info->persistentMapping.dirtyRanges.empty()) return;
+
+        GLCompat::FlushDirtyRanges(BufferTarget(info->type), info->glBuffer, info->persistentMapping);
     }
 
     PISCES_API UniformBufferHandle HardwareResourceManager::allocateStaticUniform( size_t size, const void *data )
     {
+        StaticUniformHeap &heap = mImpl->staticUniforms;
+
+        const size_t unit = TlsfAllocator::GRANULARITY;
         size_t alignment = mImpl->uniformBlockAllignment;
         // Adjust size to the next multiple of aligment
         size_t alignedSize = ((size+alignment-1) / alignment) * alignment;
 
-        size_t requiredSize = mImpl->staticUniforms.nextOffset+alignedSize;
+        size_t unitOffset;
+        uint32_t id;
+        if (!heap.allocator.allocate(alignedSize/alignment*unit, unitOffset, id)) {
+            size_t newSize = std::max( (size_t)MIN_UNIFORM_BLOCK_BUFFER_SIZE, 2*(heap.size+alignedSize));
+            newSize = (newSize+alignment-1) / alignment * alignment;
 
-        if (mImpl->staticUniforms.size < requiredSize) {
-            size_t newSize = std::max( (size_t)MIN_UNIFORM_BLOCK_BUFFER_SIZE, 2*requiredSize);
-
-            if (mImpl->staticUniforms.buffer) {
-                resizeBuffer(mImpl->staticUniforms.buffer, newSize, BufferResizeFlags::KeepRange, 0, mImpl->staticUniforms.nextOffset);
+            if (heap.buffer) {
+                // Pending updates are uploaded from the shadow, so only the gpu side has to be copied
+                resizeBuffer(heap.buffer, newSize, BufferResizeFlags::KeepRange, 0, 0, heap.size);
             }
             else {
-                mImpl->staticUniforms.buffer = allocateBuffer(BufferType::Uniform, BufferUsage::Static, BufferFlags::Upload, newSize, nullptr);;
+                heap.buffer = allocateBuffer(BufferType::Uniform, BufferUsage::Static, BufferFlags::Upload, newSize, nullptr);
+            }
+
+            if (!heap.buffer) {   
+                return UniformBufferHandle();
             }
+            heap.size = newSize;
+            heap.shadow.resize(newSize);
+            heap.allocator.grow(newSize/alignment*unit);
 
-            if (!mImpl->staticUniforms.buffer) {   
+            if (!heap.allocator.allocate(alignedSize/alignment*unit, unitOffset, id)) {
+                LOG_ERROR("Failed to allocate static uniform of %zu bytes", size);
                 return UniformBufferHandle();
             }
-            mImpl->staticUniforms.size = newSize;
         }
 
         UniformBufferHandle handle;
-            handle.buffer = mImpl->staticUniforms.buffer;
-            handle.offset = mImpl->staticUniforms.nextOffset;
+            handle.buffer = heap.buffer;
+            handle.offset = unitOffset/unit*alignment;
             handle.size = size;
 
-        mImpl->staticUniforms.nextOffset += alignedSize;
+        heap.allocations[handle.offset] = {id, size};
 
-        uploadBuffer(handle.buffer, handle.offset, size, data);
+        memcpy(heap.shadow.data() + handle.offset, data, size);
+        GLCompat::MarkDirtyRange(heap.dirtyRanges, handle.offset, size);
         return handle;
     }
 
@@ -614,17 +1055,38 @@ namespace Pisces
     {
         if (!uniform) return;
 
-        if (uniform.buffer != mImpl->staticUniforms.buffer) {
+        StaticUniformHeap &heap = mImpl->staticUniforms;
+
+        auto allocation = heap.allocations.find(uniform.offset);
+        if (uniform.buffer != heap.buffer || allocation == heap.allocations.end()) {
             LOG_WARNING("Trying to update uniform that wasn't created by allocateStaticUniform!");
             return;
         }
 
-        if (uniform.size != size) {
-            LOG_WARNING("Trying to update uniform that was created with a different size (original: %zu, updated: %zu)", uniform.size, size);
+        if (allocation->second.size != size) {
+            LOG_WARNING("Trying to update uniform that was created with a different size (original: %zu, updated: %zu)", allocation->second.size, size);
+            return;
+        }
+
+        // Uploaded by the next Context::execute, together with all other updates
+        memcpy(heap.shadow.data() + uniform.offset, data, size);
+        GLCompat::MarkDirtyRange(heap.dirtyRanges, uniform.offset, size);
+    }
+
+    PISCES_API void HardwareResourceManager::freeStaticUniform( UniformBufferHandle uniform )
+    {
+        if (!uniform) return;
+
+        StaticUniformHeap &heap = mImpl->staticUniforms;
+
+        auto allocation = heap.allocations.find(uniform.offset);
+        if (uniform.buffer != heap.buffer || allocation == heap.allocations.end()) {
+            LOG_WARNING("Trying to free uniform that wasn't created by allocateStaticUniform!");
             return;
         }
 
-        uploadBuffer(uniform.buffer, uniform.offset, size, data);
+        heap.allocator.free(allocation->second.id);
+        heap.allocations.erase(allocation);
     }
 
     PISCES_API void HardwareResourceManager::copyBuffer( BufferHandle target, size_t targetOffset, BufferHandle source, size_t sourceOffset, size_t size )
@@ -634,10 +1096,7 @@ namespace Pisces
 
         if (!(tgt && src)) return;
 
-        glBindBuffer(GL_COPY_READ_BUFFER, src->glBuffer);
-        glBindBuffer(GL_COPY_WRITE_BUFFER, tgt->glBuffer);
-
-        glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, sourceOffset, targetOffset, size);
+        GLCompat::CopyNamedBufferSubData(src->glBuffer, tgt->glBuffer, sourceOffset, targetOffset, size);
     }
 
     PISCES_API size_t HardwareResourceManager::getUniformAlignment()
@@ -655,27 +1114,22 @@ namespace Pisces
             LOG_ERROR("Can't resize buffer (%i) that is mapped!", (int)buffer);
         }
 
-        GLBuffer newBuffer;
-        glGenBuffers(1, &newBuffer.handle);
-        
         GLenum target = BufferTarget(info->type);
-        glBindBuffer(target, newBuffer);
-        GLCompat::BufferStorage(target, info->usage, info->flags, newSize, nullptr);
+
+        GLBuffer newBuffer;
+        GLCompat::CreateBuffer(target, &newBuffer.handle);
+        GLCompat::NamedBufferStorage(target, newBuffer, info->usage, info->flags, newSize, nullptr);
         
         if (info->persistentMapping.data != nullptr) {
             // unmap persistent mapping
-
-            glBindBuffer(target, info->glBuffer);
-            GLCompat::UnMapBuffer(target, false, info->persistentMapping);
+            GLCompat::UnMapBuffer(target, info->glBuffer, false, info->persistentMapping);
         }
 
         if (all(flags, BufferResizeFlags::KeepRange)) {
-            glBindBuffer(GL_COPY_WRITE_BUFFER, newBuffer);
-            glBindBuffer(GL_COPY_READ_BUFFER, info->glBuffer);
-
-            glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, sourceOffset, targetOffset, size);
+            GLCompat::CopyNamedBufferSubData(info->glBuffer, newBuffer, sourceOffset, targetOffset, size);
         }
 
+        mImpl->retired().buffers.push_back(std::move(info->glBuffer));
         info->glBuffer = std::move(newBuffer);
         info->size = newSize;
     }
@@ -692,9 +1146,7 @@ namespace Pisces
         }
 
         
-        GLenum target = BufferTarget(info->type);
-        glBindBuffer(target, info->glBuffer);
-        glGetBufferSubData(target, offset, size, data);
+        GLCompat::GetNamedBufferSubData(BufferTarget(info->type), info->glBuffer, offset, size, data);
     }
 
     void loadBuiltinTypes( HardwareResourceManager *hardwareMgr )
@@ -12,6 +12,7 @@
 #include "Common/FromString.h"
 
 #include <cassert>
+#include <cstring>
 #include <vector>
 
 namespace Pisces
@@ -31,6 +32,31 @@ namespace Pisces
     {
     }
 
+    // "none" or any combination of the channels r, g, b & a, e.g. "rgb"
+    static bool ParseColorWriteMask( const char *str, ColorWriteMask &mask )
+    {
+        if (strcmp(str, "none") == 0) {
+            mask = ColorWriteMask::None;
+            return true;
+        }
+
+        ColorWriteMask result = ColorWriteMask::None;
+        for (const char *c = str; *c; ++c) {
+            switch (*c) {
+            case 'r': result = set(result, ColorWriteMask::Red); break;
+            case 'g': result = set(result, ColorWriteMask::Green); break;
+            case 'b': result = set(result, ColorWriteMask::Blue); break;
+            case 'a': result = set(result, ColorWriteMask::Alpha); break;
+            default:
+                return false;
+            }
+        }
+        if (result == ColorWriteMask::None) return false;
+
+        mask = result;
+        return true;
+    }
+
     PISCES_API ResourceHandle PipelineLoader::loadResource( Common::Archive &archive, libyaml::Node node )
     {
         using Common::FromString;
@@ -71,14 +97,61 @@ namespace Pisces
 
             bool depthWrite = false,
                  depthTest = false,
-                 faceCulling = false;
+                 faceCulling = false,
+                 stencilTest = false;
             GET_VALUE("bool", depthWrite, node, "DepthWrite");
             GET_VALUE("bool", depthTest, node, "DepthTest");
             GET_VALUE("bool", faceCulling, node, "FaceCulling");
+            GET_VALUE("bool", stencilTest, node, "StencilTest");
 
             if (depthWrite) params.flags = set(params.flags, PipelineFlags::DepthWrite);
             if (depthTest) params.flags = set(params.flags, PipelineFlags::DepthTest);
             if (faceCulling) params.flags = set(params.flags, PipelineFlags::FaceCulling);
+            if (stencilTest) params.flags = set(params.flags, PipelineFlags::StencilTest);
+
+            GET_VALUE("CompareFunc", params.state.depthFunc, node, "DepthFunc");
+            GET_VALUE("CullMode", params.state.cullMode, node, "CullMode");
+            GET_VALUE("BlendEquation", params.state.colorBlendEquation, node, "ColorBlendEquation");
+            GET_VALUE("BlendEquation", params.state.alphaBlendEquation, node, "AlphaBlendEquation");
+            GET_VALUE("float", params.state.polygonOffsetFactor, node, "PolygonOffsetFactor");
+            GET_VALUE("float", params.state.polygonOffsetUnits, node, "PolygonOffsetUnits");
+
+            auto colorWriteMaskNode = node["ColorWriteMask"];
+            if (colorWriteMaskNode) {
+                if (!colorWriteMaskNode.isScalar() || !ParseColorWriteMask(colorWriteMaskNode.scalar(), params.state.colorWriteMask)) {
+                    auto mark = colorWriteMaskNode.startMark();
+                    THROW(std::runtime_error, 
+                          "Expected \"ColorWriteMask\" (none or any of r, g, b & a) in \"%s::%s\" at %i:%i",
+                          archive.name(), node.filename(), mark.line, mark.col
+                    );
+                }
+            }
+
+            // Stencil sets both faces, StencilFront & StencilBack override one of them
+            auto readStencilFace = [&]( const char *attribute, StencilFaceState &face ) {
+                auto faceNode = node[attribute];
+                if (!faceNode) return;
+                if (!faceNode.isMap()) {
+                    auto mark = faceNode.startMark();
+                    THROW(std::runtime_error, 
+                          "Expected a map for \"%s\" in \"%s::%s\" at %i:%i",
+                          attribute, archive.name(), node.filename(), mark.line, mark.col
+                    );
+                }
+
+                GET_VALUE("CompareFunc", face.func, faceNode, "Func");
+                GET_VALUE("StencilOp", face.fail, faceNode, "Fail");
+                GET_VALUE("StencilOp", face.depthFail, faceNode, "DepthFail");
+                GET_VALUE("StencilOp", face.pass, faceNode, "Pass");
+            };
+            readStencilFace("Stencil", params.state.stencilFront);
+            params.state.stencilBack = params.state.stencilFront;
+            readStencilFace("StencilFront", params.state.stencilFront);
+            readStencilFace("StencilBack", params.state.stencilBack);
+
+            GET_VALUE("int", params.state.stencilReference, node, "StencilReference");
+            GET_VALUE("uint32_t", params.state.stencilReadMask, node, "StencilReadMask");
+            GET_VALUE("uint32_t", params.state.stencilWriteMask, node, "StencilWriteMask");
 
 
             auto programNode = node["Program"];
@@ -15,7 +15,10 @@
 #include <glbinding/gl33core/gl.h>
 using namespace gl33core;
 
+#include <cassert>
+#include <chrono>
 #include <stdexcept>
+#include <thread>
 
 namespace Pisces
 {
@@ -31,53 +34,174 @@ namespace Pisces
         else {
             LOG_WARNING("GL doesn't support compute shaders!");
         }
+
+        // The state the command queue compiler assumes at the start and end of every queue
+        PipelineFlags defaultFlags = PipelineFlags::DepthTest|PipelineFlags::DepthWrite|PipelineFlags::FaceCulling;
+        uint32_t defaultState = FindOrAddRenderState(mImpl.impl(), ResolveRenderState(defaultFlags, BlendMode::Replace, PipelineState()));
+        assert(defaultState == DEFAULT_RENDER_STATE);
+
+        mImpl->supportsParallelCompile = glbinding::ContextInfo::supported({GLextension::GL_KHR_parallel_shader_compile});
+        if (mImpl->supportsParallelCompile) {
+            // Let the driver pick the thread count
+            gl::glMaxShaderCompilerThreadsKHR(0xFFFFFFFF);
+            LOG_INFORMATION("GL supports parallel shader compilation");
+        }
+
+        mImpl->driverId = std::string((const char*)glGetString(GL_VENDOR)) + "|" + 
+                          (const char*)glGetString(GL_RENDERER) + "|" + 
+                          (const char*)glGetString(GL_VERSION);
     }
 
     PISCES_API PipelineManager::~PipelineManager()
     {}
+
+    PISCES_API void PipelineManager::setProgramCacheDirectory( const char *directory )
+    {
+        mImpl->programCacheDirectory.clear();
+        if (directory == nullptr || directory[0] == '\0') return;
+
+        GLint formats = 0;
+        if (glbinding::ContextInfo::supported({GLextension::GL_ARB_get_program_binary})) {
+            glGetIntegerv(gl::GL_NUM_PROGRAM_BINARY_FORMATS, &formats);
+        }
+        if (formats == 0) {
+            LOG_WARNING("GL doesn't support program binaries, not caching programs in \"%s\"", directory);
+            return;
+        }
+
+        mImpl->programCacheDirectory = directory;
+    }
   
+    PISCES_API void PipelineManager::beginProgramBatch()
+    {
+        mImpl->batchPrograms = true;
+    }
+
+    PISCES_API void PipelineManager::finishProgramBatch()
+    {
+        mImpl->batchPrograms = false;
+
+        auto &pending = mImpl->pendingPrograms;
+        while (!pending.empty()) {
+            bool finished = false;
+            for (size_t i=0; i < pending.size(); ) {
+                if (!IsProgramBuildDone(mImpl.impl(), pending[i]->build)) {
+                    ++i;
+                    continue;
+                }
+
+                FinishPendingProgram(mImpl.impl(), *pending[i]);
+                std::swap(pending[i], pending.back());
+                pending.pop_back();
+                finished = true;
+            }
+
+            if (!finished) {
+                std::this_thread::sleep_for(std::chrono::milliseconds(1));
+            }
+        }
+    }
+
     PISCES_API ProgramHandle PipelineManager::createRenderProgram( const RenderProgramInitParams &params )
     {
         try {
-            int count = 0;
-            GLShader shaders[3];
-            
+            // The sources are needed for the cache key, so files are read before compiling
+            std::string vertexSource, fragmentSource, geometrySource;
             if (params.sourceIsFilename) {
-                shaders[0] = LoadShader(GL_VERTEX_SHADER, params.vertexSource.c_str());
-                shaders[1] = LoadShader(GL_FRAGMENT_SHADER, params.fragmentSource.c_str());
-                count = 2;
+                vertexSource = LoadShaderSource(params.vertexSource.c_str());
+                fragmentSource = LoadShaderSource(params.fragmentSource.c_str());
                 if (!params.geometrySource.empty()) {
-                    shaders[count] = LoadShader(GL_GEOMETRY_SHADER, params.geometrySource.c_str());
-                    count++;
+                    geometrySource = LoadShaderSource(params.geometrySource.c_str());
                 }
             }
             else {
-                const char *fragmentSource = params.fragmentSource.c_str();
-                GLint fragmentSourceLen = (GLint) params.fragmentSource.length();
-                shaders[0] = CreateShader(GL_FRAGMENT_SHADER, 1, &fragmentSource, &fragmentSourceLen);
-        
-                const char *vertexSource = params.vertexSource.c_str();
-                GLint vertexSourceLen = (GLint) params.vertexSource.size();
-                shaders[1] = CreateShader(GL_VERTEX_SHADER, 1, &vertexSource, &vertexSourceLen);
+                vertexSource = params.vertexSource;
+                fragmentSource = params.fragmentSource;
+                geometrySource = params.geometrySource;
+            }
 
-                count = 2;
-                if (!params.geometrySource.empty()) {
-                    const char *source = params.geometrySource.c_str();
-                    GLint sourceLen  = (GLint)params.geometrySource.size();
-                    shaders[count] = CreateShader(GL_GEOMETRY_SHADER, 1, &source, &sourceLen);
-                    ++count;
+            if (!params.variants.empty()) {
+                if (params.variants.size() > 32) {
+                    THROW(std::runtime_error, "At most 32 variants are supported, got %zu", params.variants.size());
+                }
+
+                // Replacing the variants of an existing program, the old variant 0 belongs to whoever created it
+                auto existing = mImpl->renderVariants.find(params.name);
+                if (existing != mImpl->renderVariants.end()) {
+                    std::vector<ProgramHandle> oldPrograms;
+                    for (const auto &program : existing->second.programs) {
+                        if (program.first != 0) oldPrograms.push_back(program.second);
+                    }
+                    mImpl->renderVariants.erase(existing);
+                    for (ProgramHandle program : oldPrograms) {
+                        destroyProgram(program);
+                    }
                 }
-                
+
+                ProgramVariants variants;
+                    variants.params = params;
+                    variants.params.sourceIsFilename = false;
+                    variants.params.vertexSource = vertexSource;
+                    variants.params.fragmentSource = fragmentSource;
+                    variants.params.geometrySource = geometrySource;
+                mImpl->renderVariants[params.name] = std::move(variants);
+
+                // Variant 0 has only the base defines and the name of the program
+                return findRenderprogram(params.name, 0);
+            }
+
+            vertexSource = SpecializeSource(vertexSource, params.defines);
+            fragmentSource = SpecializeSource(fragmentSource, params.defines);
+            if (!geometrySource.empty()) {
+                geometrySource = SpecializeSource(geometrySource, params.defines);
+            }
+
+            bool useCache = !mImpl->programCacheDirectory.empty();
+            uint64_t key = 0;
+            if (useCache) {
+                ProgramHash hash;
+                    hash.add(mImpl->driverId);
+                    hash.add("render");
+                    hash.add(vertexSource);
+                    hash.add(fragmentSource);
+                    hash.add(geometrySource);
+                    hash.add(params.bindings);
+                key = hash.value;
             }
 
+            ProgramBuild build;
+            bool cached = useCache && LoadProgramBinary(mImpl.impl(), key, build.program);
+            if (!cached) {
+                build.cacheKey = key;
+                SubmitShader(build, GL_FRAGMENT_SHADER, fragmentSource);
+                SubmitShader(build, GL_VERTEX_SHADER, vertexSource);
+                if (!geometrySource.empty()) {
+                    SubmitShader(build, GL_GEOMETRY_SHADER, geometrySource);
+                }
+                SubmitLink(build, nullptr, 0, useCache);
+            }
+            bool pending = !cached && mImpl->batchPrograms;
+
             RenderProgramInfo info;
                 info.name = params.name;
-                info.glProgram =  CreateProgram(count, shaders);
                 info.flags = params.flags;
 
-            OnProgramCreated(&info, params.bindings);
+            if (!pending) {
+                if (!cached) FinishProgramBuild(mImpl.impl(), build);
+                info.glProgram = std::move(build.program);
+                OnProgramCreated(&info, params.bindings);
+            }
 
-            return mImpl->renderPrograms.create(std::move(info));
+            ProgramHandle handle = mImpl->renderPrograms.create(std::move(info));
+            mImpl->renderProgramNames.insert(params.name, handle);
+            if (pending) {
+                mImpl->pendingPrograms.emplace_back(new PendingProgram());
+                PendingProgram &program = *mImpl->pendingPrograms.back();
+                    program.build = std::move(build);
+                    program.bindings = params.bindings;
+                    program.render = handle;
+            }
+            return handle;
         } catch (const std::exception &e) {
             LOG_ERROR("Failed to create render program - error: %s", e.what());
             return ProgramHandle();
@@ -86,16 +210,72 @@ namespace Pisces
 
     PISCES_API void PipelineManager::destroyProgram( ProgramHandle handle )
     {
+        const RenderProgramInfo *info = mImpl->renderPrograms.find(handle);
+        if (!info) return;
+
+        // Variant 0 is the program handed out by createRenderProgram, the other variants & the sources go with it
+        std::vector<ProgramHandle> variantPrograms;
+        auto variants = mImpl->renderVariants.find(info->name);
+        if (variants != mImpl->renderVariants.end()) {
+            auto base = variants->second.programs.find(0);
+            if (base != variants->second.programs.end() && base->second == handle) {
+                for (const auto &program : variants->second.programs) {
+                    if (program.second != handle) variantPrograms.push_back(program.second);
+                }
+                mImpl->renderVariants.erase(variants);
+            }
+        }
+
+        mImpl->renderProgramNames.erase(info->name, handle);
         mImpl->renderPrograms.free(handle);
+
+        for (ProgramHandle program : variantPrograms) {
+            destroyProgram(program);
+        }
     }
 
     PISCES_API ProgramHandle PipelineManager::findRenderprogram(Common::StringId name)
     {
-        return mImpl->renderPrograms.findIf(
-            [&]( const RenderProgramInfo &info ) {
-                return info.name == name;
+        return mImpl->renderProgramNames.find(name);
+    }
+
+    PISCES_API ProgramHandle PipelineManager::findRenderprogram( Common::StringId name, uint32_t variantKey )
+    {
+        auto iter = mImpl->renderVariants.find(name);
+        if (iter == mImpl->renderVariants.end()) {
+            LOG_WARNING("Render program \"%s\" has no variants", Common::GetCString(name));
+            return ProgramHandle();
+        }
+
+        ProgramVariants &variants = iter->second;
+        size_t variantCount = variants.params.variants.size();
+        if (variantCount < 32 && (variantKey >> variantCount) != 0) {
+            LOG_WARNING("Invalid variant key 0x%x for render program \"%s\", it has %zu variants", variantKey, Common::GetCString(name), variantCount);
+            return ProgramHandle();
+        }
+
+        auto program = variants.programs.find(variantKey);
+        if (program != variants.programs.end() && mImpl->renderPrograms.find(program->second)) {
+            return program->second;
+        }
+
+        RenderProgramInitParams params = variants.params;
+            params.variants.clear();
+        for (size_t i=0; i < variantCount; ++i) {
+            if (variantKey & (1u << i)) {
+                params.defines.emplace_back(variants.params.variants[i], "1");
             }
-        );
+        }
+        if (variantKey != 0) {
+            params.name = Common::CreateStringId((std::string(Common::GetCString(name)) + "#" + std::to_string(variantKey)).c_str());
+        }
+
+        // Only compiled on the first use, the binary cache keys on the specialized sources
+        ProgramHandle handle = createRenderProgram(params);
+        if (handle) {
+            variants.programs[variantKey] = handle;
+        }
+        return handle;
     }
 
     PISCES_API bool PipelineManager::supportsComputePrograms()
@@ -111,20 +291,46 @@ namespace Pisces
         }
 
         try {
-            const char *source = params.source.c_str();
-            GLint sourceLen = (GLint) params.source.size();
+            bool useCache = !mImpl->programCacheDirectory.empty();
+            uint64_t key = 0;
+            if (useCache) {
+                ProgramHash hash;
+                    hash.add(mImpl->driverId);
+                    hash.add("compute");
+                    hash.add(params.source);
+                    hash.add(params.bindings);
+                key = hash.value;
+            }
 
-            GLShader shader = CreateShader(gl::GL_COMPUTE_SHADER, 1, &source, &sourceLen);
-            GLProgram program = CreateProgram(1, &shader);
+            ProgramBuild build;
+            bool cached = useCache && LoadProgramBinary(mImpl.impl(), key, build.program);
+            if (!cached) {
+                build.cacheKey = key;
+                SubmitShader(build, gl::GL_COMPUTE_SHADER, params.source);
+                SubmitLink(build, nullptr, 0, useCache);
+            }
+            bool pending = !cached && mImpl->batchPrograms;
 
             ComputeProgramInfo info;
                 info.name = params.name;
-                info.glProgram = std::move(program);
                 info.flags = params.flags;
 
-            OnProgramCreated(&info, params.bindings);
-            
-            return mImpl->computePrograms.create(std::move(info));
+            if (!pending) {
+                if (!cached) FinishProgramBuild(mImpl.impl(), build);
+                info.glProgram = std::move(build.program);
+                OnProgramCreated(&info, params.bindings);
+            }
+
+            ComputeProgramHandle handle = mImpl->computePrograms.create(std::move(info));
+            mImpl->computeProgramNames.insert(params.name, handle);
+            if (pending) {
+                mImpl->pendingPrograms.emplace_back(new PendingProgram());
+                PendingProgram &program = *mImpl->pendingPrograms.back();
+                    program.build = std::move(build);
+                    program.bindings = params.bindings;
+                    program.compute = handle;
+            }
+            return handle;
         } catch (const std::exception &e) {
             LOG_ERROR("Failed to create compute program - error: %s", e.what());
             return ComputeProgramHandle();
@@ -133,16 +339,16 @@ namespace Pisces
 
     PISCES_API void PipelineManager::destroyProgram( ComputeProgramHandle handle )
     {
+        const ComputeProgramInfo *info = mImpl->computePrograms.find(handle);
+        if (!info) return;
+
+        mImpl->computeProgramNames.erase(info->name, handle);
         mImpl->computePrograms.free(handle);
     }
 
     PISCES_API ComputeProgramHandle PipelineManager::findComputeProgram(Common::StringId name)
     {
-        return mImpl->computePrograms.findIf(
-            [&]( const ComputeProgramInfo &info ) {
-                return info.name == name;
-            }
-        );
+        return mImpl->computeProgramNames.find(name);
     }
     
     PISCES_API TransformProgramHandle PipelineManager::createTransformProgram( const TransformProgramInitParams &params )
@@ -154,55 +360,57 @@ namespace Pisces
                       (int)params.captureCount, (int)MAX_TRANFORM_FEEDBACK_CAPTURE_VARIABLES
                 );
             }
-            const char *source = params.source.c_str();
-            GLint sourceLen = (GLint) params.source.size();
-
-            GLShader vertexShader = CreateShader(GL_VERTEX_SHADER, 1, &source, &sourceLen);
-            GLProgram program(glCreateProgram());
-
-            glAttachShader(program, vertexShader);
-
             const char *variables[MAX_TRANFORM_FEEDBACK_CAPTURE_VARIABLES];
             for (int i=0; i < params.captureCount; ++i) {
                 variables[i] = params.capture[i].name.c_str();
             }
-            glTransformFeedbackVaryings(program, (GLsizei)params.captureCount, variables, GL_INTERLEAVED_ATTRIBS);
-
-            LinkProgram(program);
-
-            for (int i=0; i < params.captureCount; ++i) {
-                GLint index = gl::glGetProgramResourceIndex(program, gl::GL_TRANSFORM_FEEDBACK_VARYING, variables[i]);
-                if (index == GL_INVALID_INDEX) {
-                    LOG_ERROR("Capture variable \"%s\" is not active!", variables[i]);
-                    continue;
-                }
 
-                GLsizei size = 1;
-                GLenum type;
-                glGetTransformFeedbackVarying(program, index, 0, nullptr, &size, &type, nullptr);
-
-                if (size != 1) {
-                    LOG_ERROR("Arrays are currently not supported for capture variables!");
+            bool useCache = !mImpl->programCacheDirectory.empty();
+            uint64_t key = 0;
+            if (useCache) {
+                ProgramHash hash;
+                    hash.add(mImpl->driverId);
+                    hash.add("transform");
+                    hash.add(params.source);
+                    hash.add(params.bindings);
+                for (int i=0; i < params.captureCount; ++i) {
+                    hash.add(params.capture[i].name);
+                    hash.add(&params.capture[i].type, sizeof(params.capture[i].type));
                 }
+                key = hash.value;
+            }
 
-                TransformCaptureType captureType = ToTransformCaptureType(type);
-                if (captureType != params.capture[i].type) {
-                    LOG_ERROR("Capture variable \"%s\" type missmatch, expected \"%s\" got \"%s\"", 
-                                variables[i], 
-                                TransformCaptureTypeToString(params.capture[i].type),
-                                TransformCaptureTypeToString(captureType)
-                    );
-                }
+            ProgramBuild build;
+            bool cached = useCache && LoadProgramBinary(mImpl.impl(), key, build.program);
+            if (!cached) {
+                build.cacheKey = key;
+                SubmitShader(build, GL_VERTEX_SHADER, params.source);
+                SubmitLink(build, variables, (int)params.captureCount, useCache);
             }
+            bool pending = !cached && mImpl->batchPrograms;
 
             TransformProgramInfo info;
-            info.name = params.name;
-            info.glProgram = std::move(program);
-            info.flags = params.flags;
+                info.name = params.name;
+                info.flags = params.flags;
 
-            OnProgramCreated(&info, params.bindings);
+            if (!pending) {
+                if (!cached) FinishProgramBuild(mImpl.impl(), build);
+                info.glProgram = std::move(build.program);
+                VerifyCaptureVariables(info.glProgram, params.capture, params.captureCount);
+                OnProgramCreated(&info, params.bindings);
+            }
 
-            return mImpl->transformPrograms.create(std::move(info));
+            TransformProgramHandle handle = mImpl->transformPrograms.create(std::move(info));
+            mImpl->transformProgramNames.insert(params.name, handle);
+            if (pending) {
+                mImpl->pendingPrograms.emplace_back(new PendingProgram());
+                PendingProgram &program = *mImpl->pendingPrograms.back();
+                    program.build = std::move(build);
+                    program.bindings = params.bindings;
+                    program.capture.assign(params.capture, params.capture + params.captureCount);
+                    program.transform = handle;
+            }
+            return handle;
         } catch (const std::exception &e) {
             LOG_ERROR("Failed to create transform program - error: %s", e.what());
             return TransformProgramHandle();
@@ -211,16 +419,16 @@ namespace Pisces
 
     PISCES_API void PipelineManager::destroyProgram( TransformProgramHandle handle )
     {
+        const TransformProgramInfo *info = mImpl->transformPrograms.find(handle);
+        if (!info) return;
+
+        mImpl->transformProgramNames.erase(info->name, handle);
         mImpl->transformPrograms.free(handle);
     }
 
     PISCES_API TransformProgramHandle PipelineManager::findTransformProgram(Common::StringId name)
     {
-        return mImpl->transformPrograms.findIf(
-            [&]( const TransformProgramInfo &info ) {
-                return info.name == name;
-            }
-        );
+        return mImpl->transformProgramNames.find(name);
     }
 
     PISCES_API PipelineHandle PipelineManager::createPipeline( const PipelineInitParams &params )
@@ -230,9 +438,11 @@ namespace Pisces
                 info.program = params.program;
                 info.name = params.name;
                 info.flags = params.flags;
-                info.blendMode = params.blendMode;
+                info.renderState = FindOrAddRenderState(mImpl.impl(), ResolveRenderState(params.flags, params.blendMode, params.state));
         
-            return mImpl->pipelines.create(std::move(info));
+            PipelineHandle handle = mImpl->pipelines.create(std::move(info));
+            mImpl->pipelineNames.insert(params.name, handle);
+            return handle;
 
         } catch (const std::exception &e) {
             LOG_ERROR("Faield to create pipeline \"%s\" - error: %s", Common::GetCString(params.name), e.what());
@@ -258,6 +468,7 @@ namespace Pisces
         tmp.program = program;
         tmp.blendMode = params.blendMode;
         tmp.flags = set(params.flags, PipelineFlags::OwnProgram);
+        tmp.state = params.state;
         tmp.name = params.name;
 
         return createPipeline(tmp);
@@ -272,15 +483,13 @@ namespace Pisces
             destroyProgram(info->program);
         }
 
+        mImpl->pipelineNames.erase(info->name, handle);
         mImpl->pipelines.free(handle);
     }
     
     PISCES_API bool PipelineManager::findPipeline( Common::StringId name, PipelineHandle &pipeline )
     {
-        PipelineHandle handle = mImpl->pipelines.findIf( [name](const PipelineInfo &info) {
-                return info.name == name;
-            }
-        );
+        PipelineHandle handle = mImpl->pipelineNames.find(name);
         if (handle) {
             pipeline = handle;
             return true;
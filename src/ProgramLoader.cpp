@@ -10,7 +10,9 @@
 #include "Common/StringFormat.h"
 #include "Common/FromString.h"
 
+#include <algorithm>
 #include <cassert>
+#include <string>
 #include <vector>
 
 namespace Pisces
@@ -44,6 +46,64 @@ namespace Pisces
 #undef FILL_BINDINGS
     }
 
+    // Appends the file to source with every #include "file" line replaced by the included file, which is
+    // looked up in the archive as well. Each file gets its own source string number in the #line directives,
+    // so compile errors point at the right file & line.
+    static void AppendShaderFile( Common::Archive &archive, const std::string &name, std::string &source, std::vector<std::string> &includeStack, int &fileCount )
+    {
+        if (std::find(includeStack.begin(), includeStack.end(), name) != includeStack.end()) {
+            THROW(std::runtime_error, "Recursive #include of \"%s\"", name.c_str());
+        }
+
+        auto file = archive.openFile(name.c_str());
+        if (!file) {
+            THROW(std::runtime_error, "Failed to open file \"%s\"", name.c_str());
+        }
+
+        const char *data = (const char*)archive.mapFile(file);
+        std::string text(data, archive.fileSize(file));
+
+        includeStack.push_back(name);
+        int fileNumber = fileCount++;
+
+        size_t pos = 0;
+        int line = 1;
+        while (pos < text.size()) {
+            size_t end = text.find('\n', pos);
+            if (end == std::string::npos) end = text.size();
+
+            size_t first = text.find_first_not_of(" \t", pos);
+            if (first < end && text.compare(first, 8, "#include") == 0) {
+                size_t open = text.find_first_of("\"<", first+8),
+                       close = open < end ? text.find_first_of("\">", open+1) : std::string::npos;
+                if (open >= end || close >= end) {
+                    THROW(std::runtime_error, "Malformed #include in \"%s\" at line %i", name.c_str(), line);
+                }
+
+                source += "#line 1 " + std::to_string(fileCount) + "\n";
+                AppendShaderFile(archive, text.substr(open+1, close-open-1), source, includeStack, fileCount);
+                source += "\n#line " + std::to_string(line+1) + " " + std::to_string(fileNumber) + "\n";
+            }
+            else {
+                source.append(text, pos, end-pos);
+                if (end < text.size()) source += '\n';
+            }
+
+            pos = end+1;
+            line++;
+        }
+
+        includeStack.pop_back();
+    }
+
+    static std::string LoadShaderFile( Common::Archive &archive, const char *name )
+    {
+        std::string source;
+        std::vector<std::string> includeStack;
+        int fileCount = 0;
+        AppendShaderFile(archive, name, source, includeStack, fileCount);
+        return source;
+    }
 
     PISCES_API ResourceHandle RenderProgramLoader::loadResource( Common::Archive &archive, libyaml::Node node )
     {
@@ -80,41 +140,48 @@ namespace Pisces
             );
         }
 
-        auto vertexShaderFile = archive.openFile(vertexShaderNode.scalar());
-        if (!vertexShaderFile) {
-            THROW(std::runtime_error, 
-                "Failed to open file \"%s\"", vertexShaderNode.scalar()    
-            );
-        }
-
-        auto fragmentShaderFile = archive.openFile(fragmentShaderNode.scalar());
-        if (!fragmentShaderFile) {
-            THROW(std::runtime_error, 
-                "Failed to open file \"%s\"", fragmentShaderNode.scalar()    
-            );
-        }
-
-        size_t vertexSourceLen = archive.fileSize(vertexShaderFile);
-        const char *vertexSource = (const char*)archive.mapFile(vertexShaderFile);
-
-        size_t fragmentSourceLen = archive.fileSize(fragmentShaderFile);
-        const char *fragmentSource = (const char*)archive.mapFile(fragmentShaderFile);
-
         RenderProgramInitParams params;
-        params.vertexSource.assign(vertexSource, vertexSourceLen);
-        params.fragmentSource.assign(fragmentSource, fragmentSourceLen);
+        params.vertexSource = LoadShaderFile(archive, vertexShaderNode.scalar());
+        params.fragmentSource = LoadShaderFile(archive, fragmentShaderNode.scalar());
 
         if (geometryShaderNode) {
-            auto file = archive.openFile(geometryShaderNode.scalar());
-            if (!file) {
-                THROW(std::runtime_error, 
-                    "Failed to open file \"%s\"", fragmentShaderNode.scalar()    
+            params.geometrySource = LoadShaderFile(archive, geometryShaderNode.scalar());
+        }
+
+        auto definesNode = node["Defines"];
+        if (definesNode) {
+            if (!definesNode.isMap()) {
+                auto mark = definesNode.startMark();
+                THROW(std::runtime_error,
+                      "Expected map in \"%s::%s\" at %i:%i",
+                       archive.name(), node.filename(), mark.line, mark.col
                 );
             }
+            for (std::pair<libyaml::Node, libyaml::Node> entry : definesNode) {
+                std::string value = entry.second.isScalar() ? entry.second.scalar() : "";
+                params.defines.emplace_back(entry.first.scalar(), value);
+            }
+        }
 
-            const char *source = (const char*)archive.mapFile(file);
-            size_t len = archive.fileSize(file);
-            params.geometrySource.assign(source, len);
+        auto variantsNode = node["Variants"];
+        if (variantsNode) {
+            if (!variantsNode.isSequence()) {
+                auto mark = variantsNode.startMark();
+                THROW(std::runtime_error,
+                      "Expected sequence in \"%s::%s\" at %i:%i",
+                       archive.name(), node.filename(), mark.line, mark.col
+                );
+            }
+            for (libyaml::Node variant : variantsNode) {
+                if (!variant.isScalar()) {
+                    auto mark = variant.startMark();
+                    THROW(std::runtime_error,
+                          "Expected scalar \"%s::%s\" at %i:%i",
+                           archive.name(), node.filename(), mark.line, mark.col
+                    );
+                }
+                params.variants.push_back(variant.scalar());
+            }
         }
 
         auto bindingNode = node["Bindings"];
@@ -156,19 +223,8 @@ namespace Pisces
                   archive.name(), node.filename(), mark.line, mark.col
             );
         }
-        auto sourceFile = archive.openFile(sourceNode.scalar());
-        if (!sourceFile) {
-            THROW(std::runtime_error, 
-                "Failed to open file \"%s\"", sourceNode.scalar()    
-            );
-        }
-
-        size_t sourceLen = archive.fileSize(sourceFile);
-        const char *source = (const char*) archive.mapFile(sourceFile);
-
-        
         ComputeProgramInitParams params;
-        params.source.assign(source, sourceLen);
+        params.source = LoadShaderFile(archive, sourceNode.scalar());
         
         auto bindingNode = node["Bindings"];
         if (bindingNode) {
@@ -209,19 +265,8 @@ namespace Pisces
                   archive.name(), node.filename(), mark.line, mark.col
             );
         }
-        auto sourceFile = archive.openFile(sourceNode.scalar());
-        if (!sourceFile) {
-            THROW(std::runtime_error, 
-                "Failed to open file \"%s\"", sourceNode.scalar()    
-            );
-        }
-
-        size_t sourceLen = archive.fileSize(sourceFile);
-        const char *source = (const char*) archive.mapFile(sourceFile);
-
-        
         TransformProgramInitParams params;
-        params.source.assign(source, sourceLen);
+        params.source = LoadShaderFile(archive, sourceNode.scalar());
         
         auto bindingNode = node["Bindings"];
         if (bindingNode) {
@@ -31,6 +31,23 @@ namespace Pisces
         mImpl->commands.emplace_back(UseVertexArray(vertexArray));
     }
 
+    PISCES_API void RenderCommandQueue::useVertexBuffers( VertexFormatHandle format, const BufferHandle *buffers, const size_t *offsets, int count,
+                                                          BufferHandle indexBuffer )
+    {
+        if (count < 0 || count > MAX_VERTEX_BUFFERS) {
+            LOG_WARNING("Trying to bind %i vertex buffers, max is %i!", count, MAX_VERTEX_BUFFERS);
+            return;
+        }
+
+        BufferArray vertexBuffers;
+        OffsetArray vertexOffsets = {};
+        for (int i=0; i < count; ++i) {
+            vertexBuffers[i] = buffers[i];
+            if (offsets) vertexOffsets[i] = offsets[i];
+        }
+        mImpl->commands.emplace_back(UseVertexBuffers(format, vertexBuffers, vertexOffsets, indexBuffer));
+    }
+
     PISCES_API void RenderCommandQueue::bindTexture( int slot, TextureHandle texture )
     {
         if (slot < 0 || slot >= MAX_BOUND_SAMPLERS) {
@@ -6,6 +6,17 @@
 #include "Common/Throw.h"
 #include "Common/StringId.h"
 #include "Common/BuiltinFromString.h"
+#include "Common/ErrorUtils.h"
+
+#include "internal/SkylinePacker.h"
+
+#include <algorithm>
+#include <cstring>
+#include <string>
+#include <vector>
+
+#include "stb_image.h"
+WRAP_HANDLE_FUNC(stbi_image, stbi_uc*, stbi_image_free, nullptr);
 
 namespace Pisces
 {
@@ -24,6 +35,7 @@ namespace Pisces
         GET_NODE(node, nameNode, "Name", isScalar(), true);
         GET_NODE(node, textureNode, "Texture", isScalar(), true);
         GET_NODE(node, pixelSpaceNode, "PixelSpace", isScalar(), false);
+        GET_NODE(node, layerNode, "Layer", isScalar(), false);
 
         GET_NODE(node, uvNode, "UV", isMap(), true);
 
@@ -67,8 +79,27 @@ namespace Pisces
         GET_FLOAT(sprite.uv.x2, x2Node, "x2");
         GET_FLOAT(sprite.uv.y2, y2Node, "y2");
 
-        int width=1, height=1;
-        if (pixelSpace && mHardwareMgr->getTextureSize(sprite.texture, &width, &height)) {
+        int width=1, height=1, layers=1;
+        mHardwareMgr->getTextureSize(sprite.texture, &width, &height, &layers);
+
+        if (layerNode) {
+            if (!Common::BuiltinFromString(layerNode.scalar(), sprite.layer)) {
+                auto mark = layerNode.startMark();
+                THROW(std::runtime_error,
+                      "Expected integer for attribute \"%s\" at %i:%i",
+                      "Layer", mark.line, mark.col
+                );
+            }
+            if (sprite.layer < 0 || sprite.layer >= layers) {
+                auto mark = layerNode.startMark();
+                THROW(std::runtime_error,
+                      "Layer %i is out of range for texture \"%s\" with %i layers at %i:%i",
+                      sprite.layer, Common::GetCString(textureName), layers, mark.line, mark.col
+                );
+            }
+        }
+
+        if (pixelSpace) {
             sprite.uv.x1 /= width;
             sprite.uv.x2 /= width;
             sprite.uv.y1 /= height;
@@ -80,5 +111,180 @@ namespace Pisces
 
         return ResourceHandle(name.handle);
     }
-}
 
+    PISCES_API ResourceHandle SpriteAtlasLoader::loadResource( Common::Archive &archive, libyaml::Node node )
+    {
+        GET_NODE(node, nameNode, "Name", isScalar(), true);
+        GET_NODE(node, sizeNode, "Size", isScalar(), true);
+        GET_NODE(node, paddingNode, "Padding", isScalar(), false);
+        GET_NODE(node, spritesNode, "Sprites", isSequence(), true);
+
+        int size = 0;
+        if (!Common::BuiltinFromString(sizeNode.scalar(), size) || size <= 0) {
+            auto mark = sizeNode.startMark();
+            THROW(std::runtime_error,
+                  "Expected positive integer for attribute \"%s\" at %i:%i",
+                  "Size", mark.line, mark.col
+            );
+        }
+
+        // Space between sprites filled with their edge texels, so linear filtering doesn't bleed into the neighbours
+        int padding = 1;
+        if (paddingNode && (!Common::BuiltinFromString(paddingNode.scalar(), padding) || padding < 0)) {
+            auto mark = paddingNode.startMark();
+            THROW(std::runtime_error,
+                  "Expected integer for attribute \"%s\" at %i:%i",
+                  "Padding", mark.line, mark.col
+            );
+        }
+
+        struct Entry {
+            Common::StringId name;
+            std::string file;
+            const void *data;
+            int dataSize;
+            int width, height;
+            int layer, x, y;
+        };
+        std::vector<Entry> entries;
+
+        // Only read the image headers here, the images are decoded one at a time when uploading
+        for (libyaml::Node spriteNode : spritesNode) {
+            GET_NODE(spriteNode, spriteNameNode, "Name", isScalar(), true);
+            GET_NODE(spriteNode, fileNode, "File", isScalar(), true);
+
+            Entry entry;
+                entry.name = Common::CreateStringId(spriteNameNode.scalar());
+                entry.file = fileNode.scalar();
+
+            auto file = archive.openFile(entry.file);
+            if (!file) {
+                THROW(std::runtime_error,
+                      "Failed to open file \"%s\"", entry.file.c_str()
+                );
+            }
+            entry.data = archive.mapFile(file);
+            entry.dataSize = (int)archive.fileSize(file);
+
+            int channels;
+            if (!stbi_info_from_memory((const stbi_uc*)entry.data, entry.dataSize, &entry.width, &entry.height, &channels)) {
+                THROW(std::runtime_error,
+                      "Failed to read image \"%s\" - error %s", entry.file.c_str(), stbi_failure_reason()
+                );
+            }
+            if (entry.width + 2*padding > size || entry.height + 2*padding > size) {
+                THROW(std::runtime_error,
+                      "Image \"%s\" (%ix%i) doesn't fit in the atlas of size %i",
+                      entry.file.c_str(), entry.width, entry.height, size
+                );
+            }
+
+            entries.push_back(entry);
+        }
+
+        // The skyline packer does best with the tallest rectangles first
+        std::vector<size_t> order(entries.size());
+        for (size_t i=0; i < order.size(); ++i) order[i] = i;
+        std::stable_sort(order.begin(), order.end(), [&](size_t lhs, size_t rhs) {
+            return entries[lhs].height > entries[rhs].height;
+        });
+
+        std::vector<SkylinePacker> layers;
+        for (size_t idx : order) {
+            Entry &entry = entries[idx];
+            int w = entry.width + 2*padding,
+                h = entry.height + 2*padding;
+
+            bool placed = false;
+            for (size_t layer=0; layer < layers.size() && !placed; ++layer) {
+                if (layers[layer].insert(w, h, entry.x, entry.y)) {
+                    entry.layer = (int)layer;
+                    placed = true;
+                }
+            }
+            if (!placed) {
+                layers.emplace_back(size, size);
+                layers.back().insert(w, h, entry.x, entry.y);
+                entry.layer = (int)layers.size() - 1;
+            }
+            entry.x += padding;
+            entry.y += padding;
+        }
+
+        Common::StringId atlasName = Common::CreateStringId(nameNode.scalar());
+
+        TextureHandle texture = mHardwareMgr->allocateTexture2DArray(PixelFormat::RGBA8, TextureFlags::None, size, size, std::max(1, (int)layers.size()));
+        if (!texture) {
+            THROW(std::runtime_error,
+                  "Failed to allocate texture for sprite atlas \"%s\"", Common::GetCString(atlasName)
+            );
+        }
+        mHardwareMgr->setTextureName(texture, atlasName);
+
+        // Texture storage starts out undefined, mipmaps would average unused space into the sprites
+        {
+            std::vector<uint8_t> transparent((size_t)size*size*4, 0);
+            for (size_t layer=0; layer < std::max<size_t>(1, layers.size()); ++layer) {
+                mHardwareMgr->uploadTexture2DArray(texture, 0, (int)layer, 0, 0, size, size, TextureUploadFlags::None, PixelFormat::RGBA8, transparent.data());
+            }
+        }
+
+        // Sprites are only registered once every image is uploaded, so a failure doesn't leave any pointing at the freed texture
+        std::vector<std::pair<Common::StringId, Sprite>> sprites;
+        sprites.reserve(entries.size());
+
+        std::vector<uint8_t> padded;
+        for (const Entry &entry : entries) {
+            int width, height;
+            stbi_image image = stbi_image(stbi_load_from_memory((const stbi_uc*)entry.data, entry.dataSize, &width, &height, nullptr, STBI_rgb_alpha));
+            if (!image) {
+                mHardwareMgr->freeTexture(texture);
+                THROW(std::runtime_error,
+                      "Failed to decode image \"%s\" - error %s", entry.file.c_str(), stbi_failure_reason()
+                );
+            }
+
+            if (padding > 0) {
+                // Replicate the edge texels into the padding
+                int paddedWidth = width + 2*padding,
+                    paddedHeight = height + 2*padding;
+                padded.resize((size_t)paddedWidth*paddedHeight*4);
+
+                const uint8_t *pixels = image;
+                for (int y=0; y < paddedHeight; ++y) {
+                    int srcY = std::min(std::max(y - padding, 0), height - 1);
+                    for (int x=0; x < paddedWidth; ++x) {
+                        int srcX = std::min(std::max(x - padding, 0), width - 1);
+                        memcpy(&padded[((size_t)y*paddedWidth + x)*4], pixels + ((size_t)srcY*width + srcX)*4, 4);
+                    }
+                }
+                mHardwareMgr->uploadTexture2DArray(texture, 0, entry.layer, entry.x - padding, entry.y - padding, paddedWidth, paddedHeight,
+                                                   TextureUploadFlags::None, PixelFormat::RGBA8, padded.data());
+            }
+            else {
+                mHardwareMgr->uploadTexture2DArray(texture, 0, entry.layer, entry.x, entry.y, width, height, TextureUploadFlags::None, PixelFormat::RGBA8, image);
+            }
+
+            Sprite sprite;
+                sprite.texture = texture;
+                sprite.layer = entry.layer;
+                sprite.uv.x1 = entry.x / (float)size;
+                sprite.uv.y1 = entry.y / (float)size;
+                sprite.uv.x2 = (entry.x + width) / (float)size;
+                sprite.uv.y2 = (entry.y + height) / (float)size;
+
+            sprites.emplace_back(entry.name, sprite);
+        }
+
+        for (const auto &sprite : sprites) {
+            mSpriteMgr->setSprite(sprite.first, sprite.second);
+        }
+
+        mHardwareMgr->generateMipmaps(texture);
+
+        LOG_INFORMATION("Packed %zu sprites into %zu layers of %ix%i for atlas \"%s\"", 
+                        entries.size(), layers.size(), size, size, Common::GetCString(atlasName));
+
+        return ResourceHandle(texture.handle);
+    }
+}
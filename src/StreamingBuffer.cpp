@@ -6,6 +6,11 @@
 #include "Common/ErrorUtils.h"
 #include "Common/PointerHelpers.h"
 
+#include <algorithm>
+#include <cstring>
+#include <deque>
+#include <vector>
+
 namespace Pisces
 {
     struct StreamingBufferBase::Impl {
@@ -15,10 +20,24 @@ namespace Pisces
 
         size_t size = 0;
 
+        // Without persistent mapping every frame maps its slice unsynchronized, which is only safe once
+        // the gpu has finished the last frame that wrote to the slice. Otherwise the buffer is orphaned.
+        bool persistent = false;
+        FenceHandle sliceFences[FRAMES_IN_FLIGHT];
+
         Impl( Context *context_ ) :
             context(context_), 
             hardwareMgr(context->getHardwareResourceManager())
         {}
+
+        // After orphaning or reallocation no earlier frame uses the storage of the buffer
+        void resetSliceFences( size_t currentSlice )
+        {
+            for (int i=0; i < FRAMES_IN_FLIGHT; ++i) {
+                sliceFences[i] = FenceHandle();
+            }
+            sliceFences[currentSlice] = context->insertFence();
+        }
     };
 
     size_t offsetForFrame( size_t size, size_t frame ) {
@@ -30,6 +49,10 @@ namespace Pisces
     {
         mImpl->buffer = mImpl->hardwareMgr->allocateBuffer(type, BufferUsage::StreamWrite, BufferFlags::MapWrite|BufferFlags::MapPersistent, size*FRAMES_IN_FLIGHT, nullptr);
         mImpl->size = size;
+
+        // The mapping is only kept if the context supports persistent mapping
+        mImpl->hardwareMgr->mapBuffer(mImpl->buffer, 0, size*FRAMES_IN_FLIGHT, BufferMapFlags::MapWrite|BufferMapFlags::Persistent);
+        mImpl->persistent = mImpl->hardwareMgr->unmapBuffer(mImpl->buffer, true);
     }
 
     PISCES_API StreamingBufferBase::~StreamingBufferBase()
@@ -37,15 +60,41 @@ namespace Pisces
         mImpl->hardwareMgr->freeBuffer(mImpl->buffer);
     }
 
-    PISCES_API void* StreamingBufferBase::mapBuffer( size_t offset, size_t size )
+    PISCES_API void* StreamingBufferBase::mapBuffer( size_t offset, size_t size, bool flushExplicit )
     {
         if( (offset+size) > mImpl->size) {
             LOG_WARNING("Trying to map invalid range [%zu, %zu], when the buffer is only %zu bytes big!", offset, size, mImpl->size);
             return nullptr;
         }
 
+        BufferMapFlags flags = BufferMapFlags::MapWrite|BufferMapFlags::Persistent;
+        if (flushExplicit) {
+            flags = set(flags, BufferMapFlags::FlushExplicit);
+        }
+
+        if (!mImpl->persistent) {
+            size_t slice = mImpl->context->currentFrame() % FRAMES_IN_FLIGHT;
+            FenceHandle fence = mImpl->context->insertFence();
+
+            FenceHandle &sliceFence = mImpl->sliceFences[slice];
+            if (sliceFence == fence || mImpl->context->isFenceSignaled(sliceFence)) {
+                flags = set(flags, BufferMapFlags::Unsynchronized);
+                sliceFence = fence;
+            }
+            else {
+                // The gpu still reads the slice, orphan the storage instead of waiting for it
+                flags = set(flags, BufferMapFlags::DiscardBuffer);
+                mImpl->resetSliceFences(slice);
+            }
+        }
+
         size_t frameOffset = currentFrameOffset();
-        return mImpl->hardwareMgr->mapBuffer(mImpl->buffer, frameOffset+offset, size, BufferMapFlags::MapWrite|BufferMapFlags::Persistent);
+        return mImpl->hardwareMgr->mapBuffer(mImpl->buffer, frameOffset+offset, size, flags);
+    }
+
+    PISCES_API void StreamingBufferBase::markWritten( size_t offset, size_t size )
+    {
+        mImpl->hardwareMgr->markBufferWritten(mImpl->buffer, currentFrameOffset()+offset, size);
     }
 
     PISCES_API void StreamingBufferBase::unmapBuffer()
@@ -69,6 +118,7 @@ namespace Pisces
 
         mImpl->hardwareMgr->resizeBuffer(mImpl->buffer, newSize*FRAMES_IN_FLIGHT, resizeFlags, currentOffset, newOffset, copySize);
         mImpl->size = newSize;
+        mImpl->resetSliceFences(currentFrame % FRAMES_IN_FLIGHT);
     }
 
     PISCES_API size_t StreamingBufferBase::currentFrameOffset()
@@ -129,11 +179,480 @@ namespace Pisces
     PISCES_API void StreamingUniformBuffer::beginAllocation()
     {
         mCurrentOffset = 0;
-        mCurrentMapping = mapBuffer(0, mImpl->size);
+        mCurrentMapping = mapBuffer(0, mImpl->size, true);
     }
 
     PISCES_API void StreamingUniformBuffer::endAllocation()
     {
+        // Only flush what was allocated instead of the whole frame
+        markWritten(0, mCurrentOffset);
         unmapBuffer();
+        mCurrentMapping = nullptr;
+    }
+
+    // Maps the whole buffer persistently, if that isn't supported the shadow is used for writes instead
+    static uint8_t* MapPersistent( HardwareResourceManager *hardwareMgr, BufferHandle buffer, size_t size, std::vector<uint8_t> &shadow )
+    {
+        void *mapping = hardwareMgr->mapBuffer(buffer, 0, size, BufferMapFlags::MapWrite|BufferMapFlags::Persistent);
+        if (hardwareMgr->unmapBuffer(buffer, true)) {
+            shadow.clear();
+            return (uint8_t*)mapping;
+        }
+
+        shadow.resize(size);
+        return nullptr;
+    }
+
+    static void FlushRange( HardwareResourceManager *hardwareMgr, BufferHandle buffer, uint8_t *persistentData, const std::vector<uint8_t> &shadow, size_t offset, size_t length )
+    {
+        if (length == 0) return;
+
+        if (persistentData) {
+            hardwareMgr->markBufferWritten(buffer, offset, length);
+            hardwareMgr->flushBuffer(buffer);
+        }
+        else {
+            hardwareMgr->uploadBuffer(buffer, offset, length, shadow.data() + offset);
+        }
+    }
+
+    // Flushes the ring positions [from, to) of a buffer of the given size
+    static void FlushRing( HardwareResourceManager *hardwareMgr, BufferHandle buffer, uint8_t *persistentData, const std::vector<uint8_t> &shadow,
+                           size_t size, uint64_t from, uint64_t to )
+    {
+        uint64_t length = to - from;
+        if (length == 0) return;
+
+        size_t offset = (size_t)(from % size);
+        if (length > size - offset) {
+            // Wrapped around, flush the end and the start of the buffer
+            FlushRange(hardwareMgr, buffer, persistentData, shadow, offset, size - offset);
+            FlushRange(hardwareMgr, buffer, persistentData, shadow, 0, std::min((size_t)length - (size - offset), size));
+        }
+        else {
+            FlushRange(hardwareMgr, buffer, persistentData, shadow, offset, (size_t)length);
+        }
+    }
+
+    struct TransientBuffer::Impl {
+        Context *context;
+        HardwareResourceManager *hardwareMgr;
+
+        BufferHandle buffer;
+        size_t size = 0;
+
+        uint8_t *persistentData = nullptr;
+        // Used when persistent mapping isn't supported, flushed with uploadBuffer
+        std::vector<uint8_t> shadow;
+
+        // Positions increase forever, the offset in the buffer is position % size
+        uint64_t head = 0,
+                 tail = 0,
+                 flushed = 0;
+
+        struct FrameRange {
+            FenceHandle fence;
+            uint64_t end;
+        };
+        std::deque<FrameRange> frames;
+
+        // Buffers replaced by a larger one, freed once the last frame using them is done. Allocations made
+        // before the switch still point into them, so their mapping or shadow is kept and flushed with the next flush.
+        struct RetiredBuffer {
+            FenceHandle fence;
+            BufferHandle buffer;
+            size_t size;
+            uint8_t *persistentData;
+            std::vector<uint8_t> shadow;
+            uint64_t flushed, head;
+        };
+        std::vector<RetiredBuffer> retired;
+
+        Impl( Context *context_ ) :
+            context(context_), 
+            hardwareMgr(context->getHardwareResourceManager())
+        {}
+
+        uint8_t* data() {
+            return persistentData ? persistentData : shadow.data();
+        }
+
+        void create( size_t newSize )
+        {
+            buffer = hardwareMgr->allocateBuffer(BufferType::Vertex, BufferUsage::StreamWrite, 
+                                                 BufferFlags::MapWrite|BufferFlags::MapPersistent|BufferFlags::Upload, newSize, nullptr);
+            size = newSize;
+
+            persistentData = MapPersistent(hardwareMgr, buffer, size, shadow);
+
+            head = tail = flushed = 0;
+            frames.clear();
+        }
+
+        void reclaim()
+        {
+            while (!frames.empty() && context->isFenceSignaled(frames.front().fence)) {
+                tail = frames.front().end;
+                frames.pop_front();
+            }
+
+            for (size_t i=0; i < retired.size(); ) {
+                if (retired[i].flushed == retired[i].head && context->isFenceSignaled(retired[i].fence)) {
+                    hardwareMgr->freeBuffer(retired[i].buffer);
+                    retired[i] = std::move(retired.back());
+                    retired.pop_back();
+                }
+                else {
+                    ++i;
+                }
+            }
+        }
+
+        void retire()
+        {
+            RetiredBuffer old;
+                old.fence = context->insertFence();
+                old.buffer = buffer;
+                old.size = size;
+                old.persistentData = persistentData;
+                old.shadow = std::move(shadow);
+                old.flushed = flushed;
+                old.head = head;
+            retired.push_back(std::move(old));
+
+            shadow.clear();
+        }
+    };
+
+    PISCES_API TransientBuffer::TransientBuffer( Context *context, size_t size ) :
+        mImpl(context)
+    {
+        mImpl->create(size);
+    }
+
+    PISCES_API TransientBuffer::~TransientBuffer()
+    {
+        for (auto &retired : mImpl->retired) {
+            mImpl->hardwareMgr->freeBuffer(retired.buffer);
+        }
+        mImpl->hardwareMgr->freeBuffer(mImpl->buffer);
+    }
+
+    PISCES_API TransientAllocation TransientBuffer::allocate( size_t size, size_t alignment )
+    {
+        if (alignment == 0) alignment = 1;
+
+        mImpl->reclaim();
+
+        uint64_t start = mImpl->head;
+        size_t offset = (size_t)(start % mImpl->size);
+        size_t aligned = (offset + alignment - 1) / alignment * alignment;
+
+        // Skip the end of the buffer if the allocation doesn't fit before it
+        if (aligned + size > mImpl->size) {
+            start += mImpl->size - offset;
+            offset = 0;
+            aligned = 0;
+        }
+
+        uint64_t end = start + (aligned - offset) + size;
+        if ((end - mImpl->tail) > mImpl->size) {
+            // The gpu is still using the rest of the ring, switch to a larger buffer
+            size_t newSize = std::max(mImpl->size*2, (size + alignment)*2);
+            LOG_INFORMATION("Transient buffer is full, growing it to %zu bytes", newSize);
+
+            mImpl->retire();
+            mImpl->create(newSize);
+
+            return allocate(size, alignment);
+        }
+
+        mImpl->head = end;
+
+        FenceHandle fence = mImpl->context->insertFence();
+        if (mImpl->frames.empty() || mImpl->frames.back().fence != fence) {
+            mImpl->frames.push_back({fence, end});
+        }
+        else {
+            mImpl->frames.back().end = end;
+        }
+
+        TransientAllocation allocation;
+            allocation.buffer = mImpl->buffer;
+            allocation.offset = aligned;
+            allocation.size = size;
+            allocation.data = mImpl->data() + aligned;
+        return allocation;
+    }
+
+    PISCES_API UniformBufferHandle TransientBuffer::allocateUniform( const void *data, size_t size, const UniformBlockInfo *blockInfo )
+    {
+        TransientAllocation allocation = allocate(size, mImpl->hardwareMgr->getUniformAlignment());
+        memcpy(allocation.data, data, size);
+
+        UniformBufferHandle handle;
+            handle.buffer = allocation.buffer;
+            handle.offset = allocation.offset;
+            handle.size = size;
+            handle.type = blockInfo;
+        return handle;
+    }
+
+    PISCES_API void TransientBuffer::flush()
+    {
+        for (auto &retired : mImpl->retired) {
+            if (retired.flushed == retired.head) continue;
+
+            FlushRing(mImpl->hardwareMgr, retired.buffer, retired.persistentData, retired.shadow, retired.size, retired.flushed, retired.head);
+            retired.flushed = retired.head;
+            // The buffer is used until the frame being flushed is done
+            retired.fence = mImpl->context->insertFence();
+        }
+
+        FlushRing(mImpl->hardwareMgr, mImpl->buffer, mImpl->persistentData, mImpl->shadow, mImpl->size, mImpl->flushed, mImpl->head);
+        mImpl->flushed = mImpl->head;
+    }
+
+    PISCES_API BufferHandle TransientBuffer::handle()
+    {
+        return mImpl->buffer;
+    }
+
+    PISCES_API size_t TransientBuffer::size()
+    {
+        return mImpl->size;
+    }
+
+    PISCES_API size_t TransientBuffer::usedSize()
+    {
+        return (size_t)(mImpl->head - mImpl->tail);
+    }
+
+    // Idle pages above the peak usage of this many frames are released
+    static const uint64_t PAGE_TRIM_INTERVAL = 300;
+    static const size_t NO_PAGE = ~(size_t)0;
+
+    struct PagedStreamingBuffer::Impl {
+        Context *context;
+        HardwareResourceManager *hardwareMgr;
+
+        BufferType type;
+        size_t pageSize = 0;
+
+        struct Page {
+            BufferHandle buffer;
+            VertexArrayHandle vertexArray;
+
+            uint8_t *persistentData = nullptr;
+            std::vector<uint8_t> shadow;
+
+            size_t used = 0,
+                   flushed = 0;
+            // Fence of the last frame that wrote to the page
+            FenceHandle fence;
+
+            uint8_t* data() {
+                return persistentData ? persistentData : shadow.data();
+            }
+        };
+        std::vector<Page> pages;
+        size_t current = NO_PAGE;
+
+        std::vector<VertexAttribute> vertexLayout;
+        BufferHandle indexBuffer;
+        IndexType indexType = IndexType::UInt16;
+
+        uint64_t lastFrame = 0,
+                 trimFrame = 0;
+        size_t peakPages = 0;
+
+        Impl( Context *context_ ) :
+            context(context_), 
+            hardwareMgr(context->getHardwareResourceManager())
+        {}
+
+        bool isIdle( size_t page ) {
+            return page != current && context->isFenceSignaled(pages[page].fence);
+        }
+
+        size_t createPage()
+        {
+            pages.emplace_back();
+            Page &page = pages.back();
+
+            page.buffer = hardwareMgr->allocateBuffer(type, BufferUsage::StreamWrite, 
+                                                      BufferFlags::MapWrite|BufferFlags::MapPersistent|BufferFlags::Upload, pageSize, nullptr);
+            page.persistentData = MapPersistent(hardwareMgr, page.buffer, pageSize, page.shadow);
+
+            if (!vertexLayout.empty()) {
+                page.vertexArray = hardwareMgr->createVertexArray(
+                    vertexLayout.data(), (int)vertexLayout.size(),
+                    &page.buffer, 1,
+                    indexBuffer ? indexBuffer : page.buffer, indexType
+                );
+            }
+
+            return pages.size()-1;
+        }
+
+        void freePage( size_t idx )
+        {
+            hardwareMgr->deleteVertexArray(pages[idx].vertexArray);
+            hardwareMgr->freeBuffer(pages[idx].buffer);
+
+            if (idx != pages.size()-1) {
+                pages[idx] = std::move(pages.back());
+                if (current == pages.size()-1) current = idx;
+            }
+            pages.pop_back();
+        }
+
+        void flushPage( Page &page )
+        {
+            FlushRange(hardwareMgr, page.buffer, page.persistentData, page.shadow, page.flushed, page.used - page.flushed);
+            page.flushed = page.used;
+        }
+
+        void nextPage()
+        {
+            if (current != NO_PAGE) {
+                flushPage(pages[current]);
+            }
+
+            size_t next = NO_PAGE;
+            for (size_t i=0; i < pages.size(); ++i) {
+                if (isIdle(i)) {
+                    next = i;
+                    break;
+                }
+            }
+            if (next == NO_PAGE) {
+                next = createPage();
+            }
+
+            pages[next].used = pages[next].flushed = 0;
+            current = next;
+        }
+
+        // Tracks how many pages are needed at most and releases idle pages above that
+        void updateUsage()
+        {
+            uint64_t frame = context->currentFrame();
+            if (frame == lastFrame) return;
+            lastFrame = frame;
+
+            size_t busyPages = 0;
+            for (size_t i=0; i < pages.size(); ++i) {
+                if (!isIdle(i)) busyPages++;
+            }
+            peakPages = std::max(peakPages, busyPages);
+
+            if (frame - trimFrame < PAGE_TRIM_INTERVAL) return;
+
+            // Keep one spare page, so usage around a page boundary doesn't allocate every frame
+            for (size_t i=pages.size(); i > 0 && pages.size() > peakPages+1; --i) {
+                if (isIdle(i-1)) {
+                    freePage(i-1);
+                }
+            }
+
+            trimFrame = frame;
+            peakPages = busyPages;
+        }
+    };
+
+    PISCES_API PagedStreamingBuffer::PagedStreamingBuffer( Context *context, BufferType type, size_t pageSize ) :
+        mImpl(context)
+    {
+        mImpl->type = type;
+        mImpl->pageSize = pageSize;
+        mImpl->trimFrame = mImpl->lastFrame = context->currentFrame();
+    }
+
+    PISCES_API PagedStreamingBuffer::~PagedStreamingBuffer()
+    {
+        for (auto &page : mImpl->pages) {
+            mImpl->hardwareMgr->deleteVertexArray(page.vertexArray);
+            mImpl->hardwareMgr->freeBuffer(page.buffer);
+        }
+    }
+
+    PISCES_API void PagedStreamingBuffer::setVertexLayout( const VertexAttribute *attributes, int attributeCount, BufferHandle indexBuffer, IndexType indexType )
+    {
+        if (!mImpl->pages.empty()) {
+            LOG_ERROR("PagedStreamingBuffer::setVertexLayout must be called before the first allocation");
+            return;
+        }
+
+        mImpl->vertexLayout.assign(attributes, attributes + attributeCount);
+        mImpl->indexBuffer = indexBuffer;
+        mImpl->indexType = indexType;
+    }
+
+    PISCES_API PagedAllocation PagedStreamingBuffer::allocate( size_t size, size_t alignment )
+    {
+        if (size > mImpl->pageSize) {
+            LOG_ERROR("Trying to allocate %zu bytes from a paged streaming buffer with %zu byte pages", size, mImpl->pageSize);
+            return {};
+        }
+
+        return allocatePartial(size, size, alignment);
+    }
+
+    PISCES_API PagedAllocation PagedStreamingBuffer::allocatePartial( size_t size, size_t minSize, size_t alignment )
+    {
+        if (alignment == 0) alignment = 1;
+        if (minSize == 0 || minSize > size) minSize = size;
+
+        if (minSize + alignment - 1 > mImpl->pageSize) {
+            LOG_ERROR("Trying to allocate %zu bytes from a paged streaming buffer with %zu byte pages", minSize, mImpl->pageSize);
+            return {};
+        }
+
+        mImpl->updateUsage();
+
+        size_t offset = 0;
+        if (mImpl->current != NO_PAGE) {
+            offset = (mImpl->pages[mImpl->current].used + alignment - 1) / alignment * alignment;
+        }
+        if (mImpl->current == NO_PAGE || offset + minSize > mImpl->pageSize) {
+            mImpl->nextPage();
+            offset = 0;
+        }
+
+        Impl::Page &page = mImpl->pages[mImpl->current];
+
+        size_t available = mImpl->pageSize - offset;
+        if (size > available) {
+            size = minSize > 0 ? available / minSize * minSize : 0;
+        }
+
+        page.used = offset + size;
+        page.fence = mImpl->context->insertFence();
+
+        PagedAllocation allocation;
+            allocation.buffer = page.buffer;
+            allocation.vertexArray = page.vertexArray;
+            allocation.offset = offset;
+            allocation.size = size;
+            allocation.data = page.data() + offset;
+        return allocation;
+    }
+
+    PISCES_API void PagedStreamingBuffer::flush()
+    {
+        if (mImpl->current != NO_PAGE) {
+            mImpl->flushPage(mImpl->pages[mImpl->current]);
+        }
+    }
+
+    PISCES_API size_t PagedStreamingBuffer::pageSize()
+    {
+        return mImpl->pageSize;
+    }
+
+    PISCES_API size_t PagedStreamingBuffer::pageCount()
+    {
+        return mImpl->pages.size();
     }
 }
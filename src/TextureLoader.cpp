@@ -92,8 +92,13 @@ namespace Pisces {
             const void *rawTexture = archive.mapFile(textureFile);
             size_t rawTextureSize = archive.fileSize(textureFile);
 
-            int width, height;
-            stbi_image image = stbi_image(stbi_load_from_memory((const stbi_uc*)rawTexture, builtin_cast<int>(rawTextureSize), &width, &height, nullptr, STBI_rgb_alpha));
+            // RGB images are decoded as is and expanded while uploading, stb would otherwise do a extra pass over the image.
+            // Grey images still needs to be expanded by stb since gl don't replicate the color channels.
+            int width, height, channels = 0;
+            stbi_info_from_memory((const stbi_uc*)rawTexture, builtin_cast<int>(rawTextureSize), &width, &height, &channels);
+            int requestedChannels = channels == STBI_rgb ? STBI_rgb : STBI_rgb_alpha;
+
+            stbi_image image = stbi_image(stbi_load_from_memory((const stbi_uc*)rawTexture, builtin_cast<int>(rawTextureSize), &width, &height, nullptr, requestedChannels));
             if (!image) {
                 THROW(std::runtime_error,
                     "Failed to decode image \"%s\" - error %s", fileStr.c_str(), stbi_failure_reason()
@@ -150,7 +155,7 @@ namespace Pisces {
                 }
             }
 
-            mImpl->hardwareMgr->uploadTexture2D(texture, 0, TextureUploadFlags::GenerateMipmaps, PixelFormat::RGBA8, image);
+            mImpl->hardwareMgr->uploadTexture2D(texture, 0, TextureUploadFlags::GenerateMipmaps, requestedChannels == STBI_rgb ? PixelFormat::RGB8 : PixelFormat::RGBA8, image);
 
             return ResourceHandle(texture.handle);
         }
@@ -84,7 +84,7 @@ namespace Pisces
         PipelineManagerImpl::Impl *pipelineMgr = Context::GetContext()->getPipelineManager()->impl();
 
         PipelineManagerImpl::RenderProgramInfo *programInfo = pipelineMgr->renderPrograms.find(handle);
-        if (programInfo == nullptr) return true;
+        if (programInfo == nullptr || programInfo->failed) return true;
 
         return PipelineManagerImpl::verifyUniformBlocksInProgram(programInfo);
     }
@@ -0,0 +1,169 @@
+// pisces-meshbench: runs MeshOptimizer::Optimize on the builtin spheres and optionally on the objects of an .obj file,
+// reports the post transform cache stats (ACMR & ATVR) before and after together with the time per run, once with the
+// default options and once with reduceOverdraw
+//
+//   pisces-meshbench [--iterations <count>] [--cache-size <size>] [<archive> <file.obj>]
+//
+// The .obj file is loaded with 32 bit indexes, so large files aren't split into 16 bit clusters.
+
+#include "Pisces/utility/MeshOptimizer.h"
+#include "Pisces/internal/BuiltinObjects.h"
+
+#ifdef PISCES_SUPPORT_LOAD_OBJ
+#   include "Pisces/utility/ObjLoader.h"
+#   include "Common/Archive.h"
+#endif
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <exception>
+#include <string>
+#include <vector>
+
+using namespace Pisces;
+
+struct Result {
+    MeshOptimizer::CacheStats before, after;
+    double milliseconds = 0.0;
+};
+
+static void Accumulate( MeshOptimizer::CacheStats &total, const MeshOptimizer::CacheStats &stats )
+{
+    total.triangles += stats.triangles;
+    total.vertexes += stats.vertexes;
+    total.misses += stats.misses;
+}
+
+static void PrintResult( const std::string &name, const char *mode, const Result &result )
+{
+    printf("%-24s %-10s %9zu tris %9zu verts   ACMR %.3f -> %.3f   ATVR %.3f -> %.3f   %10.3f ms\n",
+           name.c_str(), mode, result.before.triangles, result.before.vertexes,
+           result.before.acmr(), result.after.acmr(), result.before.atvr(), result.after.atvr(),
+           result.milliseconds);
+}
+
+// Every run optimizes a fresh copy, the time of the copy isn't included
+template< typename Mesh, typename OptimizeFn >
+static Result Run( const Mesh &mesh, int iterations, OptimizeFn optimize )
+{
+    using Clock = std::chrono::steady_clock;
+
+    Result result;
+    double seconds = 0.0;
+    for (int i=0; i < iterations; ++i) {
+        Mesh copy = mesh;
+
+        auto start = Clock::now();
+        MeshOptimizer::Report report = optimize(copy);
+        seconds += std::chrono::duration<double>(Clock::now() - start).count();
+
+        result.before = report.before;
+        result.after = report.after;
+    }
+    result.milliseconds = seconds / iterations * 1e3;
+    return result;
+}
+
+struct BuiltinMesh {
+    std::vector<BuiltinVertex> vertexes;
+    std::vector<uint32_t> indexes;
+};
+
+static void BenchBuiltin( BuiltinObject object, const char *name, int iterations, const MeshOptimizer::Options (&options)[2] )
+{
+    const BuiltinObjectInfo &info = BuiltinObjectInfos[(int)object];
+
+    BuiltinMesh mesh;
+    mesh.vertexes.assign(info.vertexes, info.vertexes + info.vertexCount);
+    mesh.indexes.assign(info.indexes, info.indexes + info.indexCount);
+
+    for (int i=0; i < 2; ++i) {
+        Result result = Run(mesh, iterations, [&]( BuiltinMesh &copy ) {
+            MeshOptimizer::Submesh submesh;
+                submesh.count = (uint32_t)copy.indexes.size();
+            return MeshOptimizer::Optimize(copy.vertexes.data(), sizeof(BuiltinVertex), copy.vertexes.size(), offsetof(BuiltinVertex, pos),
+                                           copy.indexes.data(), &submesh, 1, options[i]);
+        });
+        PrintResult(name, options[i].reduceOverdraw ? "overdraw" : "default", result);
+    }
+}
+
+#ifdef PISCES_SUPPORT_LOAD_OBJ
+static void BenchObj( const ObjLoader::Result &obj, const char *name, int iterations, const MeshOptimizer::Options (&options)[2] )
+{
+    for (int i=0; i < 2; ++i) {
+        Result total;
+        for (const ObjLoader::Object &object : obj.objects) {
+            Result result = Run(object, iterations, [&]( ObjLoader::Object &copy ) {
+                return MeshOptimizer::Optimize(copy, options[i]);
+            });
+
+            Accumulate(total.before, result.before);
+            Accumulate(total.after, result.after);
+            total.milliseconds += result.milliseconds;
+        }
+        PrintResult(name, options[i].reduceOverdraw ? "overdraw" : "default", total);
+    }
+}
+#endif
+
+static int PrintUsage()
+{
+    fprintf(stderr, "usage: pisces-meshbench [--iterations <count>] [--cache-size <size>] [<archive> <file.obj>]\n");
+    return 1;
+}
+
+int main( int argc, char **argv )
+{
+    int iterations = 100,
+        cacheSize = 16;
+
+    const char *args[2];
+    int argCount = 0;
+    for (int i=1; i < argc; ++i) {
+        if (strcmp(argv[i], "--iterations") == 0 && i+1 < argc) {
+            iterations = atoi(argv[++i]);
+        }
+        else if (strcmp(argv[i], "--cache-size") == 0 && i+1 < argc) {
+            cacheSize = atoi(argv[++i]);
+        }
+        else if (argCount < 2) {
+            args[argCount++] = argv[i];
+        }
+        else {
+            return PrintUsage();
+        }
+    }
+    if (iterations <= 0 || cacheSize <= 0 || (argCount != 0 && argCount != 2)) return PrintUsage();
+
+    MeshOptimizer::Options options[2];
+    options[0].cacheSize = cacheSize;
+    options[1].cacheSize = cacheSize;
+    options[1].reduceOverdraw = true;
+
+    printf("%i iterations, cache size %i\n", iterations, cacheSize);
+
+    BenchBuiltin(BuiltinObject::IcoSphere, "IcoSphere", iterations, options);
+    BenchBuiltin(BuiltinObject::UVSphere, "UVSphere", iterations, options);
+
+    if (argCount == 2) {
+#ifdef PISCES_SUPPORT_LOAD_OBJ
+        try {
+            Common::Archive archive = Common::Archive::OpenArchive(args[0]);
+            ObjLoader::Result obj = ObjLoader::LoadFile(archive, args[1], IndexType::UInt32);
+            BenchObj(obj, args[1], iterations, options);
+        }
+        catch (const std::exception &e) {
+            fprintf(stderr, "Failed to load \"%s\": %s\n", args[1], e.what());
+            return 1;
+        }
+#else
+        fprintf(stderr, "Pisces was built without PISCES_SUPPORT_LOAD_OBJ, can't load \"%s\"\n", args[1]);
+        return 1;
+#endif
+    }
+    return 0;
+}
@@ -0,0 +1,159 @@
+// pisces-meshcook: converts .obj files into the cooked binary mesh format loaded by MeshLoader
+//
+//   pisces-meshcook [--index32] [--lods <count>] [--lod-error <error>] [--optimize] [--overdraw]
+//                   [--position <type>] [--uv <type>] [--normal <type>] <archive> <file.obj> <output.mesh>
+//
+// --lods appends up to count simplified lods with half the triangles each, none with an error above --lod-error (object space).
+// --optimize reorders triangles & vertexes for the vertex cache and fetch, --overdraw also sorts triangle clusters.
+// --position, --uv & --normal quantize the attribute to float32, float16, snorm16, unorm16, snorm8, unorm8 or snorm10 (2_10_10_10)
+
+#include "Pisces/utility/ObjLoader.h"
+#include "Pisces/utility/MeshCooker.h"
+#include "Pisces/utility/MeshOptimizer.h"
+#include "Pisces/utility/MeshQuantizer.h"
+
+#include "Common/Archive.h"
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <exception>
+#include <fstream>
+#include <limits>
+#include <vector>
+
+using namespace Pisces;
+
+// Attributes of MeshCooker::FromObj
+static const int POSITION_ATTRIBUTE = 0,
+                 UV_ATTRIBUTE = 1,
+                 NORMAL_ATTRIBUTE = 2;
+
+static const char *ATTRIBUTE_NAMES[] = {"position", "uv", "normal"};
+
+static const struct {
+    const char *name;
+    VertexAttributeType type;
+} TYPE_NAMES[] = {
+    {"float32", VertexAttributeType::Float32},
+    {"float16", VertexAttributeType::Float16},
+    {"snorm16", VertexAttributeType::NormInt16},
+    {"unorm16", VertexAttributeType::NormUInt16},
+    {"snorm8", VertexAttributeType::NormInt8},
+    {"unorm8", VertexAttributeType::NormUInt8},
+    {"snorm10", VertexAttributeType::NormInt3x10_1x2},
+};
+
+static bool ParseType( const char *name, VertexAttributeType &type )
+{
+    for (const auto &entry : TYPE_NAMES) {
+        if (strcmp(entry.name, name) == 0) {
+            type = entry.type;
+            return true;
+        }
+    }
+    return false;
+}
+
+static int PrintUsage()
+{
+    fprintf(stderr, "usage: pisces-meshcook [--index32] [--lods <count>] [--lod-error <error>] [--optimize] [--overdraw]\n"
+                    "                       [--position <type>] [--uv <type>] [--normal <type>] <archive> <file.obj> <output.mesh>\n"
+                    "types: float32, float16, snorm16, unorm16, snorm8, unorm8, snorm10\n");
+    return 1;
+}
+
+int main( int argc, char **argv )
+{
+    IndexType indexType = IndexType::UInt16;
+    bool optimize = false;
+    int lodCount = 0;
+    float lodError = std::numeric_limits<float>::max();
+    MeshOptimizer::Options options;
+    std::vector<MeshQuantizer::Encoding> encodings;
+
+    const char *args[3];
+    int argCount = 0;
+    for (int i=1; i < argc; ++i) {
+        if (strcmp(argv[i], "--index32") == 0) {
+            indexType = IndexType::UInt32;
+        }
+        else if (strcmp(argv[i], "--lods") == 0 && i+1 < argc) {
+            lodCount = atoi(argv[++i]);
+        }
+        else if (strcmp(argv[i], "--lod-error") == 0 && i+1 < argc) {
+            lodError = (float)atof(argv[++i]);
+        }
+        else if (strcmp(argv[i], "--optimize") == 0) {
+            optimize = true;
+        }
+        else if (strcmp(argv[i], "--overdraw") == 0) {
+            optimize = true;
+            options.reduceOverdraw = true;
+        }
+        else if (strcmp(argv[i], "--position") == 0 || strcmp(argv[i], "--uv") == 0 || strcmp(argv[i], "--normal") == 0) {
+            MeshQuantizer::Encoding encoding;
+            encoding.attribute = argv[i][2] == 'p' ? POSITION_ATTRIBUTE : argv[i][2] == 'u' ? UV_ATTRIBUTE : NORMAL_ATTRIBUTE;
+            if (i+1 >= argc || !ParseType(argv[++i], encoding.type)) {
+                return PrintUsage();
+            }
+            encodings.push_back(encoding);
+        }
+        else if (argCount < 3) {
+            args[argCount++] = argv[i];
+        }
+        else {
+            return PrintUsage();
+        }
+    }
+    if (argCount != 3) {
+        return PrintUsage();
+    }
+
+    try {
+        Common::Archive archive = Common::Archive::OpenArchive(args[0]);
+        ObjLoader::Result obj = ObjLoader::LoadFile(archive, args[1], indexType);
+
+        MeshCooker::Mesh mesh = MeshCooker::FromObj(obj);
+
+        if (lodCount > 0) {
+            MeshCooker::GenerateLods(mesh, lodCount, 0.5f, lodError, POSITION_ATTRIBUTE);
+            for (size_t i=1; i < mesh.lods.size(); ++i) {
+                size_t indexCount = 0;
+                for (uint32_t s=0; s < mesh.lods[i].submeshCount; ++s) {
+                    indexCount += mesh.submeshes[mesh.lods[i].firstSubmesh + s].count;
+                }
+                printf("lod %zu: %zu triangles, error %g\n", i, indexCount / 3, mesh.lods[i].error);
+            }
+        }
+
+        if (optimize) {
+            MeshOptimizer::Report report = MeshCooker::Optimize(mesh, 0, options);
+            printf("vertex cache (%i entries): ACMR %.3f -> %.3f, ATVR %.3f -> %.3f\n", options.cacheSize,
+                   report.before.acmr(), report.after.acmr(), report.before.atvr(), report.after.atvr()
+            );
+        }
+
+        if (!encodings.empty()) {
+            MeshQuantizer::Report report = MeshQuantizer::Quantize(mesh, encodings.data(), encodings.size(), POSITION_ATTRIBUTE);
+            printf("vertex stride: %u -> %u bytes\n", report.vertexStrideBefore, report.vertexStrideAfter);
+            for (size_t i=0; i < report.errors.size(); ++i) {
+                printf("%s error: max %g, mean %g\n", ATTRIBUTE_NAMES[i], report.errors[i].maxError, report.errors[i].meanError);
+            }
+        }
+
+        std::ofstream stream(args[2], std::ios::binary | std::ios::trunc);
+        if (!stream) {
+            fprintf(stderr, "Failed to open \"%s\" for writing\n", args[2]);
+            return 1;
+        }
+        MeshCooker::Write(mesh, stream);
+
+        printf("%s: %u vertexes, %zu indexes, %zu submeshes\n", args[2], mesh.vertexCount, mesh.indexes.size(), mesh.submeshes.size());
+    }
+    catch (const std::exception &e) {
+        fprintf(stderr, "Failed to cook \"%s\": %s\n", args[1], e.what());
+        return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,133 @@
+// pisces-objcheck: compares the ObjLoader::Result of an .obj file against a stored reference dump, so changes to the
+// loader can be checked for bit identical output. data/objcheck.ref was written by the tinyobjloader based loader.
+//
+//   pisces-objcheck [--write] <archive> <file.obj> <reference>
+//
+// --write replaces the reference with the output of the current loader instead of comparing.
+
+#include "Pisces/utility/ObjLoader.h"
+
+#include "Common/Archive.h"
+
+#include <cstdio>
+#include <cstring>
+#include <exception>
+#include <fstream>
+#include <sstream>
+#include <string>
+
+using namespace Pisces;
+
+static uint32_t FloatBits( float value )
+{
+    uint32_t bits;
+    memcpy(&bits, &value, sizeof(bits));
+    return bits;
+}
+
+// One line per vertex, index list & sub object. Floats are written as their bits, so any difference shows
+static std::string Dump( const ObjLoader::Result &result )
+{
+    std::ostringstream stream;
+    char line[256];
+
+    for (const auto &object : result.objects) {
+        size_t indexCount = object.indexType == IndexType::UInt32 ? object.indexes32.size() : object.indexes.size();
+
+        stream << "object \"" << Common::GetCString(object.name) << "\" vertexes " << object.vertexes.size()
+               << " indexes " << indexCount << " subobjects " << object.subobjects.size() << "\n";
+
+        for (const auto &vertex : object.vertexes) {
+            snprintf(line, sizeof(line), "v %08x %08x %08x %04x %04x %08x\n",
+                     FloatBits(vertex.pos[0]), FloatBits(vertex.pos[1]), FloatBits(vertex.pos[2]),
+                     vertex.uv[0], vertex.uv[1], vertex.normal);
+            stream << line;
+        }
+
+        stream << "i";
+        for (size_t i=0; i < indexCount; ++i) {
+            stream << " " << (object.indexType == IndexType::UInt32 ? object.indexes32[i] : object.indexes[i]);
+        }
+        stream << "\n";
+
+        for (const auto &subObject : object.subobjects) {
+            stream << "s " << subObject.first << " " << subObject.count << " " << subObject.baseVertex
+                   << " \"" << Common::GetCString(subObject.material) << "\"\n";
+        }
+    }
+    return stream.str();
+}
+
+static int PrintUsage()
+{
+    fprintf(stderr, "usage: pisces-objcheck [--write] <archive> <file.obj> <reference>\n");
+    return 1;
+}
+
+int main( int argc, char **argv )
+{
+    bool write = false;
+
+    const char *args[3];
+    int argCount = 0;
+    for (int i=1; i < argc; ++i) {
+        if (strcmp(argv[i], "--write") == 0) {
+            write = true;
+        }
+        else if (argCount < 3) {
+            args[argCount++] = argv[i];
+        }
+        else {
+            return PrintUsage();
+        }
+    }
+    if (argCount != 3) {
+        return PrintUsage();
+    }
+
+    std::string dump;
+    try {
+        Common::Archive archive = Common::Archive::OpenArchive(args[0]);
+        dump = Dump(ObjLoader::LoadFile(archive, args[1]));
+    }
+    catch (const std::exception &e) {
+        fprintf(stderr, "Failed to load \"%s\": %s\n", args[1], e.what());
+        return 1;
+    }
+
+    if (write) {
+        std::ofstream stream(args[2], std::ios::binary | std::ios::trunc);
+        if (!stream) {
+            fprintf(stderr, "Failed to open \"%s\" for writing\n", args[2]);
+            return 1;
+        }
+        stream << dump;
+        printf("%s: written\n", args[2]);
+        return 0;
+    }
+
+    std::ifstream stream(args[2], std::ios::binary);
+    if (!stream) {
+        fprintf(stderr, "Failed to open \"%s\"\n", args[2]);
+        return 1;
+    }
+    std::ostringstream reference;
+    reference << stream.rdbuf();
+
+    std::istringstream expected(reference.str()), actual(dump);
+    std::string expectedLine, actualLine;
+    for (int lineNumber=1; ; ++lineNumber) {
+        bool hasExpected = (bool)std::getline(expected, expectedLine),
+             hasActual = (bool)std::getline(actual, actualLine);
+        if (!hasExpected && !hasActual) break;
+
+        if (hasExpected != hasActual || expectedLine != actualLine) {
+            fprintf(stderr, "%s: mismatch at line %i\n  expected: %s\n  actual:   %s\n", args[1], lineNumber,
+                    hasExpected ? expectedLine.c_str() : "<end>", hasActual ? actualLine.c_str() : "<end>");
+            return 1;
+        }
+    }
+
+    printf("%s: matches %s\n", args[1], args[2]);
+    return 0;
+}
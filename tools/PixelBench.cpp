@@ -0,0 +1,202 @@
+// pisces-pixelbench: measures the throughput of every PixelKernels routine for every pixel format it handles, once per
+// implementation level the cpu supports (scalar, SSE2, AVX2). The output of every level is compared with the scalar
+// one, the exit code is 1 if any of them differs.
+//
+//   pisces-pixelbench [--size <width> <height>] [--iterations <count>]
+
+#include "Pisces/internal/PixelKernels.h"
+
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <functional>
+#include <string>
+#include <vector>
+
+using namespace Pisces;
+
+static const char *FORMAT_NAMES[] = {"", "r8", "rg8", "rgb8", "rgba8"};
+static const char *LEVEL_NAMES[] = {"scalar", "sse2", "avx2"};
+
+struct Image {
+    int width = 0, height = 0;
+
+    // Inputs, big enough for rgba8 & rgba32f
+    std::vector<uint8_t> bytes;
+    std::vector<float> floats;
+
+    // Outputs
+    std::vector<uint8_t> dstBytes;
+    std::vector<float> dstFloats;
+
+    size_t pixelCount() const { return (size_t)width * height; }
+};
+
+struct Kernel {
+    std::string name;
+    // Bytes read & written per pixel, used for the throughput
+    size_t bytesPerPixel;
+    std::function<void( Image& )> run;
+};
+
+static std::vector<Kernel> CreateKernels()
+{
+    std::vector<Kernel> kernels;
+
+    for (int channels=1; channels <= 4; ++channels) {
+        kernels.push_back({std::string("FlipVertical ") + FORMAT_NAMES[channels], (size_t)channels * 2,
+            [channels]( Image &image ) {
+                size_t rowBytes = (size_t)image.width * channels;
+                memcpy(image.dstBytes.data(), image.bytes.data(), rowBytes * image.height);
+                PixelKernels::FlipVertical(image.dstBytes.data(), rowBytes, rowBytes, image.height);
+            }
+        });
+        kernels.push_back({std::string("FlipVerticalCopy ") + FORMAT_NAMES[channels], (size_t)channels * 2,
+            [channels]( Image &image ) {
+                size_t rowBytes = (size_t)image.width * channels;
+                PixelKernels::FlipVerticalCopy(image.dstBytes.data(), rowBytes, image.bytes.data(), rowBytes, rowBytes, image.height);
+            }
+        });
+    }
+
+    kernels.push_back({"PremultiplyAlpha rgba8", 8,
+        []( Image &image ) {
+            PixelKernels::PremultiplyAlpha(image.dstBytes.data(), image.bytes.data(), image.pixelCount());
+        }
+    });
+
+    for (int srcChannels=1; srcChannels <= 4; ++srcChannels) {
+        for (int dstChannels=1; dstChannels <= 4; ++dstChannels) {
+            kernels.push_back({std::string("ConvertChannels ") + FORMAT_NAMES[srcChannels] + " -> " + FORMAT_NAMES[dstChannels],
+                (size_t)(srcChannels + dstChannels),
+                [srcChannels, dstChannels]( Image &image ) {
+                    PixelKernels::ConvertChannels(image.dstBytes.data(), dstChannels, image.bytes.data(), srcChannels, image.pixelCount());
+                }
+            });
+        }
+    }
+
+    kernels.push_back({"Swizzle rgba8 (bgra)", 8,
+        []( Image &image ) {
+            const uint8_t mask[4] = {2, 1, 0, 3};
+            PixelKernels::Swizzle(image.dstBytes.data(), image.bytes.data(), mask, image.pixelCount());
+        }
+    });
+
+    for (bool hasAlpha : {false, true}) {
+        int channels = hasAlpha ? 4 : 3;
+        kernels.push_back({std::string("SrgbToLinear ") + (hasAlpha ? "srgb8_a8" : "srgb8"), (size_t)channels * 5,
+            [channels, hasAlpha]( Image &image ) {
+                PixelKernels::SrgbToLinear(image.dstFloats.data(), image.bytes.data(), image.pixelCount() * channels, hasAlpha);
+            }
+        });
+        kernels.push_back({std::string("LinearToSrgb ") + (hasAlpha ? "srgb8_a8" : "srgb8"), (size_t)channels * 5,
+            [channels, hasAlpha]( Image &image ) {
+                PixelKernels::LinearToSrgb(image.dstBytes.data(), image.floats.data(), image.pixelCount() * channels, hasAlpha);
+            }
+        });
+    }
+
+    return kernels;
+}
+
+static void ClearOutputs( Image &image )
+{
+    memset(image.dstBytes.data(), 0, image.dstBytes.size());
+    memset(image.dstFloats.data(), 0, image.dstFloats.size() * sizeof(float));
+}
+
+static int PrintUsage()
+{
+    fprintf(stderr, "usage: pisces-pixelbench [--size <width> <height>] [--iterations <count>]\n");
+    return 1;
+}
+
+int main( int argc, char **argv )
+{
+    using Clock = std::chrono::steady_clock;
+
+    Image image;
+    image.width = 2048;
+    image.height = 2048;
+    int iterations = 20;
+
+    for (int i=1; i < argc; ++i) {
+        if (strcmp(argv[i], "--size") == 0 && i+2 < argc) {
+            image.width = atoi(argv[++i]);
+            image.height = atoi(argv[++i]);
+        }
+        else if (strcmp(argv[i], "--iterations") == 0 && i+1 < argc) {
+            iterations = atoi(argv[++i]);
+        }
+        else {
+            return PrintUsage();
+        }
+    }
+    if (image.width <= 0 || image.height <= 0 || iterations <= 0) return PrintUsage();
+
+    size_t valueCount = image.pixelCount() * 4;
+    image.bytes.resize(valueCount);
+    image.floats.resize(valueCount);
+    image.dstBytes.resize(valueCount);
+    image.dstFloats.resize(valueCount);
+
+    // Linear values slightly outside of [0, 1] so the clamping is covered as well
+    uint32_t seed = 12345;
+    for (size_t i=0; i < valueCount; ++i) {
+        seed = seed * 1664525u + 1013904223u;
+        image.bytes[i] = (uint8_t)(seed >> 24);
+        image.floats[i] = (float)(seed >> 8) / (float)(1 << 24) * 1.2f - 0.1f;
+    }
+
+    std::vector<Kernel> kernels = CreateKernels();
+
+    // Output of the scalar level for every kernel
+    std::vector<std::vector<uint8_t>> referenceBytes(kernels.size());
+    std::vector<std::vector<float>> referenceFloats(kernels.size());
+
+    printf("%ix%i pixels, %i iterations\n", image.width, image.height, iterations);
+
+    bool ok = true;
+    for (int level=0; level <= (int)PixelKernels::Level::AVX2; ++level) {
+        PixelKernels::Level used = PixelKernels::InitPixelKernels((PixelKernels::Level)level);
+        if ((int)used != level) {
+            printf("%s: not supported\n", LEVEL_NAMES[level]);
+            continue;
+        }
+
+        printf("%s\n", LEVEL_NAMES[level]);
+        for (size_t k=0; k < kernels.size(); ++k) {
+            const Kernel &kernel = kernels[k];
+
+            ClearOutputs(image);
+            kernel.run(image);
+
+            bool matches = true;
+            if (level == 0) {
+                referenceBytes[k] = image.dstBytes;
+                referenceFloats[k] = image.dstFloats;
+            }
+            else {
+                matches = image.dstBytes == referenceBytes[k] &&
+                          memcmp(image.dstFloats.data(), referenceFloats[k].data(), valueCount * sizeof(float)) == 0;
+                ok &= matches;
+            }
+
+            auto start = Clock::now();
+            for (int i=0; i < iterations; ++i) {
+                kernel.run(image);
+            }
+            double seconds = std::chrono::duration<double>(Clock::now() - start).count() / iterations;
+
+            printf("  %-32s %9.1f Mpixel/s %8.2f GB/s%s\n", kernel.name.c_str(),
+                   image.pixelCount() / seconds * 1e-6, image.pixelCount() * kernel.bytesPerPixel / seconds * 1e-9,
+                   matches ? "" : "  MISMATCH (differs from scalar)");
+        }
+    }
+
+    PixelKernels::InitPixelKernels();
+    return ok ? 0 : 1;
+}
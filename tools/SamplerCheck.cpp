@@ -0,0 +1,177 @@
+// pisces-samplercheck: compiles a queue that samples a texture through two sampler handles sharing a sampler object,
+// changes the params of one of them with setSamplerParams and executes the same compiled queue again. The sampled
+// values are captured with transform feedback, the queue must still execute and pick up the new params of only the
+// changed sampler. Runs with texture units and, when supported, with bindless textures.
+//
+//   pisces-samplercheck
+
+#define SDL_MAIN_HANDLED
+
+#include "Pisces/Context.h"
+#include "Pisces/CompiledRenderQueue.h"
+#include "Pisces/PipelineManager.h"
+#include "Pisces/HardwareResourceManager.h"
+#include "Pisces/RenderCommandQueue.h"
+
+#include "Common/StringId.h"
+
+#include <SDL.h>
+
+#include <cmath>
+#include <cstdio>
+#include <exception>
+
+using namespace Pisces;
+
+static const char *TRANSFORM_SHADER = R"(
+#version 330 core
+
+layout(location=0) in float gCoord;
+
+uniform sampler2D Texture;
+
+out float vValue;
+
+void main()
+{
+    vValue = textureLod(Texture, vec2(gCoord, 0.5), 0.0).r;
+}
+)";
+
+// Outside of [0,1], so Repeat reads the black texel and ClampToEdge the white one
+static const float SAMPLE_COORD = 1.25f;
+
+static SamplerParams EdgeSampling( EdgeSamplingMode mode )
+{
+    SamplerParams params;
+        params.minFilter = SamplerMinFilter::Nearest;
+        params.magFilter = SamplerMagFilter::Nearest;
+        params.edgeSamplingX = mode;
+        params.edgeSamplingY = mode;
+    return params;
+}
+
+static bool Check( const char *step, const float (&values)[2], float expectedA, float expectedB )
+{
+    bool ok = std::fabs(values[0] - expectedA) < 0.01f && std::fabs(values[1] - expectedB) < 0.01f;
+    printf("  %-24s sampler a %.2f (expected %.2f), sampler b %.2f (expected %.2f)%s\n", step,
+           values[0], expectedA, values[1], expectedB, ok ? "" : "  FAILED");
+    return ok;
+}
+
+static bool Run( Context *context, RenderQueueCompileFlags flags )
+{
+    HardwareResourceManager *hardwareMgr = context->getHardwareResourceManager();
+    PipelineManager *pipelineMgr = context->getPipelineManager();
+
+    TransformCaptureVariable capture;
+        capture.name = "vValue";
+        capture.type = TransformCaptureType::Float;
+
+    TransformProgramInitParams programParams;
+        programParams.name = Common::CreateStringId("SamplerCheck.program");
+        programParams.source = TRANSFORM_SHADER;
+        programParams.bindings.samplers[0] = "Texture";
+        programParams.capture = &capture;
+        programParams.captureCount = 1;
+    TransformProgramHandle program = pipelineMgr->createTransformProgram(programParams);
+
+    // Black texel at x=0, white at x=1
+    const uint8_t pixels[] = {0, 0, 0, 255, 255, 255, 255, 255};
+    TextureHandle texture = hardwareMgr->allocateTexture2D(PixelFormat::RGBA8, TextureFlags::None, 2, 1);
+    hardwareMgr->uploadTexture2D(texture, 0, TextureUploadFlags::None, PixelFormat::RGBA8, pixels);
+
+    // Same params, so both handles start with the same sampler object
+    TextureHandle samplerA = hardwareMgr->createSampler(texture, EdgeSampling(EdgeSamplingMode::Repeat)),
+                  samplerB = hardwareMgr->createSampler(texture, EdgeSampling(EdgeSamplingMode::Repeat));
+
+    const VertexAttribute layout[] = {
+        {VertexAttributeType::Float32, 0, 1, sizeof(float), 0},
+    };
+    BufferHandle coordBuffer = hardwareMgr->allocateBuffer(BufferType::Vertex, BufferUsage::Static, BufferFlags::None, sizeof(float), &SAMPLE_COORD);
+    VertexArrayHandle vertexArray = hardwareMgr->createVertexArray(layout, 1, &coordBuffer, 1, BufferHandle(), IndexType::None);
+
+    BufferHandle captureBuffer = hardwareMgr->allocateBuffer(BufferType::Vertex, BufferUsage::DynamicCopy, BufferFlags::None, 2*sizeof(float), nullptr);
+
+    RenderCommandQueuePtr queue = context->createRenderCommandQueue();
+    queue->useVertexArray(vertexArray);
+    for (int i=0; i < 2; ++i) {
+        queue->bindTexture(0, i == 0 ? samplerA : samplerB);
+        queue->beginTransformFeedback(program, Primitive::Points, captureBuffer, i*sizeof(float), sizeof(float));
+        queue->draw(Primitive::Points, 0, 1);
+        queue->endTransformFeedback();
+    }
+
+    RenderQueueCompileOptions options;
+        options.flags = flags;
+    CompiledRenderQueuePtr compiled = context->compile(queue, options);
+
+    bool ok = true;
+    float values[2] = {-1.f, -1.f};
+
+    context->execute(compiled);
+    hardwareMgr->downloadBuffer(captureBuffer, 0, sizeof(values), values);
+    ok &= Check("compiled", values, 0.f, 0.f);
+
+    hardwareMgr->setSamplerParams(samplerA, EdgeSampling(EdgeSamplingMode::ClampToEdge));
+
+    values[0] = values[1] = -1.f;
+    context->execute(compiled);
+    hardwareMgr->downloadBuffer(captureBuffer, 0, sizeof(values), values);
+    ok &= Check("after setSamplerParams", values, 1.f, 0.f);
+
+    hardwareMgr->setSamplerParams(samplerA, EdgeSampling(EdgeSamplingMode::Repeat));
+
+    values[0] = values[1] = -1.f;
+    context->execute(compiled);
+    hardwareMgr->downloadBuffer(captureBuffer, 0, sizeof(values), values);
+    ok &= Check("after changing it back", values, 0.f, 0.f);
+
+    hardwareMgr->deleteVertexArray(vertexArray);
+    hardwareMgr->freeBuffer(captureBuffer);
+    hardwareMgr->freeBuffer(coordBuffer);
+    hardwareMgr->freeTexture(samplerB);
+    hardwareMgr->freeTexture(samplerA);
+    hardwareMgr->freeTexture(texture);
+    pipelineMgr->destroyProgram(program);
+
+    return ok;
+}
+
+int main( int argc, char ** )
+{
+    if (argc != 1) {
+        fprintf(stderr, "usage: pisces-samplercheck\n");
+        return 1;
+    }
+
+    if (SDL_Init(SDL_INIT_VIDEO) != 0) {
+        fprintf(stderr, "Failed to initialize SDL - %s\n", SDL_GetError());
+        return 1;
+    }
+
+    bool ok = true;
+    try {
+        Context::InitParams params;
+            params.windowTitle = "pisces-samplercheck";
+            params.enableVSync = false;
+            params.initRemotery = false;
+        Context *context = Context::Initilize(params);
+
+        printf("texture units\n");
+        ok &= Run(context, RenderQueueCompileFlags::None);
+
+        // Without ARB_bindless_texture the compiler falls back to texture units
+        printf("bindless textures\n");
+        ok &= Run(context, RenderQueueCompileFlags::BindlessTextures);
+
+        Context::Shutdown();
+    }
+    catch (const std::exception &e) {
+        fprintf(stderr, "%s\n", e.what());
+        ok = false;
+    }
+
+    SDL_Quit();
+    return ok ? 0 : 1;
+}
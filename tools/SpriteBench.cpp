@@ -0,0 +1,169 @@
+// pisces-spritebench: pushes a moving field of sprites spread over several textures into a SpriteBatch every frame and
+// reports the cpu time per frame of each step: push, sort & fill (both in end()), draw (recording the queue) and execute
+// (compiling & submitting it), together with the frame time
+//
+//   pisces-spritebench [--frames <count>] [--sprites <count>] [--textures <count>]
+
+#define SDL_MAIN_HANDLED
+
+#include "Pisces/Context.h"
+#include "Pisces/HardwareResourceManager.h"
+#include "Pisces/RenderCommandQueue.h"
+#include "Pisces/Sprite.h"
+#include "Pisces/utility/SpriteBatch.h"
+
+#include <SDL.h>
+
+#include <glm/vec2.hpp>
+#include <glm/mat4x4.hpp>
+
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <exception>
+#include <vector>
+
+using namespace Pisces;
+
+struct Result {
+    double push = 0.0, sort = 0.0, fill = 0.0, draw = 0.0, execute = 0.0,
+           frame = 0.0;
+    size_t draws = 0;
+};
+
+static Result Run( Context *context, int frameCount, int spriteCount, int textureCount )
+{
+    using Clock = std::chrono::steady_clock;
+    auto seconds = []( Clock::time_point start, Clock::time_point end ) {
+        return std::chrono::duration<double>(end - start).count();
+    };
+
+    HardwareResourceManager *hardwareMgr = context->getHardwareResourceManager();
+
+    std::vector<TextureHandle> textures(textureCount);
+    for (int i=0; i < textureCount; ++i) {
+        uint32_t color = 0xFF000000u | (uint32_t)(i * 2654435761u >> 8);
+        textures[i] = hardwareMgr->allocateTexture2D(PixelFormat::RGBA8, TextureFlags::None, 1, 1);
+        hardwareMgr->uploadTexture2D(textures[i], 0, TextureUploadFlags::None, PixelFormat::RGBA8, &color);
+    }
+
+    // Textures are assigned pseudo randomly, so the sort has to reorder every frame
+    std::vector<Sprite> sprites(spriteCount);
+    for (int i=0; i < spriteCount; ++i) {
+        sprites[i].texture = textures[(i * 2654435761u >> 16) % textureCount];
+        sprites[i].uv = {0.f, 0.f, 1.f, 1.f};
+    }
+
+    Result result;
+    {
+        SpriteBatch batch(context);
+        glm::mat4 viewProjection(1.f);
+
+        auto start = Clock::now();
+        for (int frame=0; frame < frameCount; ++frame) {
+            auto pushStart = Clock::now();
+            batch.begin();
+            for (int i=0; i < spriteCount; ++i) {
+                float angle = (i * 0.618034f + frame * 0.01f) * 6.2831853f,
+                      radius = (float)(i % 1024) / 1024.f;
+                batch.push(sprites[i], glm::vec2(std::cos(angle), std::sin(angle)) * radius, glm::vec2(0.01f), angle);
+            }
+            auto endStart = Clock::now();
+            batch.end();
+            auto drawStart = Clock::now();
+
+            RenderCommandQueuePtr queue = context->createRenderCommandQueue();
+            queue->clear(ClearFlags::Color);
+            batch.draw(queue, viewProjection);
+            auto executeStart = Clock::now();
+
+            context->execute(queue);
+            auto executeEnd = Clock::now();
+
+            context->swapFrameBuffer();
+
+            SpriteBatch::Timings timings = batch.timings();
+            result.push += seconds(pushStart, endStart);
+            result.sort += timings.sort;
+            result.fill += timings.fill;
+            result.draw += seconds(drawStart, executeStart);
+            result.execute += seconds(executeStart, executeEnd);
+            result.draws = batch.drawCount();
+
+            SDL_Event event;
+            while (SDL_PollEvent(&event)) {}
+        }
+        result.frame = seconds(start, Clock::now());
+    }
+
+    for (TextureHandle texture : textures) {
+        hardwareMgr->freeTexture(texture);
+    }
+
+    // Per frame in milliseconds
+    for (double *value : {&result.push, &result.sort, &result.fill, &result.draw, &result.execute, &result.frame}) {
+        *value = *value / frameCount * 1e3;
+    }
+    return result;
+}
+
+static int PrintUsage()
+{
+    fprintf(stderr, "usage: pisces-spritebench [--frames <count>] [--sprites <count>] [--textures <count>]\n");
+    return 1;
+}
+
+int main( int argc, char **argv )
+{
+    int frameCount = 500,
+        spriteCount = 100000,
+        textureCount = 16;
+
+    for (int i=1; i < argc; ++i) {
+        if (strcmp(argv[i], "--frames") == 0 && i+1 < argc) {
+            frameCount = atoi(argv[++i]);
+        }
+        else if (strcmp(argv[i], "--sprites") == 0 && i+1 < argc) {
+            spriteCount = atoi(argv[++i]);
+        }
+        else if (strcmp(argv[i], "--textures") == 0 && i+1 < argc) {
+            textureCount = atoi(argv[++i]);
+        }
+        else {
+            return PrintUsage();
+        }
+    }
+    if (frameCount <= 0 || spriteCount <= 0 || textureCount <= 0) return PrintUsage();
+
+    if (SDL_Init(SDL_INIT_VIDEO) != 0) {
+        fprintf(stderr, "Failed to initialize SDL - %s\n", SDL_GetError());
+        return 1;
+    }
+
+    int status = 0;
+    try {
+        Context::InitParams params;
+            params.windowTitle = "pisces-spritebench";
+            params.enableVSync = false;
+            params.enableDebugContext = false;
+            params.initRemotery = false;
+        Context *context = Context::Initilize(params);
+
+        Result result = Run(context, frameCount, spriteCount, textureCount);
+
+        printf("%i frames of %i sprites on %i textures, %zu draws per frame\n", frameCount, spriteCount, textureCount, result.draws);
+        printf("push %.3f ms, sort %.3f ms, fill %.3f ms, draw %.3f ms, execute %.3f ms, frame %.3f ms\n",
+               result.push, result.sort, result.fill, result.draw, result.execute, result.frame);
+
+        Context::Shutdown();
+    }
+    catch (const std::exception &e) {
+        fprintf(stderr, "%s\n", e.what());
+        status = 1;
+    }
+
+    SDL_Quit();
+    return status;
+}
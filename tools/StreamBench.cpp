@@ -0,0 +1,222 @@
+// pisces-streambench: streams a particle workload through a StreamingBuffer every frame and reports the cpu time spent
+// in mapBuffer, writing & unmapBuffer together with the frame time, once with ARB_buffer_storage (persistent mapping)
+// and once on the GL 3.3 fallback (unsynchronized maps & orphaning)
+//
+//   pisces-streambench [--frames <count>] [--particles <count>] [--backend storage|compat|both]
+
+#define SDL_MAIN_HANDLED
+
+#include "Pisces/Context.h"
+#include "Pisces/PipelineManager.h"
+#include "Pisces/HardwareResourceManager.h"
+#include "Pisces/RenderCommandQueue.h"
+#include "Pisces/StreamingBuffer.h"
+
+#include "Common/StringId.h"
+
+#include <SDL.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <exception>
+
+using namespace Pisces;
+
+struct ParticleVertex {
+    float x, y;
+    uint32_t color;
+};
+
+static const VertexAttribute PARTICLE_LAYOUT[] = {
+    {VertexAttributeType::Float32, offsetof(ParticleVertex, x), 2, sizeof(ParticleVertex), 0},
+    {VertexAttributeType::NormUInt8, offsetof(ParticleVertex, color), 4, sizeof(ParticleVertex), 0},
+};
+
+static const char *VERTEX_SHADER = R"(
+#version 330 core
+
+layout(location=0) in vec2 gPosition;
+layout(location=1) in vec4 gColor;
+
+out vec4 vColor;
+
+void main()
+{
+    gl_Position = vec4(gPosition, 0.0, 1.0);
+    vColor = gColor;
+}
+)";
+static const char *FRAGMENT_SHADER = R"(
+#version 330 core
+
+in vec4 vColor;
+
+layout(location=0) out vec4 color;
+
+void main()
+{
+    color = vColor;
+}
+)";
+
+// Two triangles per particle
+static const int VERTEXES_PER_PARTICLE = 6;
+
+struct Result {
+    double streamMicroseconds = 0.0, worstStreamMicroseconds = 0.0,
+           frameMilliseconds = 0.0;
+};
+
+static Result Run( bool enableExtensions, int frameCount, int particleCount )
+{
+    using Clock = std::chrono::steady_clock;
+
+    Context::InitParams params;
+        params.windowTitle = "pisces-streambench";
+        params.enableExtensions = enableExtensions;
+        params.enableVSync = false;
+        params.enableDebugContext = false;
+        params.initRemotery = false;
+    Context *context = Context::Initilize(params);
+
+    Result result;
+    {
+        PipelineProgramInitParams pipelineParams;
+            pipelineParams.name = Common::CreateStringId("StreamBench");
+            pipelineParams.programParams.name = Common::CreateStringId("StreamBench.program");
+            pipelineParams.programParams.vertexSource = VERTEX_SHADER;
+            pipelineParams.programParams.fragmentSource = FRAGMENT_SHADER;
+        PipelineHandle pipeline = context->getPipelineManager()->createPipeline(pipelineParams);
+
+        size_t vertexCount = (size_t)particleCount * VERTEXES_PER_PARTICLE;
+        StreamingBuffer<ParticleVertex> buffer(context, BufferType::Vertex, vertexCount);
+
+        BufferHandle vertexBuffer = buffer.handle();
+        VertexArrayHandle vertexArray = context->getHardwareResourceManager()->createVertexArray(
+            PARTICLE_LAYOUT, 2, &vertexBuffer, 1, BufferHandle(), IndexType::None
+        );
+
+        double streamSeconds = 0.0;
+        auto start = Clock::now();
+        for (int frame=0; frame < frameCount; ++frame) {
+            auto streamStart = Clock::now();
+
+            size_t first = buffer.currentFrameOffset();
+            ParticleVertex *vertexes = buffer.mapBuffer(0, vertexCount);
+            for (int i=0; i < particleCount; ++i) {
+                float angle = (i * 0.618034f + frame * 0.01f) * 6.2831853f,
+                      radius = (float)(i % 1024) / 1024.f;
+                float x = std::cos(angle) * radius,
+                      y = std::sin(angle) * radius,
+                      size = 0.004f;
+                uint32_t color = 0xFF000000u | (uint32_t)(i * 2654435761u >> 8);
+
+                const float corners[VERTEXES_PER_PARTICLE][2] = {
+                    {-1,-1}, {1,-1}, {1,1}, {-1,-1}, {1,1}, {-1,1}
+                };
+                for (int k=0; k < VERTEXES_PER_PARTICLE; ++k) {
+                    ParticleVertex &vertex = vertexes[i*VERTEXES_PER_PARTICLE + k];
+                        vertex.x = x + corners[k][0]*size;
+                        vertex.y = y + corners[k][1]*size;
+                        vertex.color = color;
+                }
+            }
+            buffer.unmapBuffer();
+
+            double seconds = std::chrono::duration<double>(Clock::now() - streamStart).count();
+            streamSeconds += seconds;
+            result.worstStreamMicroseconds = std::max(result.worstStreamMicroseconds, seconds * 1e6);
+
+            RenderCommandQueuePtr queue = context->createRenderCommandQueue();
+            queue->clear(ClearFlags::Color);
+            queue->usePipeline(pipeline);
+            queue->useVertexArray(vertexArray);
+            queue->draw(Primitive::Triangles, 0, vertexCount, first);
+            context->execute(queue);
+            context->swapFrameBuffer();
+
+            SDL_Event event;
+            while (SDL_PollEvent(&event)) {}
+        }
+        double totalSeconds = std::chrono::duration<double>(Clock::now() - start).count();
+
+        result.streamMicroseconds = streamSeconds / frameCount * 1e6;
+        result.frameMilliseconds = totalSeconds / frameCount * 1e3;
+
+        context->getHardwareResourceManager()->deleteVertexArray(vertexArray);
+        context->getPipelineManager()->destroyPipeline(pipeline);
+    }
+    Context::Shutdown();
+
+    return result;
+}
+
+static int PrintUsage()
+{
+    fprintf(stderr, "usage: pisces-streambench [--frames <count>] [--particles <count>] [--backend storage|compat|both]\n");
+    return 1;
+}
+
+int main( int argc, char **argv )
+{
+    int frameCount = 1000,
+        particleCount = 20000;
+    bool runStorage = true,
+         runCompat = true;
+
+    for (int i=1; i < argc; ++i) {
+        if (strcmp(argv[i], "--frames") == 0 && i+1 < argc) {
+            frameCount = atoi(argv[++i]);
+        }
+        else if (strcmp(argv[i], "--particles") == 0 && i+1 < argc) {
+            particleCount = atoi(argv[++i]);
+        }
+        else if (strcmp(argv[i], "--backend") == 0 && i+1 < argc) {
+            const char *backend = argv[++i];
+            runStorage = strcmp(backend, "storage") == 0 || strcmp(backend, "both") == 0;
+            runCompat = strcmp(backend, "compat") == 0 || strcmp(backend, "both") == 0;
+            if (!runStorage && !runCompat) return PrintUsage();
+        }
+        else {
+            return PrintUsage();
+        }
+    }
+    if (frameCount <= 0 || particleCount <= 0) return PrintUsage();
+
+    if (SDL_Init(SDL_INIT_VIDEO) != 0) {
+        fprintf(stderr, "Failed to initialize SDL - %s\n", SDL_GetError());
+        return 1;
+    }
+
+    int status = 0;
+    try {
+        printf("%i frames of %i particles (%zu KiB per frame)\n", frameCount, particleCount,
+               (size_t)particleCount * VERTEXES_PER_PARTICLE * sizeof(ParticleVertex) / 1024);
+
+        const struct {
+            const char *name;
+            bool enableExtensions, run;
+        } backends[] = {
+            {"storage (persistent map)", true, runStorage},
+            {"compat (unsynchronized map)", false, runCompat},
+        };
+        for (const auto &backend : backends) {
+            if (!backend.run) continue;
+
+            Result result = Run(backend.enableExtensions, frameCount, particleCount);
+            printf("%-28s stream %8.1f us/frame (worst %8.1f us), frame %6.3f ms\n", backend.name,
+                   result.streamMicroseconds, result.worstStreamMicroseconds, result.frameMilliseconds);
+        }
+    }
+    catch (const std::exception &e) {
+        fprintf(stderr, "%s\n", e.what());
+        status = 1;
+    }
+
+    SDL_Quit();
+    return status;
+}
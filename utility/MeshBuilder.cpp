@@ -3,8 +3,8 @@
 #include "HardwareResourceManager.h"
 #include "RenderCommandQueue.h"
 
-#include "Common/GeneratorN.h"
 #include "Common/PointerHelpers.h"
+#include <limits>
 #include <vector>
 
 #include <glm/vec3.hpp>
@@ -13,12 +13,17 @@
 
 namespace Pisces
 {
+    // Vertexes a draw can reach with 16 bit indexes relative to its base vertex
+    static const size_t MAX_COMMAND_VERTEXES = (size_t)std::numeric_limits<uint16_t>::max() + 1;
+    static const uint32_t NO_VERTEX = ~0u;
+
     struct MeshBuilder::Impl {
         Context *context;
 
         const VertexAttribute *layout;
         int layoutSize,
             positionIndex;
+        IndexType indexType;
 
         BufferHandle vertexBuffer,
                      indexBuffer;
@@ -28,6 +33,7 @@ namespace Pisces
 
         std::vector<uint8_t> vertexes;
         std::vector<uint16_t> indexes;
+        std::vector<uint32_t> indexes32;
 
         struct Command {
             size_t first = 0, count = 0,
@@ -35,14 +41,147 @@ namespace Pisces
         };
         std::vector<Command> commands;
 
+        // scratch space to split meshes into clusters
+        std::vector<uint32_t> remap;
+        std::vector<uint32_t> clusterVertexes;
+
+        size_t vertexCount() const
+        {
+            return vertexes.size() / vertexSize;
+        }
+
+        size_t indexCount() const
+        {
+            return indexType == IndexType::UInt16 ? indexes.size() : indexes32.size();
+        }
+
+        void pushIndex( size_t index )
+        {
+            if (indexType == IndexType::UInt16) {
+                assert(index < MAX_COMMAND_VERTEXES);
+                indexes.push_back((uint16_t)index);
+            }
+            else {
+                indexes32.push_back((uint32_t)index);
+            }
+        }
+
+        // Returns the last command if it can reach count more vertexes, otherwise starts a new one
+        Command& reserveCommand( size_t count )
+        {
+            if (!commands.empty()) {
+                auto &command = commands.back();
+                if (indexType == IndexType::UInt32 || (vertexCount() - command.base + count) <= MAX_COMMAND_VERTEXES) {
+                    return command;
+                }
+            }
+
+            commands.emplace_back();
+            auto &command = commands.back();
+                command.first = indexCount();
+                command.base = vertexCount();
+            return command;
+        }
+
+        void appendVertexes( const glm::mat4 &modelMatrix, const void *from, size_t count )
+        {
+            VertexAttribute positionAttribute = layout[positionIndex];
+            assert (positionAttribute.count == 3);
+            assert (positionAttribute.type == VertexAttributeType::Float32);
+
+            size_t requiredSize = vertexSize * count + vertexes.size();
+            if (requiredSize > vertexes.capacity()) {
+                vertexes.reserve(requiredSize*2);
+            }
+
+            const int MAX_VERTEX_SIZE = sizeof(float)*32;
+            uint8_t tmp[MAX_VERTEX_SIZE];
+
+            assert (vertexSize < sizeof(tmp));
+
+            for (size_t i=0; i < count; ++i) {
+                memcpy(tmp, Common::advance(from, i * vertexSize), vertexSize);
+
+                glm::vec4 pos;
+                memcpy(&pos, Common::advance(tmp, positionAttribute.offset), sizeof(float)*3);
+                pos.w = 1.f;
+                pos = modelMatrix * pos;
+                pos /= pos.w;
+
+                memcpy(Common::advance(tmp, positionAttribute.offset), &pos, sizeof(float)*3);
+
+                vertexes.insert(vertexes.end(), tmp, tmp + vertexSize);
+            }
+        }
+
+        template< typename Index >
+        void pushMesh( const glm::mat4 &modelMatrix,
+                       const void *meshVertexes, size_t meshVertexCount,
+                       const Index *meshIndexes, size_t meshIndexCount )
+        {
+            if (indexType == IndexType::UInt32 || meshVertexCount <= MAX_COMMAND_VERTEXES) {
+                auto &command = reserveCommand(meshVertexCount);
+                size_t base = vertexCount() - command.base;
+                command.count += meshIndexCount;
+
+                for (size_t i=0; i < meshIndexCount; ++i) {
+                    assert (meshIndexes[i] < meshVertexCount);
+                    pushIndex(meshIndexes[i] + base);
+                }
+                appendVertexes(modelMatrix, meshVertexes, meshVertexCount);
+                return;
+            }
+
+            // Too many vertexes for one draw: triangles are split in order into clusters, so each cluster
+            // keeps the locality of the original index order, and vertexes are copied in first use order.
+            assert (meshIndexCount % 3 == 0);
+
+            remap.assign(meshVertexCount, NO_VERTEX);
+            clusterVertexes.clear();
+
+            auto *command = &reserveCommand(MAX_COMMAND_VERTEXES);
+
+            for (size_t i=0; i+2 < meshIndexCount; i += 3) {
+                size_t added = 0;
+                for (int j=0; j < 3; ++j) {
+                    bool repeated = (j > 0 && meshIndexes[i+j] == meshIndexes[i]) || (j > 1 && meshIndexes[i+j] == meshIndexes[i+1]);
+                    if (!repeated && remap[meshIndexes[i+j]] == NO_VERTEX) added++;
+                }
+
+                if (vertexCount() - command->base + added > MAX_COMMAND_VERTEXES) {
+                    for (uint32_t vertex : clusterVertexes) {
+                        remap[vertex] = NO_VERTEX;
+                    }
+                    clusterVertexes.clear();
+
+                    command = &reserveCommand(MAX_COMMAND_VERTEXES);
+                }
+
+                for (int j=0; j < 3; ++j) {
+                    size_t vertex = meshIndexes[i+j];
+                    assert (vertex < meshVertexCount);
+
+                    if (remap[vertex] == NO_VERTEX) {
+                        remap[vertex] = (uint32_t)(vertexCount() - command->base);
+                        clusterVertexes.push_back((uint32_t)vertex);
+                        appendVertexes(modelMatrix, Common::advance(meshVertexes, vertex * vertexSize), 1);
+                    }
+                    pushIndex(remap[vertex]);
+                }
+                command->count += 3;
+            }
+        }
     };
 
-    PISCES_API MeshBuilder::MeshBuilder( Context *context, const VertexAttribute *layout, int layoutSize, int positionIndex )
+    PISCES_API MeshBuilder::MeshBuilder( Context *context, const VertexAttribute *layout, int layoutSize, int positionIndex, IndexType indexType )
     {
+        assert(indexType == IndexType::UInt16 || indexType == IndexType::UInt32);
+
         mImpl->context = context;
         mImpl->layout = layout;
         mImpl->layoutSize = layoutSize;
         mImpl->positionIndex = positionIndex;
+        mImpl->indexType = indexType;
 
         int size = layout->stride;
         for (int i=0; i < layoutSize; ++i) {
@@ -78,80 +217,32 @@ namespace Pisces
         hardwareMgr->deleteVertexArray(mImpl->vertexArray);
 
         mImpl->vertexBuffer = hardwareMgr->allocateBuffer(BufferType::Vertex, BufferUsage::Static, BufferFlags::None, mImpl->vertexes.size(), mImpl->vertexes.data());
-        mImpl->indexBuffer  = hardwareMgr->allocateBuffer(BufferType::Index, BufferUsage::Static, BufferFlags::None, mImpl->indexes.size()*sizeof(uint16_t), mImpl->indexes.data());
+        if (mImpl->indexType == IndexType::UInt16) {
+            mImpl->indexBuffer = hardwareMgr->allocateBuffer(BufferType::Index, BufferUsage::Static, BufferFlags::None, mImpl->indexes.size()*sizeof(uint16_t), mImpl->indexes.data());
+        }
+        else {
+            mImpl->indexBuffer = hardwareMgr->allocateBuffer(BufferType::Index, BufferUsage::Static, BufferFlags::None, mImpl->indexes32.size()*sizeof(uint32_t), mImpl->indexes32.data());
+        }
 
-        mImpl->vertexArray = hardwareMgr->createVertexArray(mImpl->layout, mImpl->layoutSize, &mImpl->vertexBuffer, 1, mImpl->indexBuffer, IndexType::UInt16);
+        mImpl->vertexArray = hardwareMgr->createVertexArray(mImpl->layout, mImpl->layoutSize, &mImpl->vertexBuffer, 1, mImpl->indexBuffer, mImpl->indexType);
 
         mImpl->vertexes.clear();
         mImpl->indexes.clear();
+        mImpl->indexes32.clear();
     }
 
     PISCES_API void MeshBuilder::pushMesh( glm::mat4 modelMatrix, 
                                            const void *vertexes, size_t vertexCount, 
                                            const uint16_t *indexes, size_t indexCount )
     {
-        size_t base = mImpl->vertexes.size() / mImpl->vertexSize;
-
-        Impl::Command *command = nullptr;
-        if (!mImpl->commands.empty()) {
-            command = &mImpl->commands.back();
-            if ((command->count+base) >= std::numeric_limits<uint16_t>::max()) {
-                command = nullptr;
-            }
-        }
-
-        if (!command) {
-            mImpl->commands.emplace_back();
-            command = &mImpl->commands.back();
-
-            command->first = mImpl->indexes.size();
-            command->base = mImpl->vertexes.size() / mImpl->vertexSize;;
-        }
-        base -= command->base;
-        command->count += indexCount;
-
-        assert((base + vertexCount) <  std::numeric_limits<uint16_t>::max());
-
-        { // Copy indexes
-            auto gen = Common::CreateGeneratorN(indexCount, [&](size_t i) {
-                assert (indexes[i] < vertexCount);
-                return indexes[i] + base;
-            });
-
-            mImpl->indexes.insert(mImpl->indexes.end(), gen.begin(), gen.end());
-        }
-        { // Copy vertexes
-            VertexAttribute positionAttribute = mImpl->layout[mImpl->positionIndex];
-            assert (positionAttribute.count == 3);
-            assert (positionAttribute.type == VertexAttributeType::Float32);
-
-            size_t requiredSize = mImpl->vertexSize * vertexCount + mImpl->vertexes.size();
-            if (requiredSize > mImpl->vertexes.capacity()) {
-                mImpl->vertexes.reserve(requiredSize*2);
-            }
-
-            const int MAX_VERTEX_SIZE = sizeof(float)*32;
-            uint8_t tmp[MAX_VERTEX_SIZE];
-
-            assert (mImpl->vertexSize < sizeof(tmp));
-
-            for (size_t i=0; i < vertexCount; ++i) {
-                const void *from = Common::advance(vertexes, i * mImpl->vertexSize);
-                memcpy(tmp, from, mImpl->vertexSize);
-
-                
-                glm::vec4 pos;
-                memcpy(&pos, Common::advance(tmp, positionAttribute.offset), sizeof(float)*3);
-                pos.w = 1.f;
-                pos = modelMatrix * pos;
-                pos /= pos.w;
-
-                memcpy(Common::advance(tmp, positionAttribute.offset), &pos, sizeof(float)*3);
-
-                mImpl->vertexes.insert(mImpl->vertexes.end(), tmp, tmp + mImpl->vertexSize);
-            }
-        }
+        mImpl->pushMesh(modelMatrix, vertexes, vertexCount, indexes, indexCount);
+    }
 
+    PISCES_API void MeshBuilder::pushMesh( glm::mat4 modelMatrix, 
+                                           const void *vertexes, size_t vertexCount, 
+                                           const uint32_t *indexes, size_t indexCount )
+    {
+        mImpl->pushMesh(modelMatrix, vertexes, vertexCount, indexes, indexCount);
     }
 
     PISCES_API void MeshBuilder::draw( RenderCommandQueuePtr commandQueue )
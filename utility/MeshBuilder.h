@@ -9,9 +9,13 @@
 
 namespace Pisces
 {
+    // Batches meshes into one vertex & index buffer.
+    // With 16 bit indexes the batch is drawn in ranges of at most 65536 vertexes, a mesh with more
+    // vertexes is split into clusters of consecutive triangles (vertexes on a cluster border are duplicated).
+    // UInt32 indexes never split but take twice the index memory.
     class MeshBuilder {
     public:
-        PISCES_API MeshBuilder( Context *context, const VertexAttribute *layout, int layoutSize, int positionIndex );
+        PISCES_API MeshBuilder( Context *context, const VertexAttribute *layout, int layoutSize, int positionIndex, IndexType indexType=IndexType::UInt16 );
         PISCES_API ~MeshBuilder();
 
         PISCES_API void begin();
@@ -21,6 +25,10 @@ namespace Pisces
             const void *vertexes, size_t vertexCount,
             const uint16_t *indexes, size_t indexCount              
         );
+        PISCES_API void pushMesh( glm::mat4 modelMatrix, 
+            const void *vertexes, size_t vertexCount,
+            const uint32_t *indexes, size_t indexCount              
+        );
 
         // binds vertex array & draws all meshes
         PISCES_API void draw( RenderCommandQueuePtr commandQueue );
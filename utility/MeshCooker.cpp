@@ -0,0 +1,324 @@
+#include "MeshCooker.h"
+#include "MeshFormat.h"
+
+#include "Common/Throw.h"
+#include "Common/ErrorUtils.h"
+
+#include <glm/common.hpp>
+
+#include <algorithm>
+#include <cstddef>
+#include <cstring>
+#include <limits>
+#include <ostream>
+#include <string>
+#include <unordered_map>
+
+namespace Pisces
+{
+#ifdef PISCES_SUPPORT_LOAD_OBJ
+    static const VertexAttribute OBJ_VERTEX_LAYOUT[] = {
+        {VertexAttributeType::Float32, offsetof(ObjLoader::Vertex, pos), 3, sizeof(ObjLoader::Vertex), 0},
+        {VertexAttributeType::NormUInt16, offsetof(ObjLoader::Vertex, uv), 2, sizeof(ObjLoader::Vertex), 0},
+        {VertexAttributeType::NormInt3x10_1x2, offsetof(ObjLoader::Vertex, normal), 4, sizeof(ObjLoader::Vertex), 0}
+    };
+
+    PISCES_API MeshCooker::Mesh MeshCooker::FromObj( const ObjLoader::Result &obj )
+    {
+        Mesh mesh;
+        mesh.layout.assign(std::begin(OBJ_VERTEX_LAYOUT), std::end(OBJ_VERTEX_LAYOUT));
+        mesh.vertexStride = sizeof(ObjLoader::Vertex);
+        mesh.indexType = IndexType::UInt16;
+        mesh.boundsMin = glm::vec3(std::numeric_limits<float>::max());
+        mesh.boundsMax = glm::vec3(-std::numeric_limits<float>::max());
+
+        size_t vertexCount = 0, indexCount = 0;
+        for (const auto &object : obj.objects) {
+            vertexCount += object.vertexes.size();
+            indexCount += object.indexType == IndexType::UInt16 ? object.indexes.size() : object.indexes32.size();
+            if (object.indexType == IndexType::UInt32) {
+                mesh.indexType = IndexType::UInt32;
+            }
+        }
+
+        mesh.vertexes.resize(vertexCount * sizeof(ObjLoader::Vertex));
+        mesh.indexes.reserve(indexCount);
+
+        for (const auto &object : obj.objects) {
+            uint32_t baseVertex = mesh.vertexCount,
+                     baseIndex = (uint32_t)mesh.indexes.size();
+
+            if (!object.vertexes.empty()) {
+                memcpy(mesh.vertexes.data() + baseVertex * sizeof(ObjLoader::Vertex), object.vertexes.data(), object.vertexes.size() * sizeof(ObjLoader::Vertex));
+            }
+            mesh.vertexCount += (uint32_t)object.vertexes.size();
+
+            for (const auto &vertex : object.vertexes) {
+                glm::vec3 pos(vertex.pos[0], vertex.pos[1], vertex.pos[2]);
+                mesh.boundsMin = glm::min(mesh.boundsMin, pos);
+                mesh.boundsMax = glm::max(mesh.boundsMax, pos);
+            }
+
+            if (object.indexType == IndexType::UInt16) {
+                mesh.indexes.insert(mesh.indexes.end(), object.indexes.begin(), object.indexes.end());
+            }
+            else {
+                mesh.indexes.insert(mesh.indexes.end(), object.indexes32.begin(), object.indexes32.end());
+            }
+
+            for (const auto &subObject : object.subobjects) {
+                if (subObject.count == 0) continue;
+
+                Submesh submesh;
+                    submesh.first = baseIndex + subObject.first;
+                    submesh.count = subObject.count;
+                    submesh.baseVertex = baseVertex + subObject.baseVertex;
+                    submesh.material = subObject.material;
+                mesh.submeshes.push_back(submesh);
+            }
+        }
+
+        if (mesh.vertexCount == 0) {
+            mesh.boundsMin = mesh.boundsMax = glm::vec3(0.f);
+        }
+
+        Lod lod;
+            lod.firstSubmesh = 0;
+            lod.submeshCount = (uint32_t)mesh.submeshes.size();
+        mesh.lods.push_back(lod);
+
+        return mesh;
+    }
+#endif
+
+#ifdef PISCES_MESH_OPTIMIZER
+    PISCES_API MeshOptimizer::Report MeshCooker::Optimize( Mesh &mesh, int positionAttribute, const MeshOptimizer::Options &options )
+    {
+        MeshOptimizer::Options meshOptions = options;
+
+        size_t positionOffset = 0;
+        if (positionAttribute >= 0 && positionAttribute < (int)mesh.layout.size() &&
+            mesh.layout[positionAttribute].type == VertexAttributeType::Float32 && mesh.layout[positionAttribute].count == 3) {
+            positionOffset = mesh.layout[positionAttribute].offset;
+        }
+        else if (options.reduceOverdraw) {
+            LOG_WARNING("Can't reduce overdraw, attribute %i isn't a float3 position", positionAttribute);
+            meshOptions.reduceOverdraw = false;
+        }
+
+        std::vector<MeshOptimizer::Submesh> submeshes;
+        for (const auto &submesh : mesh.submeshes) {
+            MeshOptimizer::Submesh info;
+                info.first = submesh.first;
+                info.count = submesh.count;
+                info.baseVertex = submesh.baseVertex;
+            submeshes.push_back(info);
+        }
+
+        return MeshOptimizer::Optimize(mesh.vertexes.data(), mesh.vertexStride, mesh.vertexCount, positionOffset,
+                                       mesh.indexes.data(), submeshes.data(), submeshes.size(), meshOptions);
+    }
+
+    PISCES_API void MeshCooker::GenerateLods( Mesh &mesh, int lodCount, float reduction, float maxError, int positionAttribute )
+    {
+        if (positionAttribute < 0 || positionAttribute >= (int)mesh.layout.size() ||
+            mesh.layout[positionAttribute].type != VertexAttributeType::Float32 || mesh.layout[positionAttribute].count < 3) {
+            THROW(std::invalid_argument, "Can't simplify, attribute %i isn't a float3 position", positionAttribute);
+        }
+        if (mesh.lods.size() > 1) {
+            THROW(std::invalid_argument, "The mesh already has %zu lods", mesh.lods.size());
+        }
+        if (mesh.vertexes.size() != (size_t)mesh.vertexCount * mesh.vertexStride) {
+            THROW(std::invalid_argument, "Vertex data of %zu bytes doesn't match %u vertexes with a stride of %u", mesh.vertexes.size(), mesh.vertexCount, mesh.vertexStride);
+        }
+
+        if (mesh.lods.empty()) {
+            Lod lod;
+                lod.firstSubmesh = 0;
+                lod.submeshCount = (uint32_t)mesh.submeshes.size();
+            mesh.lods.push_back(lod);
+        }
+        const Lod base = mesh.lods[0];
+
+        std::vector<MeshOptimizer::Submesh> submeshes;
+        size_t baseIndexCount = 0;
+        for (uint32_t i=0; i < base.submeshCount; ++i) {
+            const Submesh &submesh = mesh.submeshes[base.firstSubmesh + i];
+
+            MeshOptimizer::Submesh info;
+                info.first = submesh.first;
+                info.count = submesh.count;
+                info.baseVertex = submesh.baseVertex;
+            submeshes.push_back(info);
+            baseIndexCount += submesh.count;
+        }
+
+        // Every lod is simplified from lod 0, so its error is measured against the full detail mesh
+        std::vector<uint32_t> lodIndexes;
+        std::vector<MeshOptimizer::Submesh> lodSubmeshes;
+        size_t previousIndexCount = baseIndexCount;
+        float ratio = 1.f, previousError = 0.f;
+
+        for (int level=1; level <= lodCount; ++level) {
+            ratio *= reduction;
+            float error = MeshOptimizer::Simplify(mesh.vertexes.data(), mesh.vertexStride, mesh.vertexCount, mesh.layout[positionAttribute].offset,
+                                                  mesh.indexes.data(), submeshes.data(), submeshes.size(), ratio, maxError,
+                                                  lodIndexes, lodSubmeshes);
+
+            // Not worth an extra lod
+            if (lodIndexes.empty() || lodIndexes.size() > previousIndexCount * 0.9) {
+                break;
+            }
+            previousIndexCount = lodIndexes.size();
+
+            Lod lod;
+                lod.firstSubmesh = (uint32_t)mesh.submeshes.size();
+                lod.error = std::max(error, previousError);
+
+            uint32_t firstIndex = (uint32_t)mesh.indexes.size();
+            mesh.indexes.insert(mesh.indexes.end(), lodIndexes.begin(), lodIndexes.end());
+
+            for (size_t i=0; i < lodSubmeshes.size(); ++i) {
+                if (lodSubmeshes[i].count == 0) continue;
+
+                Submesh submesh;
+                    submesh.first = firstIndex + lodSubmeshes[i].first;
+                    submesh.count = lodSubmeshes[i].count;
+                    submesh.baseVertex = lodSubmeshes[i].baseVertex;
+                    submesh.material = mesh.submeshes[base.firstSubmesh + i].material;
+                mesh.submeshes.push_back(submesh);
+            }
+            lod.submeshCount = (uint32_t)mesh.submeshes.size() - lod.firstSubmesh;
+            mesh.lods.push_back(lod);
+
+            previousError = lod.error;
+        }
+    }
+#endif
+
+    static uint64_t Align( uint64_t offset, uint64_t alignment )
+    {
+        return (offset + alignment - 1) / alignment * alignment;
+    }
+
+    PISCES_API void MeshCooker::Write( const Mesh &mesh, std::ostream &stream )
+    {
+        if (mesh.indexType != IndexType::UInt16 && mesh.indexType != IndexType::UInt32) {
+            THROW(std::invalid_argument, "Cooked meshes need UInt16 or UInt32 indexes");
+        }
+        if (mesh.vertexes.size() != (size_t)mesh.vertexCount * mesh.vertexStride) {
+            THROW(std::invalid_argument, "Vertex data of %zu bytes doesn't match %u vertexes with a stride of %u", mesh.vertexes.size(), mesh.vertexCount, mesh.vertexStride);
+        }
+
+        std::vector<MeshFormat::Attribute> attributes;
+        for (const auto &attribute : mesh.layout) {
+            if (attribute.source != 0 || attribute.stride != (int)mesh.vertexStride) {
+                THROW(std::invalid_argument, "Cooked mesh attributes have to read from source 0 with the vertex stride");
+            }
+
+            MeshFormat::Attribute info;
+                info.type = (uint32_t)attribute.type;
+                info.offset = (uint32_t)attribute.offset;
+                info.count = (uint32_t)attribute.count;
+            attributes.push_back(info);
+        }
+
+        // Material names are stored once
+        std::string strings;
+        std::unordered_map<uint32_t, uint32_t> stringOffsets;
+        auto addString = [&]( Common::StringId name ) {
+            if (!name) return MeshFormat::NO_STRING;
+
+            auto result = stringOffsets.emplace(name.handle, (uint32_t)strings.size());
+            if (result.second) {
+                strings += Common::GetCString(name);
+                strings += '\0';
+            }
+            return result.first->second;
+        };
+
+        std::vector<MeshFormat::Submesh> submeshes;
+        for (const auto &submesh : mesh.submeshes) {
+            if ((uint64_t)submesh.first + submesh.count > mesh.indexes.size()) {
+                THROW(std::invalid_argument, "Submesh index range [%u, %u) is out of range", submesh.first, submesh.first+submesh.count);
+            }
+
+            MeshFormat::Submesh info;
+                info.first = submesh.first;
+                info.count = submesh.count;
+                info.baseVertex = submesh.baseVertex;
+                info.material = addString(submesh.material);
+            submeshes.push_back(info);
+        }
+
+        std::vector<MeshFormat::Lod> lods;
+        for (const auto &lod : mesh.lods) {
+            MeshFormat::Lod info;
+                info.firstSubmesh = lod.firstSubmesh;
+                info.submeshCount = lod.submeshCount;
+                info.error = lod.error;
+                info.reserved = 0;
+            lods.push_back(info);
+        }
+
+        std::vector<uint16_t> indexes16;
+        if (mesh.indexType == IndexType::UInt16) {
+            indexes16.reserve(mesh.indexes.size());
+            for (uint32_t index : mesh.indexes) {
+                if (index > std::numeric_limits<uint16_t>::max()) {
+                    THROW(std::invalid_argument, "Index %u doesn't fit into 16 bit", index);
+                }
+                indexes16.push_back((uint16_t)index);
+            }
+        }
+        const void *indexData = mesh.indexType == IndexType::UInt16 ? (const void*)indexes16.data() : (const void*)mesh.indexes.data();
+        size_t indexSize = mesh.indexes.size() * (mesh.indexType == IndexType::UInt16 ? sizeof(uint16_t) : sizeof(uint32_t));
+
+        MeshFormat::Header header;
+        memset(&header, 0, sizeof(header));
+            header.magic = MeshFormat::MAGIC;
+            header.version = MeshFormat::VERSION;
+            header.vertexCount = mesh.vertexCount;
+            header.vertexStride = mesh.vertexStride;
+            header.indexCount = (uint32_t)mesh.indexes.size();
+            header.indexType = (uint32_t)mesh.indexType;
+            header.attributeCount = (uint32_t)attributes.size();
+            header.submeshCount = (uint32_t)submeshes.size();
+            header.lodCount = (uint32_t)lods.size();
+            header.stringsSize = (uint32_t)strings.size();
+            for (int i=0; i < 3; ++i) {
+                header.boundsMin[i] = mesh.boundsMin[i];
+                header.boundsMax[i] = mesh.boundsMax[i];
+                header.positionScale[i] = mesh.positionScale[i];
+                header.positionOffset[i] = mesh.positionOffset[i];
+            }
+
+        uint64_t offset = sizeof(header);
+        header.attributesOffset = offset;   offset += attributes.size() * sizeof(MeshFormat::Attribute);
+        header.submeshesOffset = offset;    offset += submeshes.size() * sizeof(MeshFormat::Submesh);
+        header.lodsOffset = offset;         offset += lods.size() * sizeof(MeshFormat::Lod);
+        header.stringsOffset = offset;      offset += strings.size();
+        header.vertexesOffset = offset = Align(offset, MeshFormat::BLOB_ALIGNMENT);
+        offset += mesh.vertexes.size();
+        header.indexesOffset = Align(offset, MeshFormat::BLOB_ALIGNMENT);
+
+        const char padding[MeshFormat::BLOB_ALIGNMENT] = {};
+        auto write = [&]( const void *data, size_t size ) {
+            if (size > 0) stream.write((const char*)data, size);
+        };
+
+        write(&header, sizeof(header));
+        write(attributes.data(), attributes.size() * sizeof(MeshFormat::Attribute));
+        write(submeshes.data(), submeshes.size() * sizeof(MeshFormat::Submesh));
+        write(lods.data(), lods.size() * sizeof(MeshFormat::Lod));
+        write(strings.data(), strings.size());
+        write(padding, header.vertexesOffset - (header.stringsOffset + strings.size()));
+        write(mesh.vertexes.data(), mesh.vertexes.size());
+        write(padding, header.indexesOffset - (header.vertexesOffset + mesh.vertexes.size()));
+        write(indexData, indexSize);
+
+        if (!stream) {
+            THROW(std::runtime_error, "Failed to write cooked mesh");
+        }
+    }
+}
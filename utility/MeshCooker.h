@@ -0,0 +1,73 @@
+#pragma once
+
+#include "Pisces/Fwd.h"
+#include "Pisces/build_config.h"
+
+#include "Common/StringId.h"
+
+#include <glm/vec3.hpp>
+
+#include <iosfwd>
+#include <limits>
+#include <vector>
+
+#ifdef PISCES_SUPPORT_LOAD_OBJ
+#   include "ObjLoader.h"
+#endif
+#ifdef PISCES_MESH_OPTIMIZER
+#   include "MeshOptimizer.h"
+#endif
+
+namespace Pisces
+{
+    // Builds meshes in the cooked binary format loaded by MeshLoader
+    class MeshCooker {
+    public:
+        struct Submesh {
+            uint32_t first=0, count=0, baseVertex=0;
+            Common::StringId material;
+        };
+        struct Lod {
+            uint32_t firstSubmesh=0, submeshCount=0;
+            float error=0.f;
+        };
+
+        struct Mesh {
+            // Attributes must read from source 0 with a stride of vertexStride
+            std::vector<VertexAttribute> layout;
+            uint32_t vertexStride=0, vertexCount=0;
+            std::vector<uint8_t> vertexes;
+
+            // Indexes are relative to the submesh baseVertex, they are kept as 32 bit
+            // and only narrowed when written with a UInt16 indexType
+            IndexType indexType = IndexType::UInt16;
+            std::vector<uint32_t> indexes;
+
+            std::vector<Submesh> submeshes;
+            std::vector<Lod> lods;
+
+            // Bounds in object space
+            glm::vec3 boundsMin, boundsMax;
+            // Stored positions are mapped to object space with position * positionScale + positionOffset, see MeshQuantizer
+            glm::vec3 positionScale = glm::vec3(1.f),
+                      positionOffset = glm::vec3(0.f);
+        };
+
+#ifdef PISCES_SUPPORT_LOAD_OBJ
+        // Every sub object becomes a submesh, the vertexes keep the packed ObjLoader::Vertex layout
+        static PISCES_API Mesh FromObj( const ObjLoader::Result &obj );
+#endif
+
+#ifdef PISCES_MESH_OPTIMIZER
+        // Reorders triangles & vertexes of all submeshes, positionAttribute is the layout index of the float3 position
+        static PISCES_API MeshOptimizer::Report Optimize( Mesh &mesh, int positionAttribute=0, const MeshOptimizer::Options &options = MeshOptimizer::Options() );
+
+        // Appends up to lodCount simplified copies of lod 0, each with about reduction times the triangles of the one before.
+        // Their indexes & submeshes are appended to the mesh, stops at maxError or once a lod hardly gets smaller.
+        // Needs float3 positions, so it has to run before MeshQuantizer.
+        static PISCES_API void GenerateLods( Mesh &mesh, int lodCount, float reduction=0.5f, float maxError=std::numeric_limits<float>::max(), int positionAttribute=0 );
+#endif
+
+        static PISCES_API void Write( const Mesh &mesh, std::ostream &stream );
+    };
+}
@@ -0,0 +1,58 @@
+#pragma once
+
+#include <cstdint>
+
+namespace Pisces
+{
+    // Layout of cooked mesh files, written by MeshCooker and memory mapped by MeshLoader.
+    // The header is followed by the attribute, submesh, lod and string tables and the vertex & index blobs,
+    // all offsets are in bytes from the start of the file. Files are stored in the byte order of the host.
+    namespace MeshFormat
+    {
+        static const uint32_t MAGIC = 0x4853454D; // "MESH"
+        static const uint32_t VERSION = 2;
+
+        // Blobs start at a multiple of this
+        static const uint32_t BLOB_ALIGNMENT = 16;
+        static const uint32_t NO_STRING = ~0u;
+
+        struct Header {
+            uint32_t magic, version;
+
+            uint32_t vertexCount, vertexStride;
+            // indexType is a IndexType, indexes are 16 or 32 bit
+            uint32_t indexCount, indexType;
+
+            uint32_t attributeCount, submeshCount, lodCount, stringsSize;
+
+            float boundsMin[3], boundsMax[3];
+            // Dequantization of the positions, position * positionScale + positionOffset is in object space
+            float positionScale[3], positionOffset[3];
+
+            uint64_t attributesOffset, submeshesOffset, lodsOffset, stringsOffset,
+                     vertexesOffset, indexesOffset;
+        };
+        static_assert(sizeof(Header) == 136, "Unexpected padding in MeshFormat::Header");
+
+        // A VertexAttribute reading from the vertex blob, the stride is the vertexStride of the header
+        struct Attribute {
+            // VertexAttributeType
+            uint32_t type;
+            uint32_t offset, count;
+        };
+
+        struct Submesh {
+            uint32_t first, count, baseVertex;
+            // Offset of a null terminated name in the string table
+            uint32_t material;
+        };
+
+        // A level of detail is a range of submeshes, lod 0 is the full detail mesh
+        struct Lod {
+            uint32_t firstSubmesh, submeshCount;
+            // Error of the simplified mesh in object space, 0 for full detail
+            float error;
+            uint32_t reserved;
+        };
+    }
+}
@@ -0,0 +1,303 @@
+#include "MeshLoader.h"
+#include "MeshFormat.h"
+#include "HardwareResourceManager.h"
+#include "RenderCommandQueue.h"
+
+#include "Common/Throw.h"
+#include "Common/ErrorUtils.h"
+#include "Common/FlatMap.h"
+
+#include <glm/mat4x4.hpp>
+#include <glm/geometric.hpp>
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+namespace Pisces
+{
+    struct MeshLoader::Impl {
+        HardwareResourceManager *hardwareMgr;
+        Common::FlatMap<Common::StringId, Mesh> meshes;
+    };
+
+    static void FreeMesh( HardwareResourceManager *hardwareMgr, Mesh &mesh )
+    {
+        hardwareMgr->deleteVertexArray(mesh.vertexArray);
+        hardwareMgr->freeBuffer(mesh.vertexBuffer);
+        hardwareMgr->freeBuffer(mesh.indexBuffer);
+    }
+
+    PISCES_API MeshLoader::MeshLoader( HardwareResourceManager *hardwareMgr )
+    {
+        mImpl->hardwareMgr = hardwareMgr;
+    }
+
+    PISCES_API MeshLoader::~MeshLoader()
+    {
+        for (auto &entry : mImpl->meshes) {
+            FreeMesh(mImpl->hardwareMgr, entry.second);
+        }
+    }
+
+    // Tables are copied out of the mapping, it doesn't have to be aligned
+    template< typename T >
+    static void ReadTable( const uint8_t *data, uint64_t offset, uint32_t count, std::vector<T> &table )
+    {
+        table.resize(count);
+        if (count > 0) {
+            memcpy(table.data(), data + offset, count * sizeof(T));
+        }
+    }
+
+    static bool InFile( uint64_t offset, uint64_t size, uint64_t fileSize )
+    {
+        return offset <= fileSize && size <= fileSize - offset;
+    }
+
+    // Bytes of one vertex worth of the attribute, packed types hold all 4 components in 4 bytes
+    static uint32_t AttributeSize( VertexAttributeType type, uint32_t count )
+    {
+        switch (type) {
+        case VertexAttributeType::IInt8:
+        case VertexAttributeType::IUInt8:
+        case VertexAttributeType::Int8:
+        case VertexAttributeType::UInt8:
+        case VertexAttributeType::NormInt8:
+        case VertexAttributeType::NormUInt8:
+            return count;
+        case VertexAttributeType::IInt16:
+        case VertexAttributeType::IUInt16:
+        case VertexAttributeType::Int16:
+        case VertexAttributeType::UInt16:
+        case VertexAttributeType::NormInt16:
+        case VertexAttributeType::NormUInt16:
+        case VertexAttributeType::Float16:
+            return count * 2;
+        case VertexAttributeType::NormInt3x10_1x2:
+        case VertexAttributeType::NormUInt3x10_1x2:
+            return 4;
+        default:
+            return count * 4;
+        }
+    }
+
+    static bool IsPacked( VertexAttributeType type )
+    {
+        return type == VertexAttributeType::NormInt3x10_1x2 || type == VertexAttributeType::NormUInt3x10_1x2;
+    }
+
+    PISCES_API ResourceHandle MeshLoader::loadResource( Common::Archive &archive, libyaml::Node node )
+    {
+        auto nameNode = node["Name"];
+        if (!nameNode.isScalar()) {
+            THROW(std::runtime_error,
+                  "Missing attribute \"Name\""
+            );
+        }
+        auto fileNode = node["File"];
+        if (!fileNode.isScalar()) {
+            THROW(std::runtime_error,
+                  "Missing attribute \"File\""
+            );
+        }
+
+        std::string filename = fileNode.scalar();
+        auto file = archive.openFile(filename);
+        if (!file) {
+            THROW(std::runtime_error,
+                  "Failed to open file \"%s\" in archive \"%s\"", filename.c_str(), archive.name()
+            );
+        }
+
+        const uint8_t *data = (const uint8_t*)archive.mapFile(file);
+        uint64_t fileSize = archive.fileSize(file);
+
+        MeshFormat::Header header;
+        if (fileSize < sizeof(header)) {
+            THROW(std::runtime_error, "\"%s\" is too small to be a cooked mesh", filename.c_str());
+        }
+        memcpy(&header, data, sizeof(header));
+
+        if (header.magic != MeshFormat::MAGIC) {
+            THROW(std::runtime_error, "\"%s\" is not a cooked mesh", filename.c_str());
+        }
+        if (header.version != MeshFormat::VERSION) {
+            THROW(std::runtime_error, "Cooked mesh \"%s\" has version %u, expected %u", filename.c_str(), header.version, MeshFormat::VERSION);
+        }
+
+        IndexType indexType = (IndexType)header.indexType;
+        if (indexType != IndexType::UInt16 && indexType != IndexType::UInt32) {
+            THROW(std::runtime_error, "Cooked mesh \"%s\" has an unknown index type %u", filename.c_str(), header.indexType);
+        }
+
+        uint64_t vertexesSize = (uint64_t)header.vertexCount * header.vertexStride,
+                 indexesSize = (uint64_t)header.indexCount * (indexType == IndexType::UInt16 ? sizeof(uint16_t) : sizeof(uint32_t));
+
+        if (!InFile(header.attributesOffset, (uint64_t)header.attributeCount * sizeof(MeshFormat::Attribute), fileSize) ||
+            !InFile(header.submeshesOffset, (uint64_t)header.submeshCount * sizeof(MeshFormat::Submesh), fileSize) ||
+            !InFile(header.lodsOffset, (uint64_t)header.lodCount * sizeof(MeshFormat::Lod), fileSize) ||
+            !InFile(header.stringsOffset, header.stringsSize, fileSize) ||
+            !InFile(header.vertexesOffset, vertexesSize, fileSize) ||
+            !InFile(header.indexesOffset, indexesSize, fileSize)) {
+            THROW(std::runtime_error, "Cooked mesh \"%s\" is truncated", filename.c_str());
+        }
+
+        std::vector<MeshFormat::Attribute> attributeInfos;
+        std::vector<MeshFormat::Submesh> submeshInfos;
+        std::vector<MeshFormat::Lod> lodInfos;
+        ReadTable(data, header.attributesOffset, header.attributeCount, attributeInfos);
+        ReadTable(data, header.submeshesOffset, header.submeshCount, submeshInfos);
+        ReadTable(data, header.lodsOffset, header.lodCount, lodInfos);
+
+        std::vector<VertexAttribute> attributes;
+        for (const auto &info : attributeInfos) {
+            if (info.type > (uint32_t)VertexAttributeType::Float32 || info.count < 1 || info.count > 4 ||
+                (IsPacked((VertexAttributeType)info.type) && info.count != 4)) {
+                THROW(std::runtime_error, "Cooked mesh \"%s\" has an invalid vertex attribute", filename.c_str());
+            }
+            if ((uint64_t)info.offset + AttributeSize((VertexAttributeType)info.type, info.count) > header.vertexStride) {
+                THROW(std::runtime_error, "Cooked mesh \"%s\" has a vertex attribute outside of the vertex stride", filename.c_str());
+            }
+
+            VertexAttribute attribute;
+                attribute.type = (VertexAttributeType)info.type;
+                attribute.offset = (int)info.offset;
+                attribute.count = (int)info.count;
+                attribute.stride = (int)header.vertexStride;
+                attribute.source = 0;
+            attributes.push_back(attribute);
+        }
+
+        const char *strings = (const char*)data + header.stringsOffset;
+        auto getString = [&]( uint32_t offset ) {
+            if (offset == MeshFormat::NO_STRING) return Common::StringId();
+            if (offset >= header.stringsSize || !memchr(strings + offset, '\0', header.stringsSize - offset)) {
+                THROW(std::runtime_error, "Cooked mesh \"%s\" has an invalid string offset", filename.c_str());
+            }
+            return Common::CreateStringId(strings + offset);
+        };
+
+        Mesh mesh;
+        mesh.indexType = indexType;
+        mesh.boundsMin = glm::vec3(header.boundsMin[0], header.boundsMin[1], header.boundsMin[2]);
+        mesh.boundsMax = glm::vec3(header.boundsMax[0], header.boundsMax[1], header.boundsMax[2]);
+        mesh.positionScale = glm::vec3(header.positionScale[0], header.positionScale[1], header.positionScale[2]);
+        mesh.positionOffset = glm::vec3(header.positionOffset[0], header.positionOffset[1], header.positionOffset[2]);
+
+        for (const auto &info : submeshInfos) {
+            if ((uint64_t)info.first + info.count > header.indexCount) {
+                THROW(std::runtime_error, "Cooked mesh \"%s\" has a submesh outside of the index buffer", filename.c_str());
+            }
+
+            // The gpu would read past the vertex buffer, so the indexes are checked once here instead of on every draw
+            const uint8_t *indexes = data + header.indexesOffset;
+            for (uint64_t i=info.first, end=(uint64_t)info.first + info.count; i < end; ++i) {
+                uint32_t index;
+                if (indexType == IndexType::UInt16) {
+                    uint16_t index16;
+                    memcpy(&index16, indexes + i * sizeof(uint16_t), sizeof(uint16_t));
+                    index = index16;
+                }
+                else {
+                    memcpy(&index, indexes + i * sizeof(uint32_t), sizeof(uint32_t));
+                }
+
+                if ((uint64_t)info.baseVertex + index >= header.vertexCount) {
+                    THROW(std::runtime_error, "Cooked mesh \"%s\" has index %u (base vertex %u) outside of its %u vertexes",
+                          filename.c_str(), index, info.baseVertex, header.vertexCount);
+                }
+            }
+
+            Mesh::Submesh submesh;
+                submesh.first = (int)info.first;
+                submesh.count = (int)info.count;
+                submesh.baseVertex = (int)info.baseVertex;
+                submesh.material = getString(info.material);
+            mesh.submeshes.push_back(submesh);
+        }
+        for (const auto &info : lodInfos) {
+            if ((uint64_t)info.firstSubmesh + info.submeshCount > header.submeshCount) {
+                THROW(std::runtime_error, "Cooked mesh \"%s\" has a lod outside of the submeshes", filename.c_str());
+            }
+
+            Mesh::Lod lod;
+                lod.firstSubmesh = (int)info.firstSubmesh;
+                lod.submeshCount = (int)info.submeshCount;
+                lod.error = info.error;
+            mesh.lods.push_back(lod);
+        }
+
+        HardwareResourceManager *hardwareMgr = mImpl->hardwareMgr;
+
+        mesh.vertexBuffer = hardwareMgr->allocateBuffer(BufferType::Vertex, BufferUsage::Static, BufferFlags::None, vertexesSize, data + header.vertexesOffset);
+        mesh.indexBuffer = hardwareMgr->allocateBuffer(BufferType::Index, BufferUsage::Static, BufferFlags::None, indexesSize, data + header.indexesOffset);
+        mesh.vertexArray = hardwareMgr->createVertexArray(attributes.data(), (int)attributes.size(), &mesh.vertexBuffer, 1, mesh.indexBuffer, indexType);
+
+        Common::StringId name = Common::CreateStringId(nameNode.scalar());
+
+        auto iter = mImpl->meshes.find(name);
+        if (iter != mImpl->meshes.end()) {
+            LOG_WARNING("Replacing mesh \"%s\" with the one from \"%s\"", Common::GetCString(name), filename.c_str());
+            FreeMesh(hardwareMgr, iter->second);
+        }
+        mImpl->meshes.insert_replace(name, std::move(mesh));
+
+        return ResourceHandle(name.handle);
+    }
+
+    PISCES_API bool MeshLoader::findMesh( Common::StringId name, Mesh &mesh )
+    {
+        auto iter = mImpl->meshes.find(name);
+        if (iter == mImpl->meshes.end()) return false;
+
+        mesh = iter->second;
+        return true;
+    }
+
+    PISCES_API int MeshLoader::SelectLod( const Mesh &mesh, const glm::mat4 &modelView, const glm::mat4 &projection,
+                                          float viewportHeight, float maxPixelError )
+    {
+        if (mesh.lods.size() <= 1) return 0;
+
+        // Errors & bounds grow with the largest scale of the model view
+        float scale = 0.f;
+        for (int i=0; i < 3; ++i) {
+            scale = std::max(scale, std::sqrt(modelView[i][0]*modelView[i][0] + modelView[i][1]*modelView[i][1] + modelView[i][2]*modelView[i][2]));
+        }
+
+        float pixelsPerUnit = projection[1][1] * viewportHeight * 0.5f;
+
+        // Perspective projections shrink with the distance, orthographic ones don't
+        if (projection[2][3] != 0.f) {
+            glm::vec3 center = (mesh.boundsMin + mesh.boundsMax) * 0.5f;
+            glm::vec4 viewCenter = modelView * glm::vec4(center, 1.f);
+            float radius = glm::length(mesh.boundsMax - mesh.boundsMin) * 0.5f * scale;
+            float distance = glm::length(glm::vec3(viewCenter.x, viewCenter.y, viewCenter.z)) - radius;
+
+            // The camera is inside the bounds
+            if (distance <= 0.f) return 0;
+            pixelsPerUnit /= distance;
+        }
+
+        for (int lod=(int)mesh.lods.size()-1; lod > 0; --lod) {
+            if (mesh.lods[lod].error * scale * pixelsPerUnit <= maxPixelError) {
+                return lod;
+            }
+        }
+        return 0;
+    }
+
+    PISCES_API void MeshLoader::Draw( RenderCommandQueuePtr commandQueue, const Mesh &mesh, int lod )
+    {
+        if (mesh.lods.empty()) return;
+
+        const Mesh::Lod &info = mesh.lods[std::min(std::max(lod, 0), (int)mesh.lods.size()-1)];
+
+        commandQueue->useVertexArray(mesh.vertexArray);
+        for (int i=0; i < info.submeshCount; ++i) {
+            const Mesh::Submesh &submesh = mesh.submeshes[info.firstSubmesh + i];
+            commandQueue->draw(Primitive::Triangles, submesh.first, submesh.count, submesh.baseVertex);
+        }
+    }
+}
@@ -0,0 +1,71 @@
+#pragma once
+
+#include "Pisces/Fwd.h"
+#include "Pisces/build_config.h"
+#include "Pisces/IResourceLoader.h"
+
+#include "Common/StringId.h"
+#include "Common/PImplHelper.h"
+
+#include <glm/fwd.hpp>
+#include <glm/vec3.hpp>
+
+#include <vector>
+
+namespace Pisces
+{
+    struct Mesh {
+        struct Submesh {
+            int first=0, count=0, baseVertex=0;
+            Common::StringId material;
+        };
+        struct Lod {
+            int firstSubmesh=0, submeshCount=0;
+            float error=0.f;
+        };
+
+        VertexArrayHandle vertexArray;
+        BufferHandle vertexBuffer, indexBuffer;
+        IndexType indexType = IndexType::None;
+
+        std::vector<Submesh> submeshes;
+        // lods[0] is the full detail mesh, the others are ranges of simplified submeshes in the same buffers
+        // with increasing error, see MeshCooker::GenerateLods
+        std::vector<Lod> lods;
+
+        glm::vec3 boundsMin, boundsMax;
+        // Positions may be quantized, position * positionScale + positionOffset is in object space.
+        // Folding it into the model matrix is free, normals have to keep using the original one.
+        glm::vec3 positionScale, positionOffset;
+    };
+
+    // Loads meshes cooked by MeshCooker (e.g. with pisces-meshcook). The file is memory mapped from the archive
+    // and the vertex & index blobs are uploaded as they are, with one buffer each.
+    // Register it with Context::registerResourceLoader, resources are described by
+    //   - Type: Mesh
+    //     Name: name
+    //     File: file in the archive
+    class MeshLoader :
+        public IResourceLoader
+    {
+    public:
+        PISCES_API MeshLoader( HardwareResourceManager *hardwareMgr );
+        // Frees the buffers & vertex arrays of all loaded meshes
+        PISCES_API ~MeshLoader();
+
+        PISCES_API virtual ResourceHandle loadResource( Common::Archive &archive, libyaml::Node node ) override;
+
+        PISCES_API bool findMesh( Common::StringId name, Mesh &mesh );
+
+        // Picks the coarsest lod whose error projects to at most maxPixelError pixels on screen, from the distance of the
+        // mesh bounds to the camera. modelView must not include the position dequantization of the mesh.
+        static PISCES_API int SelectLod( const Mesh &mesh, const glm::mat4 &modelView, const glm::mat4 &projection,
+                                         float viewportHeight, float maxPixelError = 1.f );
+        // Draws all submeshes of the lod with the vertex array of the mesh, materials are up to the caller
+        static PISCES_API void Draw( RenderCommandQueuePtr commandQueue, const Mesh &mesh, int lod = 0 );
+
+    private:
+        struct Impl;
+        PImplHelper<Impl, 64> mImpl;
+    };
+}
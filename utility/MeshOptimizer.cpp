@@ -0,0 +1,771 @@
+#include "MeshOptimizer.h"
+
+#include "Common/ErrorUtils.h"
+
+#include <glm/vec3.hpp>
+#include <glm/geometric.hpp>
+
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+#include <cstddef>
+#include <cstring>
+#include <numeric>
+#include <unordered_map>
+#include <unordered_set>
+
+namespace Pisces
+{
+    static const uint32_t NO_VERTEX = ~0u;
+
+    // Fifo cache simulation, a vertex is cached if less than cacheSize misses happened since it was transformed
+    class CacheSimulator {
+    public:
+        CacheSimulator( size_t vertexCount, int cacheSize ) :
+            mStamps(vertexCount, 0),
+            mCacheSize((uint32_t)cacheSize),
+            mTime((uint32_t)cacheSize + 1)
+        {}
+
+        // Returns true on a cache miss
+        bool access( uint32_t vertex )
+        {
+            if (mTime - mStamps[vertex] > mCacheSize) {
+                mStamps[vertex] = mTime++;
+                return true;
+            }
+            return false;
+        }
+
+        void reset()
+        {
+            mTime += mCacheSize + 1;
+        }
+
+        // How long ago the vertex was transformed, more than cacheSize if it isn't cached
+        uint32_t age( uint32_t vertex ) const
+        {
+            return mTime - mStamps[vertex];
+        }
+
+    private:
+        std::vector<uint32_t> mStamps;
+        uint32_t mCacheSize, mTime;
+    };
+
+    static void Accumulate( MeshOptimizer::CacheStats &stats, const MeshOptimizer::CacheStats &other )
+    {
+        stats.triangles += other.triangles;
+        stats.vertexes += other.vertexes;
+        stats.misses += other.misses;
+    }
+
+    PISCES_API MeshOptimizer::CacheStats MeshOptimizer::AnalyzeVertexCache( const uint32_t *indexes, size_t indexCount, size_t vertexCount, int cacheSize )
+    {
+        CacheStats stats;
+        stats.triangles = indexCount / 3;
+
+        CacheSimulator cache(vertexCount, cacheSize);
+        std::vector<bool> referenced(vertexCount, false);
+
+        for (size_t i=0; i < indexCount; ++i) {
+            uint32_t vertex = indexes[i];
+            assert(vertex < vertexCount);
+
+            if (!referenced[vertex]) {
+                referenced[vertex] = true;
+                stats.vertexes++;
+            }
+            if (cache.access(vertex)) {
+                stats.misses++;
+            }
+        }
+        return stats;
+    }
+
+    PISCES_API void MeshOptimizer::OptimizeVertexCache( uint32_t *indexes, size_t indexCount, size_t vertexCount,
+                                                        int cacheSize, float clusterThreshold,
+                                                        std::vector<uint32_t> *clusters )
+    {
+        size_t triangleCount = indexCount / 3;
+
+        if (clusters) clusters->clear();
+        if (triangleCount == 0) return;
+
+        // Triangles using each vertex and the number of them not emitted yet
+        std::vector<uint32_t> live(vertexCount, 0),
+                              offsets(vertexCount + 1, 0),
+                              adjacency(triangleCount * 3);
+
+        for (size_t i=0; i < triangleCount*3; ++i) {
+            assert(indexes[i] < vertexCount);
+            live[indexes[i]]++;
+        }
+        for (size_t i=0; i < vertexCount; ++i) {
+            offsets[i+1] = offsets[i] + live[i];
+        }
+        {
+            std::vector<uint32_t> fill(offsets.begin(), offsets.end() - 1);
+            for (size_t i=0; i < triangleCount*3; ++i) {
+                adjacency[fill[indexes[i]]++] = (uint32_t)(i / 3);
+            }
+        }
+
+        CacheSimulator cache(vertexCount, cacheSize);
+        std::vector<bool> emitted(triangleCount, false);
+        std::vector<uint32_t> deadEnd, candidates, output, hardBoundaries;
+        deadEnd.reserve(triangleCount * 3);
+        output.reserve(triangleCount * 3);
+
+        uint32_t scan = 0;
+        auto skipDeadEnd = [&]() {
+            while (!deadEnd.empty()) {
+                uint32_t vertex = deadEnd.back();
+                deadEnd.pop_back();
+                if (live[vertex] > 0) return vertex;
+            }
+            for (; scan < vertexCount; ++scan) {
+                if (live[scan] > 0) return scan;
+            }
+            return NO_VERTEX;
+        };
+
+        // Emit all triangles around the fanning vertex, then continue with the neighbour that will still
+        // be in the cache after its remaining triangles are emitted. Jumps elsewhere are hard cluster boundaries.
+        uint32_t fan = skipDeadEnd();
+        bool jumped = true;
+        while (fan != NO_VERTEX) {
+            if (jumped) {
+                hardBoundaries.push_back((uint32_t)(output.size() / 3));
+            }
+
+            candidates.clear();
+            for (uint32_t i=offsets[fan]; i < offsets[fan+1]; ++i) {
+                uint32_t triangle = adjacency[i];
+                if (emitted[triangle]) continue;
+
+                for (int j=0; j < 3; ++j) {
+                    uint32_t vertex = indexes[triangle*3 + j];
+                    output.push_back(vertex);
+                    deadEnd.push_back(vertex);
+                    candidates.push_back(vertex);
+                    live[vertex]--;
+                    cache.access(vertex);
+                }
+                emitted[triangle] = true;
+            }
+
+            uint32_t next = NO_VERTEX;
+            int64_t best = -1;
+            for (uint32_t vertex : candidates) {
+                if (live[vertex] == 0) continue;
+
+                int64_t priority = 0;
+                if (cache.age(vertex) + 2*live[vertex] <= (uint32_t)cacheSize) {
+                    priority = cache.age(vertex);
+                }
+                if (priority > best) {
+                    best = priority;
+                    next = vertex;
+                }
+            }
+
+            jumped = next == NO_VERTEX;
+            fan = jumped ? skipDeadEnd() : next;
+        }
+
+        assert(output.size() == triangleCount * 3);
+        std::copy(output.begin(), output.end(), indexes);
+
+        if (!clusters) return;
+
+        // Hard clusters are split further where the miss rate of the part so far is close to the one of the
+        // whole cluster, every part starts with a cold cache since it may be moved away from its neighbours
+        hardBoundaries.push_back((uint32_t)triangleCount);
+        CacheSimulator clusterCache(vertexCount, cacheSize);
+
+        for (size_t h=0; h+1 < hardBoundaries.size(); ++h) {
+            uint32_t start = hardBoundaries[h],
+                     end = hardBoundaries[h+1];
+
+            clusterCache.reset();
+            size_t clusterMisses = 0;
+            for (uint32_t i=start*3; i < end*3; ++i) {
+                clusterMisses += clusterCache.access(indexes[i]);
+            }
+            float threshold = clusterThreshold * clusterMisses / (end - start);
+
+            clusters->push_back(start);
+            clusterCache.reset();
+
+            size_t misses = 0;
+            uint32_t last = start;
+            for (uint32_t t=start; t < end; ++t) {
+                for (int j=0; j < 3; ++j) {
+                    misses += clusterCache.access(indexes[t*3 + j]);
+                }
+                if (t+1 < end && misses <= threshold * (t + 1 - last)) {
+                    clusters->push_back(t + 1);
+                    clusterCache.reset();
+                    misses = 0;
+                    last = t + 1;
+                }
+            }
+        }
+    }
+
+    PISCES_API void MeshOptimizer::OptimizeOverdraw( uint32_t *indexes, size_t indexCount, const std::vector<uint32_t> &clusters,
+                                                     const void *vertexes, size_t vertexStride, size_t positionOffset )
+    {
+        size_t triangleCount = indexCount / 3;
+        if (clusters.size() < 2) return;
+
+        auto position = [&]( uint32_t vertex ) {
+            float pos[3];
+            memcpy(pos, (const uint8_t*)vertexes + vertex * vertexStride + positionOffset, sizeof(pos));
+            return glm::vec3(pos[0], pos[1], pos[2]);
+        };
+
+        struct Cluster {
+            uint32_t start, end;
+            glm::vec3 centroid = glm::vec3(0.f),
+                      normal = glm::vec3(0.f);
+            float area = 0.f;
+            float sortKey = 0.f;
+        };
+        std::vector<Cluster> infos(clusters.size());
+
+        glm::vec3 meshCentroid(0.f);
+        float meshArea = 0.f;
+
+        for (size_t c=0; c < clusters.size(); ++c) {
+            Cluster &cluster = infos[c];
+                cluster.start = clusters[c];
+                cluster.end = c+1 < clusters.size() ? clusters[c+1] : (uint32_t)triangleCount;
+
+            for (uint32_t t=cluster.start; t < cluster.end; ++t) {
+                glm::vec3 a = position(indexes[t*3 + 0]),
+                          b = position(indexes[t*3 + 1]),
+                          c = position(indexes[t*3 + 2]);
+
+                glm::vec3 normal = glm::cross(b - a, c - a);
+                float area = glm::length(normal);
+
+                cluster.centroid += (a + b + c) * (area / 3.f);
+                cluster.normal += normal;
+                cluster.area += area;
+            }
+
+            meshCentroid += cluster.centroid;
+            meshArea += cluster.area;
+
+            if (cluster.area > 0.f) {
+                cluster.centroid /= cluster.area;
+            }
+        }
+        if (meshArea > 0.f) {
+            meshCentroid /= meshArea;
+        }
+
+        for (auto &cluster : infos) {
+            float length = glm::length(cluster.normal);
+            if (length > 0.f) {
+                cluster.sortKey = glm::dot(cluster.centroid - meshCentroid, cluster.normal / length);
+            }
+        }
+
+        std::stable_sort(infos.begin(), infos.end(), []( const Cluster &lhs, const Cluster &rhs ) {
+            return lhs.sortKey > rhs.sortKey;
+        });
+
+        std::vector<uint32_t> sorted;
+        sorted.reserve(triangleCount * 3);
+        for (const auto &cluster : infos) {
+            sorted.insert(sorted.end(), indexes + cluster.start*3, indexes + cluster.end*3);
+        }
+        std::copy(sorted.begin(), sorted.end(), indexes);
+    }
+
+    PISCES_API void MeshOptimizer::OptimizeVertexFetch( uint32_t *indexes, size_t indexCount, size_t vertexCount, std::vector<uint32_t> &remap )
+    {
+        remap.assign(vertexCount, NO_VERTEX);
+
+        uint32_t next = 0;
+        for (size_t i=0; i < indexCount; ++i) {
+            uint32_t &vertex = remap[indexes[i]];
+            if (vertex == NO_VERTEX) {
+                vertex = next++;
+            }
+            indexes[i] = vertex;
+        }
+        for (auto &vertex : remap) {
+            if (vertex == NO_VERTEX) {
+                vertex = next++;
+            }
+        }
+    }
+
+    PISCES_API MeshOptimizer::Report MeshOptimizer::Optimize( void *vertexes, size_t vertexStride, size_t vertexCount, size_t positionOffset,
+                                                              uint32_t *indexes, const Submesh *submeshes, size_t submeshCount,
+                                                              const Options &options )
+    {
+        Report report;
+
+        std::vector<uint32_t> bases;
+        for (size_t i=0; i < submeshCount; ++i) {
+            bases.push_back(submeshes[i].baseVertex);
+        }
+        std::sort(bases.begin(), bases.end());
+        bases.erase(std::unique(bases.begin(), bases.end()), bases.end());
+
+        std::vector<uint32_t> clusters, remap, groupIndexes;
+        std::vector<uint8_t> groupVertexes;
+
+        for (size_t g=0; g < bases.size(); ++g) {
+            uint32_t base = bases[g];
+            size_t end = g+1 < bases.size() ? bases[g+1] : vertexCount;
+            if (base >= end) continue;
+
+            size_t groupVertexCount = end - base;
+
+            // The submeshes of the group are optimized as one index list, so vertex fetch order follows all of them
+            groupIndexes.clear();
+            bool valid = true;
+            for (size_t i=0; i < submeshCount; ++i) {
+                if (submeshes[i].baseVertex != base) continue;
+
+                const uint32_t *first = indexes + submeshes[i].first;
+                valid = valid && submeshes[i].count % 3 == 0 &&
+                        std::all_of(first, first + submeshes[i].count, [&]( uint32_t index ) { return index < groupVertexCount; });
+                groupIndexes.insert(groupIndexes.end(), first, first + submeshes[i].count);
+            }
+            if (!valid) {
+                LOG_WARNING("Skipping submeshes at base vertex %u, they aren't triangle lists within their vertex range", base);
+                continue;
+            }
+
+            uint8_t *firstVertex = (uint8_t*)vertexes + base * vertexStride;
+
+            size_t offset = 0;
+            for (size_t i=0; i < submeshCount; ++i) {
+                if (submeshes[i].baseVertex != base) continue;
+
+                uint32_t *range = groupIndexes.data() + offset;
+                size_t count = submeshes[i].count;
+                offset += count;
+
+                Accumulate(report.before, AnalyzeVertexCache(range, count, groupVertexCount, options.cacheSize));
+
+                if (options.reduceOverdraw) {
+                    OptimizeVertexCache(range, count, groupVertexCount, options.cacheSize, options.overdrawThreshold, &clusters);
+                    OptimizeOverdraw(range, count, clusters, firstVertex, vertexStride, positionOffset);
+                }
+                else {
+                    OptimizeVertexCache(range, count, groupVertexCount, options.cacheSize);
+                }
+            }
+
+            if (options.optimizeVertexFetch) {
+                OptimizeVertexFetch(groupIndexes.data(), groupIndexes.size(), groupVertexCount, remap);
+
+                groupVertexes.assign(firstVertex, firstVertex + groupVertexCount * vertexStride);
+                for (size_t v=0; v < groupVertexCount; ++v) {
+                    memcpy(firstVertex + remap[v] * vertexStride, groupVertexes.data() + v * vertexStride, vertexStride);
+                }
+            }
+
+            offset = 0;
+            for (size_t i=0; i < submeshCount; ++i) {
+                if (submeshes[i].baseVertex != base) continue;
+
+                uint32_t *range = groupIndexes.data() + offset;
+                size_t count = submeshes[i].count;
+                offset += count;
+
+                Accumulate(report.after, AnalyzeVertexCache(range, count, groupVertexCount, options.cacheSize));
+                std::copy(range, range + count, indexes + submeshes[i].first);
+            }
+        }
+
+        return report;
+    }
+
+    // Sum of squared distances to planes, weighted by the area of their triangles.
+    // Dividing by the total weight gives the mean squared distance in object space.
+    struct Quadric {
+        double a00=0, a11=0, a22=0, a01=0, a02=0, a12=0,
+               b0=0, b1=0, b2=0, c=0, w=0;
+
+        // The plane is dot(normal, p) + d = 0, normal has unit length
+        void addPlane( const glm::vec3 &normal, double d, double weight )
+        {
+            double x = normal.x, y = normal.y, z = normal.z;
+            a00 += weight*x*x;  a11 += weight*y*y;  a22 += weight*z*z;
+            a01 += weight*x*y;  a02 += weight*x*z;  a12 += weight*y*z;
+            b0 += weight*x*d;   b1 += weight*y*d;   b2 += weight*z*d;
+            c += weight*d*d;
+            w += weight;
+        }
+
+        void add( const Quadric &other )
+        {
+            a00 += other.a00;  a11 += other.a11;  a22 += other.a22;
+            a01 += other.a01;  a02 += other.a02;  a12 += other.a12;
+            b0 += other.b0;    b1 += other.b1;    b2 += other.b2;
+            c += other.c;
+            w += other.w;
+        }
+
+        double error( const glm::vec3 &p ) const
+        {
+            double x = p.x, y = p.y, z = p.z;
+            double sum = a00*x*x + a11*y*y + a22*z*z + 2*(a01*x*y + a02*x*z + a12*y*z) + 2*(b0*x + b1*y + b2*z) + c;
+            return w > 0 ? std::max(sum, 0.0) / w : 0.0;
+        }
+    };
+
+    struct Collapse {
+        uint32_t from, to;
+        double cost;
+    };
+
+    // Collapses vertexes into neighbours until the triangle count reaches targetTriangles or the next collapse
+    // costs more than targetError. triangleSubmesh is kept in sync with the triangles, returns the largest error.
+    static float SimplifyGroup( const std::vector<glm::vec3> &positions, std::vector<uint32_t> &indexes, std::vector<uint32_t> &triangleSubmesh,
+                                size_t targetTriangles, float targetError )
+    {
+        size_t vertexCount = positions.size();
+
+        // Vertexes sharing a position are the sides of a uv or normal seam. Topology and errors work on the welded
+        // points, all vertexes of a point are collapsed together
+        std::vector<uint32_t> order(vertexCount);
+        std::iota(order.begin(), order.end(), 0);
+        auto lessPosition = [&]( uint32_t a, uint32_t b ) {
+            const glm::vec3 &pa = positions[a], &pb = positions[b];
+            return pa.x != pb.x ? pa.x < pb.x : pa.y != pb.y ? pa.y < pb.y : pa.z < pb.z;
+        };
+        std::sort(order.begin(), order.end(), lessPosition);
+
+        std::vector<uint32_t> weld(vertexCount);
+        std::vector<glm::vec3> points;
+        for (size_t i=0; i < vertexCount; ++i) {
+            if (i == 0 || lessPosition(order[i-1], order[i])) {
+                points.push_back(positions[order[i]]);
+            }
+            weld[order[i]] = (uint32_t)points.size() - 1;
+        }
+        size_t pointCount = points.size();
+        std::vector<uint8_t> locked(pointCount, 0);
+
+        // Open or non manifold edges of the welded mesh, their points are the border of the mesh or of a cluster
+        std::unordered_map<uint64_t, uint32_t> edges;
+        std::unordered_set<uint64_t> vertexEdges;
+        auto edgeKey = []( uint32_t a, uint32_t b ) { return ((uint64_t)a << 32) | b; };
+        for (size_t i=0; i < indexes.size(); i += 3) {
+            for (int e=0; e < 3; ++e) {
+                uint32_t a = indexes[i+e], b = indexes[i+(e+1)%3];
+                edges[edgeKey(weld[a], weld[b])]++;
+                vertexEdges.insert(edgeKey(a, b));
+            }
+        }
+        for (const auto &edge : edges) {
+            uint32_t a = (uint32_t)(edge.first >> 32), b = (uint32_t)edge.first;
+            auto twin = edges.find(edgeKey(b, a));
+            if (a == b || edge.second != 1 || twin == edges.end() || twin->second != 1) {
+                locked[a] = locked[b] = 1;
+            }
+        }
+
+        std::vector<uint32_t> pointSubmesh(pointCount, NO_VERTEX);
+        std::vector<Quadric> quadrics(pointCount);
+        for (size_t i=0; i < indexes.size(); i += 3) {
+            uint32_t submesh = triangleSubmesh[i/3];
+            for (int k=0; k < 3; ++k) {
+                uint32_t &owner = pointSubmesh[weld[indexes[i+k]]];
+                if (owner != NO_VERTEX && owner != submesh) {
+                    locked[weld[indexes[i+k]]] = 1;
+                }
+                owner = submesh;
+            }
+
+            const glm::vec3 &p0 = positions[indexes[i]], &p1 = positions[indexes[i+1]], &p2 = positions[indexes[i+2]];
+            glm::vec3 normal = glm::cross(p1 - p0, p2 - p0);
+            float area = glm::length(normal);
+            if (area <= 0.f) continue;
+
+            normal /= area;
+            for (int k=0; k < 3; ++k) {
+                quadrics[weld[indexes[i+k]]].addPlane(normal, -glm::dot(normal, p0), area * 0.5f);
+            }
+
+            // Seam edges only exist on one side with these vertexes, a plane through the edge keeps the seam from
+            // drifting across the surface
+            for (int e=0; e < 3; ++e) {
+                uint32_t a = indexes[i+e], b = indexes[i+(e+1)%3];
+                if (vertexEdges.count(edgeKey(b, a))) continue;
+
+                glm::vec3 edge = positions[b] - positions[a];
+                float length = glm::length(edge);
+                if (length <= 0.f) continue;
+
+                glm::vec3 side = glm::normalize(glm::cross(edge / length, normal));
+                double d = -glm::dot(side, positions[a]);
+                quadrics[weld[a]].addPlane(side, d, length * length);
+                quadrics[weld[b]].addPlane(side, d, length * length);
+            }
+        }
+
+        double maxCost = (double)targetError * targetError;
+        double error = 0.0;
+
+        std::vector<uint32_t> adjacencyOffsets, adjacency, remap, marks(pointCount, 0), counted(pointCount, 0);
+        std::vector<uint32_t> wedgeTarget(vertexCount), wedgeMarks(vertexCount, 0);
+        std::vector<uint8_t> passLocked;
+        std::vector<Collapse> collapses;
+        uint32_t stamp = 0;
+
+        while (indexes.size() / 3 > targetTriangles) {
+            size_t triangleCount = indexes.size() / 3;
+
+            // Triangles around every point
+            adjacencyOffsets.assign(pointCount + 1, 0);
+            for (uint32_t index : indexes) {
+                adjacencyOffsets[weld[index] + 1]++;
+            }
+            for (size_t p=0; p < pointCount; ++p) {
+                adjacencyOffsets[p + 1] += adjacencyOffsets[p];
+            }
+            adjacency.resize(indexes.size());
+            {
+                std::vector<uint32_t> fill(adjacencyOffsets.begin(), adjacencyOffsets.end() - 1);
+                for (size_t i=0; i < indexes.size(); ++i) {
+                    adjacency[fill[weld[indexes[i]]]++] = (uint32_t)(i / 3);
+                }
+            }
+
+            collapses.clear();
+            for (size_t i=0; i < indexes.size(); i += 3) {
+                for (int e=0; e < 3; ++e) {
+                    uint32_t from = weld[indexes[i+e]], to = weld[indexes[i+(e+1)%3]];
+                    if (locked[from]) continue;
+
+                    Collapse collapse;
+                        collapse.from = from;
+                        collapse.to = to;
+                        collapse.cost = quadrics[from].error(points[to]);
+                    collapses.push_back(collapse);
+                }
+            }
+            std::sort(collapses.begin(), collapses.end(), []( const Collapse &a, const Collapse &b ) { return a.cost < b.cost; });
+
+            remap.resize(vertexCount);
+            std::iota(remap.begin(), remap.end(), 0);
+            passLocked.assign(pointCount, 0);
+
+            size_t removed = 0, wanted = triangleCount - targetTriangles;
+            for (const auto &collapse : collapses) {
+                if (collapse.cost > maxCost || removed >= wanted) break;
+
+                uint32_t from = collapse.from, to = collapse.to;
+                if (passLocked[from] || passLocked[to]) continue;
+
+                // The edge has to be shared by exactly two triangles with one point each on the other side,
+                // otherwise the collapse pinches the surface
+                ++stamp;
+                for (uint32_t t=adjacencyOffsets[from]; t < adjacencyOffsets[from+1]; ++t) {
+                    for (int k=0; k < 3; ++k) marks[weld[indexes[adjacency[t]*3 + k]]] = stamp;
+                }
+                int shared = 0;
+                for (uint32_t t=adjacencyOffsets[to]; t < adjacencyOffsets[to+1]; ++t) {
+                    for (int k=0; k < 3; ++k) {
+                        uint32_t p = weld[indexes[adjacency[t]*3 + k]];
+                        if (p != from && p != to && marks[p] == stamp && counted[p] != stamp) {
+                            counted[p] = stamp;
+                            ++shared;
+                        }
+                    }
+                }
+                if (shared != 2) continue;
+
+                // Every vertex of from moves to the vertex of to it shares an edge with. Seam vertexes only find
+                // a single one when collapsing along the seam, a vertex without one would lose its attributes
+                bool mapped = true;
+                for (uint32_t t=adjacencyOffsets[from]; t < adjacencyOffsets[from+1] && mapped; ++t) {
+                    const uint32_t *triangle = &indexes[adjacency[t]*3];
+                    int a = weld[triangle[0]] == from ? 0 : weld[triangle[1]] == from ? 1 : 2,
+                        b = weld[triangle[0]] == to ? 0 : weld[triangle[1]] == to ? 1 : weld[triangle[2]] == to ? 2 : -1;
+                    if (b < 0) continue;
+
+                    uint32_t wedge = triangle[a];
+                    mapped = wedgeMarks[wedge] != stamp || wedgeTarget[wedge] == triangle[b];
+                    wedgeMarks[wedge] = stamp;
+                    wedgeTarget[wedge] = triangle[b];
+                }
+                for (uint32_t t=adjacencyOffsets[from]; t < adjacencyOffsets[from+1] && mapped; ++t) {
+                    for (int k=0; k < 3; ++k) {
+                        uint32_t v = indexes[adjacency[t]*3 + k];
+                        mapped = mapped && (weld[v] != from || wedgeMarks[v] == stamp);
+                    }
+                }
+                if (!mapped) continue;
+
+                // The remaining triangles around from must not flip
+                bool flips = false;
+                size_t collapsed = 0;
+                for (uint32_t t=adjacencyOffsets[from]; t < adjacencyOffsets[from+1] && !flips; ++t) {
+                    const uint32_t *triangle = &indexes[adjacency[t]*3];
+                    if (weld[triangle[0]] == to || weld[triangle[1]] == to || weld[triangle[2]] == to) {
+                        ++collapsed;
+                        continue;
+                    }
+
+                    glm::vec3 p[3], moved[3];
+                    for (int k=0; k < 3; ++k) {
+                        p[k] = points[weld[triangle[k]]];
+                        moved[k] = weld[triangle[k]] == from ? points[to] : p[k];
+                    }
+                    glm::vec3 before = glm::cross(p[1] - p[0], p[2] - p[0]),
+                              after = glm::cross(moved[1] - moved[0], moved[2] - moved[0]);
+                    flips = glm::dot(before, after) <= 1e-2f * glm::length(before) * glm::length(after);
+                }
+                if (flips) continue;
+
+                for (uint32_t t=adjacencyOffsets[from]; t < adjacencyOffsets[from+1]; ++t) {
+                    for (int k=0; k < 3; ++k) {
+                        uint32_t v = indexes[adjacency[t]*3 + k];
+                        if (weld[v] == from) remap[v] = wedgeTarget[v];
+                    }
+                }
+                quadrics[to].add(quadrics[from]);
+                error = std::max(error, collapse.cost);
+                removed += collapsed;
+
+                // Collapses of a pass don't touch each others triangles, so the checks above stay valid
+                for (uint32_t t=adjacencyOffsets[from]; t < adjacencyOffsets[from+1]; ++t) {
+                    for (int k=0; k < 3; ++k) passLocked[weld[indexes[adjacency[t]*3 + k]]] = 1;
+                }
+            }
+            if (removed == 0) break;
+
+            size_t write = 0;
+            for (size_t i=0; i < indexes.size(); i += 3) {
+                uint32_t a = remap[indexes[i]], b = remap[indexes[i+1]], c = remap[indexes[i+2]];
+                if (a == b || b == c || a == c) continue;
+
+                triangleSubmesh[write/3] = triangleSubmesh[i/3];
+                indexes[write++] = a;
+                indexes[write++] = b;
+                indexes[write++] = c;
+            }
+            indexes.resize(write);
+            triangleSubmesh.resize(write/3);
+        }
+
+        return (float)std::sqrt(error);
+    }
+
+    PISCES_API float MeshOptimizer::Simplify( const void *vertexes, size_t vertexStride, size_t vertexCount, size_t positionOffset,
+                                              const uint32_t *indexes, const Submesh *submeshes, size_t submeshCount,
+                                              float targetRatio, float targetError,
+                                              std::vector<uint32_t> &lodIndexes, std::vector<Submesh> &lodSubmeshes )
+    {
+        lodIndexes.clear();
+        lodSubmeshes.assign(submeshCount, Submesh());
+
+        std::vector<uint32_t> bases;
+        for (size_t i=0; i < submeshCount; ++i) {
+            bases.push_back(submeshes[i].baseVertex);
+        }
+        std::sort(bases.begin(), bases.end());
+        bases.erase(std::unique(bases.begin(), bases.end()), bases.end());
+
+        std::vector<glm::vec3> positions;
+        std::vector<uint32_t> groupIndexes, triangleSubmesh;
+        float error = 0.f;
+
+        for (size_t g=0; g < bases.size(); ++g) {
+            uint32_t base = bases[g];
+            size_t end = g+1 < bases.size() ? bases[g+1] : vertexCount;
+            size_t groupVertexCount = base < end ? end - base : 0;
+
+            // The submeshes of the group are simplified together, so their shared vertexes stay in place
+            groupIndexes.clear();
+            triangleSubmesh.clear();
+            bool valid = true;
+            for (size_t i=0; i < submeshCount; ++i) {
+                if (submeshes[i].baseVertex != base) continue;
+
+                const uint32_t *first = indexes + submeshes[i].first;
+                valid = valid && submeshes[i].count % 3 == 0 &&
+                        std::all_of(first, first + submeshes[i].count, [&]( uint32_t index ) { return index < groupVertexCount; });
+                groupIndexes.insert(groupIndexes.end(), first, first + submeshes[i].count);
+                triangleSubmesh.insert(triangleSubmesh.end(), submeshes[i].count / 3, (uint32_t)i);
+            }
+
+            if (valid) {
+                positions.resize(groupVertexCount);
+                const uint8_t *firstVertex = (const uint8_t*)vertexes + base * vertexStride;
+                for (size_t v=0; v < groupVertexCount; ++v) {
+                    memcpy(&positions[v], firstVertex + v * vertexStride + positionOffset, sizeof(glm::vec3));
+                }
+
+                size_t targetTriangles = (size_t)std::ceil(groupIndexes.size() / 3 * (double)targetRatio);
+                error = std::max(error, SimplifyGroup(positions, groupIndexes, triangleSubmesh, targetTriangles, targetError));
+            }
+            else {
+                LOG_WARNING("Not simplifying submeshes at base vertex %u, they aren't triangle lists within their vertex range", base);
+            }
+
+            // Triangles kept their order, so the ones of every submesh are still in one piece
+            size_t triangle = 0;
+            for (size_t i=0; i < submeshCount; ++i) {
+                if (submeshes[i].baseVertex != base) continue;
+
+                Submesh &lodSubmesh = lodSubmeshes[i];
+                    lodSubmesh.first = (uint32_t)lodIndexes.size();
+                    lodSubmesh.baseVertex = base;
+                for (; triangle < triangleSubmesh.size() && triangleSubmesh[triangle] == i; ++triangle) {
+                    lodIndexes.insert(lodIndexes.end(), &groupIndexes[triangle*3], &groupIndexes[triangle*3] + 3);
+                }
+                lodSubmesh.count = (uint32_t)lodIndexes.size() - lodSubmesh.first;
+            }
+        }
+
+        return error;
+    }
+
+#ifdef PISCES_SUPPORT_LOAD_OBJ
+    PISCES_API MeshOptimizer::Report MeshOptimizer::Optimize( ObjLoader::Object &object, const Options &options )
+    {
+        std::vector<uint32_t> indexes;
+        if (object.indexType == IndexType::UInt16) {
+            indexes.assign(object.indexes.begin(), object.indexes.end());
+        }
+        else {
+            indexes.swap(object.indexes32);
+        }
+
+        std::vector<Submesh> submeshes;
+        for (const auto &subObject : object.subobjects) {
+            if (subObject.count == 0) continue;
+
+            Submesh submesh;
+                submesh.first = subObject.first;
+                submesh.count = subObject.count;
+                submesh.baseVertex = subObject.baseVertex;
+            submeshes.push_back(submesh);
+        }
+
+        Report report = Optimize(object.vertexes.data(), sizeof(ObjLoader::Vertex), object.vertexes.size(), offsetof(ObjLoader::Vertex, pos),
+                                 indexes.data(), submeshes.data(), submeshes.size(), options);
+
+        if (object.indexType == IndexType::UInt16) {
+            std::copy(indexes.begin(), indexes.end(), object.indexes.begin());
+        }
+        else {
+            indexes.swap(object.indexes32);
+        }
+        return report;
+    }
+#endif
+}
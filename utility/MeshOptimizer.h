@@ -0,0 +1,94 @@
+#pragma once
+
+#include "Pisces/Fwd.h"
+#include "Pisces/build_config.h"
+
+#include <vector>
+
+#ifdef PISCES_SUPPORT_LOAD_OBJ
+#   include "ObjLoader.h"
+#endif
+
+namespace Pisces
+{
+    // Reorders indexed triangle lists for the gpu:
+    //  - triangles for the post transform cache (Tipsify, Sander et al. 2007)
+    //  - optionally clusters of triangles so outward facing ones are drawn first, which reduces overdraw
+    //  - vertexes in first use order for vertex fetch locality
+    // and simplifies them for levels of detail.
+    class MeshOptimizer {
+    public:
+        struct Options {
+            // Simulated fifo post transform cache
+            int cacheSize;
+            bool reduceOverdraw;
+            // A cluster may end where its cache miss rate is within this factor of the optimized one,
+            // larger values give smaller clusters, so less overdraw for more cache misses
+            float overdrawThreshold;
+            bool optimizeVertexFetch;
+
+            Options() :
+                cacheSize(16),
+                reduceOverdraw(false),
+                overdrawThreshold(1.05f),
+                optimizeVertexFetch(true)
+            {}
+        };
+
+        struct CacheStats {
+            size_t triangles = 0,
+                   vertexes = 0,
+                   misses = 0;
+
+            // Average cache miss ratio, transformed vertexes per triangle (0.5 is ideal for large meshes)
+            float acmr() const { return triangles ? (float)misses / triangles : 0.f; }
+            // Average transformed vertex ratio, transformed vertexes per referenced vertex (1 is ideal)
+            float atvr() const { return vertexes ? (float)misses / vertexes : 0.f; }
+        };
+        struct Report {
+            CacheStats before, after;
+        };
+
+        struct Submesh {
+            uint32_t first=0, count=0, baseVertex=0;
+        };
+
+        // Optimizes a triangle list made of submeshes, indexes are relative to their submesh's baseVertex.
+        // Submeshes with the same baseVertex share the vertexes up to the next baseVertex (or vertexCount),
+        // vertexes are only moved within that range. Index ranges of submeshes must not overlap.
+        // positionOffset is the offset of a float3 position in the vertex, it's only needed to reduce overdraw.
+        static PISCES_API Report Optimize( void *vertexes, size_t vertexStride, size_t vertexCount, size_t positionOffset,
+                                           uint32_t *indexes, const Submesh *submeshes, size_t submeshCount,
+                                           const Options &options = Options() );
+
+#ifdef PISCES_SUPPORT_LOAD_OBJ
+        static PISCES_API Report Optimize( ObjLoader::Object &object, const Options &options = Options() );
+#endif
+
+        // Reorders the triangles in place. clusters receives the first triangle of every cluster
+        // whose triangles can be moved as a whole without hurting the cache hit rate much.
+        static PISCES_API void OptimizeVertexCache( uint32_t *indexes, size_t indexCount, size_t vertexCount,
+                                                    int cacheSize = 16, float clusterThreshold = 1.05f,
+                                                    std::vector<uint32_t> *clusters = nullptr );
+
+        // Sorts the clusters from OptimizeVertexCache, triangles on the outside of the mesh facing away from its center come first
+        static PISCES_API void OptimizeOverdraw( uint32_t *indexes, size_t indexCount, const std::vector<uint32_t> &clusters,
+                                                 const void *vertexes, size_t vertexStride, size_t positionOffset );
+
+        // Computes remap[old vertex] = new vertex in first use order and rewrites the indexes,
+        // unreferenced vertexes are moved to the end
+        static PISCES_API void OptimizeVertexFetch( uint32_t *indexes, size_t indexCount, size_t vertexCount, std::vector<uint32_t> &remap );
+
+        // Simplifies the submeshes to about targetRatio of their triangles by collapsing edges in order of their quadric error,
+        // without exceeding targetError (in object space). The result only references existing vertexes, lodSubmeshes[i] is the
+        // simplified submeshes[i] with first relative to lodIndexes. Topology is taken from the welded positions: the vertexes of
+        // a uv or normal seam only collapse together along the seam, vertexes on open edges and between submeshes are never moved,
+        // so submeshes and 16 bit clusters don't crack apart. Returns the error of the result.
+        static PISCES_API float Simplify( const void *vertexes, size_t vertexStride, size_t vertexCount, size_t positionOffset,
+                                          const uint32_t *indexes, const Submesh *submeshes, size_t submeshCount,
+                                          float targetRatio, float targetError,
+                                          std::vector<uint32_t> &lodIndexes, std::vector<Submesh> &lodSubmeshes );
+
+        static PISCES_API CacheStats AnalyzeVertexCache( const uint32_t *indexes, size_t indexCount, size_t vertexCount, int cacheSize = 16 );
+    };
+}
@@ -0,0 +1,297 @@
+#include "MeshQuantizer.h"
+
+#include "Common/Throw.h"
+
+#include <glm/common.hpp>
+#include <glm/gtc/packing.hpp>
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <limits>
+
+namespace Pisces
+{
+    static const int MAX_COMPONENTS = 4;
+
+    static bool IsPacked( VertexAttributeType type )
+    {
+        return type == VertexAttributeType::NormInt3x10_1x2 || type == VertexAttributeType::NormUInt3x10_1x2;
+    }
+
+    // Size of one component, 0 for types the quantizer can't convert
+    static int ComponentSize( VertexAttributeType type )
+    {
+        switch (type) {
+        case VertexAttributeType::NormInt8:
+        case VertexAttributeType::NormUInt8:
+            return 1;
+        case VertexAttributeType::NormInt16:
+        case VertexAttributeType::NormUInt16:
+        case VertexAttributeType::Float16:
+            return 2;
+        case VertexAttributeType::Float32:
+        case VertexAttributeType::NormInt3x10_1x2:
+        case VertexAttributeType::NormUInt3x10_1x2:
+            return 4;
+        default:
+            return 0;
+        }
+    }
+
+    static int AttributeSize( VertexAttributeType type, int count )
+    {
+        return IsPacked(type) ? 4 : ComponentSize(type) * count;
+    }
+
+    static bool IsSignedNormalized( VertexAttributeType type )
+    {
+        return type == VertexAttributeType::NormInt8 || type == VertexAttributeType::NormInt16 || type == VertexAttributeType::NormInt3x10_1x2;
+    }
+
+    static bool IsUnsignedNormalized( VertexAttributeType type )
+    {
+        return type == VertexAttributeType::NormUInt8 || type == VertexAttributeType::NormUInt16 || type == VertexAttributeType::NormUInt3x10_1x2;
+    }
+
+    static int32_t EncodeSnorm( float value, int bits )
+    {
+        float max = (float)((1 << (bits-1)) - 1);
+        return (int32_t)std::round(glm::clamp(value, -1.f, 1.f) * max);
+    }
+
+    static float DecodeSnorm( int32_t value, int bits )
+    {
+        float max = (float)((1 << (bits-1)) - 1);
+        return std::max((float)value / max, -1.f);
+    }
+
+    static uint32_t EncodeUnorm( float value, int bits )
+    {
+        float max = (float)((1u << bits) - 1);
+        return (uint32_t)std::round(glm::clamp(value, 0.f, 1.f) * max);
+    }
+
+    static float DecodeUnorm( uint32_t value, int bits )
+    {
+        return (float)value / (float)((1u << bits) - 1);
+    }
+
+    static int32_t SignExtend( uint32_t value, int bits )
+    {
+        return (int32_t)(value << (32 - bits)) >> (32 - bits);
+    }
+
+    // Missing components decode as 0
+    static void Decode( VertexAttributeType type, int count, const uint8_t *data, float *values )
+    {
+        std::fill(values, values + MAX_COMPONENTS, 0.f);
+
+        if (IsPacked(type)) {
+            uint32_t packed;
+            memcpy(&packed, data, sizeof(packed));
+            for (int i=0; i < MAX_COMPONENTS; ++i) {
+                int bits = i < 3 ? 10 : 2;
+                uint32_t field = (packed >> (i*10)) & ((1u << bits) - 1);
+                values[i] = type == VertexAttributeType::NormInt3x10_1x2 ? DecodeSnorm(SignExtend(field, bits), bits) : DecodeUnorm(field, bits);
+            }
+            return;
+        }
+
+        for (int i=0; i < count; ++i) {
+            switch (type) {
+            case VertexAttributeType::NormInt8:     { int8_t v;   memcpy(&v, data + i, 1);   values[i] = DecodeSnorm(v, 8); break; }
+            case VertexAttributeType::NormUInt8:    { uint8_t v;  memcpy(&v, data + i, 1);   values[i] = DecodeUnorm(v, 8); break; }
+            case VertexAttributeType::NormInt16:    { int16_t v;  memcpy(&v, data + i*2, 2); values[i] = DecodeSnorm(v, 16); break; }
+            case VertexAttributeType::NormUInt16:   { uint16_t v; memcpy(&v, data + i*2, 2); values[i] = DecodeUnorm(v, 16); break; }
+            case VertexAttributeType::Float16:      { uint16_t v; memcpy(&v, data + i*2, 2); values[i] = glm::unpackHalf1x16(v); break; }
+            case VertexAttributeType::Float32:      { memcpy(&values[i], data + i*4, 4); break; }
+            default:
+                break;
+            }
+        }
+    }
+
+    static void Encode( VertexAttributeType type, int count, const float *values, uint8_t *data )
+    {
+        if (IsPacked(type)) {
+            uint32_t packed = 0;
+            for (int i=0; i < MAX_COMPONENTS; ++i) {
+                int bits = i < 3 ? 10 : 2;
+                uint32_t field = type == VertexAttributeType::NormInt3x10_1x2 ? (uint32_t)EncodeSnorm(values[i], bits) : EncodeUnorm(values[i], bits);
+                packed |= (field & ((1u << bits) - 1)) << (i*10);
+            }
+            memcpy(data, &packed, sizeof(packed));
+            return;
+        }
+
+        for (int i=0; i < count; ++i) {
+            switch (type) {
+            case VertexAttributeType::NormInt8:     { int8_t v = (int8_t)EncodeSnorm(values[i], 8);        memcpy(data + i, &v, 1); break; }
+            case VertexAttributeType::NormUInt8:    { uint8_t v = (uint8_t)EncodeUnorm(values[i], 8);      memcpy(data + i, &v, 1); break; }
+            case VertexAttributeType::NormInt16:    { int16_t v = (int16_t)EncodeSnorm(values[i], 16);     memcpy(data + i*2, &v, 2); break; }
+            case VertexAttributeType::NormUInt16:   { uint16_t v = (uint16_t)EncodeUnorm(values[i], 16);   memcpy(data + i*2, &v, 2); break; }
+            case VertexAttributeType::Float16:      { uint16_t v = glm::packHalf1x16(values[i]);           memcpy(data + i*2, &v, 2); break; }
+            case VertexAttributeType::Float32:      { memcpy(data + i*4, &values[i], 4); break; }
+            default:
+                break;
+            }
+        }
+    }
+
+    PISCES_API MeshQuantizer::Report MeshQuantizer::Quantize( MeshCooker::Mesh &mesh, const Encoding *encodings, size_t encodingCount, int positionAttribute )
+    {
+        if (mesh.vertexes.size() != (size_t)mesh.vertexCount * mesh.vertexStride) {
+            THROW(std::invalid_argument, "Vertex data of %zu bytes doesn't match %u vertexes with a stride of %u", mesh.vertexes.size(), mesh.vertexCount, mesh.vertexStride);
+        }
+        if (positionAttribute >= (int)mesh.layout.size() || (positionAttribute >= 0 && mesh.layout[positionAttribute].count < 3)) {
+            THROW(std::invalid_argument, "Attribute %i isn't a position", positionAttribute);
+        }
+
+        const std::vector<VertexAttribute> &source = mesh.layout;
+        for (const auto &attribute : source) {
+            if (ComponentSize(attribute.type) == 0) {
+                THROW(std::invalid_argument, "Can't quantize attributes of type %i", (int)attribute.type);
+            }
+        }
+
+        std::vector<VertexAttribute> layout = source;
+        for (size_t i=0; i < encodingCount; ++i) {
+            const Encoding &encoding = encodings[i];
+            if (encoding.attribute < 0 || encoding.attribute >= (int)layout.size()) {
+                THROW(std::invalid_argument, "Encoding for attribute %i, the mesh only has %zu", encoding.attribute, layout.size());
+            }
+            if (ComponentSize(encoding.type) == 0) {
+                THROW(std::invalid_argument, "Can't quantize attribute %i to type %i", encoding.attribute, (int)encoding.type);
+            }
+            if (encoding.count < 0 || encoding.count > MAX_COMPONENTS) {
+                THROW(std::invalid_argument, "Encoding for attribute %i has %i components", encoding.attribute, encoding.count);
+            }
+
+            VertexAttribute &attribute = layout[encoding.attribute];
+            attribute.type = encoding.type;
+            if (encoding.count > 0) {
+                attribute.count = encoding.count;
+            }
+            if (IsPacked(attribute.type)) {
+                attribute.count = MAX_COMPONENTS;
+            }
+        }
+        if (positionAttribute >= 0 && layout[positionAttribute].count < 3) {
+            THROW(std::invalid_argument, "Positions need at least 3 components");
+        }
+
+        // Every attribute starts at a multiple of 4 bytes
+        uint32_t stride = 0;
+        for (auto &attribute : layout) {
+            attribute.offset = (int)stride;
+            stride += (AttributeSize(attribute.type, attribute.count) + 3) & ~3u;
+        }
+        for (auto &attribute : layout) {
+            attribute.stride = (int)stride;
+        }
+
+        Report report;
+        report.vertexStrideBefore = mesh.vertexStride;
+        report.vertexStrideAfter = stride;
+        report.errors.resize(layout.size());
+        report.positionScale = glm::vec3(1.f);
+        report.positionOffset = glm::vec3(0.f);
+
+        auto readPosition = [&]( uint32_t vertex, float *values ) {
+            const VertexAttribute &attribute = source[positionAttribute];
+            Decode(attribute.type, attribute.count, mesh.vertexes.data() + (size_t)vertex * mesh.vertexStride + attribute.offset, values);
+            for (int i=0; i < 3; ++i) {
+                values[i] = values[i] * mesh.positionScale[i] + mesh.positionOffset[i];
+            }
+        };
+
+        if (positionAttribute >= 0 && mesh.vertexCount > 0) {
+            glm::vec3 boundsMin(std::numeric_limits<float>::max()), boundsMax(-std::numeric_limits<float>::max());
+            for (uint32_t vertex=0; vertex < mesh.vertexCount; ++vertex) {
+                float values[MAX_COMPONENTS];
+                readPosition(vertex, values);
+
+                glm::vec3 pos(values[0], values[1], values[2]);
+                boundsMin = glm::min(boundsMin, pos);
+                boundsMax = glm::max(boundsMax, pos);
+            }
+            mesh.boundsMin = boundsMin;
+            mesh.boundsMax = boundsMax;
+
+            VertexAttributeType type = layout[positionAttribute].type;
+            for (int i=0; i < 3; ++i) {
+                float extent = boundsMax[i] - boundsMin[i];
+                if (IsSignedNormalized(type)) {
+                    report.positionOffset[i] = (boundsMin[i] + boundsMax[i]) * 0.5f;
+                    report.positionScale[i] = extent > 0.f ? extent * 0.5f : 1.f;
+                }
+                else if (IsUnsignedNormalized(type)) {
+                    report.positionOffset[i] = boundsMin[i];
+                    report.positionScale[i] = extent > 0.f ? extent : 1.f;
+                }
+                else if (type == VertexAttributeType::Float16) {
+                    // Half floats are most precise near 0
+                    report.positionOffset[i] = (boundsMin[i] + boundsMax[i]) * 0.5f;
+                }
+            }
+        }
+
+        std::vector<uint8_t> vertexes((size_t)mesh.vertexCount * stride, 0);
+        for (uint32_t vertex=0; vertex < mesh.vertexCount; ++vertex) {
+            for (size_t attributeIndex=0; attributeIndex < layout.size(); ++attributeIndex) {
+                const VertexAttribute &from = source[attributeIndex],
+                                      &to = layout[attributeIndex];
+                bool isPosition = (int)attributeIndex == positionAttribute;
+
+                float values[MAX_COMPONENTS];
+                if (isPosition) {
+                    readPosition(vertex, values);
+                }
+                else {
+                    Decode(from.type, from.count, mesh.vertexes.data() + (size_t)vertex * mesh.vertexStride + from.offset, values);
+                }
+
+                float stored[MAX_COMPONENTS];
+                std::copy(values, values + MAX_COMPONENTS, stored);
+                if (isPosition) {
+                    for (int i=0; i < 3; ++i) {
+                        stored[i] = (values[i] - report.positionOffset[i]) / report.positionScale[i];
+                    }
+                }
+
+                uint8_t *data = vertexes.data() + (size_t)vertex * stride + to.offset;
+                Encode(to.type, to.count, stored, data);
+
+                float decoded[MAX_COMPONENTS];
+                Decode(to.type, to.count, data, decoded);
+                if (isPosition) {
+                    for (int i=0; i < 3; ++i) {
+                        decoded[i] = decoded[i] * report.positionScale[i] + report.positionOffset[i];
+                    }
+                }
+
+                float distance = 0.f;
+                for (int i=0; i < from.count; ++i) {
+                    distance += (decoded[i] - values[i]) * (decoded[i] - values[i]);
+                }
+                distance = std::sqrt(distance);
+
+                AttributeError &error = report.errors[attributeIndex];
+                error.maxError = std::max(error.maxError, distance);
+                error.meanError += distance;
+            }
+        }
+        for (auto &error : report.errors) {
+            error.meanError = mesh.vertexCount > 0 ? error.meanError / mesh.vertexCount : 0.f;
+        }
+
+        mesh.layout = std::move(layout);
+        mesh.vertexStride = stride;
+        mesh.vertexes = std::move(vertexes);
+        mesh.positionScale = report.positionScale;
+        mesh.positionOffset = report.positionOffset;
+
+        return report;
+    }
+}
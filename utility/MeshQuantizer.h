@@ -0,0 +1,45 @@
+#pragma once
+
+#include "Pisces/Fwd.h"
+#include "Pisces/build_config.h"
+
+#include "MeshCooker.h"
+
+#include <glm/vec3.hpp>
+
+#include <vector>
+
+namespace Pisces
+{
+    // Re-encodes the vertex attributes of cooked meshes with smaller types. Supported types are
+    // Float32, Float16, NormInt8/16, NormUInt8/16 and NormInt3x10_1x2/NormUInt3x10_1x2.
+    // Positions are stored relative to the mesh bounds, normalized types cover the bounds exactly and
+    // Float16 is centered on them. The mesh's positionScale & positionOffset map them back to object space.
+    class MeshQuantizer {
+    public:
+        struct Encoding {
+            // Index into the mesh layout
+            int attribute = 0;
+            VertexAttributeType type = VertexAttributeType::Float32;
+            // 0 keeps the count of the attribute, packed types always have 4 components
+            int count = 0;
+        };
+
+        struct AttributeError {
+            // Distance between the original and the quantized value, positions in object space
+            float maxError = 0.f, meanError = 0.f;
+        };
+        struct Report {
+            uint32_t vertexStrideBefore = 0, vertexStrideAfter = 0;
+            // One per attribute of the layout
+            std::vector<AttributeError> errors;
+
+            // position = quantized position * positionScale + positionOffset
+            glm::vec3 positionScale, positionOffset;
+        };
+
+        // Attributes without an encoding keep their type. positionAttribute is the layout index of the position,
+        // -1 if the mesh has none. Attributes are aligned to 4 bytes in the new layout.
+        static PISCES_API Report Quantize( MeshCooker::Mesh &mesh, const Encoding *encodings, size_t encodingCount, int positionAttribute = 0 );
+    };
+}
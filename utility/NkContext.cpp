@@ -15,6 +15,7 @@
 #include <SDL.h>
 
 #include <cassert>
+#include <cstring>
 #include <algorithm>
 
 #include <glm/mat4x4.hpp>
@@ -67,11 +68,8 @@ namespace Pisces
             {VertexAttributeType::NormUInt8, offsetof(nkVertex, col), 4, sizeof(nkVertex), 0},
         };
 
-        const size_t DEFAULT_VERTEX_BUFFER_SIZE = 4096,
-                     DEFAULT_INDEX_BUFFER_SIZE  = 8192;
-
-        const size_t MAX_VERTEX_BUFFER_SIZE = 32768,
-                     MAX_INDEX_BUFFER_SIZE = 65536;
+        // Limited by the 16 bit indexes
+        const size_t MAX_VERTEX_COUNT = 65536;
 
         static const char *DefaultVertexShader = R"(
 #version 330
@@ -121,17 +119,16 @@ void main()
         TextureHandle fontTexture;
         PipelineHandle pipeline;
 
-        VertexArrayHandle vertexArray;
-        StreamingBuffer<nkVertex> vertexBuffer;
-        StreamingBuffer<nkIndex> indexBuffer;
+        // Vertexes & indexes are converted on the cpu and then copied to the context transient buffer
+        NkBufferHandle vertexData,
+                       indexData;
 
-        size_t maxVertexCount = DEFAULT_VERTEX_BUFFER_SIZE,
-               maxIndexCount = DEFAULT_INDEX_BUFFER_SIZE;
+        VertexArrayHandle vertexArray;
+        // Transient buffers the vertex array was created for
+        BufferHandle vertexArrayBuffer, vertexArrayIndexBuffer;
 
         Impl( Context *ctx_ ) :
-            ctx(ctx_),
-            vertexBuffer(ctx, BufferType::Vertex, DEFAULT_VERTEX_BUFFER_SIZE),
-            indexBuffer(ctx, BufferType::Index, DEFAULT_INDEX_BUFFER_SIZE)
+            ctx(ctx_)
         {}
     };
 
@@ -164,6 +161,11 @@ void main()
         mImpl->nkCmdBuffer = NkBufferHandle(new nk_buffer);
         nk_buffer_init_default(mImpl->nkCmdBuffer);
 
+        mImpl->vertexData = NkBufferHandle(new nk_buffer);
+        nk_buffer_init_default(mImpl->vertexData);
+        mImpl->indexData = NkBufferHandle(new nk_buffer);
+        nk_buffer_init_default(mImpl->indexData);
+
         PipelineManager *pipelineMgr = ctx->getPipelineManager();
         if (!pipelineMgr->findPipeline(Common::CreateStringId("Nuklear"), mImpl->pipeline)) {
             LOG_WARNING("Failed to find pipeline 'Nuklear' - trying to create one.");
@@ -274,80 +276,48 @@ void main()
             config.null = mImpl->nkNullTexture;
 
 
-        bool recreateVA = !mImpl->vertexArray;
-
-        for (int tries=0; tries < 2; ++tries) {
-            nk_buffer_clear(mImpl->nkCmdBuffer);
-
-            nkVertex *vertexes = mImpl->vertexBuffer.mapBuffer(0, mImpl->maxVertexCount);
-            nkIndex *indexes = mImpl->indexBuffer.mapBuffer(0, mImpl->maxIndexCount);
-
-            assert(vertexes && indexes);
-
-            nk_buffer vertexBuffer,
-                      indexBuffer;
+        nk_buffer_clear(mImpl->nkCmdBuffer);
+        nk_buffer_clear(mImpl->vertexData);
+        nk_buffer_clear(mImpl->indexData);
 
-            nk_buffer_init_fixed(&vertexBuffer, vertexes, sizeof(nkVertex)*mImpl->maxVertexCount);
-            nk_buffer_init_fixed(&indexBuffer, indexes, sizeof(nkIndex)*mImpl->maxIndexCount);
+        nk_flags res = nk_convert(ctx, mImpl->nkCmdBuffer, mImpl->vertexData, mImpl->indexData, &config);
+        assert (res != NK_CONVERT_INVALID_PARAM);
+        if (res != NK_CONVERT_SUCCESS) {
+            LOG_ERROR("Failed to convert nuklear draw commands (%i)", (int)res);
+            return;
+        }
 
-            nk_flags res = nk_convert(ctx, mImpl->nkCmdBuffer, &vertexBuffer, &indexBuffer, &config);
+        size_t vertexCount = mImpl->vertexData->allocated / sizeof(nkVertex),
+               indexCount = mImpl->indexData->allocated / sizeof(nkIndex);
+        if (vertexCount == 0 || indexCount == 0) return;
 
-            mImpl->vertexBuffer.unmapBuffer();
-            mImpl->indexBuffer.unmapBuffer();
-            
-            assert (res != NK_CONVERT_INVALID_PARAM);
-            assert ((res&NK_CONVERT_COMMAND_BUFFER_FULL) == false);
+        if (vertexCount > MAX_VERTEX_COUNT) {
+            // If this happends I need to investigate why, 16 bit indexes can't address more vertexes
+            FATAL_ERROR("To many nuklear vertexes, max is %zu - needs %zu", MAX_VERTEX_COUNT, vertexCount);
+        }
 
-            if (res == NK_CONVERT_SUCCESS) break;
+        TransientBuffer *transientBuffer = mImpl->ctx->getTransientBuffer();
 
-            if (res & NK_CONVERT_VERTEX_BUFFER_FULL) {
-                size_t needed = vertexBuffer.needed / sizeof(nkVertex);
-                size_t newSize = needed + needed/2;
-                newSize = std::min(newSize, MAX_VERTEX_BUFFER_SIZE);
+        // Align to the vertex size so the offset can be used as base vertex
+        TransientAllocation vertexes = transientBuffer->allocate(vertexCount*sizeof(nkVertex), sizeof(nkVertex));
+        TransientAllocation indexes = transientBuffer->allocate(indexCount*sizeof(nkIndex), sizeof(nkIndex));
+        assert(vertexes && indexes);
 
-                if (needed < newSize) {
-                    mImpl->vertexBuffer.resize(newSize, StreamingBufferResizeFlags::None);
-                    mImpl->maxVertexCount = newSize;
-                    recreateVA = true;
+        memcpy(vertexes.data, nk_buffer_memory(mImpl->vertexData), vertexes.size);
+        memcpy(indexes.data, nk_buffer_memory(mImpl->indexData), indexes.size);
 
-                    LOG_INFORMATION("Nuklear vertex buffer size increased to %zu", newSize);
-                }
-                else {
-                    // If this happends I need to investigate why, in the best case just increase MAX_VERTEX_BUFFER_SIZE
-                    FATAL_ERROR("To big of a vertex buffer, max is %zu - needs %zu", sizeof(nkVertex)*MAX_VERTEX_BUFFER_SIZE, (size_t)vertexBuffer.needed);
-                }
-            }
-            if (res & NK_CONVERT_ELEMENT_BUFFER_FULL) {
-                size_t needed = indexBuffer.needed / sizeof(nkIndex);
-                size_t newSize = needed + needed/2;
-                newSize = std::min(newSize, MAX_INDEX_BUFFER_SIZE);
-
-                if (needed < newSize) {
-                    mImpl->indexBuffer.resize(newSize, StreamingBufferResizeFlags::None);
-                    mImpl->maxIndexCount = newSize;
-                    recreateVA = true;
-
-                    LOG_INFORMATION("Nuklear index buffer size increased to %zu", newSize);
-                }
-                else {
-                    // If this happends I need to investigate why, in the best case just increase MAX_INDEX_BUFFER_SIZE
-                    FATAL_ERROR("To big of a vertex buffer, max is %zu - needs %zu", sizeof(nkIndex)*MAX_INDEX_BUFFER_SIZE, (size_t)vertexBuffer.needed);
-                }
-            }
-        }
-
-        if (recreateVA) {
+        // The transient buffer is replaced when it grows, which can happen between the two allocations
+        if (mImpl->vertexArrayBuffer != vertexes.buffer || mImpl->vertexArrayIndexBuffer != indexes.buffer) {
             HardwareResourceManager *hardwareMgr = mImpl->ctx->getHardwareResourceManager();
             hardwareMgr->deleteVertexArray(mImpl->vertexArray);
 
-            BufferHandle vertexBuffer = mImpl->vertexBuffer.handle();
-            BufferHandle indexBuffer = mImpl->indexBuffer.handle();
-
             mImpl->vertexArray = hardwareMgr->createVertexArray(
                 NK_VERTEX_LAYOUT, NK_VERTEX_LAYOUT_SIZE,
-                &vertexBuffer, 1,
-                indexBuffer, nkIndexType
+                &vertexes.buffer, 1,
+                indexes.buffer, nkIndexType
             );
+            mImpl->vertexArrayBuffer = vertexes.buffer;
+            mImpl->vertexArrayIndexBuffer = indexes.buffer;
         }
 
         RenderCommandQueuePtr commandQueue = mImpl->ctx->createRenderCommandQueue();
@@ -371,8 +341,8 @@ void main()
         commandQueue->bindUniform(0, ortho);
 
         const nk_draw_command *cmd = nullptr;
-        size_t base  = mImpl->vertexBuffer.currentFrameOffset(),
-               first = mImpl->indexBuffer.currentFrameOffset();
+        size_t base  = vertexes.offset / sizeof(nkVertex),
+               first = indexes.offset / sizeof(nkIndex);
 
         nk_draw_foreach(cmd, ctx, mImpl->nkCmdBuffer) {
             ClipRect rect;
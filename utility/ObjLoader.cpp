@@ -2,175 +2,646 @@
 
 #include "Common/Throw.h"
 
-#include "tiny_obj_loader.h"
-#include "Common/Throw.h"
-#include "Common/MemStreamBuf.h"
-
 #include <glm/vec3.hpp>
 #include <glm/vec2.hpp>
 
 #include <glm/gtc/packing.hpp>
 
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <exception>
+#include <limits>
+#include <string>
+#include <thread>
+
 
 namespace Pisces
 {
-    PISCES_API ObjLoader::Result ObjLoader::LoadFile( Common::Archive &archive, const std::string &filename )
+    // The parser follows the rules of tinyobjloader's callback loader (line splitting, number parsing
+    // and index triples) so files load exactly as they did when it was used.
+    namespace
     {
-        using namespace tinyobj;
-
-        auto file = archive.openFile(filename);
-        if (!file) {
-            THROW(std::runtime_error, 
-                  "Failed to open file \"%s\" in archive \"%s\"", filename.c_str(), archive.name()
-            );
-        }
+        const size_t MIN_CHUNK_SIZE = 256 * 1024;
 
-        Common::MemStreamBuf buf(archive.mapFile(file), archive.fileSize(file));
-        std::istream stream(&buf);
+        // Raw obj indices, 1 based and 0 if missing
+        struct Index {
+            int vertex = 0, normal = 0, texcoord = 0;
 
+            bool operator == ( const Index &other ) const {
+                return vertex == other.vertex && normal == other.normal && texcoord == other.texcoord;
+            }
+        };
 
         struct Face {
             Common::StringId material;
-            index_t indexes[3];
+            Index indexes[3];
         };
-        struct ObjectData {
-            Common::StringId name;
-            size_t firstFace = 0, faceCount = 0;
+
+        // usemtl and o statements, applied in file order when the chunks are merged
+        struct Statement {
+            enum Type { Material, Object } type;
+            // faces of the chunk before the statement
+            size_t face;
+            const char *name;
+            size_t length;
         };
-        struct Data {
-            const char *filename;
+
+        struct Chunk {
+            const char *begin, *end;
+
             std::vector<glm::vec3> positions;
             std::vector<glm::vec3> normals;
             std::vector<glm::vec2> texcoords;
-            std::vector<Face> faces;
-            std::vector<ObjectData> objects;
-            Common::StringId material;
-        };
-
-        tinyobj::callback_t callbacks;
+            std::vector<Index> faces;
+            std::vector<Statement> statements;
 
-        callbacks.vertex_cb = [](void *user_data, real_t x, real_t y, real_t z, real_t w) {
-            Data *data = (Data*)user_data;
-            data->positions.emplace_back(x, y, z);
+            // vertex count of the first face that isn't a triangle
+            int polygonSize = 3;
+            std::exception_ptr exception;
         };
-        callbacks.normal_cb = [](void *user_data, real_t x, real_t y, real_t z) {
-            Data *data = (Data*)user_data;
-            data->normals.emplace_back(x, y, z);
-        };
-        callbacks.texcoord_cb = [](void *user_data, real_t x, real_t y, real_t z) {
-            Data *data = (Data*)user_data;
-            data->texcoords.emplace_back(x,y);
+
+        struct ObjectData {
+            Common::StringId name;
+            size_t firstFace = 0, faceCount = 0;
         };
-        callbacks.index_cb = [](void *user_data, index_t *indices, int num_indices) {
-            Data *data = (Data*)user_data;
 
-            if (num_indices != 3) {
-                THROW(std::runtime_error, "Failed to load obj file \"%s\" unsuported! (only support triangles this file contains %i-gons", data->filename, num_indices);
+        // Past the end of the line reads as '\0', like the null terminated lines tinyobjloader works on
+        inline char Peek( const char *token, const char *end )
+        {
+            return token < end ? *token : '\0';
+        }
+
+        inline bool IsSpace( char c )
+        {
+            return c == ' ' || c == '\t';
+        }
+
+        inline bool IsDigit( char c )
+        {
+            return c >= '0' && c <= '9';
+        }
+
+        inline const char* SkipSpaces( const char *token, const char *end )
+        {
+            while (token < end && IsSpace(*token)) token++;
+            return token;
+        }
+
+        bool TryParseDouble( const char *s, const char *end, double *result )
+        {
+            if (s >= end) return false;
+
+            double mantissa = 0.0;
+            int exponent = 0;
+            char sign = '+';
+            char expSign = '+';
+            const char *curr = s;
+            int read = 0;
+            bool leadingDecimalDots = false;
+
+            if (*curr == '+' || *curr == '-') {
+                sign = *curr;
+                curr++;
+                if (Peek(curr, end) == '.') {
+                    leadingDecimalDots = true;
+                }
+            }
+            else if (*curr == '.') {
+                leadingDecimalDots = true;
+            }
+            else if (!IsDigit(*curr)) {
+                return false;
             }
 
-            Face face;
-                face.material = data->material;
-                face.indexes[0] = indices[0];
-                face.indexes[1] = indices[1];
-                face.indexes[2] = indices[2];
+            if (!leadingDecimalDots) {
+                while (curr < end && IsDigit(*curr)) {
+                    mantissa *= 10;
+                    mantissa += static_cast<int>(*curr - '0');
+                    curr++;
+                    read++;
+                }
+                if (read == 0) return false;
+            }
 
-            data->faces.emplace_back(face);
-            data->objects.back().faceCount++;
-        };
-        callbacks.usemtl_cb = [](void *user_data, const char *name, int material_id) {
-            Data *data = (Data*)user_data;
-            data->material = Common::CreateStringId(name);
-        };
-        callbacks.mtllib_cb = [](void *user_data, const material_t *materials, int num_materials) {};
+            if (curr < end && *curr == '.') {
+                static const double powLut[] = {
+                    1.0, 0.1, 0.01, 0.001, 0.0001, 0.00001, 0.000001, 0.0000001,
+                };
+                const int lutEntries = sizeof powLut / sizeof powLut[0];
+
+                curr++;
+                read = 1;
+                while (curr < end && IsDigit(*curr)) {
+                    mantissa += static_cast<int>(*curr - '0') * (read < lutEntries ? powLut[read] : std::pow(10.0, -read));
+                    read++;
+                    curr++;
+                }
+            }
 
-        callbacks.group_cb = [](void *user_data, const char **names, int num_names) {};
-        callbacks.object_cb = [](void *user_data, const char *name) {
+            if (curr < end && (*curr == 'e' || *curr == 'E')) {
+                curr++;
+                char c = Peek(curr, end);
+                if (c == '+' || c == '-') {
+                    expSign = c;
+                    curr++;
+                }
+                else if (!IsDigit(c)) {
+                    return false;
+                }
 
-            Data *data = (Data*)user_data;
-            
-            if (data->objects.back().faceCount > 0) {
-                data->objects.emplace_back();
+                read = 0;
+                while (curr < end && IsDigit(*curr)) {
+                    if (exponent > std::numeric_limits<int>::max() / 10) {
+                        return false;
+                    }
+                    exponent *= 10;
+                    exponent += static_cast<int>(*curr - '0');
+                    curr++;
+                    read++;
+                }
+                exponent *= (expSign == '+' ? 1 : -1);
+                if (read == 0) return false;
             }
 
-            auto &object = data->objects.back();
-            object.firstFace = data->faces.size();
-            object.name = Common::CreateStringId(name);
-        };
+            *result = (sign == '+' ? 1 : -1) *
+                      (exponent ? std::ldexp(mantissa * std::pow(5.0, exponent), exponent) : mantissa);
+            return true;
+        }
+
+        float ParseReal( const char *&token, const char *end, double defaultValue=0.0 )
+        {
+            token = SkipSpaces(token, end);
+
+            const char *numberEnd = token;
+            while (numberEnd < end && !IsSpace(*numberEnd)) numberEnd++;
+
+            double value = defaultValue;
+            TryParseDouble(token, numberEnd, &value);
+            token = numberEnd;
+
+            return static_cast<float>(value);
+        }
+
+        // Same as atoi, the number ends at the first character that isn't a digit
+        int ParseInt( const char *token, const char *end )
+        {
+            while (token < end && (IsSpace(*token) || *token == '\v' || *token == '\f')) token++;
+
+            bool negative = false;
+            if (token < end && (*token == '+' || *token == '-')) {
+                negative = *token == '-';
+                token++;
+            }
+
+            unsigned value = 0;
+            while (token < end && IsDigit(*token)) {
+                value = value * 10 + (unsigned)(*token - '0');
+                token++;
+            }
+            return (int)(negative ? 0u - value : value);
+        }
+
+        inline const char* SkipIndex( const char *token, const char *end )
+        {
+            while (token < end && *token != '/' && !IsSpace(*token)) token++;
+            return token;
+        }
+
+        // v, v/vt, v//vn or v/vt/vn
+        Index ParseTriple( const char *&token, const char *end )
+        {
+            Index index;
+
+            index.vertex = ParseInt(token, end);
+            token = SkipIndex(token, end);
+            if (Peek(token, end) != '/') return index;
+            token++;
+
+            if (Peek(token, end) == '/') {
+                token++;
+                index.normal = ParseInt(token, end);
+                token = SkipIndex(token, end);
+                return index;
+            }
+
+            index.texcoord = ParseInt(token, end);
+            token = SkipIndex(token, end);
+            if (Peek(token, end) != '/') return index;
+            token++;
+
+            index.normal = ParseInt(token, end);
+            token = SkipIndex(token, end);
+            return index;
+        }
+
+        void ParseLine( Chunk &chunk, const char *token, const char *end )
+        {
+            token = SkipSpaces(token, end);
+            if (token == end || *token == '#') return;
+
+            char c0 = *token, c1 = Peek(token+1, end);
+
+            if (c0 == 'v' && IsSpace(c1)) {
+                token += 2;
+                float x = ParseReal(token, end);
+                float y = ParseReal(token, end);
+                float z = ParseReal(token, end);
+                chunk.positions.emplace_back(x, y, z);
+            }
+            else if (c0 == 'v' && c1 == 'n' && IsSpace(Peek(token+2, end))) {
+                token += 3;
+                float x = ParseReal(token, end);
+                float y = ParseReal(token, end);
+                float z = ParseReal(token, end);
+                chunk.normals.emplace_back(x, y, z);
+            }
+            else if (c0 == 'v' && c1 == 't' && IsSpace(Peek(token+2, end))) {
+                token += 3;
+                float x = ParseReal(token, end);
+                float y = ParseReal(token, end);
+                chunk.texcoords.emplace_back(x, y);
+            }
+            else if (c0 == 'f' && IsSpace(c1)) {
+                token = SkipSpaces(token + 2, end);
+
+                Index indexes[3];
+                int count = 0;
+                while (token < end) {
+                    Index index = ParseTriple(token, end);
+                    if (count < 3) indexes[count] = index;
+                    count++;
+                    token = SkipSpaces(token, end);
+                }
 
-        Data data;
-        data.objects.emplace_back();
-        data.filename = filename.c_str();
-        std::string error;
-        if (!tinyobj::LoadObjWithCallback(stream, callbacks, &data, nullptr, &error)) {
-            THROW(std::runtime_error, "Failed to load obj file \"%s\" error: %s", filename.c_str(), error.c_str());   
+                // Empty faces are skipped, like tinyobjloader did
+                if (count == 0) return;
+                if (count != 3) {
+                    if (chunk.polygonSize == 3) {
+                        chunk.polygonSize = count;
+                    }
+                    return;
+                }
+                chunk.faces.insert(chunk.faces.end(), indexes, indexes+3);
+            }
+            else if (end - token >= 7 && strncmp(token, "usemtl", 6) == 0 && IsSpace(token[6])) {
+                Statement statement;
+                    statement.type = Statement::Material;
+                    statement.face = chunk.faces.size() / 3;
+                    statement.name = token + 7;
+                    statement.length = end - (token + 7);
+                chunk.statements.push_back(statement);
+            }
+            else if (c0 == 'o' && IsSpace(c1)) {
+                Statement statement;
+                    statement.type = Statement::Object;
+                    statement.face = chunk.faces.size() / 3;
+                    statement.name = token + 2;
+                    statement.length = end - (token + 2);
+                chunk.statements.push_back(statement);
+            }
         }
 
-        struct Less {
-            bool operator () ( const index_t &lhs, const index_t &rhs) const {
-                return std::tie(lhs.vertex_index, lhs.normal_index, lhs.texcoord_index) <
-                       std::tie(rhs.vertex_index, rhs.normal_index, rhs.texcoord_index);
+        // '\r', '\n' and "\r\n" all end a line, a '\0' ends its content
+        void ParseChunk( Chunk &chunk )
+        {
+            const char *pos = chunk.begin;
+            while (pos < chunk.end) {
+                const char *line = pos;
+                while (pos < chunk.end && *pos != '\n' && *pos != '\r' && *pos != '\0') pos++;
+                const char *lineEnd = pos;
+                while (pos < chunk.end && *pos != '\n' && *pos != '\r') pos++;
+
+                ParseLine(chunk, line, lineEnd);
+
+                if (pos < chunk.end) {
+                    pos += (*pos == '\r' && pos+1 < chunk.end && pos[1] == '\n') ? 2 : 1;
+                }
+            }
+        }
+
+        // Chunk ends are moved past the next line break, so no line is split between two chunks
+        std::vector<Chunk> SplitChunks( const char *data, size_t size )
+        {
+            size_t count = std::max(1u, std::thread::hardware_concurrency());
+            count = std::max<size_t>(1, std::min(count, size / MIN_CHUNK_SIZE));
+
+            std::vector<Chunk> chunks;
+            chunks.reserve(count);
+
+            const char *begin = data, *end = data + size;
+            for (size_t i=0; i < count && begin < end; ++i) {
+                const char *split = i+1 < count ? std::max(begin, data + size * (i+1) / count) : end;
+                while (split < end && *split != '\n' && *split != '\r') split++;
+                if (split < end) split++;
+                if (split < end && split[-1] == '\r' && *split == '\n') split++;
+
+                chunks.emplace_back();
+                chunks.back().begin = begin;
+                chunks.back().end = split;
+                begin = split;
+            }
+            return chunks;
+        }
+
+        void ParseChunks( std::vector<Chunk> &chunks )
+        {
+            auto parse = []( Chunk *chunk ) {
+                try {
+                    ParseChunk(*chunk);
+                }
+                catch (...) {
+                    chunk->exception = std::current_exception();
+                }
             };
-        };
-        std::map<index_t, int, Less> indexLookup;
 
-        auto lookupIndex = [&]( index_t index ) {
-            auto iter = indexLookup.find(index);
-            if (iter != indexLookup.end()) {
-                return iter->second;
+            std::vector<std::thread> threads;
+            threads.reserve(chunks.size());
+            for (size_t i=1; i < chunks.size(); ++i) {
+                threads.emplace_back(parse, &chunks[i]);
+            }
+            if (!chunks.empty()) {
+                parse(&chunks[0]);
+            }
+            for (auto &thread : threads) {
+                thread.join();
+            }
+
+            for (auto &chunk : chunks) {
+                if (chunk.exception) {
+                    std::rethrow_exception(chunk.exception);
+                }
+            }
+        }
+
+        inline uint32_t HashIndex( const Index &index )
+        {
+            uint32_t h = (uint32_t)index.vertex * 0x9E3779B1u;
+            h ^= (uint32_t)index.normal * 0x85EBCA77u;
+            h ^= (uint32_t)index.texcoord * 0xC2B2AE3Du;
+            h ^= h >> 16;
+            h *= 0x7FEB352Du;
+            h ^= h >> 15;
+            return h;
+        }
+
+        // Open addressing map from index triple to vertex, linear probing and kept at most half full
+        class IndexLookup {
+        public:
+            void reset( size_t expected )
+            {
+                size_t capacity = 16;
+                while (capacity < expected * 2) capacity *= 2;
+
+                mSlots.assign(capacity, Slot());
+                mSize = 0;
+            }
+
+            bool contains( const Index &index ) const
+            {
+                size_t mask = mSlots.size() - 1;
+                for (size_t slot = HashIndex(index) & mask; mSlots[slot].vertex != -1; slot = (slot + 1) & mask) {
+                    if (mSlots[slot].index == index) return true;
+                }
+                return false;
+            }
+
+            // Returns the vertex already stored for index, or stores vertex
+            int insert( const Index &index, int vertex )
+            {
+                if ((mSize + 1) * 2 > mSlots.size()) {
+                    grow();
+                }
+
+                size_t mask = mSlots.size() - 1;
+                for (size_t slot = HashIndex(index) & mask;; slot = (slot + 1) & mask) {
+                    if (mSlots[slot].vertex == -1) {
+                        mSlots[slot].index = index;
+                        mSlots[slot].vertex = vertex;
+                        mSize++;
+                        return vertex;
+                    }
+                    if (mSlots[slot].index == index) {
+                        return mSlots[slot].vertex;
+                    }
+                }
+            }
+
+        private:
+            struct Slot {
+                Index index;
+                int vertex = -1;
+            };
+
+            void grow()
+            {
+                std::vector<Slot> slots(mSlots.size() * 2);
+                mSlots.swap(slots);
+
+                size_t mask = mSlots.size() - 1;
+                for (auto &entry : slots) {
+                    if (entry.vertex == -1) continue;
+
+                    size_t slot = HashIndex(entry.index) & mask;
+                    while (mSlots[slot].vertex != -1) slot = (slot + 1) & mask;
+                    mSlots[slot] = entry;
+                }
             }
-            return -1;
+
+            std::vector<Slot> mSlots;
+            size_t mSize = 0;
         };
 
+        template< typename T >
+        void Concat( std::vector<T> &dst, const std::vector<Chunk> &chunks, std::vector<T> Chunk::*member )
+        {
+            size_t size = 0;
+            for (auto &chunk : chunks) size += (chunk.*member).size();
+
+            dst.reserve(size);
+            for (auto &chunk : chunks) {
+                dst.insert(dst.end(), (chunk.*member).begin(), (chunk.*member).end());
+            }
+        }
+    }
+
+    PISCES_API ObjLoader::Result ObjLoader::LoadFile( Common::Archive &archive, const std::string &filename, IndexType indexType )
+    {
+        if (indexType != IndexType::UInt16 && indexType != IndexType::UInt32) {
+            THROW(std::invalid_argument, "Can't load obj file \"%s\", index type has to be UInt16 or UInt32", filename.c_str());
+        }
+
+        auto file = archive.openFile(filename);
+        if (!file) {
+            THROW(std::runtime_error,
+                  "Failed to open file \"%s\" in archive \"%s\"", filename.c_str(), archive.name()
+            );
+        }
+
+        std::vector<Chunk> chunks = SplitChunks((const char*)archive.mapFile(file), archive.fileSize(file));
+        ParseChunks(chunks);
+
+        for (auto &chunk : chunks) {
+            if (chunk.polygonSize != 3) {
+                THROW(std::runtime_error, "Failed to load obj file \"%s\" unsuported! (only support triangles this file contains %i-gons", filename.c_str(), chunk.polygonSize);
+            }
+        }
+
+        // Indexes are absolute, so the chunks' attributes are simply appended in order
+        std::vector<glm::vec3> positions, normals;
+        std::vector<glm::vec2> texcoords;
+        Concat(positions, chunks, &Chunk::positions);
+        Concat(normals, chunks, &Chunk::normals);
+        Concat(texcoords, chunks, &Chunk::texcoords);
+
+        size_t faceCount = 0;
+        for (auto &chunk : chunks) faceCount += chunk.faces.size() / 3;
+
+        std::vector<Face> faces;
+        faces.reserve(faceCount);
+
+        std::vector<ObjectData> objects;
+        objects.emplace_back();
+        Common::StringId material;
+
+        for (auto &chunk : chunks) {
+            size_t next = 0;
+
+            auto appendFaces = [&]( size_t last ) {
+                for (; next < last; ++next) {
+                    Face face;
+                        face.material = material;
+                        face.indexes[0] = chunk.faces[next*3 + 0];
+                        face.indexes[1] = chunk.faces[next*3 + 1];
+                        face.indexes[2] = chunk.faces[next*3 + 2];
+                    faces.push_back(face);
+                    objects.back().faceCount++;
+                }
+            };
+
+            for (auto &statement : chunk.statements) {
+                appendFaces(statement.face);
+
+                auto name = Common::CreateStringId(std::string(statement.name, statement.length).c_str());
+                if (statement.type == Statement::Material) {
+                    material = name;
+                }
+                else {
+                    if (objects.back().faceCount > 0) {
+                        objects.emplace_back();
+                    }
+                    objects.back().firstFace = faces.size();
+                    objects.back().name = name;
+                }
+            }
+            appendFaces(chunk.faces.size() / 3);
+        }
+        chunks.clear();
+
+        // Vertexes a sub object can reach with 16 bit indexes relative to its base vertex
+        const size_t maxClusterVertexes = indexType == IndexType::UInt16 ? (size_t)std::numeric_limits<uint16_t>::max() + 1 : std::numeric_limits<size_t>::max();
+
+        IndexLookup indexLookup;
+        std::vector<Index> uniqueIndexes;
+
         Result result;
+        result.objects.reserve(objects.size());
 
-        for (auto iter=data.objects.begin(), end=data.objects.end(); iter != end; ++iter) {
+        for (auto iter=objects.begin(), end=objects.end(); iter != end; ++iter) {
             Object object;
 
             object.name = iter->name;
-            indexLookup.clear();
+            object.indexType = indexType;
+            if (indexType == IndexType::UInt16) {
+                object.indexes.reserve(iter->faceCount * 3);
+            }
+            else {
+                object.indexes32.reserve(iter->faceCount * 3);
+            }
+            indexLookup.reset(std::min(iter->faceCount, maxClusterVertexes));
+            uniqueIndexes.clear();
 
             SubObject subObject;
+            size_t indexCount = 0;
 
             for (size_t i=0, c=iter->faceCount; i < c; ++i) {
-                Face face = data.faces[i + iter->firstFace];
+                const Face &face = faces[i + iter->firstFace];
 
                 if (subObject.material != face.material) {
                     if (subObject.count > 0) {
                         object.subobjects.push_back(subObject);
                     }
                     subObject.material = face.material;
-                    subObject.first = (int)object.indexes.size();
+                    subObject.first = (int)indexCount;
                     subObject.count = 0;
                 }
 
-                for (int i=0; i < 3; ++i) {
-                    index_t index = face.indexes[i];
+                // Faces stay in file order, a face that doesn't fit into the current cluster starts the next one
+                if (maxClusterVertexes != std::numeric_limits<size_t>::max()) {
+                    size_t added = 0;
+                    for (int j=0; j < 3; ++j) {
+                        const Index &index = face.indexes[j];
+                        bool repeated = (j > 0 && index == face.indexes[0]) || (j > 1 && index == face.indexes[1]);
+                        if (!repeated && !indexLookup.contains(index)) added++;
+                    }
 
-                    int idx = lookupIndex(index);
-                    if (idx == -1) {
-                        Vertex vertex;
-                        vertex.pos[0] = data.positions[index.vertex_index-1].x;
-                        vertex.pos[1] = data.positions[index.vertex_index-1].y;
-                        vertex.pos[2] = data.positions[index.vertex_index-1].z;
-                        vertex.uv[0] = glm::packUnorm1x16(data.texcoords[index.texcoord_index-1].x);
-                        vertex.uv[1] = glm::packUnorm1x16(data.texcoords[index.texcoord_index-1].y);
-                        vertex.normal = glm::packSnorm3x10_1x2(glm::vec4(data.normals[index.normal_index-1], 0.f));
+                    if (uniqueIndexes.size() - subObject.baseVertex + added > maxClusterVertexes) {
+                        if (subObject.count > 0) {
+                            object.subobjects.push_back(subObject);
+                        }
+                        subObject.first = (int)indexCount;
+                        subObject.count = 0;
+                        subObject.baseVertex = (int)uniqueIndexes.size();
 
-                        object.vertexes.push_back(vertex);
-                        idx = (int)object.vertexes.size() - 1;
+                        indexLookup.reset(std::min(c - i, maxClusterVertexes));
+                    }
+                }
 
-                        indexLookup[index] = idx;
+                for (int j=0; j < 3; ++j) {
+                    const Index &index = face.indexes[j];
+
+                    int next = (int)uniqueIndexes.size() - subObject.baseVertex;
+                    int idx = indexLookup.insert(index, next);
+                    if (idx == next) {
+                        if (index.vertex < 1 || index.vertex > (int)positions.size() ||
+                            index.texcoord < 1 || index.texcoord > (int)texcoords.size() ||
+                            index.normal < 1 || index.normal > (int)normals.size()) {
+                            THROW(std::runtime_error, "Failed to load obj file \"%s\" face index %i/%i/%i is out of range (faces need a position, texcoord and normal)",
+                                  filename.c_str(), index.vertex, index.texcoord, index.normal
+                            );
+                        }
+                        uniqueIndexes.push_back(index);
                     }
 
                     subObject.count++;
-                    object.indexes.push_back(idx);
+                    indexCount++;
+                    if (indexType == IndexType::UInt16) {
+                        object.indexes.push_back((uint16_t)idx);
+                    }
+                    else {
+                        object.indexes32.push_back((uint32_t)idx);
+                    }
                 }
             }
             object.subobjects.push_back(subObject);
-            result.objects.push_back(object);
+
+            object.vertexes.resize(uniqueIndexes.size());
+            for (size_t i=0; i < uniqueIndexes.size(); ++i) {
+                const Index &index = uniqueIndexes[i];
+
+                Vertex &vertex = object.vertexes[i];
+                    vertex.pos[0] = positions[index.vertex-1].x;
+                    vertex.pos[1] = positions[index.vertex-1].y;
+                    vertex.pos[2] = positions[index.vertex-1].z;
+                    vertex.uv[0] = glm::packUnorm1x16(texcoords[index.texcoord-1].x);
+                    vertex.uv[1] = glm::packUnorm1x16(texcoords[index.texcoord-1].y);
+                    vertex.normal = glm::packSnorm3x10_1x2(glm::vec4(normals[index.normal-1], 0.f));
+            }
+
+            result.objects.push_back(std::move(object));
         }
 
-        return std::move(result);
+        return result;
     }
 
-}
\ No newline at end of file
+}
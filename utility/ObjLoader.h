@@ -22,13 +22,18 @@ namespace Pisces
 
         struct SubObject {
             int first=0, count=0;
+            // indexes are relative to baseVertex
+            int baseVertex=0;
             Common::StringId material;
         };
         struct Object {
             Common::StringId name;
 
             std::vector<Vertex> vertexes;
+            // only one of them is used, depending on indexType
+            IndexType indexType = IndexType::UInt16;
             std::vector<uint16_t> indexes;
+            std::vector<uint32_t> indexes32;
 
             std::vector<SubObject> subobjects;
         };
@@ -36,6 +41,9 @@ namespace Pisces
             std::vector<Object> objects;
         };
 
-        static PISCES_API Result LoadFile( Common::Archive &archive, const std::string &filename );
+        // With UInt16 an object with more than 65536 vertexes is split into clusters of consecutive faces,
+        // each cluster starts a sub object with its own baseVertex and vertexes on cluster borders are duplicated.
+        // UInt32 keeps every object in one vertex range.
+        static PISCES_API Result LoadFile( Common::Archive &archive, const std::string &filename, IndexType indexType=IndexType::UInt16 );
     };
 }
\ No newline at end of file
@@ -0,0 +1,351 @@
+#include "SpriteBatch.h"
+
+#include "Context.h"
+#include "HardwareResourceManager.h"
+#include "PipelineManager.h"
+#include "RenderCommandQueue.h"
+#include "Sprite.h"
+#include "StreamingBuffer.h"
+
+#include "Common/ErrorUtils.h"
+#include "Common/Throw.h"
+
+#include <Remotery.h>
+
+#include <glm/vec2.hpp>
+#include <glm/mat4x4.hpp>
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <memory>
+#include <vector>
+
+namespace Pisces
+{
+    struct SpriteVertex {
+        glm::vec2 position;
+        glm::vec2 uv;
+        float layer;
+        Color color;
+    };
+
+    static const int SpriteVertexLayoutSize = 4;
+    static const VertexAttribute SpriteVertexLayout[SpriteVertexLayoutSize] = {
+        {VertexAttributeType::Float32, offsetof(SpriteVertex, position), 2, sizeof(SpriteVertex), 0},
+        {VertexAttributeType::Float32, offsetof(SpriteVertex, uv), 2, sizeof(SpriteVertex), 0},
+        {VertexAttributeType::Float32, offsetof(SpriteVertex, layer), 1, sizeof(SpriteVertex), 0},
+        {VertexAttributeType::NormUInt8, offsetof(SpriteVertex, color), 4, sizeof(SpriteVertex), 0}
+    };
+
+    static const char *DefaultVertexShader = R"(
+#version 330 core
+
+layout(location=0) in vec2 gPosition;
+layout(location=1) in vec2 gTexcoord;
+layout(location=2) in float gLayer;
+layout(location=3) in vec4 gColor;
+
+out vec3 vTexcoord;
+out vec4 vColor;
+
+uniform mat4 ViewProjection;
+
+void main()
+{
+    gl_Position = ViewProjection*vec4(gPosition,0.0,1.0);
+    vTexcoord = vec3(gTexcoord, gLayer);
+    vColor = gColor;
+}
+)";
+    static const char *DefaultFragmentShader = R"(
+#version 330 core
+
+in vec3 vTexcoord;
+in vec4 vColor;
+
+layout(location=0) out vec4 color;
+
+uniform sampler2D Texture;
+
+void main()
+{
+    color = vColor * texture(Texture, vTexcoord.xy);
+}
+)";
+    static const char *DefaultArrayFragmentShader = R"(
+#version 330 core
+
+in vec3 vTexcoord;
+in vec4 vColor;
+
+layout(location=0) out vec4 color;
+
+uniform sampler2DArray Texture;
+
+void main()
+{
+    color = vColor * texture(Texture, vTexcoord);
+}
+)";
+
+    static PipelineHandle FindOrCreatePipeline( PipelineManager *pipelineMgr, const char *name, const char *fragmentSource )
+    {
+        PipelineHandle pipeline;
+        if (pipelineMgr->findPipeline(Common::CreateStringId(name), pipeline)) {
+            return pipeline;
+        }
+
+        LOG_WARNING("Failed to find pipeline '%s' - trying to create one.", name);
+
+        std::string programName = std::string(name) + ".program";
+
+        PipelineProgramInitParams params;
+            params.blendMode = BlendMode::Alpha;
+            params.flags = PipelineFlags::None;
+            params.name = Common::CreateStringId(name);
+            params.programParams.vertexSource = DefaultVertexShader;
+            params.programParams.fragmentSource = fragmentSource;
+            params.programParams.bindings.samplers[0] = "Texture";
+            params.programParams.bindings.uniforms[0] = "ViewProjection";
+            params.programParams.name = Common::CreateStringId(programName.c_str());
+
+        pipeline = pipelineMgr->createPipeline(params);
+        if (!pipeline) {
+            THROW(std::runtime_error, "Failed create SpriteBatch - failed to create pipeline \"%s\"", name);
+        }
+        return pipeline;
+    }
+
+    struct SpriteBatch::Impl {
+        Context *context;
+
+        PipelineHandle pipeline,
+                       arrayPipeline;
+
+        std::unique_ptr<PagedStreamingBuffer> vertexBuffer;
+        BufferHandle indexBuffer;
+
+        size_t spritesPerPage = 0;
+
+        struct Instance {
+            Sprite sprite;
+            glm::vec2 position, size;
+            float rotation;
+            Color color;
+        };
+        std::vector<Instance> instances;
+        // (texture << 32 | layer, instance index), sorted in end()
+        std::vector<std::pair<uint64_t, uint32_t>> order;
+
+        // A batch never spans pages, sprites of one texture are split into a draw per page
+        struct Batch {
+            TextureHandle texture;
+            VertexArrayHandle vertexArray;
+            bool isArray = false;
+            size_t first = 0, count = 0, baseVertex = 0;
+        };
+        std::vector<Batch> batches;
+
+        Timings timings;
+
+        Impl( Context *context_ ) :
+            context(context_)
+        {}
+
+        // (Re)creates the vertex pages & the shared index buffer, buffers of the old pages are freed once the gpu is done with them
+        void createPages( size_t capacity )
+        {
+            HardwareResourceManager *hardwareMgr = context->getHardwareResourceManager();
+
+            vertexBuffer.reset();
+            hardwareMgr->freeBuffer(indexBuffer);
+
+            spritesPerPage = capacity;
+
+            // Every sprite is a quad, the indexes never change so they live in a static buffer shared by all pages
+            std::vector<uint32_t> indexes(spritesPerPage*6);
+            for (size_t i=0; i < spritesPerPage; ++i) {
+                uint32_t base = (uint32_t)(i*4);
+                uint32_t *quad = &indexes[i*6];
+                quad[0] = base+0; quad[1] = base+1; quad[2] = base+2;
+                quad[3] = base+0; quad[4] = base+2; quad[5] = base+3;
+            }
+            indexBuffer = hardwareMgr->allocateBuffer(BufferType::Index, BufferUsage::Static, BufferFlags::None, indexes.size()*sizeof(uint32_t), indexes.data());
+
+            vertexBuffer.reset( new PagedStreamingBuffer(context, BufferType::Vertex, spritesPerPage*4*sizeof(SpriteVertex)) );
+            vertexBuffer->setVertexLayout(SpriteVertexLayout, SpriteVertexLayoutSize, indexBuffer, IndexType::UInt32);
+        }
+    };
+
+    PISCES_API SpriteBatch::SpriteBatch( Context *context, size_t pageCapacity ) :
+        mImpl(context)
+    {
+        PipelineManager *pipelineMgr = context->getPipelineManager();
+
+        mImpl->pipeline = FindOrCreatePipeline(pipelineMgr, "SpriteBatch", DefaultFragmentShader);
+        mImpl->arrayPipeline = FindOrCreatePipeline(pipelineMgr, "SpriteBatchArray", DefaultArrayFragmentShader);
+
+        size_t spritesPerPage = pageCapacity > 0 ? pageCapacity : 1;
+        mImpl->createPages(spritesPerPage);
+
+        mImpl->instances.reserve(spritesPerPage);
+        mImpl->order.reserve(spritesPerPage);
+    }
+
+    PISCES_API SpriteBatch::~SpriteBatch()
+    {
+        HardwareResourceManager *hardwareMgr = mImpl->context->getHardwareResourceManager();
+
+        mImpl->vertexBuffer.reset();
+        hardwareMgr->freeBuffer(mImpl->indexBuffer);
+    }
+
+    PISCES_API void SpriteBatch::begin()
+    {
+        mImpl->instances.clear();
+        mImpl->order.clear();
+        mImpl->batches.clear();
+    }
+
+    PISCES_API void SpriteBatch::push( const Sprite &sprite, glm::vec2 position, glm::vec2 size, float rotation, Color color )
+    {
+        uint64_t key = ((uint64_t)(uint32_t)sprite.texture << 32) | (uint32_t)sprite.layer;
+
+        mImpl->order.emplace_back(key, (uint32_t)mImpl->instances.size());
+        mImpl->instances.push_back({sprite, position, size, rotation, color});
+    }
+
+    PISCES_API void SpriteBatch::end()
+    {
+        rmt_ScopedCPUSampleString("Pisces::SpriteBatch::end", RMTSF_None);
+        using Clock = std::chrono::steady_clock;
+
+        mImpl->timings = {};
+
+        size_t count = mImpl->instances.size();
+        if (count == 0) return;
+
+        HardwareResourceManager *hardwareMgr = mImpl->context->getHardwareResourceManager();
+
+        // Pages grow to the largest frame, so every texture stays a single draw
+        if (count > mImpl->spritesPerPage) {
+            size_t capacity = mImpl->spritesPerPage;
+            while (capacity < count) capacity *= 2;
+
+            LOG_INFORMATION("SpriteBatch: growing pages to %zu sprites", capacity);
+            mImpl->createPages(capacity);
+        }
+
+        auto sortStart = Clock::now();
+        {
+            rmt_ScopedCPUSampleString("Pisces::SpriteBatch::sort", RMTSF_None);
+            // The index is part of the key, so sprites with the same texture & layer keep their order
+            if (!std::is_sorted(mImpl->order.begin(), mImpl->order.end())) {
+                std::sort(mImpl->order.begin(), mImpl->order.end());
+            }
+        }
+
+        auto fillStart = Clock::now();
+        mImpl->timings.sort = std::chrono::duration<double>(fillStart - sortStart).count();
+        {
+            rmt_ScopedCPUSampleString("Pisces::SpriteBatch::fill", RMTSF_None);
+
+            const size_t quadSize = 4*sizeof(SpriteVertex);
+
+            PagedAllocation page;
+            SpriteVertex *vertexes = nullptr;
+            size_t pageSprites = 0, pageIndex = 0;
+
+            Impl::Batch *batch = nullptr;
+            for (size_t i=0; i < count; ++i) {
+                const Impl::Instance &instance = mImpl->instances[mImpl->order[i].second];
+                const Sprite &sprite = instance.sprite;
+
+                bool newPage = pageIndex == pageSprites;
+                if (newPage) {
+                    page = mImpl->vertexBuffer->allocatePartial((count-i)*quadSize, quadSize, sizeof(SpriteVertex));
+                    if (!page) {
+                        LOG_ERROR("SpriteBatch failed to allocate vertexes, skipping %zu sprites", count-i);
+                        break;
+                    }
+                    vertexes = (SpriteVertex*)page.data;
+                    pageSprites = page.size / quadSize;
+                    pageIndex = 0;
+                }
+
+                if (newPage || batch->texture != sprite.texture) {
+                    TextureType type = TextureType::Texture2D;
+                    if (!hardwareMgr->getTextureType(sprite.texture, &type)) {
+                        LOG_WARNING("SpriteBatch: sprite uses an invalid texture");
+                    }
+
+                    mImpl->batches.emplace_back();
+                    batch = &mImpl->batches.back();
+                    batch->texture = sprite.texture;
+                    batch->vertexArray = page.vertexArray;
+                    batch->isArray = type == TextureType::Texture2DArray;
+                    batch->first = pageIndex*6;
+                    batch->baseVertex = page.offset / sizeof(SpriteVertex);
+                }
+                batch->count += 6;
+
+                float c = std::cos(instance.rotation),
+                      s = std::sin(instance.rotation);
+                glm::vec2 axisX = glm::vec2(c, s) * (instance.size.x*0.5f),
+                          axisY = glm::vec2(-s, c) * (instance.size.y*0.5f);
+
+                float layer = (float)sprite.layer;
+
+                SpriteVertex *quad = vertexes + pageIndex*4;
+                pageIndex++;
+                quad[0] = {instance.position - axisX - axisY, {sprite.uv.x1, sprite.uv.y1}, layer, instance.color};
+                quad[1] = {instance.position + axisX - axisY, {sprite.uv.x2, sprite.uv.y1}, layer, instance.color};
+                quad[2] = {instance.position + axisX + axisY, {sprite.uv.x2, sprite.uv.y2}, layer, instance.color};
+                quad[3] = {instance.position - axisX + axisY, {sprite.uv.x1, sprite.uv.y2}, layer, instance.color};
+            }
+        }
+
+        mImpl->vertexBuffer->flush();
+        mImpl->timings.fill = std::chrono::duration<double>(Clock::now() - fillStart).count();
+    }
+
+    PISCES_API void SpriteBatch::draw( RenderCommandQueuePtr commandQueue, const glm::mat4 &viewProjection )
+    {
+        if (mImpl->batches.empty()) return;
+
+        PipelineHandle current;
+        VertexArrayHandle currentVertexArray;
+        for (const auto &batch : mImpl->batches) {
+            if (batch.vertexArray != currentVertexArray) {
+                commandQueue->useVertexArray(batch.vertexArray);
+                currentVertexArray = batch.vertexArray;
+            }
+
+            PipelineHandle pipeline = batch.isArray ? mImpl->arrayPipeline : mImpl->pipeline;
+            if (pipeline != current) {
+                commandQueue->usePipeline(pipeline);
+                commandQueue->bindUniform(0, viewProjection);
+                current = pipeline;
+            }
+
+            commandQueue->bindTexture(0, batch.texture);
+            commandQueue->draw(Primitive::Triangles, batch.first, batch.count, batch.baseVertex);
+        }
+    }
+
+    PISCES_API size_t SpriteBatch::spriteCount()
+    {
+        return mImpl->instances.size();
+    }
+
+    PISCES_API size_t SpriteBatch::drawCount()
+    {
+        return mImpl->batches.size();
+    }
+
+    PISCES_API SpriteBatch::Timings SpriteBatch::timings()
+    {
+        return mImpl->timings;
+    }
+}
@@ -0,0 +1,49 @@
+#pragma once
+
+#include "Pisces/Fwd.h"
+#include "Pisces/build_config.h"
+
+#include "Common/PImplHelper.h"
+
+#include <glm/fwd.hpp>
+
+namespace Pisces
+{
+    struct Sprite;
+
+    // Collects sprites during a frame and draws them with one indexed draw per texture.
+    // Sprites are sorted by texture and layer, sprites sharing both keep their submission order.
+    // Vertexes are streamed into pages of at least pageCapacity sprites, pages grow to the sprite count of the
+    // largest frame so a texture only spans pages when earlier frames still use part of the current page.
+    class SpriteBatch {
+    public:
+        // Cpu time spent in the steps of the last end(), in seconds
+        struct Timings {
+            double sort = 0.0,
+                   fill = 0.0;
+        };
+
+        PISCES_API SpriteBatch( Context *context, size_t pageCapacity=1024 );
+        PISCES_API ~SpriteBatch();
+
+        SpriteBatch( const SpriteBatch& ) = delete;
+        SpriteBatch& operator = ( const SpriteBatch& ) = delete;
+
+        PISCES_API void begin();
+        PISCES_API void end();
+
+        // position is the center of the sprite, size is in world units and rotation in radians
+        PISCES_API void push( const Sprite &sprite, glm::vec2 position, glm::vec2 size, float rotation=0.f, Color color=NamedColors::White );
+
+        // binds pipeline & vertex array and draws all sprites pushed between begin() and end()
+        PISCES_API void draw( RenderCommandQueuePtr commandQueue, const glm::mat4 &viewProjection );
+
+        PISCES_API size_t spriteCount();
+        PISCES_API size_t drawCount();
+        PISCES_API Timings timings();
+
+    private:
+        struct Impl;
+        PImplHelper<Impl, 256> mImpl;
+    };
+}